@@ -13,12 +13,17 @@
 #include <sys/syscall.h>
 
 #include <vardef.h>
+#include <dart_layout.h>
 
 // Not all alternative libc implementations support these constants yet.
 #ifndef O_CLOEXEC
 #define O_CLOEXEC 02000000
 #endif
 
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
 // structs
 struct shmem_hdr {
     char command;
@@ -30,16 +35,28 @@ struct shmem_hdr {
 #define FSSHARE_MNT                 "/host"
 #define FS_DISK_IMG                 FSSHARE_MNT "/disk.img"
 #define FS_DISK_MNT                 "/work"
-
-#define _MB(i)                      ((i) * (1 << 20))
-
-#define IVSHMEM_OFFSET_METADATA     0
-#define IVSHMEM_OFFSET_BYTECODE     IVSHMEM_OFFSET_METADATA + _MB(2)
-#define IVSHMEM_OFFSET_STRACE       IVSHMEM_OFFSET_BYTECODE + _MB(48)
-#define IVSHMEM_SIZE                IVSHMEM_OFFSET_STRACE + _MB(12)
+#define FS_DISK_DEV                 "/dev/vda"
+
+// shmem_hdr status
+#define SHMEM_STATUS_BOOT           0
+#define SHMEM_STATUS_DONE           1
+#define SHMEM_STATUS_SNAPSHOT       2   // guest: ready to be snapshotted
+#define SHMEM_STATUS_RESUME         3   // host: restored with a new program
+#define SHMEM_STATUS_WAITING        4   // guest: ready for the next program
+#define SHMEM_STATUS_PROGRAM        5   // host: the next program is given
+#define SHMEM_STATUS_SHUTDOWN       6   // host: no more programs
+
+// regions of the instance, located through the table given by the host
+#define SHMEM_REGION(r)             ((char *) g_shmem + \
+                                     g_layout.regions[r].offset)
+#define SHMEM_REGION_SIZE(r)        (g_layout.regions[r].size)
 
 // init.c
 extern void *g_shmem;
+extern struct ivshmem_table g_layout;
+
+void setup_fsshare(void);
+void clean_fsshare(void);
 
 // util.c
 void set_buf(char *buf, size_t size, ...);
@@ -54,12 +71,17 @@ void dart_launch(void);
 void dart_finish(void);
 void dart_ctxt_syscall_enter(unsigned long sysno);
 void dart_ctxt_syscall_exit(unsigned long sysno);
+void dart_ctxt_syscall_auto(bool on);
+void dart_delay(unsigned long hval, unsigned long usec);
+bool dart_hook_patch(unsigned long hval, bool off);
 
 // racer functions
 void racer_test(void);
 void racer_prep(void);
 void racer_cont(void);
 void racer_fuzz(void);
+void racer_fuzz_snapshot(void);
+void racer_fuzz_persist(void);
 
 // utils
 static inline void load_module(const char *path) {
@@ -68,8 +90,9 @@ static inline void load_module(const char *path) {
         panic(errno, "No module found.", NULL);
     }
 
+    // dependencies stay loaded across programs in persistent mode
     int rv = (int) syscall(SYS_finit_module, fd, "", 0);
-    if (rv != 0) {
+    if (rv != 0 && errno != EEXIST) {
         panic(errno, "Failed to load module", NULL);
     }
 
@@ -85,5 +108,7 @@ static inline void unload_module(const char *name) {
 
 // racer configs
 #define RACER_THREAD_MAX 64
+#define RACER_BARRIER_MAX 16
+#define RACER_CPU_MAX 256
 
 #endif /* _RACER_INITRAMFS_COMMON_H_ */
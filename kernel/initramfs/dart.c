@@ -7,6 +7,14 @@
 #define CMD_DART_FINISH                 2
 #define CMD_DART_CTXT_SYSCALL_START     3
 #define CMD_DART_CTXT_SYSCALL_EXIT      4
+#define CMD_DART_CTXT_SYSCALL_AUTO      5
+#define CMD_DART_DELAY_USEC             6
+#define CMD_DART_DELAY_HVAL             7
+#define CMD_DART_HOOK_PATCH             8
+#define CMD_DART_HOOK_UNPATCH           9
+
+// whether the kernel marks the syscall contexts of this thread itself
+static __thread bool dart_syscall_auto = false;
 
 // wrappers
 void dart_launch(void) {
@@ -18,9 +26,36 @@ void dart_finish(void) {
 }
 
 void dart_ctxt_syscall_enter(unsigned long sysno) {
+    if (dart_syscall_auto) {
+        return;
+    }
     syscall(SYS_DART, CMD_DART_CTXT_SYSCALL_START, sysno);
 }
 
 void dart_ctxt_syscall_exit(unsigned long sysno) {
+    if (dart_syscall_auto) {
+        return;
+    }
     syscall(SYS_DART, CMD_DART_CTXT_SYSCALL_EXIT, sysno);
 }
+
+void dart_ctxt_syscall_auto(bool on) {
+    // stay with the explicit marking if the kernel does not support it
+    if (syscall(SYS_DART, CMD_DART_CTXT_SYSCALL_AUTO, on ? 1 : 0) == 0) {
+        dart_syscall_auto = on;
+    }
+}
+
+void dart_delay(unsigned long hval, unsigned long usec) {
+    syscall(SYS_DART, CMD_DART_DELAY_USEC, usec);
+    syscall(SYS_DART, CMD_DART_DELAY_HVAL, hval);
+}
+
+// turn off (or back on) the hooks of a function, given its hash in the
+// instrumentation record, a module goes by the hashes of its functions,
+// only effective before the launch
+bool dart_hook_patch(unsigned long hval, bool off) {
+    return syscall(
+            SYS_DART, off ? CMD_DART_HOOK_PATCH : CMD_DART_HOOK_UNPATCH, hval
+    ) == 0;
+}
@@ -15,6 +15,7 @@
 
 // global pointer to the ivshmem
 void *g_shmem = NULL;
+struct ivshmem_table g_layout;
 
 // utils
 static inline void mount_pseudofs(char *type, char *dest) {
@@ -33,13 +34,35 @@ static inline void *setup_ivshmem(void) {
         panic(errno, "Failed to open ivshmem device", NULL);
     }
 
+    // the region table comes as the second map of the uio device
+    long page = sysconf(_SC_PAGESIZE);
+    void *table = mmap(0, page, PROT_READ, MAP_SHARED, fd, page);
+    if (table == (void *) -1) {
+        panic(errno, "Failed to mmap ivshmem table", NULL);
+    }
+
+    memcpy(&g_layout, table, sizeof(g_layout));
+    munmap(table, page);
+
+    // the kernel falls back to the default layout alike
+    if (!ivshmem_table_check(&g_layout)) {
+        ivshmem_table_default(&g_layout);
+    }
+
+    // at the address the host relocates the bytecode against
     void *ivshmem = mmap(
-            0, IVSHMEM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0
+            (void *) INSTMEM_USER_VADDR, g_layout.user_size,
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0
     );
     if (ivshmem == (void *) -1) {
         panic(errno, "Failed to mmap ivshmem", NULL);
     }
 
+    // older kernels take the address as a mere hint
+    if (ivshmem != (void *) INSTMEM_USER_VADDR) {
+        panic(0, "Failed to mmap ivshmem at its fixed address", NULL);
+    }
+
     // prevent from getting swapped out
     rv = mlockall(MCL_CURRENT | MCL_FUTURE);
     if (rv) {
@@ -57,18 +80,18 @@ static inline void clean_ivshmem(void *ivshmem) {
         panic(errno, "Failed to munlockall", NULL);
     }
 
-    rv = munmap(ivshmem, IVSHMEM_SIZE);
+    rv = munmap(ivshmem, g_layout.user_size);
     if (rv) {
         panic(errno, "Failed to munmap ivshmem", NULL);
     }
 }
 
-static inline void setup_fsshare(void) {
+void setup_fsshare(void) {
     int rv;
 
-    // prepare the mount point
+    // prepare the mount point (exists if re-attached after a snapshot)
     rv = mkdir(FSSHARE_MNT, 0777);
-    if (rv == -1) {
+    if (rv == -1 && errno != EEXIST) {
         panic(errno, "Failed to create host point", NULL);
     }
 
@@ -83,7 +106,7 @@ static inline void setup_fsshare(void) {
     }
 }
 
-static inline void clean_fsshare(void) {
+void clean_fsshare(void) {
     int rv;
 
     // do force umount
@@ -113,7 +136,7 @@ int main(void) {
     struct shmem_hdr *hdr = (struct shmem_hdr *) g_shmem;
 
     // mark that we have not started executing
-    hdr->status = 0;
+    hdr->status = SHMEM_STATUS_BOOT;
 
     // fork and wait
     pid_t child = fork();
@@ -146,6 +169,12 @@ int main(void) {
             case 'f':
                 racer_fuzz();
                 break;
+            case 's':
+                racer_fuzz_snapshot();
+                break;
+            case 'l':
+                racer_fuzz_persist();
+                break;
             default:
                 warn("Unknown command, exiting...", NULL);
                 break;
@@ -153,7 +182,7 @@ int main(void) {
     }
 
     // mark that we have done with the execution
-    hdr->status = 1;
+    hdr->status = SHMEM_STATUS_DONE;
 
     // tear-down
     clean_fsshare();
@@ -13,51 +13,8 @@ void racer_cont(void) {
     );
 
     // get bytecode info
-    char *cur = (char *) g_shmem + IVSHMEM_OFFSET_BYTECODE;
-
-    // parse head segment, locate regions
-    struct region_head *head = (struct region_head *) cur;
-    if (memcmp(head->magics, "bytecode", 8) != 0) {
-        panic(0, "Magic number does not match", NULL);
-    }
-
-    char *meta = cur + head->offset_meta;
-    char *code = cur + head->offset_code;
-    char *heap = cur + head->offset_heap;
-
-    cur += sizeof(struct region_head);
-    if (cur != (char *) meta) {
-        panic(0, "Region head corrupted", NULL);
-    }
-
-    // parse meta_ptr segment, fixup pointers
-    struct region_meta_ptr *meta_ptr = (struct region_meta_ptr *) cur;
-    for (size_t i = 0; i < meta_ptr->num_ptrs; i++) {
-        size_t *offs = (size_t *) (heap + meta_ptr->off_ptrs[i]);
-        if (*offs) {
-            *offs += (size_t) heap;
-        }
-    }
-
-    cur += sizeof(struct region_meta_ptr) +
-           sizeof(size_t) * meta_ptr->num_ptrs;
-
-    // parse meta_fd segment, the info will be used to close all fds
-    struct region_meta_fd *meta_fd = (struct region_meta_fd *) cur;
-
-    cur += sizeof(struct region_meta_fd) +
-           sizeof(struct lego_pack) * meta_fd->num_fds;
-    if (cur != code) {
-        panic(0, "Region meta corrupted", NULL);
-    }
-
-    // parse code segment
-    struct region_code *code_hdr = (struct region_code *) cur;
-
-    cur += sizeof(struct region_code) + sizeof(size_t) * code_hdr->num_threads;
-    if (cur != (code + code_hdr->offset_main)) {
-        panic(0, "Region code - header part corrupted", NULL);
-    }
+    struct program prog;
+    load_program(&prog);
 
     // close stdin, this is causing hangs
     close(0);
@@ -68,10 +25,11 @@ void racer_cont(void) {
 
     sem_init(&sema_init, 0, 0);
     sem_init(&sema_fini, 0, 0);
+    directive_init();
 
-    for (size_t i = 0; i < code_hdr->num_threads; i++) {
-        targs[i].code = code + code_hdr->offset_subs[i];
-        targs[i].heap = heap;
+    for (size_t i = 0; i < prog.num_threads; i++) {
+        targs[i].code = prog.subs[i];
+        targs[i].heap = prog.heap;
 
         rv = pthread_create(&tptrs[i], NULL, thread_func, &targs[i]);
         if (rv) {
@@ -95,10 +53,10 @@ void racer_cont(void) {
     }
 
     // run the precalls first
-    interpret(code + code_hdr->offset_main, heap);
+    interpret(prog.main, prog.heap);
 
     // inform threads that we are ready
-    for (size_t i = 0; i < code_hdr->num_threads; i++) {
+    for (size_t i = 0; i < prog.num_threads; i++) {
         rv = sem_post(&sema_init);
         if (rv) {
             panic(rv, "Failed to post for init semaphore");
@@ -106,7 +64,7 @@ void racer_cont(void) {
     }
 
     // wait for threads to finish
-    for (size_t i = 0; i < code_hdr->num_threads; i++) {
+    for (size_t i = 0; i < prog.num_threads; i++) {
         rv = sem_wait(&sema_fini);
         if (rv) {
             panic(rv, "Failed to wait for fini semaphore");
@@ -114,11 +72,7 @@ void racer_cont(void) {
     }
 
     // close all fd ever appeared
-    for (size_t i = 0; i < meta_fd->num_fds; i++) {
-        dart_ctxt_syscall_enter(SYS_close);
-        close(load_slot(&meta_fd->fds[i], heap));
-        dart_ctxt_syscall_exit(SYS_close);
-    }
+    interpret(prog.fini, prog.heap);
 
     // change directory
     dart_ctxt_syscall_enter(SYS_chdir);
@@ -134,7 +88,7 @@ void racer_cont(void) {
                  FS_DISK_MNT);
 
     // wait for join all threads
-    for (size_t i = 0; i < code_hdr->num_threads; i++) {
+    for (size_t i = 0; i < prog.num_threads; i++) {
         rv = pthread_join(tptrs[i], NULL);
         if (rv) {
             panic(rv, "Failed to join threads", NULL);
@@ -3,61 +3,59 @@
 #endif
 #include "fuzzer.inc"
 
-// main
-void racer_fuzz(void) {
-    int rv;
+#include <sys/wait.h>
 
-    // get mount info
-    struct mount_info *info = (struct mount_info *) (
-            (char *) g_shmem + sizeof(struct shmem_hdr)
-    );
+// snapshot
+static void snapshot_point(void) {
+    struct shmem_hdr *hdr = (struct shmem_hdr *) g_shmem;
 
-    // get bytecode info
-    char *cur = (char *) g_shmem + IVSHMEM_OFFSET_BYTECODE;
+    // a mounted 9p blocks the migration, re-attach it after the restore
+    clean_fsshare();
 
-    // parse head segment, locate regions
-    struct region_head *head = (struct region_head *) cur;
-    if (memcmp(head->magics, "bytecode", 8) != 0) {
-        panic(0, "Magic number does not match", NULL);
+    // let the host take the snapshot, a restored one resumes from the loop
+    __atomic_store_n(&hdr->status, SHMEM_STATUS_SNAPSHOT, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&hdr->status, __ATOMIC_SEQ_CST) !=
+           SHMEM_STATUS_RESUME) {
+        usleep(1000);
     }
 
-    char *meta = cur + head->offset_meta;
-    char *code = cur + head->offset_code;
-    char *heap = cur + head->offset_heap;
-
-    cur += sizeof(struct region_head);
-    if (cur != (char *) meta) {
-        panic(0, "Region head corrupted", NULL);
-    }
+    setup_fsshare();
+}
 
-    // parse meta_ptr segment, fixup pointers
-    struct region_meta_ptr *meta_ptr = (struct region_meta_ptr *) cur;
-    for (size_t i = 0; i < meta_ptr->num_ptrs; i++) {
-        size_t *offs = (size_t *) (heap + meta_ptr->off_ptrs[i]);
-        if (*offs) {
-            *offs += (size_t) heap;
-        }
+static void enter_workdir(const char *path) {
+    dart_ctxt_syscall_enter(SYS_chdir);
+    int rv = chdir(path);
+    dart_ctxt_syscall_exit(SYS_chdir);
+    if (rv != 0) {
+        panic(errno, "Failed to chdir to ", path, NULL);
     }
+}
 
-    cur += sizeof(struct region_meta_ptr) +
-           sizeof(size_t) * meta_ptr->num_ptrs;
+// main
+static void fuzz(bool snapshot) {
+    int rv;
 
-    // parse meta_fd segment, the info will be used to close all fds
-    struct region_meta_fd *meta_fd = (struct region_meta_fd *) cur;
+    // get mount info
+    struct mount_info *info = (struct mount_info *) (
+            (char *) g_shmem + sizeof(struct shmem_hdr)
+    );
 
-    cur += sizeof(struct region_meta_fd) +
-           sizeof(struct lego_pack) * meta_fd->num_fds;
-    if (cur != code) {
-        panic(0, "Region meta corrupted", NULL);
+    // in snapshot mode, set-up (with the disk as a block device) happens
+    // before the bytecode is given, so that a restore skips all of it
+    if (snapshot) {
+        mount_image(info->mod_main, info->mod_main_num,
+                    info->mod_deps, info->mod_deps_num,
+                    info->fs_type, info->mnt_opts,
+                    NULL,
+                    FS_DISK_DEV, FS_DISK_MNT);
+
+        enter_workdir(FS_DISK_MNT);
+        snapshot_point();
     }
 
-    // parse code segment
-    struct region_code *code_hdr = (struct region_code *) cur;
-
-    cur += sizeof(struct region_code) + sizeof(size_t) * code_hdr->num_threads;
-    if (cur != (code + code_hdr->offset_main)) {
-        panic(0, "Region code - header part corrupted", NULL);
-    }
+    // get bytecode info
+    struct program prog;
+    load_program(&prog);
 
     // close stdin, this is causing hangs
     close(0);
@@ -71,10 +69,11 @@ void racer_fuzz(void) {
 
     sem_init(&sema_init, 0, 0);
     sem_init(&sema_fini, 0, 0);
+    directive_init();
 
-    for (size_t i = 0; i < code_hdr->num_threads; i++) {
-        targs[i].code = code + code_hdr->offset_subs[i];
-        targs[i].heap = heap;
+    for (size_t i = 0; i < prog.num_threads; i++) {
+        targs[i].code = prog.subs[i];
+        targs[i].heap = prog.heap;
 
         rv = pthread_create(&tptrs[i], NULL, thread_func, &targs[i]);
         if (rv) {
@@ -82,26 +81,28 @@ void racer_fuzz(void) {
         }
     }
 
-    // set-up
-    mount_image(info->mod_main, info->mod_main_num,
-                info->mod_deps, info->mod_deps_num,
-                info->fs_type, info->mnt_opts,
-                LOOP_DEV,
-                FS_DISK_IMG, FS_DISK_MNT);
+    // set-up, on a copy-on-write view of the image in memory
+    if (!snapshot) {
+        ramdisk_load(FS_DISK_IMG);
+        ramdisk_attach();
 
-    // change directory
-    dart_ctxt_syscall_enter(SYS_chdir);
-    rv = chdir(FS_DISK_MNT);
-    dart_ctxt_syscall_exit(SYS_chdir);
-    if (rv != 0) {
-        panic(errno, "Failed to chdir to disk mount point", NULL);
+        mount_image(info->mod_main, info->mod_main_num,
+                    info->mod_deps, info->mod_deps_num,
+                    info->fs_type, info->mnt_opts,
+                    NULL,
+                    RAMDISK_DEV, FS_DISK_MNT);
+
+        enter_workdir(FS_DISK_MNT);
     }
 
     // run the precalls first
-    interpret(code + code_hdr->offset_main, heap);
+#ifdef RACER_SYSCALL_AUTO
+    dart_ctxt_syscall_auto(true);
+#endif
+    interpret(prog.main, prog.heap);
 
     // inform threads that we are ready
-    for (size_t i = 0; i < code_hdr->num_threads; i++) {
+    for (size_t i = 0; i < prog.num_threads; i++) {
         rv = sem_post(&sema_init);
         if (rv) {
             panic(rv, "Failed to post for init semaphore");
@@ -109,7 +110,7 @@ void racer_fuzz(void) {
     }
 
     // wait for threads to finish
-    for (size_t i = 0; i < code_hdr->num_threads; i++) {
+    for (size_t i = 0; i < prog.num_threads; i++) {
         rv = sem_wait(&sema_fini);
         if (rv) {
             panic(rv, "Failed to wait for fini semaphore");
@@ -117,30 +118,78 @@ void racer_fuzz(void) {
     }
 
     // close all fd ever appeared
-    for (size_t i = 0; i < meta_fd->num_fds; i++) {
-        dart_ctxt_syscall_enter(SYS_close);
-        close(load_slot(&meta_fd->fds[i], heap));
-        dart_ctxt_syscall_exit(SYS_close);
-    }
+    interpret(prog.fini, prog.heap);
 
     // change directory
-    dart_ctxt_syscall_enter(SYS_chdir);
-    rv = chdir("/");
-    dart_ctxt_syscall_exit(SYS_chdir);
-    if (rv != 0) {
-        panic(errno, "Failed to chdir to root directory", NULL);
-    }
+    enter_workdir("/");
+#ifdef RACER_SYSCALL_AUTO
+    dart_ctxt_syscall_auto(false);
+#endif
 
     // tear-down
     umount_image(info->mod_names, info->mod_names_num,
-                 LOOP_DEV, FS_DISK_IMG,
+                 NULL,
+                 snapshot ? FS_DISK_DEV : RAMDISK_DEV,
                  FS_DISK_MNT);
 
+    if (!snapshot) {
+        ramdisk_detach();
+    }
+
     // wait for join all threads
-    for (size_t i = 0; i < code_hdr->num_threads; i++) {
+    for (size_t i = 0; i < prog.num_threads; i++) {
         rv = pthread_join(tptrs[i], NULL);
         if (rv) {
             panic(rv, "Failed to join threads", NULL);
         }
     }
 }
+
+void racer_fuzz(void) {
+    fuzz(false);
+}
+
+void racer_fuzz_snapshot(void) {
+    fuzz(true);
+}
+
+void racer_fuzz_persist(void) {
+    struct shmem_hdr *hdr = (struct shmem_hdr *) g_shmem;
+
+    while (true) {
+        // ring the doorbell and wait for the host to give the next program
+        __atomic_store_n(&hdr->status, SHMEM_STATUS_WAITING, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&hdr->status, __ATOMIC_SEQ_CST) ==
+               SHMEM_STATUS_WAITING) {
+            usleep(1000);
+        }
+
+        if (__atomic_load_n(&hdr->status, __ATOMIC_SEQ_CST) !=
+            SHMEM_STATUS_PROGRAM) {
+            break;
+        }
+
+        // execute each program in a fresh process, the mount and umount in
+        // it re-launches and finishes dart, which resets all its states,
+        // and the disk is a fresh copy-on-write view of the golden image
+        pid_t child = fork();
+        if (child < 0) {
+            panic(errno, "Failed to spawn program process", NULL);
+        }
+
+        if (!child) {
+            fuzz(false);
+            exit(0);
+        }
+
+        int status;
+        if (waitpid(child, &status, 0) != child) {
+            panic(errno, "Failed to wait for program termination", NULL);
+        }
+
+        // a failed program leaves the system in an unknown state, stop here
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            break;
+        }
+    }
+}
@@ -1,13 +1,11 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <sys/uio.h>
 
-#include <pthread.h>
-#include <semaphore.h>
-
 #include "common.h"
 #include "strace.h"
 
@@ -18,8 +16,8 @@ struct console {
 
 static struct console *console;
 
-static char *ledger;
-static pthread_spinlock_t ledger_lock;
+#define STRACE_CONSOLE_SIZE \
+        (SHMEM_REGION_SIZE(INSTMEM_REGION_STRACE) - sizeof(struct console))
 
 // missing declarations
 struct linux_dirent {
@@ -149,21 +147,170 @@ static inline int _print_vector_struct_iovec(char *buf, long val) {
                    iov->iov_base, iov->iov_len);
 }
 
+// binary blobs of the values that are dereferenced by the printers
+static inline int _blob_none(char *blob, long val) {
+    (void) blob;
+    (void) val;
+    return 0;
+}
+
+#define _blob_ptr_hex _blob_none
+#define _blob_int_hex _blob_none
+#define _blob_int_oct _blob_none
+#define _blob_int_signed _blob_none
+#define _blob_int_unsigned _blob_none
+#define _blob_fd _blob_none
+#define _blob_buf _blob_none
+
+static inline int _blob_words(char *blob, const long *words, int n) {
+    memcpy(blob, words, n * sizeof(long));
+    return n * sizeof(long);
+}
+
+static inline int _blob_ref_int_signed(char *blob, long val) {
+    if (val == 0) {
+        return 0;
+    }
+
+    return _blob_words(blob, (long *) val, 1);
+}
+
+#define _blob_ref_int_unsigned _blob_ref_int_signed
+
+static inline int _blob_str(char *blob, long val) {
+    if (val == 0) {
+        return 0;
+    }
+
+    size_t len = strnlen((char *) val, STRACE_BLOB_SIZE_MAX);
+    memcpy(blob, (char *) val, len);
+    return len;
+}
+
+static inline int _blob_struct_stat(char *blob, long val) {
+    if (val == 0) {
+        return 0;
+    }
+
+    struct stat *statbuf = (struct stat *) val;
+    long words[] = {statbuf->st_ino, statbuf->st_size, statbuf->st_nlink};
+    return _blob_words(blob, words, 3);
+}
+
+static inline int _blob_struct_linux_dirent(char *blob, long val) {
+    if (val == 0) {
+        return 0;
+    }
+
+    struct linux_dirent *dirent = (struct linux_dirent *) val;
+    long words[] = {dirent->d_ino, dirent->d_off};
+    return _blob_words(blob, words, 2);
+}
+
+static inline int _blob_struct_linux_dirent64(char *blob, long val) {
+    if (val == 0) {
+        return 0;
+    }
+
+    struct linux_dirent64 *dirent = (struct linux_dirent64 *) val;
+    long words[] = {dirent->d_ino, dirent->d_off};
+    return _blob_words(blob, words, 2);
+}
+
+static inline int _blob_vector_struct_iovec(char *blob, long val) {
+    if (val == 0) {
+        return 0;
+    }
+
+    struct iovec *iov = (struct iovec *) val;
+    long words[] = {(long) iov->iov_base, iov->iov_len};
+    return _blob_words(blob, words, 2);
+}
+
+// console space is reserved lock-free, entries are dropped once it is full
+static inline char *strace_reserve(size_t len) {
+    unsigned long off = __atomic_fetch_add(
+            &console->count, len, __ATOMIC_RELAXED
+    );
+
+    if (off + len > STRACE_CONSOLE_SIZE) {
+        // later entries will not fit either, mark the end for the host
+        if (off + sizeof(unsigned int) <= STRACE_CONSOLE_SIZE) {
+            memset(console->buffer + off, 0, sizeof(unsigned int));
+        }
+        return NULL;
+    }
+
+    return console->buffer + off;
+}
+
+static inline void strace_commit(const char *msg, size_t len) {
+    if (len >= 1024) {
+        panic(0, "strace entry exceeds size limit", NULL);
+    }
+
+    char *entry = strace_reserve(len);
+    if (entry) {
+        memcpy(entry, msg, len);
+    }
+}
+
+static inline unsigned long strace_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
 // auto-generated print functions
 static inline int gettid(void) {
     return syscall(__NR_gettid);
 }
 
 #define _STRACE_ARG_DEF(A, P) , long A
+
+#ifdef RACER_STRACE_BINARY
+#define _STRACE_ARG_CNT(A, P) + 1
+#define _STRACE_ARG_USE(A, P) \
+        arg->word = A; \
+        arg->kind = STRACE_KIND_##P; \
+        arg->blen = _blob_##P(blob, A); \
+        blob += arg->blen; \
+        arg++;
+
+#define STRACE(name, pret, ...) \
+        static void strace_##name( \
+                const char *tokn, long sysno, long retv \
+                VARDEF2(_STRACE_ARG_DEF, , ##__VA_ARGS__) \
+        ) { \
+            char msg[1024] __attribute__((aligned(8))); \
+            struct strace_record *rec = (struct strace_record *) msg; \
+            rec->argc = 0 VARDEF2(_STRACE_ARG_CNT, , ##__VA_ARGS__); \
+            rec->exit = tokn[0] == '<'; \
+            rec->kret = STRACE_KIND_##pret; \
+            rec->rsvd = 0; \
+            rec->tid = gettid(); \
+            rec->sysno = sysno; \
+            rec->retv = retv; \
+            rec->time = strace_time(); \
+            strncpy(rec->call, #name, sizeof(rec->call)); \
+            struct strace_arg *arg = rec->args; \
+            char *blob = (char *) (rec->args + rec->argc); \
+            VARDEF2(_STRACE_ARG_USE, , ##__VA_ARGS__) \
+            (void) arg; \
+            rec->size = (blob - msg + 7) & ~7ul; \
+            strace_commit(msg, rec->size); \
+        }
+#else
 #define _STRACE_ARG_USE(A, P) \
         buf += _print_##P(buf, A); \
         buf += sprintf(buf, ", ");
 
 #define STRACE(name, pret, ...) \
         static void strace_##name( \
-                const char *tokn, long retv \
+                const char *tokn, long sysno, long retv \
                 VARDEF2(_STRACE_ARG_DEF, , ##__VA_ARGS__) \
         ) { \
+            (void) sysno; \
             char msg[1024]; \
             char *buf = msg; \
             buf += sprintf(buf, "[strace:%4d] %s " #name "(", gettid(), tokn); \
@@ -171,18 +318,9 @@ static inline int gettid(void) {
             buf += sprintf(buf, ") = <ret: "); \
             buf += _print_##pret(buf, retv); \
             buf += sprintf(buf, ">\n"); \
-            size_t len = buf - msg; \
-            if (len >= sizeof(msg)) { \
-                panic(0, "strace entry exceeds size limit", NULL); \
-            } \
-            char *entry; \
-            pthread_spin_lock(&ledger_lock); \
-            entry = ledger; \
-            ledger += len; \
-            console->count += len; \
-            pthread_spin_unlock(&ledger_lock); \
-            memcpy(entry, msg, len); \
+            strace_commit(msg, buf - msg); \
         }
+#endif
 
 // default strace functions
 STRACE(unknown_0, int_hex)
@@ -465,14 +603,15 @@ STRACE(readahead, int_signed,
 // init
 void strace_init(void) {
     // find the location of the ledger
-    console = (struct console *) ((char *) g_shmem + IVSHMEM_OFFSET_STRACE);
+    console = (struct console *) SHMEM_REGION(INSTMEM_REGION_STRACE);
 
     // reset the count
     console->count = 0;
-    ledger = console->buffer;
 
-    // initialize the spin lock
-    pthread_spin_init(&ledger_lock, 0);
+#ifdef RACER_STRACE_BINARY
+    // let the host tell the binary log from the text console
+    strace_commit(STRACE_BINARY_MAGIC, sizeof(STRACE_BINARY_MAGIC));
+#endif
 
     // assign strace with default pointers
     for (int i = 0; i < STRACE_SYSCALL_NUM_MAX; i++) {
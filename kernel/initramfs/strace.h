@@ -5,8 +5,55 @@
 
 #define STRACE_SYSCALL_NUM_MAX          1024
 
+// log syscalls as binary records (formatted on the host by fuzz_strace.py)
+// instead of text lines, comment out to fall back to the text console
+#define RACER_STRACE_BINARY
+
+#define STRACE_BINARY_MAGIC             "STRACEB"
+#define STRACE_BLOB_SIZE_MAX            64
+
+// kinds of values (mirrored in fuzz_strace.py)
+enum strace_kind {
+    STRACE_KIND_ptr_hex = 0,
+    STRACE_KIND_int_hex,
+    STRACE_KIND_int_oct,
+    STRACE_KIND_int_signed,
+    STRACE_KIND_int_unsigned,
+    STRACE_KIND_ref_int_signed,
+    STRACE_KIND_ref_int_unsigned,
+    STRACE_KIND_fd,
+    STRACE_KIND_str,
+    STRACE_KIND_buf,
+    STRACE_KIND_struct_stat,
+    STRACE_KIND_struct_linux_dirent,
+    STRACE_KIND_struct_linux_dirent64,
+    STRACE_KIND_vector_struct_iovec,
+};
+
+// binary record: the header, the args, then the blobs of the args in order
+struct strace_arg {
+    long word;
+    unsigned char kind;
+    unsigned char blen;
+    unsigned char rsvd[6];
+};
+
+struct strace_record {
+    unsigned int size;          // total size, 8-byte aligned (0 ends a log)
+    unsigned char argc;
+    unsigned char exit;         // 0 on "->", 1 on "<-"
+    unsigned char kret;
+    unsigned char rsvd;
+    long tid;
+    long sysno;
+    long retv;
+    unsigned long time;         // in ns, CLOCK_MONOTONIC
+    char call[16];
+    struct strace_arg args[0];
+};
+
 #define STRACE_HANDLE_DECLARE(n, ...) \
-        typedef void (*t_strace_##n)(const char *, long, ##__VA_ARGS__); \
+        typedef void (*t_strace_##n)(const char *, long, long, ##__VA_ARGS__); \
         extern t_strace_##n STRACE_HANDLES_##n[STRACE_SYSCALL_NUM_MAX]
 
 #define STRACE_HANDLE_DEFINE(n) \
@@ -0,0 +1,181 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+#include "type_int.h"
+#include "type_buf.h"
+#include "type_str.h"
+#include "type_path.h"
+#include "type_fd.h"
+#include "type_len.h"
+
+using namespace spec;
+
+/**
+ * Mutations per second over a program mixing all the type families, and
+ * the requests that reached the upstream allocator while measuring.
+ *
+ * usage: spec_bench [mutations] [seed]
+ */
+
+class CountedResource : public pmr::memory_resource {
+public:
+    size_t count = 0;
+    size_t total = 0;
+
+protected:
+    void *do_allocate(size_t bytes, size_t align) override {
+        count++;
+        total += bytes;
+        return pmr::new_delete_resource()->allocate(bytes, align);
+    }
+
+    void do_deallocate(void *p, size_t bytes, size_t align) override {
+        pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+
+    bool do_is_equal(const pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// types are validated in place, a moved type is not validated
+template<typename T>
+static void add(vector<unique_ptr<Kind>> &kinds, T &&type) {
+    auto item = make_unique<T>(std::move(type));
+    item->validate();
+    kinds.push_back(std::move(item));
+}
+
+static TypeStrRange mk_segment() {
+    TypeStrRange segment;
+    text chars;
+    for (char c : spec_charset()) {
+        if (c != '/') {
+            chars.push_back(c);
+        }
+    }
+    segment.char_set(std::move(chars));
+    segment.char_sep(text());
+    segment.char_min(1);
+    segment.char_max(SPEC_RAND_PATH_SEG_MAX);
+    return segment;
+}
+
+static void mk_kinds(vector<unique_ptr<Kind>> &kinds) {
+    // paths and fds first, so that the others may refer to them
+    const NodeType marks[] = {
+            NodeType::DIR, NodeType::FILE, NodeType::DIR,
+            NodeType::FILE, NodeType::LINK, NodeType::SYM,
+    };
+    for (NodeType mark : marks) {
+        TypePath path;
+        path.mark(mark);
+        path.segment(mk_segment());
+        add(kinds, std::move(path));
+
+        TypeFd fd;
+        fd.mark(mark);
+        add(kinds, std::move(fd));
+    }
+
+    for (NodeType mark : {NodeType::DIR, NodeType::FILE}) {
+        TypePathExt path_ext;
+        path_ext.mark(mark);
+        add(kinds, std::move(path_ext));
+
+        TypeFdExt fd_ext;
+        fd_ext.mark(mark);
+        add(kinds, std::move(fd_ext));
+    }
+
+    TypeIntConst<int64_t> int_const;
+    int_const.val_const(-100);
+    add(kinds, std::move(int_const));
+
+    TypeIntRange<uint32_t> int_range;
+    int_range.val_min(0);
+    int_range.val_max(4096);
+    add(kinds, std::move(int_range));
+
+    TypeIntFlag<int32_t> int_flag;
+    int_flag.vals({0x1, 0x2, 0x40, 0x80, 0x200, 0x400, 0x800, 0x10000});
+    int_flag.elem_min(0);
+    int_flag.elem_max(8);
+    int_flag.use_ops({IntFlagOp::OR});
+    int_flag.use_neg(false);
+    add(kinds, std::move(int_flag));
+
+    TypeBufConst buf_const;
+    buf_const.val_const(bytes(64, byte(0x41)));
+    add(kinds, std::move(buf_const));
+
+    TypeBufRange buf_range;
+    buf_range.byte_set(bytes());
+    buf_range.byte_sep(bytes());
+    buf_range.byte_min(0);
+    buf_range.byte_max(SPEC_RAND_SIZE_MAX);
+    add(kinds, std::move(buf_range));
+
+    TypeStrConst str_const;
+    str_const.val_const(text("user.racer"));
+    add(kinds, std::move(str_const));
+
+    TypeStrRange str_range = mk_segment();
+    str_range.char_max(256);
+    add(kinds, std::move(str_range));
+
+    TypeLen<uint64_t, TypeBufRange> len_buf;
+    TypeBufRange buf_sized;
+    buf_sized.byte_set(bytes());
+    buf_sized.byte_sep(bytes());
+    buf_sized.byte_min(0);
+    buf_sized.byte_max(SPEC_PAGE_SIZE);
+    len_buf.object(std::move(buf_sized));
+    add(kinds, std::move(len_buf));
+}
+
+int main(int argc, char *argv[]) {
+    size_t num = argc > 1 ? strtoull(argv[1], nullptr, 0) : 1000000;
+    uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 0) : 0;
+
+    vector<unique_ptr<Kind>> kinds;
+    mk_kinds(kinds);
+
+    CountedResource upstream;
+    Program prog(seed, &upstream);
+
+    // warm up: engage every lego and let the pool grow to its steady size
+    for (size_t i = 0; i < num / 10 + kinds.size(); i++) {
+        const Kind &kind = *kinds[i % kinds.size()];
+        if (prog.rng().below(2)) {
+            kind.mutate(prog);
+        } else {
+            kind.puzzle(prog);
+        }
+    }
+
+    size_t count = upstream.count;
+    size_t total = upstream.total;
+
+    auto time_start = chrono::steady_clock::now();
+    for (size_t i = 0; i < num; i++) {
+        const Kind &kind = *kinds[prog.rng().below(kinds.size())];
+        if (prog.rng().below(2)) {
+            kind.mutate(prog);
+        } else {
+            kind.puzzle(prog);
+        }
+    }
+    auto time_end = chrono::steady_clock::now();
+
+    double secs = chrono::duration<double>(time_end - time_start).count();
+    cout << "types: " << kinds.size() << ", legos: " << prog.size() << endl;
+    cout << "mutations: " << num << " in " << secs << " s, "
+         << size_t(num / secs) << " per sec" << endl;
+    cout << "upstream allocations: " << upstream.count - count
+         << " (" << upstream.total - total << " bytes)" << endl;
+
+    return 0;
+}
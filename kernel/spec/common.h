@@ -6,8 +6,12 @@
 
 // std
 #include <functional>
+#include <typeinfo>
+#include <limits>
+#include <memory_resource>
 #include <string>
 #include <tuple>
+#include <utility>
 #include <vector>
 #include <unordered_map>
 #include <optional>
@@ -22,7 +26,10 @@
 
 // scoping
 using namespace std;
-using bytes = vector<byte>;
+
+// variable-sized data lives in the memory resource of its owner
+using bytes = pmr::vector<byte>;
+using text = pmr::string;
 
 namespace spec {
 
@@ -33,8 +40,8 @@ namespace spec {
 
     // type traits
     template<typename T>
-    struct copyable_type : true_type {
-        static_assert(is_copy_assignable_v<T> && is_copy_constructible_v<T>);
+    struct movable_type : true_type {
+        static_assert(is_move_assignable_v<T> && is_move_constructible_v<T>);
     };
 
     /** random type is not allowed by default */
@@ -43,15 +50,16 @@ namespace spec {
             : false_type {
     };
 
-    /** primitive types (i.e., numerical, string, and bytes) are allowed */
+    /** primitive types (i.e., numerical, enum, and string) are allowed */
     template<typename T>
     struct is_allowed_attr_type<T,
             enable_if_t<
                     is_integral_v<T> ||
+                    is_enum_v<T> ||
                     is_same_v<string, T> ||
-                    is_same_v<bytes, T>
+                    is_same_v<text, T>
             >
-    > : copyable_type<T> {
+    > : movable_type<T> {
     };
 
     /** Bean types are allowed */
@@ -60,7 +68,7 @@ namespace spec {
             enable_if_t<
                     is_base_of_v<Bean, T>
             >
-    > : copyable_type<T> {
+    > : movable_type<T> {
     };
 
     /** optional types allowed only if its value_type is allowed */
@@ -79,7 +87,7 @@ namespace spec {
             enable_if_t<
                     is_allowed_attr_type_optional<T>::value
             >
-    > : copyable_type<T> {
+    > : movable_type<T> {
     };
 
     /** tuple types allowed only if all member types are allowed */
@@ -98,17 +106,17 @@ namespace spec {
             enable_if_t<
                     is_allowed_attr_type_tuple<T>::value
             >
-    > : copyable_type<T> {
+    > : movable_type<T> {
     };
 
-    /** vector types allowed only if the value type is allowed */
+    /** vector types (bytes included) allowed only if the value type is allowed */
     template<typename T_Vector>
     struct is_allowed_attr_type_vector
             : false_type {
     };
 
-    template<typename U>
-    struct is_allowed_attr_type_vector<vector<U>>
+    template<typename U, typename A>
+    struct is_allowed_attr_type_vector<vector<U, A>>
             : is_allowed_attr_type<U> {
     };
 
@@ -117,7 +125,7 @@ namespace spec {
             enable_if_t<
                     is_allowed_attr_type_vector<T>::value
             >
-    > : copyable_type<T> {
+    > : movable_type<T> {
     };
 
     /** map types allowed only if both the key and value types are allowed */
@@ -136,7 +144,7 @@ namespace spec {
             enable_if_t<
                     is_allowed_attr_type_map<T>::value
             >
-    > : copyable_type<T> {
+    > : movable_type<T> {
     };
 
     // foundations
@@ -148,18 +156,38 @@ namespace spec {
         optional<T> _attr = {};
 
     public:
+        bool has() const {
+            return _attr.has_value();
+        }
+
         explicit operator const T &() const {
 #ifdef RACER_DEBUG
             assert(_attr.has_value());
 #endif
-            return _attr.value();
+            return *_attr;
         }
 
         Attr &operator=(const T &other) {
-            // is_allowed_attr_type_v<T> makes sure that _attr can be copy assigned
+            // an engaged _attr copies into its own storage, allocating only
+            // when the capacity falls short
             _attr = other;
             return *this;
         }
+
+        Attr &operator=(T &&other) {
+            // is_allowed_attr_type_v<T> makes sure that _attr can be move assigned
+            _attr = std::move(other);
+            return *this;
+        }
+
+        // for in-place updates, constructs the value from args if unset
+        template<typename... Args>
+        T &ensure(Args &&... args) {
+            if (!_attr.has_value()) {
+                _attr.emplace(std::forward<Args>(args)...);
+            }
+            return *_attr;
+        }
     };
 
     class Bean {
@@ -168,14 +196,16 @@ namespace spec {
         bool _check = false;
 
     public:
-        virtual void validate() {
+        // NOTE: not virtual, BEAN() chains the validation of the bases
+        // statically, so a bean of plain data (e.g., a Rand) has no vtable
+        void validate() {
 #ifdef RACER_DEBUG
             assert(!_check);
 #endif
             _check = true;
         }
 
-        virtual void _validate() {
+        void _validate() {
             // by default, do nothing
         }
     };
@@ -184,33 +214,57 @@ namespace spec {
 protected: \
     Attr<type> _##name; \
 public: \
-    /* attribute setter */ \
+    /* attribute setters */ \
     void name(const type &other) { \
         this->_##name = other; \
         this->_check = false; \
     } \
-    /* attribute getter */ \
+    void name(type &&other) { \
+        this->_##name = std::move(other); \
+        this->_check = false; \
+    } \
+    /* attribute getters */ \
     const type &name() const { \
         return static_cast<const type&>(this->_##name); \
+    } \
+    bool has_##name() const { \
+        return this->_##name.has(); \
+    } \
+    /* attribute editor, constructed from args if unset */ \
+    template<typename... Args> \
+    type &name##_edit(Args &&... args) { \
+        this->_check = false; \
+        return this->_##name.ensure(std::forward<Args>(args)...); \
     }
 
-#define _BEAN_ATTR_SET(type, name) \
-    name(other.name()); \
+#define _BEAN_ATTR_COPY(type, name) \
+    this->_##name = other._##name;
+
+#define _BEAN_ATTR_MOVE(type, name) \
+    this->_##name = std::move(other._##name);
 
 #define BEAN(name, base, ...) \
     class name: public base { \
     public: \
-        /* allow default and copy constructors only */ \
+        /* allow default, copy, and move constructors only, */ \
+        /* the result carries the attributes but is not validated */ \
         name(): base() {} \
         name(const name &other): base(other) { \
-            VARDEF2(_BEAN_ATTR_SET, , ##__VA_ARGS__) \
+            VARDEF2(_BEAN_ATTR_COPY, , ##__VA_ARGS__) \
+            this->_check = false; \
+        } \
+        name(name &&other) noexcept: base(std::move(other)) { \
+            VARDEF2(_BEAN_ATTR_MOVE, , ##__VA_ARGS__) \
+            this->_check = false; \
         } \
+        name &operator=(const name &other) = default; \
+        name &operator=(name &&other) = default; \
     protected: \
         /* define attributes according to the list */ \
         VARDEF2(_BEAN_ATTR_DEF, , ##__VA_ARGS__) \
     public: \
         /* attribute validation */ \
-        void validate() override { \
+        void validate() { \
             base::validate(); \
             name::_validate(); \
         }
@@ -224,15 +278,13 @@ public: \
          */
     };
 
-    template<typename R>
-    BEAN(Type, Bean)
+    BEAN(Kind, Bean)
         /**
-         *  A semantic type, guiding the mutation of one data point in the program.
-         *  i.e., each Type object represents one possible mutation point.
+         *  The untyped view of a Type, so that mutation points of different
+         *  Rand types can be held (and picked from) together.
          */
     public:
-        using rand_type = R;
-        static_assert(is_base_of_v<Rand, R>);
+        virtual ~Kind() = default;
 
     public:
         // size in memory
@@ -241,10 +293,25 @@ public: \
         // mutating the data point (evolve with strict semantics)
         virtual void mutate(Program &prog) const = 0;
 
-        /*
         // puzzling the data point (evolve with loose semantics)
         virtual void puzzle(Program &prog) const = 0;
+    };
+
+    template<typename R>
+    BEAN(Type, Kind)
+        /**
+         *  A semantic type, guiding the mutation of one data point in the program.
+         *  i.e., each Type object represents one possible mutation point.
+         */
+    public:
+        using rand_type = R;
+        static_assert(is_base_of_v<Rand, R>);
 
+    public:
+        // initializing the data point when it first appears in the program
+        virtual void engage(R &rand, Program &prog) const = 0;
+
+        /*
         // updating the data point after mutation happens elsewhere
         virtual void update(Program &prog) const = 0;
 
@@ -311,26 +378,107 @@ public: \
          tuple<T_Args...>, args)
     };
 
-    // generated program
-    template<typename T>
-    struct Lego {
-    public:
-        using R = typename T::rand_type;
-        static_assert(is_base_of_v<Type<R>, T>);
+    // randomness
+    class Random {
+        /**
+         *  xoshiro256**, the program-wide source of randomness.
+         *
+         *  Mutation draws several numbers per step, hence the generator is
+         *  kept small and inlined rather than going through <random>.
+         */
 
-    protected:
-        //optional<reference_wrapper<R>> _rand = {};
+    private:
+        uint64_t _s[4];
+
+        static uint64_t rotl(uint64_t x, int k) {
+            return (x << k) | (x >> (64 - k));
+        }
 
-        /*
     public:
-        bool hasRand() {
-            return _rand.has_value();
+        explicit Random(uint64_t seed) {
+            // splitmix64 expands the seed into the state
+            for (uint64_t &i : _s) {
+                uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                i = z ^ (z >> 31);
+            }
+        }
+
+        uint64_t next() {
+            uint64_t r = rotl(_s[1] * 5, 7) * 9;
+            uint64_t t = _s[1] << 17;
+            _s[2] ^= _s[0];
+            _s[3] ^= _s[1];
+            _s[1] ^= _s[2];
+            _s[0] ^= _s[3];
+            _s[2] ^= t;
+            _s[3] = rotl(_s[3], 45);
+            return r;
         }
 
-        R &getRand() {
-            return _rand.value();
+        // in [0, n), n > 0
+        uint64_t below(uint64_t n) {
+#ifdef RACER_DEBUG
+            assert(n != 0);
+#endif
+            return uint64_t((static_cast<unsigned __int128>(next()) * n) >> 64);
+        }
+
+        // in [lo, hi], of any integral type
+        template<typename I>
+        I range(I lo, I hi) {
+            static_assert(is_integral_v<I>);
+            uint64_t span = uint64_t(hi) - uint64_t(lo);
+            if (span == numeric_limits<uint64_t>::max()) {
+                return I(next());
+            }
+            return I(uint64_t(lo) + below(span + 1));
         }
+
+        // in [0, 1)
+        double unit() {
+            return double(next() >> 11) * 0x1.0p-53;
+        }
+
+        template<typename C>
+        const typename C::value_type &pick(const C &items) {
+            return items[below(items.size())];
+        }
+    };
+
+    // generated program
+    template<typename R>
+    struct Lego {
+        /**
+         *  The placement of a Type in the program, holds its Rand.
          */
+        static_assert(is_base_of_v<Rand, R>);
+
+    public:
+        R rand;
+
+        // order in which the legos enter the program
+        size_t index;
+
+        explicit Lego(size_t index) : rand(), index(index) {}
+    };
+
+    // mirrors NodeType in spec_basis.py
+    enum class NodeType : uint8_t {
+        GENERIC = 0,
+        FILE = 1,
+        DIR = 2,
+        LINK = 3,
+        SYM = 4,
+    };
+
+    static constexpr size_t NODE_TYPE_NUM = 5;
+
+    // the legos other legos may refer to
+    enum class NodeKind : uint8_t {
+        PATH,
+        FD,
     };
 
     class Program {
@@ -341,33 +489,146 @@ public: \
          *      - code region: holding immutable data and list of syscalls
          *      - data region: holding mutable data chunks
          *      - exec region: holding the runtime states of the execution
+         *
+         *  All the legos and their variable-sized data (bytes, text) are
+         *  drawn from one pool, which recycles the blocks freed by earlier
+         *  mutations, so once the program has warmed up, mutating it rarely
+         *  goes back to the upstream allocator.
          */
 
-        // type-to-rand mapping
+    public:
+        struct Node {
+            NodeKind kind;
+            NodeType mark;
+            size_t index;
+            const Kind *type;
+        };
+
     private:
-        template<typename T>
-        static unordered_map<
-                const Program *,
-                unordered_map<reference_wrapper<T>, Lego<T>>
-        > _lego;
+        struct Slot {
+            void *lego;
+            void (*drop)(void *);
+#ifdef RACER_DEBUG
+            const type_info *rtti;
+#endif
+        };
+
+        // NOTE: declared first, so it outlives everything drawn from it
+        pmr::unsynchronized_pool_resource _pool;
+
+        Random _rng;
+
+        // type-to-lego mapping, keyed by the address of the Type object
+        pmr::unordered_map<const void *, Slot> _legos;
+        pmr::vector<const void *> _order;
+
+        // legos that may be referred to, by their NodeKind and NodeType
+        pmr::vector<Node> _nodes;
 
     public:
-        template<typename T>
-        Lego<T> &lego(const T &type) {
-            return _lego<T>[this][cref(type)];
+        explicit Program(
+                uint64_t seed,
+                pmr::memory_resource *upstream = pmr::new_delete_resource()
+        ) : _pool(pmr::pool_options{0, 1 << 20}, upstream),
+            _rng(seed),
+            _legos(&_pool), _order(&_pool), _nodes(&_pool) {}
+
+        ~Program() {
+            // drop legos in the reverse order of their creation
+            for (auto i = _order.rbegin(); i != _order.rend(); i++) {
+                const Slot &slot = _legos.at(*i);
+                slot.drop(slot.lego);
+            }
         }
 
+        // a program is bound to its pool
+        Program(const Program &) = delete;
+
+        Program &operator=(const Program &) = delete;
+
+    public:
+        pmr::memory_resource *resource() {
+            return &_pool;
+        }
+
+        Random &rng() {
+            return _rng;
+        }
+
+        size_t size() const {
+            return _order.size();
+        }
+
+    public:
+        /** the lego of the type, which engages the type on first use */
         template<typename T>
-        const Lego<T> &lego(const T &type) const {
-            return _lego<T>[this][cref(type)];
+        Lego<typename T::rand_type> &lego(const T &type) {
+            using R = typename T::rand_type;
+            static_assert(is_base_of_v<Type<R>, T>);
+
+            auto it = _legos.find(&type);
+            if (it != _legos.end()) {
+#ifdef RACER_DEBUG
+                assert(*it->second.rtti == typeid(R));
+#endif
+                return *static_cast<Lego<R> *>(it->second.lego);
+            }
+
+            pmr::polymorphic_allocator<Lego<R>> alloc(&_pool);
+            Lego<R> *item = alloc.allocate(1);
+            new(item) Lego<R>(_order.size());
+
+            Slot slot;
+            slot.lego = item;
+            slot.drop = [](void *ptr) {
+                static_cast<Lego<R> *>(ptr)->~Lego<R>();
+            };
+#ifdef RACER_DEBUG
+            slot.rtti = &typeid(R);
+#endif
+            _legos.emplace(&type, slot);
+            _order.push_back(&type);
+
+            // legos are not relocated, the engagement may create more
+            type.engage(item->rand, *this);
+            return *item;
         }
-    };
 
-    template<typename T>
-    unordered_map<
-            const Program *,
-            unordered_map<reference_wrapper<T>, Lego<T>>
-    > Program::_lego;
+    public:
+        size_t add_node(NodeKind kind, NodeType mark,
+                        const Kind *type, size_t index) {
+            _nodes.push_back(Node{kind, mark, index, type});
+            return _nodes.size() - 1;
+        }
+
+        const Node &node(size_t id) const {
+            return _nodes[id];
+        }
+
+        /**
+         *  picks a node of the kind uniformly among those engaged before
+         *  the given index, either of the mark or of any other mark
+         */
+        optional<size_t> pick_node(NodeKind kind, NodeType mark, bool same,
+                                   size_t before) {
+            optional<size_t> pick = {};
+
+            // reservoir sampling, no candidate list is built
+            uint64_t seen = 0;
+            for (size_t i = 0; i < _nodes.size(); i++) {
+                const Node &item = _nodes[i];
+                if (item.kind != kind || item.index >= before ||
+                    (item.mark == mark) != same) {
+                    continue;
+                }
+                if (_rng.below(++seen) == 0) {
+                    pick = i;
+                }
+            }
+
+            return pick;
+        }
+    };
 
 }; // spec namespace
 
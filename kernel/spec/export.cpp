@@ -0,0 +1,31 @@
+#include "packer.h"
+
+using namespace spec;
+
+/*
+ * c interface of the packer (loaded by script/spec_packer.py through ctypes)
+ * returns the size of the bytecode written into the region, -1 if it does
+ * not fit
+ */
+extern "C" int64_t spec_pack_program(
+        void *region, uint64_t size, uint64_t base,
+        const uint64_t *ptrs, uint64_t num_ptrs,
+        const uint64_t *code, const uint64_t *code_off, uint64_t num_streams,
+        const uint8_t *heap, uint64_t heap_size,
+        uint64_t *heap_at) {
+
+    Arena arena(region, size);
+    PackResult result = Packer::pack(arena, {
+            base,
+            ptrs, num_ptrs,
+            code, code_off, num_streams,
+            heap, heap_size,
+    });
+
+    if (result.error.has_value()) {
+        return -1;
+    }
+
+    *heap_at = result.heap_at;
+    return static_cast<int64_t>(result.size);
+}
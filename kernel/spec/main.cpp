@@ -9,8 +9,15 @@ int main() {
     ri.data(2);
     ri.validate();
 
-    TypeInt<uint8_t> ti;
+    TypeIntRange<uint8_t> ti;
+    ti.val_min(0);
+    ti.val_max(16);
+    ti.validate();
     cout << ti.size().value() << endl;
 
+    Program prog(0);
+    ti.mutate(prog);
+    cout << int(prog.lego(ti).rand.data()) << endl;
+
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,259 @@
+#ifndef _RACER_SPEC_MUTATE_H_
+#define _RACER_SPEC_MUTATE_H_
+
+#include <algorithm>
+
+#include "common.h"
+
+namespace spec {
+
+    // mirrors spec_const.py
+    static constexpr size_t SPEC_PAGE_SIZE = 4096;
+    static constexpr size_t SPEC_RAND_SIZE_MAX = SPEC_PAGE_SIZE * 3 / 2;
+    static constexpr size_t SPEC_RAND_PATH_SEG_MAX = 16;
+
+    static constexpr int32_t SPEC_FD_LIMIT_MIN = 3;
+    static constexpr int32_t SPEC_FD_LIMIT_MAX = 200;
+
+    // the full byteset (0 - 255) and charset (1 - 255)
+    inline const bytes &spec_byteset() {
+        static const bytes items = [] {
+            bytes r;
+            for (unsigned i = 0; i < 256; i++) {
+                r.push_back(byte(i));
+            }
+            return r;
+        }();
+        return items;
+    }
+
+    inline const text &spec_charset() {
+        static const text items = [] {
+            text r;
+            for (unsigned i = 1; i < 256; i++) {
+                r.push_back(char(i));
+            }
+            return r;
+        }();
+        return items;
+    }
+
+    template<typename I>
+    struct IntEngine {
+        /**
+         *  The mutation of an integer of any width, mirrors KindSendInt in
+         *  spec_type_int.py: a candidate is computed wide and then clamped
+         *  into the range of I.
+         */
+        static_assert(is_integral_v<I>);
+
+        using wide = __int128;
+
+        static constexpr wide int_min = numeric_limits<I>::min();
+        static constexpr wide int_max = numeric_limits<I>::max();
+
+        static I sanitize(wide data) {
+            if (data < int_min) {
+                return I(int_min);
+            }
+            if (data > int_max) {
+                return I(int_max);
+            }
+            return I(data);
+        }
+
+        template<size_t N>
+        static I choose(const wide (&items)[N], Random &rng) {
+            return sanitize(items[rng.below(N)]);
+        }
+
+        static I drag(I data, Random &rng) {
+            double p = rng.unit();
+
+            if (p < 0.45) {
+                // [DRAG] inc/dec based on the existing value
+                wide v = data;
+                wide step = (v < 0 ? -v : v) / 10;
+                const wide items[] = {
+                        v + 1, v + step, v + v,
+                        v - 1, v - step, v - 2 * v,
+                };
+                return choose(items, rng);
+            }
+
+            if (p < 0.9) {
+                // [DRAG] choose from an extreme value (integer range-wise)
+                const wide items[] = {
+                        0,
+                        1, 4096,
+                        -1, -4096,
+                        int_min, int_min + 1, int_min + 4096,
+                        int_max, int_max - 1, int_max - 4096,
+                };
+                return choose(items, rng);
+            }
+
+            // [DRAG] choose a random number within the integer range
+            return rng.range(numeric_limits<I>::min(),
+                             numeric_limits<I>::max());
+        }
+    };
+
+    template<typename S>
+    struct SeqEngine {
+        /**
+         *  The mutation of a sequence, i.e., the bytes of a buf or the chars
+         *  of a str, mirrors KindSendBuf/KindSendStr in spec_type_*.py.
+         *
+         *  All operations edit the sequence in place, in the memory resource
+         *  it was created in, so a steady-state mutation reuses the capacity
+         *  left by the previous ones instead of building new sequences.
+         */
+        using E = typename S::value_type;
+
+        // num elements drawn from the set, joined with the separator
+        static void cook(S &data, size_t num, const S &set, const S &sep,
+                         Random &rng) {
+            data.clear();
+            for (size_t i = 0; i < num; i++) {
+                if (i != 0) {
+                    data.insert(data.end(), sep.begin(), sep.end());
+                }
+                data.push_back(rng.pick(set));
+            }
+        }
+
+        static size_t randrange(size_t n, Random &rng) {
+            return n == 0 ? 0 : rng.below(n);
+        }
+
+        static void drag(S &data, size_t limit, const S &set, Random &rng) {
+            size_t size = data.size();
+            double p = rng.unit();
+
+            if (size == 0) {
+                // [DRAG] randomly cook up a sequence if currently empty
+                cook(data, randrange(limit, rng), set, S(), rng);
+            } else if (p < 0.2) {
+                // [DRAG] insert NULL at random places
+                data[rng.below(size)] = E(0);
+            } else if (p < 0.3) {
+                // [DRAG] repeat the existing data n times
+                size_t n = rng.range<size_t>(1, 3);
+                data.resize(size * n);
+                for (size_t i = 1; i < n; i++) {
+                    std::copy_n(data.begin(), size, data.begin() + size * i);
+                }
+            } else if (p < 0.45) {
+                // [DRAG] add an element randomly
+                size_t stuff = rng.below(size);
+                for (size_t i = 0; i < stuff; i++) {
+                    data.insert(data.begin() + rng.below(data.size()),
+                                rng.pick(set));
+                }
+            } else if (p < 0.6) {
+                // [DRAG] del an element randomly
+                size_t strip = rng.below(size);
+                for (size_t i = 0; i < strip; i++) {
+                    data.erase(data.begin() + rng.below(data.size()));
+                }
+            } else if (p < 0.75) {
+                // [DRAG] mod an element randomly
+                size_t place = rng.below(size);
+                for (size_t i = 0; i < place; i++) {
+                    data[rng.below(size)] = rng.pick(set);
+                }
+            } else if (p < 0.9) {
+                // [DRAG] repeat a special element up to the limit
+                switch (rng.below(3)) {
+                    case 0:
+                        data.clear();
+                        break;
+                    case 1:
+                        data.assign(1, E(0));
+                        break;
+                    default:
+                        data.assign(randrange(limit, rng), E(0));
+                        break;
+                }
+            } else {
+                // [DRAG] randomly cook up a sequence
+                cook(data, randrange(limit, rng), set, S(), rng);
+            }
+        }
+
+        // the count to cook for a ranged sequence, in [lo, hi] or around it
+        static size_t extreme(size_t lo, size_t hi, Random &rng) {
+            size_t mid = (lo + hi) / 2;
+            size_t step_lo = lo / 10;
+            size_t step_hi = hi / 10;
+            const size_t items[] = {
+                    1, lo, hi, mid,
+                    lo == 0 ? 0 : lo - 1, lo - step_lo,
+                    hi == 0 ? 0 : hi - 1, hi - step_hi,
+                    lo + 1, lo + step_lo,
+                    hi + 1, hi + step_hi,
+            };
+            return items[rng.below(sizeof(items) / sizeof(items[0]))];
+        }
+    };
+
+    // for the legos referring to other legos, i.e., PathExt and FdExt
+    BEAN(RandNodeExt, Rand,
+         int64_t, pick)
+        /**
+         *  The id of the node picked, -1 if no node is available.
+         */
+    };
+
+    template<NodeKind K>
+    BEAN(TypeNodeExt, Type<RandNodeExt>,
+         NodeType, mark)
+        /**
+         *  A reference to an existing node in the program, mirrors
+         *  KindSendPathExt and KindSendFdExt.
+         */
+
+    public:
+        optional<size_t> size() const override {
+            return {};
+        }
+
+        void engage(RandNodeExt &rand, Program &prog) const override {
+            rand.pick(pick(prog, mark(), true));
+        }
+
+        void mutate(Program &prog) const override {
+            auto &rand = prog.lego(*this).rand;
+
+            if (rand.pick() >= 0 && prog.rng().unit() < 0.5) {
+                // [TOSS] mutate the underlying node
+                prog.node(rand.pick()).type->mutate(prog);
+            } else {
+                // [TOSS] choose another node
+                rand.pick(pick(prog, mark(), true));
+            }
+        }
+
+        void puzzle(Program &prog) const override {
+            auto &rand = prog.lego(*this).rand;
+
+            if (rand.pick() >= 0 && prog.rng().unit() < 0.5) {
+                // [DRAG] puzzle the underlying node
+                prog.node(rand.pick()).type->puzzle(prog);
+            } else {
+                // [DRAG] choose another node not in the same type
+                rand.pick(pick(prog, mark(), false));
+            }
+        }
+
+    protected:
+        int64_t pick(Program &prog, NodeType which, bool same) const {
+            auto id = prog.pick_node(K, which, same, prog.lego(*this).index);
+            return id.has_value() ? int64_t(*id) : -1;
+        }
+    };
+
+} // spec namespace
+
+#endif /* _RACER_SPEC_MUTATE_H_ */
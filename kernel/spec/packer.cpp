@@ -0,0 +1,65 @@
+#include "packer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace spec {
+
+    static const char BYTECODE_MAGIC[8] = {
+            'b', 'y', 't', 'e', 'c', 'o', 'd', '2',
+    };
+
+    PackResult Packer::pack(Arena &arena, const PackInput &input) {
+        PackResult result = {PackError::OVERFLOW, 0, 0};
+
+        // head: magic, code offset, heap offset, heap address
+        uint64_t *head = arena.words(4);
+        if (head == nullptr) {
+            return result;
+        }
+        memcpy(head, BYTECODE_MAGIC, sizeof(BYTECODE_MAGIC));
+        head[1] = arena.used();
+
+        // code: number of sub threads, offset of each stream, the streams
+        size_t num_words = input.code_off[input.num_streams];
+        uint64_t *code = arena.words(1 + input.num_streams + num_words);
+        if (code == nullptr) {
+            return result;
+        }
+
+        code[0] = input.num_streams - 2;
+
+        uint64_t cursor = (1 + input.num_streams) * sizeof(uint64_t);
+        for (size_t i = 0; i < input.num_streams; i++) {
+            code[1 + i] = cursor;
+            cursor += (input.code_off[i + 1] - input.code_off[i]) *
+                      sizeof(uint64_t);
+        }
+        copy(input.code, input.code + num_words,
+             code + 1 + input.num_streams);
+        head[2] = arena.used();
+        head[3] = input.base + head[2];
+
+        // heap, with the pointers (at any alignment) relocated
+        uint8_t *heap = arena.alloc(input.heap_size);
+        if (heap == nullptr) {
+            return result;
+        }
+        memcpy(heap, input.heap, input.heap_size);
+
+        for (size_t i = 0; i < input.num_ptrs; i++) {
+            uint64_t value;
+            memcpy(&value, heap + input.ptrs[i], sizeof(value));
+            if (value != 0) {
+                value += head[3];
+                memcpy(heap + input.ptrs[i], &value, sizeof(value));
+            }
+        }
+
+        result.error = nullopt;
+        result.size = arena.used();
+        result.heap_at = head[2];
+        return result;
+    }
+
+} // spec namespace
@@ -0,0 +1,107 @@
+#ifndef _RACER_SPEC_PACKER_H_
+#define _RACER_SPEC_PACKER_H_
+
+// c headers
+#include <cstddef>
+#include <cstdint>
+
+// std
+#include <optional>
+
+// scoping
+using namespace std;
+
+namespace spec {
+
+    class Arena {
+        /**
+         *  Bump allocation over a region owned by the caller, i.e., the
+         *  bytecode region of an instance mapped from the ivshmem file.
+         *  Nothing is ever freed, the whole region is reused per program.
+         */
+
+    private:
+        uint8_t *_base;
+        size_t _size;
+        size_t _used = 0;
+
+    public:
+        Arena(void *base, size_t size)
+                : _base(static_cast<uint8_t *>(base)), _size(size) {}
+
+        // null once the region is exhausted
+        uint8_t *alloc(size_t size) {
+            if (size > _size - _used) {
+                return nullptr;
+            }
+
+            uint8_t *ptr = _base + _used;
+            _used += size;
+            return ptr;
+        }
+
+        uint64_t *words(size_t num) {
+            return reinterpret_cast<uint64_t *>(alloc(num * sizeof(uint64_t)));
+        }
+
+        // give back the tail of the latest allocations, down to used
+        void rewind(size_t used) {
+            if (used < _used) {
+                _used = used;
+            }
+        }
+
+        size_t used() const {
+            return _used;
+        }
+    };
+
+    struct PackInput {
+        /**
+         *  The pieces of a program before the layout (see BytecodeParts in
+         *  script/spec_basis.py), all borrowed from the caller.
+         */
+
+        // address the region is mapped at in the guest
+        uint64_t base;
+
+        // pointers to relocate, in any order
+        const uint64_t *ptrs;
+        size_t num_ptrs;
+
+        // words of the streams (main, fini, then the subs), the i-th one
+        // spans [code_off[i], code_off[i + 1]) in code
+        const uint64_t *code;
+        const uint64_t *code_off;
+        size_t num_streams;
+
+        // heap, starting at its reserved offset
+        const uint8_t *heap;
+        size_t heap_size;
+    };
+
+    enum class PackError {
+        OVERFLOW,
+    };
+
+    struct PackResult {
+        optional<PackError> error;
+        size_t size;
+        size_t heap_at;
+    };
+
+    class Packer {
+        /**
+         *  Writes the layout the guest interpreter expects straight into an
+         *  arena: head, code (per-stream offsets and instructions) and heap
+         *  (with the pointers relocated against the base), the same bytes
+         *  as Program.gen_bytecode() but without assembling them in python.
+         */
+
+    public:
+        static PackResult pack(Arena &arena, const PackInput &input);
+    };
+
+} // spec namespace
+
+#endif /* _RACER_SPEC_PACKER_H_ */
@@ -0,0 +1,124 @@
+#ifndef _RACER_SPEC_TYPE_BUF_H_
+#define _RACER_SPEC_TYPE_BUF_H_
+
+#include "common.h"
+#include "mutate.h"
+
+namespace spec {
+
+BEAN(RandBuf, Rand,
+     bytes, data)
+};
+
+// the size of the object, for TypeLen
+inline size_t size_of(const RandBuf &rand) {
+    return rand.data().size();
+}
+
+BEAN(TypeBuf, Type<RandBuf>,
+     optional<size_t>, fix_size)
+    /**
+     * Mirrors KindSendBuf, fix_size defaults to unset (no fixed size).
+     */
+
+public:
+    using engine = SeqEngine<bytes>;
+
+public:
+    optional<size_t> size() const override {
+        return fix();
+    }
+
+    void engage(RandBuf &rand, Program &prog) const override {
+        toss(rand.data_edit(prog.resource()), prog.rng());
+    }
+
+    void mutate(Program &prog) const override {
+        auto &rand = prog.lego(*this).rand;
+        toss(rand.data_edit(prog.resource()), prog.rng());
+    }
+
+    void puzzle(Program &prog) const override {
+        auto &data = prog.lego(*this).rand.data_edit(prog.resource());
+        drag(data, prog.rng());
+        sanitize(data);
+    }
+
+protected:
+    optional<size_t> fix() const {
+        return has_fix_size() ? fix_size() : nullopt;
+    }
+
+    size_t limit(Random &rng) const {
+        auto size = fix();
+        if (size.has_value()) {
+            return *size;
+        }
+        return SPEC_PAGE_SIZE + rng.range<int64_t>(-1024, 1024);
+    }
+
+    void sanitize(bytes &data) const {
+        auto size = fix();
+        if (size.has_value() && data.size() > *size) {
+            data.resize(*size);
+        }
+    }
+
+    virtual void toss(bytes &data, Random &rng) const = 0;
+
+    virtual void drag(bytes &data, Random &rng) const {
+        engine::drag(data, limit(rng), spec_byteset(), rng);
+    }
+};
+
+BEAN(TypeBufConst, TypeBuf,
+     bytes, val_const)
+
+protected:
+    void toss(bytes &data, Random &) const override {
+        data.assign(val_const().begin(), val_const().end());
+    }
+};
+
+BEAN(TypeBufRange, TypeBuf,
+     bytes, byte_set,
+     bytes, byte_sep,
+     size_t, byte_min,
+     size_t, byte_max)
+    /**
+     * Mirrors KindSendBufRange, an empty byte_set stands for all bytes.
+     */
+
+public:
+    void _validate() {
+#ifdef RACER_DEBUG
+        assert(byte_min() <= byte_max());
+#endif
+    }
+
+protected:
+    const bytes &set() const {
+        return byte_set().empty() ? spec_byteset() : byte_set();
+    }
+
+    void toss(bytes &data, Random &rng) const override {
+        engine::cook(data, rng.range(byte_min(), byte_max()),
+                     set(), byte_sep(), rng);
+    }
+
+    void drag(bytes &data, Random &rng) const override {
+        if (rng.unit() < 0.5) {
+            // [DRAG] choose from an extreme value (given range-wise)
+            engine::cook(data, engine::extreme(byte_min(), byte_max(), rng),
+                         set(), byte_sep(), rng);
+            return;
+        }
+
+        // [DRAG] use parent strategy
+        TypeBuf::drag(data, rng);
+    }
+};
+
+} // spec namespace
+
+#endif /* _RACER_SPEC_TYPE_BUF_H_ */
@@ -0,0 +1,88 @@
+#ifndef _RACER_SPEC_TYPE_FD_H_
+#define _RACER_SPEC_TYPE_FD_H_
+
+#include "common.h"
+#include "mutate.h"
+
+namespace spec {
+
+BEAN(RandFd, Rand,
+     int32_t, val)
+};
+
+BEAN(TypeFd, Type<RandFd>,
+     NodeType, mark,
+     optional<int32_t>, val_const)
+    /**
+     * Mirrors KindSendFd, val_const defaults to unset (a random fd).
+     */
+
+public:
+    using engine = IntEngine<int32_t>;
+
+public:
+    optional<size_t> size() const override {
+        return sizeof(int32_t);
+    }
+
+    void engage(RandFd &rand, Program &prog) const override {
+        // prep
+        prog.add_node(NodeKind::FD, mark(), this, prog.lego(*this).index);
+
+        // init
+        rand.val(toss(prog.rng()));
+    }
+
+    void mutate(Program &prog) const override {
+        prog.lego(*this).rand.val(toss(prog.rng()));
+    }
+
+    void puzzle(Program &prog) const override {
+        auto &rand = prog.lego(*this).rand;
+        rand.val(drag(rand.val(), prog.rng()));
+    }
+
+protected:
+    static int32_t sanitize(engine::wide data) {
+        return int32_t(std::clamp<engine::wide>(
+                data, SPEC_FD_LIMIT_MIN, SPEC_FD_LIMIT_MAX
+        ));
+    }
+
+    int32_t toss(Random &rng) const {
+        if (has_val_const() && val_const().has_value()) {
+            return *val_const();
+        }
+        return rng.range(SPEC_FD_LIMIT_MIN, SPEC_FD_LIMIT_MAX);
+    }
+
+    static int32_t drag(int32_t data, Random &rng) {
+        double p = rng.unit();
+
+        if (p < 0.25) {
+            // [DRAG] choose from an extreme value
+            return rng.below(2) ? SPEC_FD_LIMIT_MIN : SPEC_FD_LIMIT_MAX;
+        }
+
+        if (p < 0.75) {
+            // [DRAG] inc/dec based on the existing value
+            engine::wide v = data;
+            engine::wide step = (v < 0 ? -v : v) / 10;
+            const engine::wide items[] = {
+                    v + 1, v + step,
+                    v - 1, v - step,
+                    v + v,
+            };
+            return sanitize(items[rng.below(5)]);
+        }
+
+        // [DRAG] choose a random number within the fd range
+        return rng.range(SPEC_FD_LIMIT_MIN, SPEC_FD_LIMIT_MAX);
+    }
+};
+
+using TypeFdExt = TypeNodeExt<NodeKind::FD>;
+
+} // spec namespace
+
+#endif /* _RACER_SPEC_TYPE_FD_H_ */
@@ -2,6 +2,7 @@
 #define _RACER_SPEC_TYPE_INT_H_
 
 #include "common.h"
+#include "mutate.h"
 
 namespace spec {
 
@@ -12,14 +13,190 @@ BEAN(RandInt, Rand,
 
 template<typename I>
 BEAN(TypeInt, Type<RandInt<I>>)
+    /**
+     * Mirrors KindSendInt, the width and signedness come from I.
+     */
+
+public:
+    using engine = IntEngine<I>;
 
 public:
     optional<size_t> size() const override {
         return sizeof(I);
     }
 
+    void engage(RandInt<I> &rand, Program &prog) const override {
+        rand.data(toss(prog.rng()));
+    }
+
     void mutate(Program &prog) const override {
-        prog.lego(*this);
+        prog.lego(*this).rand.data(toss(prog.rng()));
+    }
+
+    void puzzle(Program &prog) const override {
+        auto &rand = prog.lego(*this).rand;
+        rand.data(drag(rand.data(), prog.rng()));
+    }
+
+protected:
+    virtual I toss(Random &rng) const = 0;
+
+    virtual I drag(I data, Random &rng) const {
+        return engine::drag(data, rng);
+    }
+};
+
+template<typename I>
+BEAN(TypeIntConst, TypeInt<I>,
+     I, val_const)
+
+protected:
+    I toss(Random &) const override {
+        return val_const();
+    }
+
+    I drag(I data, Random &rng) const override {
+        if (rng.unit() < 0.5) {
+            // [DRAG] inc/dec based on the given constant value
+            typename TypeInt<I>::engine::wide v = val_const();
+            auto step = (v < 0 ? -v : v) / 10;
+            const decltype(v) items[] = {
+                    v + 1, v + step, v,
+                    v - 1, v - step, -2 * v,
+            };
+            return TypeInt<I>::engine::choose(items, rng);
+        }
+
+        // [DRAG] use parent strategy
+        return TypeInt<I>::drag(data, rng);
+    }
+};
+
+enum class IntFlagOp : uint8_t {
+    AND,
+    OR,
+    XOR,
+};
+
+template<typename I>
+BEAN(TypeIntFlag, TypeInt<I>,
+     vector<I>, vals,
+     size_t, elem_min,
+     size_t, elem_max,
+     vector<IntFlagOp>, use_ops,
+     bool, use_neg)
+
+public:
+    void _validate() {
+        _elem_set = vals();
+        if (use_neg()) {
+            for (I v : vals()) {
+                _elem_set.push_back(I(~v));
+            }
+        }
+        std::sort(_elem_set.begin(), _elem_set.end());
+        _elem_set.erase(std::unique(_elem_set.begin(), _elem_set.end()),
+                        _elem_set.end());
+
+#ifdef RACER_DEBUG
+        assert(elem_min() <= elem_max() && elem_max() <= _elem_set.size());
+#endif
+    }
+
+protected:
+    // NOTE: derived by _validate(), and shuffled in place when sampled
+    mutable vector<I> _elem_set;
+
+    I toss(Random &rng) const override {
+        size_t num = rng.range(elem_min(), elem_max());
+        if (num == 0) {
+            return 0;
+        }
+
+        // partial Fisher-Yates, the first num items are the sample
+        for (size_t i = 0; i < num; i++) {
+            size_t j = i + rng.below(_elem_set.size() - i);
+            std::swap(_elem_set[i], _elem_set[j]);
+        }
+
+        I res = _elem_set[0];
+        for (size_t i = 1; i < num; i++) {
+            IntFlagOp op = use_ops().empty() ?
+                           IntFlagOp::OR : rng.pick(use_ops());
+            switch (op) {
+                case IntFlagOp::AND:
+                    res = I(res & _elem_set[i]);
+                    break;
+                case IntFlagOp::OR:
+                    res = I(res | _elem_set[i]);
+                    break;
+                case IntFlagOp::XOR:
+                    res = I(res ^ _elem_set[i]);
+                    break;
+            }
+        }
+
+        return res;
+    }
+
+    I drag(I data, Random &rng) const override {
+        double p = rng.unit();
+
+        if (p < 0.1) {
+            // [DRAG] use 0
+            return 0;
+        }
+
+        if (p < 0.5) {
+            // [DRAG] use | with all flags
+            I res = 0;
+            for (I v : _elem_set) {
+                res = I(res | v);
+            }
+            return res;
+        }
+
+        // [DRAG] use parent strategy
+        return TypeInt<I>::drag(data, rng);
+    }
+};
+
+template<typename I>
+BEAN(TypeIntRange, TypeInt<I>,
+     I, val_min,
+     I, val_max)
+
+public:
+    void _validate() {
+#ifdef RACER_DEBUG
+        assert(val_min() <= val_max());
+#endif
+    }
+
+protected:
+    I toss(Random &rng) const override {
+        return rng.range(val_min(), val_max());
+    }
+
+    I drag(I data, Random &rng) const override {
+        if (rng.unit() < 0.5) {
+            // [DRAG] choose from an extreme value (given range-wise)
+            typename TypeInt<I>::engine::wide lo = val_min(), hi = val_max();
+            auto mid = (lo + hi) / 2;
+            auto step_lo = (lo < 0 ? -lo : lo) / 10;
+            auto step_hi = (hi < 0 ? -hi : hi) / 10;
+            const decltype(lo) items[] = {
+                    lo, hi, mid,
+                    lo - 1, lo - step_lo,
+                    hi - 1, hi - step_hi,
+                    lo + 1, lo + step_lo,
+                    hi + 1, hi + step_hi,
+            };
+            return TypeInt<I>::engine::choose(items, rng);
+        }
+
+        // [DRAG] use parent strategy
+        return TypeInt<I>::drag(data, rng);
     }
 };
 
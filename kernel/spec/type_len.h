@@ -0,0 +1,87 @@
+#ifndef _RACER_SPEC_TYPE_LEN_H_
+#define _RACER_SPEC_TYPE_LEN_H_
+
+#include "common.h"
+#include "mutate.h"
+
+namespace spec {
+
+BEAN(RandLen, Rand,
+     uint64_t, cut_abs,
+     uint8_t, cut_rel)
+    /**
+     * The offset to the actual length, either absolute (in bytes) or
+     * relative (in tenths of the size), at most one of them is non-zero.
+     */
+};
+
+template<typename I, typename T_Obj>
+BEAN(TypeLen, Type<RandLen>,
+     T_Obj, object)
+    /**
+     * Mirrors KindSendLen, the object is measured with size_of() of its
+     * Rand, i.e., the size of a buf or of a str (with the NULL).
+     */
+
+protected:
+    static_assert(is_integral_v<I>);
+    static_assert(is_base_of_v<Kind, T_Obj>);
+
+public:
+    optional<size_t> size() const override {
+        return sizeof(I);
+    }
+
+    void engage(RandLen &rand, Program &prog) const override {
+        // prep
+        prog.lego(object());
+
+        // init
+        rand.cut_abs(0);
+        rand.cut_rel(0);
+    }
+
+    void mutate(Program &prog) const override {
+        // [TOSS] change the underlying object
+        object().mutate(prog);
+    }
+
+    void puzzle(Program &prog) const override {
+        auto &rand = prog.lego(*this).rand;
+        double p = prog.rng().unit();
+
+        if (p < 0.1) {
+            // [DRAG] add an offset (absolute) to the length
+            static const uint64_t items[] = {1, 8, 64, 512, 4096};
+            rand.cut_abs(items[prog.rng().below(5)]);
+            rand.cut_rel(0);
+        } else if (p < 0.2) {
+            // [DRAG] add an offset (relative) to the length
+            static const uint8_t items[] = {1, 5, 9, 10};
+            rand.cut_abs(0);
+            rand.cut_rel(items[prog.rng().below(4)]);
+        } else {
+            // [DRAG] change the underlying object
+            object().puzzle(prog);
+        }
+    }
+
+public:
+    I measure(Program &prog) const {
+        const auto &rand = prog.lego(*this).rand;
+        size_t size = size_of(prog.lego(object()).rand);
+
+        // adjust for offset (only substraction allowed, stopped at 0)
+        if (rand.cut_rel() != 0) {
+            size = size * (10 - rand.cut_rel()) / 10;
+        } else if (size >= rand.cut_abs()) {
+            size -= rand.cut_abs();
+        }
+
+        return I(size);
+    }
+};
+
+} // spec namespace
+
+#endif /* _RACER_SPEC_TYPE_LEN_H_ */
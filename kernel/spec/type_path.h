@@ -0,0 +1,187 @@
+#ifndef _RACER_SPEC_TYPE_PATH_H_
+#define _RACER_SPEC_TYPE_PATH_H_
+
+#include "common.h"
+#include "mutate.h"
+#include "type_str.h"
+
+namespace spec {
+
+enum class PathStrategy : uint8_t {
+    CREATE_SEGMENT = 0,         // create a completely new segment as path
+    APPEND_SEGMENT = 1,         // extend base (PathDir) with a new segment
+    CHANGE_LAST_SEGMENT = 2,    // replace the last segment, not changing type
+    REMOVE_FIRST_SEGMENT = 3,   // remove first segment, not changing type
+};
+
+static constexpr size_t PATH_STRATEGY_NUM = 4;
+
+BEAN(RandPath, Rand,
+     int64_t, dirp,
+     bool, comp)
+    /**
+     * dirp is the id of the node of the parent path, -1 if none.
+     */
+};
+
+BEAN(TypePath, Type<RandPath>,
+     NodeType, mark,
+     TypeStrRange, segment,
+     char, pathsep,
+     vector<uint32_t>, strategies)
+    /**
+     * Mirrors KindSendPath. The segment is a lego on its own, pathsep
+     * defaults to '/', and strategies, the weights indexed by PathStrategy,
+     * default to the same weight for all.
+     */
+
+public:
+    optional<size_t> size() const override {
+        return {};
+    }
+
+    void engage(RandPath &rand, Program &prog) const override {
+        // prep
+        prog.lego(segment());
+        prog.add_node(NodeKind::PATH, mark(), this, prog.lego(*this).index);
+
+        // init
+        build(rand, prog);
+    }
+
+    void mutate(Program &prog) const override {
+        auto &rand = prog.lego(*this).rand;
+        double p = prog.rng().unit();
+
+        if (rand.dirp() < 0 || !rand.comp() || p < 0.5) {
+            // [TOSS] re-build the path from scratch
+            build(rand, prog);
+        } else if (p < 0.75) {
+            // [TOSS] change component
+            segment().mutate(prog);
+        } else {
+            // [TOSS] change directory
+            rand.dirp(parent(prog, mark(), true));
+        }
+    }
+
+    void puzzle(Program &prog) const override {
+        auto &rand = prog.lego(*this).rand;
+
+        if (rand.comp() && prog.rng().unit() < 0.5) {
+            // [DRAG] puzzle component
+            segment().puzzle(prog);
+        } else {
+            // [DRAG] re-build path in a messy way
+            auto k = PathStrategy(prog.rng().below(PATH_STRATEGY_NUM));
+            make(k, mark(), false, rand, prog);
+        }
+    }
+
+public:
+    // the path as the segments joined with pathsep
+    void render(Program &prog, text &out) const {
+        pmr::vector<const text *> segs(prog.resource());
+        collect(prog.lego(*this).rand, prog, segs);
+
+        out.clear();
+        for (size_t i = 0; i < segs.size(); i++) {
+            if (i != 0) {
+                out.push_back(sep());
+            }
+            out.append(*segs[i]);
+        }
+    }
+
+protected:
+    char sep() const {
+        return has_pathsep() ? pathsep() : '/';
+    }
+
+    static const TypePath &cast(const Program::Node &node) {
+        return *static_cast<const TypePath *>(node.type);
+    }
+
+    int64_t pick(Program &prog, NodeType which, bool same) const {
+        auto id = prog.pick_node(NodeKind::PATH, which, same,
+                                 prog.lego(*this).index);
+        return id.has_value() ? int64_t(*id) : -1;
+    }
+
+    // the parent of a path of the given mark picked from the program
+    int64_t parent(Program &prog, NodeType which, bool same) const {
+        int64_t id = pick(prog, which, same);
+        if (id < 0) {
+            return -1;
+        }
+        const TypePath &type = cast(prog.node(id));
+        return prog.lego(type).rand.dirp();
+    }
+
+    // with same unset, picks the paths of any mark other than which
+    void make(PathStrategy k, NodeType which, bool same,
+              RandPath &rand, Program &prog) const {
+        switch (k) {
+            case PathStrategy::CREATE_SEGMENT:
+                rand.dirp(-1);
+                rand.comp(true);
+                break;
+            case PathStrategy::APPEND_SEGMENT:
+                rand.dirp(pick(prog, same ? NodeType::DIR : which, same));
+                rand.comp(true);
+                break;
+            case PathStrategy::CHANGE_LAST_SEGMENT:
+                rand.dirp(parent(prog, which, same));
+                rand.comp(true);
+                break;
+            case PathStrategy::REMOVE_FIRST_SEGMENT:
+                rand.dirp(parent(prog, which, same));
+                rand.comp(false);
+                break;
+        }
+    }
+
+    void build(RandPath &rand, Program &prog) const {
+        uint64_t total = 0;
+        for (size_t i = 0; i < PATH_STRATEGY_NUM; i++) {
+            total += weight(i);
+        }
+
+        uint64_t needle = prog.rng().below(total);
+        for (size_t i = 0; i < PATH_STRATEGY_NUM; i++) {
+            if (needle < weight(i)) {
+                make(PathStrategy(i), mark(), true, rand, prog);
+                return;
+            }
+            needle -= weight(i);
+        }
+    }
+
+    uint64_t weight(size_t i) const {
+        if (!has_strategies()) {
+            return 1;
+        }
+        return i < strategies().size() ? strategies()[i] : 0;
+    }
+
+    void collect(const RandPath &rand, Program &prog,
+                 pmr::vector<const text *> &segs) const {
+        // fill in segments from begin to end
+        if (rand.dirp() >= 0) {
+            const TypePath &type = cast(prog.node(rand.dirp()));
+            type.collect(prog.lego(type).rand, prog, segs);
+        }
+
+        if (rand.comp()) {
+            segs.push_back(&prog.lego(segment()).rand.data());
+        } else if (!segs.empty()) {
+            segs.erase(segs.begin());
+        }
+    }
+};
+
+using TypePathExt = TypeNodeExt<NodeKind::PATH>;
+
+} // spec namespace
+
+#endif /* _RACER_SPEC_TYPE_PATH_H_ */
@@ -0,0 +1,125 @@
+#ifndef _RACER_SPEC_TYPE_STR_H_
+#define _RACER_SPEC_TYPE_STR_H_
+
+#include "common.h"
+#include "mutate.h"
+
+namespace spec {
+
+BEAN(RandStr, Rand,
+     text, data)
+};
+
+// the size of the object (with the NULL), for TypeLen
+inline size_t size_of(const RandStr &rand) {
+    return rand.data().size() + 1;
+}
+
+BEAN(TypeStr, Type<RandStr>,
+     optional<size_t>, fix_size)
+    /**
+     * Mirrors KindSendStr, fix_size is the maximum length of the string,
+     * including the NULL, and defaults to unset (no fixed size).
+     */
+
+public:
+    using engine = SeqEngine<text>;
+
+public:
+    optional<size_t> size() const override {
+        return fix();
+    }
+
+    void engage(RandStr &rand, Program &prog) const override {
+        toss(rand.data_edit(prog.resource()), prog.rng());
+    }
+
+    void mutate(Program &prog) const override {
+        auto &rand = prog.lego(*this).rand;
+        toss(rand.data_edit(prog.resource()), prog.rng());
+    }
+
+    void puzzle(Program &prog) const override {
+        auto &data = prog.lego(*this).rand.data_edit(prog.resource());
+        drag(data, prog.rng());
+        sanitize(data);
+    }
+
+protected:
+    optional<size_t> fix() const {
+        return has_fix_size() ? fix_size() : nullopt;
+    }
+
+    size_t limit(Random &rng) const {
+        auto size = fix();
+        if (size.has_value()) {
+            return *size;
+        }
+        return SPEC_PAGE_SIZE + rng.range<int64_t>(-1024, 1024);
+    }
+
+    void sanitize(text &data) const {
+        auto size = fix();
+        if (size.has_value() && data.size() + 1 > *size) {
+            data.resize(*size == 0 ? 0 : *size - 1);
+        }
+    }
+
+    virtual void toss(text &data, Random &rng) const = 0;
+
+    virtual void drag(text &data, Random &rng) const {
+        engine::drag(data, limit(rng), spec_charset(), rng);
+    }
+};
+
+BEAN(TypeStrConst, TypeStr,
+     text, val_const)
+
+protected:
+    void toss(text &data, Random &) const override {
+        data.assign(val_const());
+    }
+};
+
+BEAN(TypeStrRange, TypeStr,
+     text, char_set,
+     text, char_sep,
+     size_t, char_min,
+     size_t, char_max)
+    /**
+     * Mirrors KindSendStrRange, an empty char_set stands for all chars.
+     */
+
+public:
+    void _validate() {
+#ifdef RACER_DEBUG
+        assert(char_min() <= char_max());
+#endif
+    }
+
+protected:
+    const text &set() const {
+        return char_set().empty() ? spec_charset() : char_set();
+    }
+
+    void toss(text &data, Random &rng) const override {
+        engine::cook(data, rng.range(char_min(), char_max()),
+                     set(), char_sep(), rng);
+    }
+
+    void drag(text &data, Random &rng) const override {
+        if (rng.unit() < 0.5) {
+            // [DRAG] choose from an extreme value (given range-wise)
+            engine::cook(data, engine::extreme(char_min(), char_max(), rng),
+                         set(), char_sep(), rng);
+            return;
+        }
+
+        // [DRAG] use parent strategy
+        TypeStr::drag(data, rng);
+    }
+};
+
+} // spec namespace
+
+#endif /* _RACER_SPEC_TYPE_STR_H_ */
@@ -0,0 +1,127 @@
+#ifndef _DART_BENCH_H_
+#define _DART_BENCH_H_
+
+/*
+ * common harness of the micro-benchmarks, included once per bench binary
+ *
+ * a scaling run repeats a workload with 1, 2, 4, ... threads (up to the
+ * number of cpus online, or BENCH_THREADS if given in the environment),
+ * each of which poses as the cpu of its index,
+ * and reports the ns per operation seen by a thread along with the
+ * aggregate throughput (and its speedup over a single thread)
+ */
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/kernel.h>
+#include <linux/percpu.h>
+
+__thread int bench_cpu = 0;
+
+static inline double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* keep the compiler from dropping the results */
+static volatile u64 sink;
+
+/* the workload of one thread, doing ops operations as cpu tid */
+typedef void (*bench_work_t)(void *arg, int tid, int nthread, u64 ops);
+
+/* resets the shared state before each run */
+typedef void (*bench_prep_t)(void *arg);
+
+struct bench_thread {
+    pthread_t handle;
+    pthread_barrier_t *barrier;
+    bench_work_t work;
+    void *arg;
+    int tid;
+    int nthread;
+    u64 ops;
+    double elapsed;
+};
+
+static void *bench_thread_main(void *p) {
+    struct bench_thread *t = p;
+    double t0;
+
+    bench_cpu_set(t->tid);
+    pthread_barrier_wait(t->barrier);
+
+    t0 = now_ns();
+    t->work(t->arg, t->tid, t->nthread, t->ops);
+    t->elapsed = now_ns() - t0;
+    return NULL;
+}
+
+/* run with nthread threads sharing ops in total, returns the wall time */
+static inline double bench_run(
+        bench_work_t work, bench_prep_t prep, void *arg, int nthread, u64 ops
+) {
+    struct bench_thread threads[BENCH_NR_CPUS];
+    pthread_barrier_t barrier;
+    double wall;
+    int i;
+
+    if (prep) {
+        prep(arg);
+    }
+
+    pthread_barrier_init(&barrier, NULL, nthread + 1);
+    for (i = 0; i < nthread; i++) {
+        threads[i].barrier = &barrier;
+        threads[i].work = work;
+        threads[i].arg = arg;
+        threads[i].tid = i;
+        threads[i].nthread = nthread;
+        threads[i].ops = ops / nthread;
+        BUG_ON(pthread_create(&threads[i].handle, NULL,
+                              bench_thread_main, &threads[i]));
+    }
+    pthread_barrier_wait(&barrier);
+
+    wall = 0;
+    for (i = 0; i < nthread; i++) {
+        pthread_join(threads[i].handle, NULL);
+        if (threads[i].elapsed > wall) {
+            wall = threads[i].elapsed;
+        }
+    }
+    pthread_barrier_destroy(&barrier);
+    return wall;
+}
+
+static inline int bench_nthread_max(void) {
+    const char *env = getenv("BENCH_THREADS");
+    long n = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+    return (int) min_t(long, max_t(long, n, 1), BENCH_NR_CPUS);
+}
+
+static inline void bench_scale(
+        const char *name, bench_work_t work, bench_prep_t prep, void *arg,
+        u64 ops
+) {
+    double wall, mops, base = 0;
+    u64 per;
+    int n;
+
+    for (n = 1; n <= bench_nthread_max(); n <<= 1) {
+        per = ops / n;
+        wall = bench_run(work, prep, arg, n, ops);
+
+        mops = per * n / wall * 1e3;
+        if (n == 1) {
+            base = mops;
+        }
+
+        printf("  %-20s %2d thread(s) | %7.1f ns/op | %8.2f Mops/s | "
+               "x%.2f\n", name, n, wall / per, mops, mops / base);
+    }
+}
+
+#endif /* _DART_BENCH_H_ */
@@ -0,0 +1,118 @@
+/*
+ * micro-benchmark of the hash table templates in dart_hash.h
+ *
+ * each template is filled to a given load factor with (shadow-word aligned)
+ * kernel addresses and then probed with hits (present keys) and misses
+ * (absent keys), reporting the average ns per operation
+ */
+
+#include "bench.h"
+
+#include "dart_hash.h"
+
+/* same footprint as a byte-granular struct dart_mc */
+struct bench_val {
+    u32 ptid;
+    u64 ctxt;
+    u64 inst;
+};
+
+#define BENCH_BITS                  20  /* must be a literal */
+#define BENCH_OPS                   (1 << 22)
+
+#define bench_flat bench_val
+#define bench_swiss bench_val
+#define bench_shard bench_val
+
+DART_HMAP_DEFINE(bench_flat, 20, 64);
+DART_HMAP_SWISS_DEFINE(bench_swiss, 20, 64);
+DART_HMAP_SHARD_DEFINE(bench_shard, 20, 64, 6);
+
+/* utils */
+#define BENCH_ADDR_BASE             0xffff888000000000ull
+#define BENCH_ADDR_MASK             ((1ull << 26) - 1)
+
+static inline u64 bench_word(u64 i) {
+    /* an odd multiplier is a bijection, so words are distinct but spread */
+    return (i * 0x9E3779B1ull) & BENCH_ADDR_MASK;
+}
+
+#define BENCH_TABLE(name) \
+        static void bench_##name( \
+                const u64 *keys_hit, const u64 *keys_miss, u64 nkey \
+        ) { \
+            ht_##name ## _t *ht; \
+            double t0, t_ins, t_hit, t_miss, t_get; \
+            u64 i, acc = 0; \
+            \
+            ht = calloc(1, sizeof(ht_##name ## _t)); \
+            BUG_ON(!ht); \
+            \
+            t0 = now_ns(); \
+            for (i = 0; i < nkey; i++) { \
+                ht_##name ## _get_slot(ht, keys_hit[i])->inst = i; \
+            } \
+            t_ins = (now_ns() - t0) / nkey; \
+            \
+            t0 = now_ns(); \
+            for (i = 0; i < BENCH_OPS; i++) { \
+                acc += ht_##name ## _has_slot(ht, keys_hit[i % nkey])->inst; \
+            } \
+            t_hit = (now_ns() - t0) / BENCH_OPS; \
+            \
+            t0 = now_ns(); \
+            for (i = 0; i < BENCH_OPS; i++) { \
+                acc += ht_##name ## _has_slot(ht, keys_miss[i % nkey]) != NULL; \
+            } \
+            t_miss = (now_ns() - t0) / BENCH_OPS; \
+            \
+            t0 = now_ns(); \
+            for (i = 0; i < BENCH_OPS; i++) { \
+                ht_##name ## _get_slot(ht, keys_hit[i % nkey])->ptid = i; \
+            } \
+            t_get = (now_ns() - t0) / BENCH_OPS; \
+            \
+            sink = acc; \
+            printf("  %-8s %6zu MB | insert %6.1f | has (hit) %6.1f | " \
+                   "has (miss) %6.1f | get (hit) %6.1f ns/op\n", \
+                   #name + 6, sizeof(ht_##name ## _t) >> 20, \
+                   t_ins, t_hit, t_miss, t_get); \
+            free(ht); \
+        }
+
+BENCH_TABLE(bench_flat)
+
+BENCH_TABLE(bench_swiss)
+
+BENCH_TABLE(bench_shard)
+
+int main(void) {
+    static const unsigned loads[] = {10, 50, 90};
+    u64 *keys_hit, *keys_miss;
+    u64 nkey, i;
+    unsigned l;
+
+    keys_hit = malloc(sizeof(u64) << BENCH_BITS);
+    keys_miss = malloc(sizeof(u64) << BENCH_BITS);
+    BUG_ON(!keys_hit || !keys_miss);
+
+    for (l = 0; l < ARRAY_SIZE(loads); l++) {
+        nkey = ((1ull << BENCH_BITS) * loads[l]) / 100;
+
+        /* hits take the even words and misses the odd ones */
+        for (i = 0; i < nkey; i++) {
+            keys_hit[i] = BENCH_ADDR_BASE + (bench_word(i) << 4);
+            keys_miss[i] = BENCH_ADDR_BASE + (bench_word(i) << 4) + 8;
+        }
+
+        printf("load %u%% (%llu keys in 2^%d slots)\n",
+               loads[l], (unsigned long long) nkey, BENCH_BITS);
+        bench_bench_flat(keys_hit, keys_miss, nkey);
+        bench_bench_swiss(keys_hit, keys_miss, nkey);
+        bench_bench_shard(keys_hit, keys_miss, nkey);
+    }
+
+    free(keys_hit);
+    free(keys_miss);
+    return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * micro-benchmark of the mem_read and mem_write implementations in
+ * rt_mem_access.inc, by access size and under increasing numbers of threads
+ *
+ * the memory cells come from dart_cell.h as in the kernel, but the control
+ * blocks and the lockset from dart_ctrl.h are tied to the kernel, hence the
+ * stand-ins below, the contexts hold no locks and the cell tables are
+ * smaller than in the kernel
+ */
+
+#include "bench.h"
+
+#define DART_MC_BITS                18
+
+#include "dart_wks.h"
+#include "dart_cell.h"
+
+/* stand-ins for dart_ctrl.h */
+#ifdef DART_LOCKSET
+struct dart_lockset {
+    lsum_32_t sum_r;
+    lsum_32_t sum_w;
+};
+
+static inline bool dart_lockset_guards(
+        const struct dart_lockset *ls, bool rw, lsum_32_t sum
+) {
+    return false;
+}
+#endif
+
+struct dart_cb {
+    ptid_32_t ptid;
+    hval_64_t ctxt;
+#ifdef DART_LOCKSET
+    struct dart_lockset lockset;
+#endif
+#ifdef DART_MC_COMPACT
+    u16 slot;
+#endif
+};
+
+#ifdef DART_MC_COMPACT
+struct __ht_dart_inst *g_dart_inst_ht = NULL;
+hval_64_t *g_dart_inst_hvals = NULL;
+atomic_t g_dart_inst_count = ATOMIC_INIT(0);
+atomic_t g_dart_inst_dropped = ATOMIC_INIT(0);
+#endif
+
+struct __ht_dart_mc *g_dart_mc_reader_ht = NULL;
+struct __ht_dart_mc *g_dart_mc_writer_ht = NULL;
+
+static inline void dart_delay_hit(hval_64_t hval) {}
+
+/* stand-ins for the globals defined in dart_wks.c */
+long dart_iseq = 0;
+
+dart_cov_map_t *g_cov_cfg_edge = NULL;
+dart_cov_map_t *g_cov_dfg_edge = NULL;
+dart_cov_map_t *g_cov_alias_inst = NULL;
+
+#ifdef DART_COV_LOCAL
+unsigned long *g_cov_cfg_edge_local = NULL;
+unsigned long *g_cov_dfg_edge_local = NULL;
+unsigned long *g_cov_alias_inst_local = NULL;
+#endif
+
+struct dart_rtinfo *g_rtinfo = NULL;
+struct dart_cov_delta *g_cov_delta = NULL;
+struct dart_rtrace *g_rtrace = NULL;
+unsigned long g_rtrace_entry_max = 0;
+
+#ifdef DART_RTRACE_DEDUP
+u32 *g_rtrace_index = NULL;
+#endif
+
+#ifdef DART_SAMPLING
+DEFINE_PER_CPU(struct dart_sampling, g_dart_sampling);
+
+u32 g_dart_sampling_period_max = 1;
+u32 g_dart_sampling_burst = DART_SAMPLING_BURST;
+#endif
+
+/* the implementations under test */
+#define DART_FUNC DART_FUNC_LIB_IMPL
+#include "rt_mem_access.inc"
+#undef DART_FUNC
+
+#define BENCH_OPS                   (1 << 21)
+#define BENCH_RTRACE_SIZE           (30ul << 20)
+
+/* the accessed range, a quarter of the cells the tables can hold */
+#define BENCH_ADDR_BASE             0xffff888000000000ull
+#define BENCH_ADDR_SPAN             ((1ull << DART_MC_BITS) * 2)
+
+/* distinct instructions doing the accesses */
+#define BENCH_INSTS                 1024
+
+struct bench_mem {
+    bool rw;
+    u64 size;
+};
+
+static unsigned long *bench_bitmap(unsigned long bits) {
+    unsigned long *map = calloc(BITS_TO_LONGS(bits), sizeof(unsigned long));
+    BUG_ON(!map);
+    return map;
+}
+
+static void prep_mem(void *arg) {
+    ht_dart_mc_reset(g_dart_mc_reader_ht);
+    ht_dart_mc_reset(g_dart_mc_writer_ht);
+#ifdef DART_MC_COMPACT
+    ht_dart_inst_reset(g_dart_inst_ht);
+    atomic_set(&g_dart_inst_count, 0);
+#endif
+    rtrace_init();
+#ifdef DART_RTRACE_DEDUP
+    memset(g_rtrace_index, 0, sizeof(u32) * RTRACE_DEDUP_SLOTS);
+#endif
+}
+
+static void work_mem(void *arg, int tid, int nthread, u64 ops) {
+    struct bench_mem *bm = arg;
+    struct dart_cb cb;
+    u64 i, off, span;
+    hval_64_t hval;
+
+    memset(&cb, 0, sizeof(cb));
+    cb.ptid = tid + 1;
+    cb.ctxt = 0x100 + tid;
+#ifdef DART_MC_COMPACT
+    cb.slot = tid + 1;
+#endif
+
+    /* threads sweep the same range, which makes them alias each other */
+    span = BENCH_ADDR_SPAN / bm->size;
+    for (i = 0; i < ops; i++) {
+        off = ((i * 0x9E3779B1ull) % span) * bm->size;
+        hval = 0x4000 + (i % BENCH_INSTS);
+
+        if (bm->rw) {
+            DART_FUNC_LIB_CALL_IMPL(mem, write, (info_64_t) &cb, hval,
+                                    BENCH_ADDR_BASE + off, bm->size);
+        } else {
+            DART_FUNC_LIB_CALL_IMPL(mem, read, (info_64_t) &cb, hval,
+                                    BENCH_ADDR_BASE + off, bm->size);
+        }
+    }
+}
+
+int main(void) {
+    static const u64 sizes[] = {1, 2, 4, 8, 16, 64};
+    struct bench_mem bm;
+    char name[32];
+    unsigned s;
+
+    g_cov_cfg_edge = bench_bitmap(_COV_CFG_EDGE_BITS);
+    g_cov_dfg_edge = bench_bitmap(_COV_DFG_EDGE_BITS);
+    g_cov_alias_inst = bench_bitmap(_COV_ALIAS_INST_BITS);
+#ifdef DART_COV_LOCAL
+    g_cov_cfg_edge_local = bench_bitmap(_COV_CFG_EDGE_BITS);
+    g_cov_dfg_edge_local = bench_bitmap(_COV_DFG_EDGE_BITS);
+    g_cov_alias_inst_local = bench_bitmap(_COV_ALIAS_INST_BITS);
+#endif
+
+    g_rtrace = calloc(1, BENCH_RTRACE_SIZE);
+    BUG_ON(!g_rtrace);
+    g_rtrace_entry_max = min_t(
+            unsigned long, _RTRACE_ENTRY_MAX,
+            (BENCH_RTRACE_SIZE - sizeof(struct dart_rtrace)) /
+            _RTRACE_ENTRY_SIZE
+    );
+#ifdef DART_RTRACE_DEDUP
+    g_rtrace_index = calloc(RTRACE_DEDUP_SLOTS, sizeof(u32));
+    BUG_ON(!g_rtrace_index);
+#endif
+
+    g_dart_mc_reader_ht = calloc(1, sizeof(*g_dart_mc_reader_ht));
+    g_dart_mc_writer_ht = calloc(1, sizeof(*g_dart_mc_writer_ht));
+    BUG_ON(!g_dart_mc_reader_ht || !g_dart_mc_writer_ht);
+
+#ifdef DART_MC_COMPACT
+    g_dart_inst_ht = calloc(1, sizeof(*g_dart_inst_ht));
+    g_dart_inst_hvals = calloc(1u << DART_INST_BITS, sizeof(hval_64_t));
+    BUG_ON(!g_dart_inst_ht || !g_dart_inst_hvals);
+#endif
+
+    printf("mem (%zu MB per cell table, %llu KB range)\n",
+           sizeof(*g_dart_mc_reader_ht) >> 20,
+           (unsigned long long) BENCH_ADDR_SPAN >> 10);
+
+    for (s = 0; s < ARRAY_SIZE(sizes); s++) {
+        bm.size = sizes[s];
+
+        bm.rw = false;
+        snprintf(name, sizeof(name), "read (%llu)",
+                 (unsigned long long) bm.size);
+        bench_scale(name, work_mem, prep_mem, &bm, BENCH_OPS);
+
+        bm.rw = true;
+        snprintf(name, sizeof(name), "write (%llu)",
+                 (unsigned long long) bm.size);
+        bench_scale(name, work_mem, prep_mem, &bm, BENCH_OPS);
+    }
+
+    free(g_dart_mc_reader_ht);
+    free(g_dart_mc_writer_ht);
+#ifdef DART_MC_COMPACT
+    free(g_dart_inst_ht);
+    free(g_dart_inst_hvals);
+#endif
+    free(g_rtrace);
+#ifdef DART_RTRACE_DEDUP
+    free(g_rtrace_index);
+#endif
+
+    sink = 0;
+    return 0;
+}
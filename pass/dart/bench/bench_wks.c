@@ -0,0 +1,206 @@
+/*
+ * micro-benchmark of the coverage, rtrace, and ledger operations in
+ * dart_wks.h and dart_log.h, under increasing numbers of threads
+ *
+ * build with -DDART_RTRACE_DEDUP (see bench_wks_dedup) for the
+ * deduplicated rtrace, and with -DDART_COV_TREE (see bench_wks_tree) for
+ * the two-level coverage maps
+ */
+
+#include "bench.h"
+
+#include "dart_wks.h"
+#include "dart_log.h"
+
+/* stand-ins for the globals defined in dart_wks.c and dart_log.c */
+long dart_iseq = 0;
+
+dart_cov_map_t *g_cov_cfg_edge = NULL;
+dart_cov_map_t *g_cov_dfg_edge = NULL;
+dart_cov_map_t *g_cov_alias_inst = NULL;
+
+#ifdef DART_COV_LOCAL
+unsigned long *g_cov_cfg_edge_local = NULL;
+unsigned long *g_cov_dfg_edge_local = NULL;
+unsigned long *g_cov_alias_inst_local = NULL;
+#endif
+
+struct dart_rtinfo *g_rtinfo = NULL;
+struct dart_cov_delta *g_cov_delta = NULL;
+struct dart_rtrace *g_rtrace = NULL;
+unsigned long g_rtrace_entry_max = 0;
+
+#ifdef DART_RTRACE_DEDUP
+u32 *g_rtrace_index = NULL;
+#endif
+
+struct dart_ledger *g_ledger = NULL;
+struct dart_reserve_ledger *g_reserve_ledger = NULL;
+
+#define BENCH_OPS                   (1 << 22)
+
+/* the default size of the rtrace region */
+#define BENCH_RTRACE_SIZE           (30ul << 20)
+
+/* distinct racing pairs, i.e., what the dedup index has to hold */
+#define BENCH_RTRACE_PAIRS          4096
+
+/* a mem read entry: code, ptid, info, hval, then addr and size */
+#define BENCH_LEDGER_ENTRY          40
+
+/* coverage */
+#ifdef DART_COV_TREE
+#define BENCH_COV_SIZE              IVSHMEM_SIZE_COV
+#else
+#define BENCH_COV_SIZE              (_COV_CFG_EDGE_BITS / 8)
+#endif
+
+static void prep_cov(void *arg) {
+    memset(g_cov_cfg_edge, 0, BENCH_COV_SIZE);
+#ifdef DART_COV_TREE
+    g_cov_cfg_edge->magic = DART_COV_TREE_MAGIC;
+    g_cov_cfg_edge->bits = DART_COV_TREE_BITS;
+#endif
+#ifdef DART_COV_LOCAL
+    bitmap_zero(g_cov_cfg_edge_local, _COV_CFG_EDGE_BITS);
+#endif
+    cov_delta_init();
+}
+
+static void work_cov(void *arg, int tid, int nthread, u64 ops) {
+    u64 i, edges = *(u64 *) arg;
+
+    /* threads walk the same edges, as cpus running the same code do */
+    for (i = 0; i < ops; i++) {
+        cov_cfg_add_edge(cov_hash_chain(i % edges, tid & 1));
+    }
+}
+
+/* rtrace */
+static void prep_rtrace(void *arg) {
+    rtrace_init();
+#ifdef DART_RTRACE_DEDUP
+    memset(g_rtrace_index, 0, sizeof(u32) * RTRACE_DEDUP_SLOTS);
+#endif
+}
+
+static void work_rtrace(void *arg, int tid, int nthread, u64 ops) {
+    u64 i, p;
+
+    for (i = 0; i < ops; i++) {
+        p = (i * nthread + tid) % BENCH_RTRACE_PAIRS;
+        rtrace_record(0x1000 + p, 0x2000 + p,
+                      0xffff888000000000ull + (i << 3), 8);
+    }
+}
+
+/* ledger */
+static void prep_ledger(void *arg) {
+    dart_ledger_init(g_ledger);
+}
+
+static void work_ledger(void *arg, int tid, int nthread, u64 ops) {
+    char entry[BENCH_LEDGER_ENTRY];
+    u64 i;
+
+    memset(entry, tid, sizeof(entry));
+    for (i = 0; i < ops; i++) {
+        dart_ledger_push(g_ledger, entry, sizeof(entry));
+    }
+}
+
+int main(void) {
+    u64 edges, ops;
+#ifdef DART_COV_LOCAL
+    unsigned long *shared;
+    double t0;
+    s64 incr;
+#endif
+
+    /* coverage, from all-new to all-seen edges */
+    g_rtinfo = calloc(1, sizeof(struct dart_rtinfo));
+    g_cov_delta = calloc(1, DART_COV_DELTA_SIZE);
+    g_cov_cfg_edge = calloc(1, BENCH_COV_SIZE);
+    BUG_ON(!g_rtinfo || !g_cov_delta || !g_cov_cfg_edge);
+#ifdef DART_COV_LOCAL
+    g_cov_cfg_edge_local = calloc(BITS_TO_LONGS(_COV_CFG_EDGE_BITS),
+                                  sizeof(unsigned long));
+    BUG_ON(!g_cov_cfg_edge_local);
+#endif
+
+    printf("coverage (cfg edges)\n");
+    edges = 1 << 10;
+    bench_scale("add (1K edges)", work_cov, prep_cov, &edges, BENCH_OPS);
+    edges = 1 << 20;
+    bench_scale("add (1M edges)", work_cov, prep_cov, &edges, BENCH_OPS);
+#ifdef DART_COV_TREE
+    printf("  %-20s %lld of %lu leaves\n", "pool",
+           (long long) atomic64_read(&g_cov_cfg_edge->leaves),
+           (unsigned long) DART_COV_TREE_POOL);
+#endif
+
+#ifdef DART_COV_LOCAL
+    /* merge what the last run left in the local map into a fresh one */
+    shared = calloc(BITS_TO_LONGS(_COV_CFG_EDGE_BITS), sizeof(unsigned long));
+    BUG_ON(!shared);
+
+    cov_delta_init();
+    t0 = now_ns();
+    incr = cov_local_merge(shared, g_cov_cfg_edge_local, _COV_CFG_EDGE_BITS,
+                           DART_COV_CFG_EDGE);
+    printf("  %-20s %lld new bits | %7.1f us\n", "merge",
+           (long long) incr, (now_ns() - t0) / 1e3);
+
+    free(shared);
+#endif
+
+    printf("  %-20s %lld new bits\n", "delta",
+           (long long) atomic64_read(&g_cov_delta->count));
+
+    free(g_cov_cfg_edge);
+#ifdef DART_COV_LOCAL
+    free(g_cov_cfg_edge_local);
+#endif
+    free(g_cov_delta);
+    free(g_rtinfo);
+
+    /* rtrace, sized as the region */
+    g_rtrace = calloc(1, BENCH_RTRACE_SIZE);
+    BUG_ON(!g_rtrace);
+    g_rtrace_entry_max = min_t(
+            unsigned long, _RTRACE_ENTRY_MAX,
+            (BENCH_RTRACE_SIZE - sizeof(struct dart_rtrace)) /
+            _RTRACE_ENTRY_SIZE
+    );
+#ifdef DART_RTRACE_DEDUP
+    g_rtrace_index = calloc(RTRACE_DEDUP_SLOTS, sizeof(u32));
+    BUG_ON(!g_rtrace_index);
+
+    /* hits of known pairs never run out of room */
+    ops = BENCH_OPS;
+    printf("rtrace (dedup, %d pairs)\n", BENCH_RTRACE_PAIRS);
+#else
+    /* only count the hits that fit */
+    ops = g_rtrace_entry_max;
+    printf("rtrace (plain, %lu entries)\n", g_rtrace_entry_max);
+#endif
+    bench_scale("record", work_rtrace, prep_rtrace, NULL, ops);
+
+    free(g_rtrace);
+#ifdef DART_RTRACE_DEDUP
+    free(g_rtrace_index);
+#endif
+
+    /* ledger, the heap is only touched as far as it is filled */
+    g_ledger = calloc(1, LEDGER_SIZE);
+    BUG_ON(!g_ledger);
+
+    printf("ledger (%d-byte entries)\n", BENCH_LEDGER_ENTRY);
+    bench_scale("push", work_ledger, prep_ledger, NULL,
+                min_t(u64, BENCH_OPS, LEDGER_SIZE / 2 / BENCH_LEDGER_ENTRY));
+
+    free(g_ledger);
+
+    sink = 0;
+    return 0;
+}
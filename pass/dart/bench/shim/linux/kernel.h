@@ -0,0 +1,195 @@
+#ifndef _DART_BENCH_SHIM_KERNEL_H_
+#define _DART_BENCH_SHIM_KERNEL_H_
+
+/*
+ * user-space stand-ins for the handful of kernel primitives that the
+ * header-only parts of dart depend on, only meant for benchmarking
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* types */
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
+
+typedef struct { int counter; } atomic_t;
+typedef struct { s64 counter; } atomic64_t;
+typedef struct { long counter; } atomic_long_t;
+
+#define ATOMIC_INIT(i)              { (i) }
+
+/* compiler */
+#define likely(x)                   __builtin_expect(!!(x), 1)
+#define unlikely(x)                 __builtin_expect(!!(x), 0)
+#define __aligned(x)                __attribute__((aligned(x)))
+
+#define ARRAY_SIZE(a)               (sizeof(a) / sizeof((a)[0]))
+#define U32_MAX                     ((u32) ~0u)
+
+#define min_t(t, a, b)              ((t) (a) < (t) (b) ? (t) (a) : (t) (b))
+#define max_t(t, a, b)              ((t) (a) > (t) (b) ? (t) (a) : (t) (b))
+#define DIV_ROUND_UP(n, d)          (((n) + (d) - 1) / (d))
+#define ALIGN(x, a)                 (((x) + (a) - 1) & ~((a) - 1))
+#define BITS_PER_LONG               64
+
+#define cpu_relax()                 __builtin_ia32_pause()
+
+/* bugging */
+#define BUG()                       abort()
+#define BUG_ON(c)                   do { if (unlikely(c)) BUG(); } while (0)
+#define BUILD_BUG_ON(c)             _Static_assert(!(c), #c)
+
+/* printing */
+#define KERN_INFO                   ""
+#define KERN_NOTICE                 ""
+#define KERN_WARNING                ""
+#define KERN_ERR                    ""
+#define printk                      printf
+
+/* irqs (there are none in user space) */
+#define local_irq_save(flags)       ((flags) = 0)
+#define local_irq_restore(flags)    ((void) (flags))
+#define in_nmi()                    0
+
+/* barriers */
+#define smp_load_acquire(p)         __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v)     __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define smp_wmb()                   __atomic_thread_fence(__ATOMIC_RELEASE)
+#define smp_rmb()                   __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define smp_mb()                    __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#define cmpxchg(p, o, n) \
+        ({ \
+            __typeof__(*(p)) __o = (o); \
+            __atomic_compare_exchange_n( \
+                p, &__o, n, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST \
+            ); \
+            __o; \
+        })
+
+/* atomics */
+#define __shim_atomic_ops(t, sfx) \
+        static inline t atomic##sfx ## _read(const void *v) { \
+            return __atomic_load_n((t *) v, __ATOMIC_RELAXED); \
+        } \
+        static inline t atomic##sfx ## _read_acquire(const void *v) { \
+            return __atomic_load_n((t *) v, __ATOMIC_ACQUIRE); \
+        } \
+        static inline void atomic##sfx ## _set(void *v, t i) { \
+            __atomic_store_n((t *) v, i, __ATOMIC_RELAXED); \
+        } \
+        static inline void atomic##sfx ## _set_release(void *v, t i) { \
+            __atomic_store_n((t *) v, i, __ATOMIC_RELEASE); \
+        } \
+        static inline t atomic##sfx ## _cmpxchg(void *v, t o, t n) { \
+            __atomic_compare_exchange_n( \
+                (t *) v, &o, n, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST \
+            ); \
+            return o; \
+        } \
+        static inline t atomic##sfx ## _fetch_add(t i, void *v) { \
+            return __atomic_fetch_add((t *) v, i, __ATOMIC_SEQ_CST); \
+        } \
+        static inline t atomic##sfx ## _fetch_inc(void *v) { \
+            return __atomic_fetch_add((t *) v, 1, __ATOMIC_SEQ_CST); \
+        } \
+        static inline void atomic##sfx ## _inc(void *v) { \
+            __atomic_fetch_add((t *) v, 1, __ATOMIC_SEQ_CST); \
+        } \
+        static inline void atomic##sfx ## _add(t i, void *v) { \
+            __atomic_fetch_add((t *) v, i, __ATOMIC_SEQ_CST); \
+        } \
+        static inline t atomic##sfx ## _inc_return(void *v) { \
+            return __atomic_add_fetch((t *) v, 1, __ATOMIC_SEQ_CST); \
+        } \
+        static inline t atomic##sfx ## _add_return(t i, void *v) { \
+            return __atomic_add_fetch((t *) v, i, __ATOMIC_SEQ_CST); \
+        } \
+
+__shim_atomic_ops(int, )
+__shim_atomic_ops(s64, 64)
+
+static inline unsigned long atomic_long_fetch_or(unsigned long i, void *v) {
+    return __atomic_fetch_or((unsigned long *) v, i, __ATOMIC_SEQ_CST);
+}
+
+/* bit operations */
+#define BITS_TO_LONGS(n)            DIV_ROUND_UP(n, BITS_PER_LONG)
+#define DECLARE_BITMAP(name, bits)  unsigned long name[BITS_TO_LONGS(bits)]
+
+static inline bool test_bit(long nr, const volatile unsigned long *addr) {
+    return (__atomic_load_n(&addr[nr / BITS_PER_LONG], __ATOMIC_RELAXED) >>
+            (nr % BITS_PER_LONG)) & 1;
+}
+
+static inline void set_bit(long nr, volatile unsigned long *addr) {
+    __atomic_fetch_or(&addr[nr / BITS_PER_LONG],
+                      1ul << (nr % BITS_PER_LONG), __ATOMIC_SEQ_CST);
+}
+
+static inline bool test_and_set_bit(long nr, volatile unsigned long *addr) {
+    unsigned long mask = 1ul << (nr % BITS_PER_LONG);
+    return __atomic_fetch_or(
+            &addr[nr / BITS_PER_LONG], mask, __ATOMIC_SEQ_CST
+    ) & mask;
+}
+
+static inline void bitmap_zero(unsigned long *dst, unsigned int nbits) {
+    memset(dst, 0, BITS_TO_LONGS(nbits) * sizeof(unsigned long));
+}
+
+static inline unsigned int hweight_long(unsigned long w) {
+    return __builtin_popcountl(w);
+}
+
+static inline unsigned long __ffs(unsigned long word) {
+    return __builtin_ctzl(word);
+}
+
+static inline unsigned long __ffs64(u64 word) {
+    return __builtin_ctzll(word);
+}
+
+static inline unsigned long find_next_bit(
+        const unsigned long *addr, unsigned long size, unsigned long offset
+) {
+    unsigned long word;
+
+    while (offset < size) {
+        word = addr[offset / BITS_PER_LONG] >> (offset % BITS_PER_LONG);
+        if (word) {
+            offset += __builtin_ctzl(word);
+            return offset < size ? offset : size;
+        }
+        offset = (offset / BITS_PER_LONG + 1) * BITS_PER_LONG;
+    }
+    return size;
+}
+
+static inline unsigned long find_first_bit(
+        const unsigned long *addr, unsigned long size
+) {
+    return find_next_bit(addr, size, 0);
+}
+
+/* hashing (same as the generic versions in linux/hash.h) */
+#define GOLDEN_RATIO_32             0x61C88647
+#define GOLDEN_RATIO_64             0x61C8864680B583EBull
+
+static inline u32 hash_32(u32 val, unsigned int bits) {
+    return (val * GOLDEN_RATIO_32) >> (32 - bits);
+}
+
+static inline u32 hash_64(u64 val, unsigned int bits) {
+    return (u32) ((val * GOLDEN_RATIO_64) >> (64 - bits));
+}
+
+#endif /* _DART_BENCH_SHIM_KERNEL_H_ */
@@ -0,0 +1,34 @@
+#ifndef _DART_BENCH_SHIM_PERCPU_H_
+#define _DART_BENCH_SHIM_PERCPU_H_
+
+#include <linux/kernel.h>
+
+/*
+ * per-cpu variables as arrays indexed by the bench thread, each of which
+ * takes the role of a cpu (see bench_cpu_set), so there is no preemption
+ */
+#define BENCH_NR_CPUS               64
+
+extern __thread int bench_cpu;
+
+static inline void bench_cpu_set(int cpu) {
+    BUG_ON(cpu < 0 || cpu >= BENCH_NR_CPUS);
+    bench_cpu = cpu;
+}
+
+#define DECLARE_PER_CPU(type, name) \
+        extern __typeof__(type) name[BENCH_NR_CPUS]
+#define DEFINE_PER_CPU(type, name) \
+        __typeof__(type) name[BENCH_NR_CPUS]
+
+#define smp_processor_id()          (bench_cpu)
+#define for_each_possible_cpu(cpu) \
+        for ((cpu) = 0; (cpu) < BENCH_NR_CPUS; (cpu)++)
+
+#define per_cpu_ptr(ptr, cpu)       (*(ptr) + (cpu))
+#define this_cpu_ptr(ptr)           per_cpu_ptr(ptr, smp_processor_id())
+#define raw_cpu_ptr(ptr)            this_cpu_ptr(ptr)
+#define get_cpu_ptr(ptr)            this_cpu_ptr(ptr)
+#define put_cpu_ptr(ptr)            ((void) (ptr))
+
+#endif /* _DART_BENCH_SHIM_PERCPU_H_ */
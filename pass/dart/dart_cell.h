@@ -0,0 +1,157 @@
+#ifndef _DART_CELL_H_
+#define _DART_CELL_H_
+
+#include "dart_common.h"
+#include "dart_hash.h"
+
+/*
+ * memory cells (and the instructions interned for the compact ones)
+ *
+ * kept apart from dart_ctrl.h as nothing here depends on the kernel, so the
+ * benchmarks measure the very same cells (only with smaller tables)
+ */
+
+/* lockset summary of the owner (see the lockset in dart_ctrl.h) */
+typedef u32 lsum_32_t;
+
+/* bits of the cell tables other than the compact one, a word cell covers
+ * the same range as 8 byte cells, the benchmarks go with fewer */
+#ifndef DART_MC_BITS
+#ifdef DART_SHADOW_WORD
+#define DART_MC_BITS                21
+#else
+#define DART_MC_BITS                24
+#endif
+#endif
+
+#ifdef DART_MC_COMPACT
+#ifdef DART_SHADOW_WORD
+#error "DART_MC_COMPACT does not work with DART_SHADOW_WORD"
+#endif
+
+/*
+ * instructions interned for the compact cells, indices are handed out in
+ * the order of first access in a run and map back to the hval, index 0 is
+ * the instruction of no access (also given out, and counted as dropped, once
+ * the indices run out, as the owner is then lost to the alias checks),
+ * the table has twice as many slots as indices, so that it stays at most
+ * half full (plus the racing insertions) and probes stay short
+ */
+#define DART_INST_BITS              20
+
+struct dart_inst {
+    u32 index;
+};
+
+DART_HMAP_DEFINE(dart_inst, 21, 64);
+extern struct __ht_dart_inst *g_dart_inst_ht;
+extern hval_64_t *g_dart_inst_hvals;
+extern atomic_t g_dart_inst_count;
+extern atomic_t g_dart_inst_dropped;
+
+static inline u32 dart_inst_intern(hval_64_t hval) {
+    struct dart_inst *slot;
+    u32 index, prev;
+
+    slot = ht_dart_inst_has_slot(g_dart_inst_ht, hval);
+    if (likely(slot)) {
+        index = smp_load_acquire(&slot->index);
+        if (likely(index)) {
+            return index;
+        }
+    }
+
+    /* a new hval only takes a slot while there are indices to give out */
+    if (unlikely(atomic_read(&g_dart_inst_count) >=
+                 (1 << DART_INST_BITS) - 1)) {
+        atomic_inc(&g_dart_inst_dropped);
+        return 0;
+    }
+
+    slot = ht_dart_inst_get_slot(g_dart_inst_ht, hval);
+    index = smp_load_acquire(&slot->index);
+    if (likely(index)) {
+        return index;
+    }
+
+    /* the hval is published before the index, a lost race wastes one */
+    index = (u32) atomic_inc_return(&g_dart_inst_count);
+    if (unlikely(index >= (1u << DART_INST_BITS))) {
+        atomic_inc(&g_dart_inst_dropped);
+        return 0;
+    }
+
+    g_dart_inst_hvals[index] = hval;
+    prev = cmpxchg(&slot->index, 0, index);
+    return prev ? prev : index;
+}
+
+static inline hval_64_t dart_inst_hval(u32 index) {
+    return g_dart_inst_hvals[index];
+}
+
+static inline void dart_inst_reset(void) {
+    atomic_set(&g_dart_inst_count, 0);
+    atomic_set(&g_dart_inst_dropped, 0);
+}
+
+/* the owner of a byte in 16 bytes with the folded key, the ptid and ctxt of
+ * the owner are not kept, the ptid is known by its slot in the cb table and
+ * the ctxt can be recovered from the ledger when needed */
+struct dart_mc {
+    u32 inst;
+    u16 slot;
+#ifdef DART_LOCKSET
+    lsum_32_t lsum;
+#endif
+};
+
+DART_HMAP_FOLD_DEFINE(dart_mc, 24);
+#elif defined(DART_SHADOW_WORD)
+/* the context of the owner is never read back, so unlike the byte cells,
+ * the word cells leave it out, taking 136 bytes instead of 8 x 24 */
+struct dart_mc_byte {
+    /* last access info */
+    ptid_32_t ptid;
+#ifdef DART_LOCKSET
+    lsum_32_t lsum;
+#endif
+    hval_64_t inst;
+};
+
+struct dart_mc {
+    /* bit i is set if byte i of the word has an owner */
+    u8 mask;
+    struct dart_mc_byte byte[SHADOW_SIZE];
+};
+
+DART_HMAP_SELECT(dart_mc, DART_MC_BITS, 64, 6);
+
+/* the mask is shared by all bytes of the word, which are owned by accesses
+ * from different cpus at the same time in exactly the racy cases */
+static inline void dart_mc_mask_update(struct dart_mc *cell, u8 set, u8 clr) {
+    u8 old, cur;
+
+    cur = *(volatile u8 *) &cell->mask;
+    do {
+        old = cur;
+        cur = cmpxchg(&cell->mask, old, (u8) ((old | set) & ~clr));
+    } while (cur != old);
+}
+#else
+struct dart_mc {
+    /* last access info */
+    ptid_32_t ptid;
+#ifdef DART_LOCKSET
+    lsum_32_t lsum;
+#endif
+    hval_64_t ctxt;
+    hval_64_t inst;
+};
+
+DART_HMAP_SELECT(dart_mc, DART_MC_BITS, 64, 6);
+#endif
+extern struct __ht_dart_mc *g_dart_mc_reader_ht;
+extern struct __ht_dart_mc *g_dart_mc_writer_ht;
+
+#endif /* _DART_CELL_H_ */
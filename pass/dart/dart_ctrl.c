@@ -4,12 +4,41 @@
 atomic_t dart_switch_meta = ATOMIC_INIT(0);
 EXPORT_SYMBOL(dart_switch_meta);
 
+#ifdef DART_SWITCH_PERCPU
+int dart_switch_data_state = 0;
+EXPORT_SYMBOL(dart_switch_data_state);
+
+DEFINE_PER_CPU(atomic_t, dart_switch_data_count);
+EXPORT_PER_CPU_SYMBOL(dart_switch_data_count);
+#else
 atomic_t dart_switch_data = ATOMIC_INIT(0);
 EXPORT_SYMBOL(dart_switch_data);
+#endif
 
 /* control block */
 struct __ht_dart_cb *g_dart_cb_ht = NULL;
 
+/* live counters */
+atomic_t g_dart_cb_tracing = ATOMIC_INIT(0);
+atomic_t g_dart_async_pending = ATOMIC_INIT(0);
+atomic_t g_dart_event_pending = ATOMIC_INIT(0);
+DECLARE_WAIT_QUEUE_HEAD(g_dart_finish_wq);
+
+#ifdef DART_CB_CACHE
+DEFINE_PER_CPU(struct dart_cb_cache_percpu, g_dart_cb_cache);
+unsigned long g_dart_cb_epoch = 0;
+#endif
+
+#ifdef DART_TRACING_GUARD
+DEFINE_PER_CPU(u8, DART_TRACING_VAR);
+EXPORT_PER_CPU_SYMBOL(DART_TRACING_VAR);
+#endif
+
+#ifdef DART_HOOK_PATCH
+u8 DART_PATCH_VAR[1ul << DART_PATCH_BITS];
+EXPORT_SYMBOL(DART_PATCH_VAR);
+#endif
+
 /* async info */
 struct __ht_dart_async *g_dart_async_ht = NULL;
 struct __ht_dart_event *g_dart_event_ht = NULL;
@@ -18,5 +47,20 @@ struct __ht_dart_event *g_dart_event_ht = NULL;
 struct __ht_dart_mc *g_dart_mc_reader_ht = NULL;
 struct __ht_dart_mc *g_dart_mc_writer_ht = NULL;
 
+#ifdef DART_MC_COMPACT
+struct __ht_dart_inst *g_dart_inst_ht = NULL;
+hval_64_t *g_dart_inst_hvals = NULL;
+atomic_t g_dart_inst_count = ATOMIC_INIT(0);
+atomic_t g_dart_inst_dropped = ATOMIC_INIT(0);
+#endif
+
+#ifdef DART_SHADOW_INVALIDATE
+struct __ht_dart_alloc *g_dart_alloc_ht = NULL;
+#endif
+
 /* ignored events TODO (for debug purpose only, removed later) */
-atomic_t g_dart_ignored_events = ATOMIC_INIT(0);
\ No newline at end of file
+atomic_t g_dart_ignored_events = ATOMIC_INIT(0);
+
+/* delay injection */
+hval_64_t g_dart_delay_hval = 0;
+unsigned long g_dart_delay_usec = 0;
@@ -2,6 +2,14 @@
 #define _DART_CTRL_H_
 
 #include "dart_common.h"
+#include "dart_cell.h"
+
+#if defined(DART_SWITCH_PERCPU) || defined(DART_CB_CACHE) || \
+    defined(DART_TRACING_GUARD)
+#include <linux/percpu.h>
+#endif
+
+#include <linux/wait.h>
 
 /*
  * global switches
@@ -9,7 +17,9 @@
  *  - data switch controls whether the recording and processing should happen
  */
 extern atomic_t dart_switch_meta;
+#ifndef DART_SWITCH_PERCPU
 extern atomic_t dart_switch_data;
+#endif
 
 #define dart_switch(name) \
         /* a switch can be turned on only when it is at value 0 */ \
@@ -34,7 +44,227 @@ extern atomic_t dart_switch_data;
 
 dart_switch(meta)
 
+#ifdef DART_SWITCH_PERCPU
+/*
+ * per-cpu data switch
+ *
+ * the switch is acquired with an increment on the counter of the local cpu
+ * followed by a check on the global state, and released with a decrement on
+ * the counter of whatever cpu the context runs on at that time, hence only
+ * the sum over all cpus is meaningful
+ *
+ * turning off the switch clears the state and then waits for the sum to
+ * drop to zero, the full barriers on both sides guarantee that an acquirer
+ * either sees the switch off or has its increment seen by the summation
+ */
+extern int dart_switch_data_state;
+DECLARE_PER_CPU(atomic_t, dart_switch_data_count);
+
+static inline long dart_switch_data_sum(void) {
+    long sum;
+    int cpu;
+
+    sum = 0;
+    for_each_possible_cpu(cpu) {
+        sum += atomic_read(per_cpu_ptr(&dart_switch_data_count, cpu));
+    }
+    return sum;
+}
+
+/*
+ * the switch can be turned on only when it is off, the sum is not checked
+ * as acquirers keep bumping and reverting their counters while it is off
+ * (the ones of a past session were drained when it was turned off)
+ */
+static inline void dart_switch_on_data(void) {
+    BUG_ON(READ_ONCE(dart_switch_data_state));
+
+    smp_store_release(&dart_switch_data_state, 1);
+}
+
+/* the switch is turned off when every acquirer has released it */
+static inline void dart_switch_off_data(void) {
+    WRITE_ONCE(dart_switch_data_state, 0);
+    smp_mb();
+
+    while (dart_switch_data_sum() != 0) {
+        cond_resched();
+    }
+}
+
+static inline bool dart_switch_acq_data(void) {
+    atomic_t *count;
+
+    /* preemption in between only costs a remote increment */
+    count = raw_cpu_ptr(&dart_switch_data_count);
+    atomic_inc(count);
+    smp_mb__after_atomic();
+
+    if (likely(READ_ONCE(dart_switch_data_state))) {
+        return true;
+    }
+
+    /* revert on the same counter so that the sum never undercounts */
+    atomic_dec(count);
+    return false;
+}
+
+static inline void dart_switch_rel_data(void) {
+    atomic_dec(raw_cpu_ptr(&dart_switch_data_count));
+}
+#else
 dart_switch(data)
+#endif
+
+#ifdef DART_LOCKSET
+/*
+ * lockset
+ *
+ * the locks held by a context, sorted by address, each summarized into two
+ * bits of a 32-bit bloom word, which is what a memory cell keeps about the
+ * locks held by its owner: the summary over all held locks goes with a read
+ * and the one over the exclusively held ones goes with a write, as in the
+ * lockset_r/lockset_w of the offline analysis
+ *
+ * only definite protection is tracked (seqlock readers are not), a full set
+ * drops the extra locks, and a bloom collision filters a pair wrongly,
+ * which is rare with the few locks held at a time
+ */
+#define DART_LOCKSET_MAX                8
+
+struct dart_lock {
+    data_64_t lock;
+    lsum_32_t bits;
+    u16 depth_r;
+    u16 depth_w;
+};
+
+struct dart_lockset {
+    u32 num;
+    lsum_32_t sum_r;
+    lsum_32_t sum_w;
+    struct dart_lock held[DART_LOCKSET_MAX];
+};
+
+static inline lsum_32_t dart_lock_bits(data_64_t lock) {
+    u32 h = hash_64(lock, 10);
+    return (1u << (h & 31)) | (1u << ((h >> 5) & 31));
+}
+
+static inline void dart_lockset_init(struct dart_lockset *ls) {
+    ls->num = 0;
+    ls->sum_r = 0;
+    ls->sum_w = 0;
+}
+
+static inline void dart_lockset_summarize(struct dart_lockset *ls) {
+    u32 i;
+
+    ls->sum_r = 0;
+    ls->sum_w = 0;
+    for (i = 0; i < ls->num; i++) {
+        ls->sum_r |= ls->held[i].bits;
+        if (ls->held[i].depth_w) {
+            ls->sum_w |= ls->held[i].bits;
+        }
+    }
+}
+
+static inline void dart_lockset_add(
+        struct dart_lockset *ls, data_64_t lock, bool rw
+) {
+    u32 i, j;
+
+    i = 0;
+    while (i < ls->num && ls->held[i].lock < lock) {
+        i++;
+    }
+
+    if (i == ls->num || ls->held[i].lock != lock) {
+        /* missing a lock only filters less */
+        if (ls->num == DART_LOCKSET_MAX) {
+            return;
+        }
+
+        for (j = ls->num; j > i; j--) {
+            ls->held[j] = ls->held[j - 1];
+        }
+        ls->num++;
+
+        ls->held[i].lock = lock;
+        ls->held[i].bits = dart_lock_bits(lock);
+        ls->held[i].depth_r = 0;
+        ls->held[i].depth_w = 0;
+    }
+
+    if (rw) {
+        ls->held[i].depth_w++;
+    } else {
+        ls->held[i].depth_r++;
+    }
+
+    dart_lockset_summarize(ls);
+}
+
+static inline void dart_lockset_del(
+        struct dart_lockset *ls, data_64_t lock, bool rw
+) {
+    u32 i;
+
+    i = 0;
+    while (i < ls->num && ls->held[i].lock < lock) {
+        i++;
+    }
+
+    /* the lock was dropped, or acquired before tracing started */
+    if (i == ls->num || ls->held[i].lock != lock) {
+        return;
+    }
+
+    if (rw) {
+        if (!ls->held[i].depth_w) {
+            return;
+        }
+        ls->held[i].depth_w--;
+    } else {
+        if (!ls->held[i].depth_r) {
+            return;
+        }
+        ls->held[i].depth_r--;
+    }
+
+    if (!ls->held[i].depth_r && !ls->held[i].depth_w) {
+        ls->num--;
+        for (; i < ls->num; i++) {
+            ls->held[i] = ls->held[i + 1];
+        }
+    }
+
+    dart_lockset_summarize(ls);
+}
+
+/* whether a lock held now (exclusively, for a write) is in the summary */
+static inline bool dart_lockset_guards(
+        const struct dart_lockset *ls, bool rw, lsum_32_t sum
+) {
+    u32 i;
+
+    if (!((rw ? ls->sum_w : ls->sum_r) & sum)) {
+        return false;
+    }
+
+    for (i = 0; i < ls->num; i++) {
+        if (rw && !ls->held[i].depth_w) {
+            continue;
+        }
+        if ((ls->held[i].bits & sum) == ls->held[i].bits) {
+            return true;
+        }
+    }
+
+    return false;
+}
+#endif
 
 /* control block */
 struct dart_cb {
@@ -56,11 +286,130 @@ struct dart_cb {
 
     /* execution information */
     info_64_t info;
+
+#ifdef DART_LOCKSET
+    /* locks held */
+    struct dart_lockset lockset;
+#endif
+
+#ifdef DART_MC_COMPACT
+    /* index of the cell in the table, unique to the ptid within a run */
+    u16 slot;
+#endif
 };
 
 DART_HMAP_DEFINE(dart_cb, 16, 32);
 extern struct __ht_dart_cb *g_dart_cb_ht;
 
+/*
+ * live counters
+ *
+ * the number of tracing contexts and pending async/event slots, maintained
+ * on every transition so that finish waits on them instead of scanning the
+ * tables, the finish waiter is woken up whenever one drops to zero
+ */
+extern atomic_t g_dart_cb_tracing;
+extern atomic_t g_dart_async_pending;
+extern atomic_t g_dart_event_pending;
+extern wait_queue_head_t g_dart_finish_wq;
+
+static inline void dart_count_update(atomic_t *count, bool prev, bool next) {
+    if (prev == next) {
+        return;
+    }
+
+    if (next) {
+        atomic_inc(count);
+        return;
+    }
+
+    /* the dec is a full barrier, as waitqueue_active requires */
+    if (atomic_dec_and_test(count) && waitqueue_active(&g_dart_finish_wq)) {
+        wake_up(&g_dart_finish_wq);
+    }
+}
+
+static inline void dart_count_reset(void) {
+    atomic_set(&g_dart_cb_tracing, 0);
+    atomic_set(&g_dart_async_pending, 0);
+    atomic_set(&g_dart_event_pending, 0);
+}
+
+/* a host stashed in a slot by a stolen context is still counted as tracing,
+ * so only entering and exiting a context changes the count */
+static inline void dart_cb_set_tracing(struct dart_cb *cb, bool tracing) {
+    dart_count_update(&g_dart_cb_tracing, cb->tracing, tracing);
+    cb->tracing = tracing;
+}
+
+#ifdef DART_CB_CACHE
+/*
+ * control block cache
+ *  - task contexts cache the pointer in task_struct (dart_cb_cache)
+ *  - softirq, hardirq, and nmi contexts cache it in per-cpu slots
+ *
+ * control blocks are never removed from the table during a run, hence a
+ * pointer stays valid as long as the epoch (bumped on every launch) matches,
+ * a task inherits the cache of its parent on fork, hence the ptid check
+ */
+struct dart_cb_cache {
+    void *cb;
+    unsigned long epoch;
+};
+
+enum dart_cb_cache_slot {
+    DART_CB_CACHE_SOFTIRQ = 0,
+    DART_CB_CACHE_HARDIRQ,
+    DART_CB_CACHE_NMI,
+    DART_CB_CACHE_NUM,
+};
+
+struct dart_cb_cache_percpu {
+    struct dart_cb_cache slot[DART_CB_CACHE_NUM];
+};
+
+DECLARE_PER_CPU(struct dart_cb_cache_percpu, g_dart_cb_cache);
+extern unsigned long g_dart_cb_epoch;
+
+/* derive the ptid and locate the cache slot of the current context */
+static inline struct dart_cb_cache *dart_cb_cache_slot(ptid_32_t *ptid) {
+    BUILD_BUG_ON(sizeof(current->dart_cb_cache) !=
+                 sizeof(struct dart_cb_cache));
+
+    if (in_nmi()) {
+        *ptid = _ptid_in_nmi();
+        return &this_cpu_ptr(&g_dart_cb_cache)->slot[DART_CB_CACHE_NMI];
+    }
+
+    if (in_irq()) {
+        *ptid = _ptid_in_hardirq();
+        return &this_cpu_ptr(&g_dart_cb_cache)->slot[DART_CB_CACHE_HARDIRQ];
+    }
+
+    if (in_serving_softirq()) {
+        *ptid = _ptid_in_softirq();
+        return &this_cpu_ptr(&g_dart_cb_cache)->slot[DART_CB_CACHE_SOFTIRQ];
+    }
+
+    if (in_task_kernel()) {
+        *ptid = _ptid_in_task_kernel();
+    } else {
+#ifdef DART_ASSERT
+        BUG_ON(!in_task_user());
+#endif
+        *ptid = _ptid_in_task_user();
+    }
+    return (struct dart_cb_cache *) &current->dart_cb_cache;
+}
+
+static inline void dart_cb_cache_fill(
+        struct dart_cb_cache *cache, struct dart_cb *cb
+) {
+    cache->cb = cb;
+    cache->epoch = g_dart_cb_epoch;
+}
+#endif
+
 /* control block api */
 static inline void dart_cb_init(struct dart_cb *cb) {
     /* start without tracing */
@@ -77,10 +426,19 @@ static inline void dart_cb_init(struct dart_cb *cb) {
 
     /* no basic block visited on start */
     cb->last_blk = 0;
+
+#ifdef DART_LOCKSET
+    /* no lock held on start */
+    dart_lockset_init(&cb->lockset);
+#endif
 }
 
 static inline struct dart_cb *dart_cb_create(ptid_32_t ptid) {
     struct dart_cb *cb;
+#ifdef DART_CB_CACHE
+    struct dart_cb_cache *cache;
+    ptid_32_t current_ptid;
+#endif
 
     /* find the control block */
     cb = ht_dart_cb_get_slot(g_dart_cb_ht, ptid);
@@ -97,6 +455,21 @@ static inline struct dart_cb *dart_cb_create(ptid_32_t ptid) {
     cb->ptid = ptid;
     dart_cb_init(cb);
 
+#ifdef DART_MC_COMPACT
+    cb->slot = (u16) (
+            container_of(cb, struct __htcell_dart_cb, val) - g_dart_cb_ht->cell
+    );
+#endif
+
+#ifdef DART_CB_CACHE
+    /* control blocks are only created for the current context */
+    cache = dart_cb_cache_slot(&current_ptid);
+#ifdef DART_ASSERT
+    BUG_ON(current_ptid != ptid);
+#endif
+    dart_cb_cache_fill(cache, cb);
+#endif
+
     return cb;
 }
 
@@ -104,6 +477,34 @@ static inline struct dart_cb *dart_cb_find(ptid_32_t ptid) {
     return ht_dart_cb_has_slot(g_dart_cb_ht, ptid);
 }
 
+/* derive the ptid and lookup the control block of the current context */
+#ifdef DART_CB_CACHE
+static inline struct dart_cb *dart_cb_current(ptid_32_t *ptid) {
+    struct dart_cb_cache *cache;
+    struct dart_cb *cb;
+
+    cache = dart_cb_cache_slot(ptid);
+
+    /* fast path, the cached control block is from this run and this ptid */
+    cb = cache->cb;
+    if (likely(cache->epoch == g_dart_cb_epoch && cb && cb->ptid == *ptid)) {
+        return cb;
+    }
+
+    /* slow path, only cache the hits as misses may be created later */
+    cb = dart_cb_find(*ptid);
+    if (cb) {
+        dart_cb_cache_fill(cache, cb);
+    }
+    return cb;
+}
+#else
+static inline struct dart_cb *dart_cb_current(ptid_32_t *ptid) {
+    *ptid = dart_ptid();
+    return dart_cb_find(*ptid);
+}
+#endif
+
 static inline void __dart_cb_tracing_count(
         ptid_32_t key, struct dart_cb *val, void *arg
 ) {
@@ -140,6 +541,117 @@ static inline void dart_cb_check(
 
 #endif
 
+#ifdef DART_TRACING_GUARD
+/*
+ * tracing mask
+ *
+ * only the context being marked updates the bits of its level, the levels
+ * other than task are unique per cpu, and the task bits are saved in the
+ * task_struct (dart_tracing) and restored at every context switch, hence a
+ * clear bit guarantees that the wrapper would have dropped the hook anyway
+ */
+DECLARE_PER_CPU(u8, DART_TRACING_VAR);
+
+static inline unsigned int dart_tracing_level(void) {
+    if (in_nmi()) {
+        return DART_TRACING_LEVEL_NMI;
+    }
+
+    if (in_irq()) {
+        return DART_TRACING_LEVEL_HARDIRQ;
+    }
+
+    if (in_serving_softirq()) {
+        return DART_TRACING_LEVEL_SOFTIRQ;
+    }
+
+    return DART_TRACING_LEVEL_TASK;
+}
+
+static inline void dart_tracing_apply(unsigned int level, u8 bits) {
+    /* each op is atomic against the interrupts on the local cpu */
+    this_cpu_and(DART_TRACING_VAR, (u8) ~(
+            DART_TRACING_BIT_TRACE(level) | DART_TRACING_BIT_ACTIVE(level)
+    ));
+    this_cpu_or(DART_TRACING_VAR, bits);
+}
+
+/* sync the mask with the control block of the current context */
+static inline void dart_tracing_mark(struct dart_cb *cb) {
+    unsigned int level;
+    u8 bits;
+
+    level = dart_tracing_level();
+
+    bits = 0;
+    if (cb->tracing) {
+        bits |= DART_TRACING_BIT_TRACE(level);
+        if (!cb->paused) {
+            bits |= DART_TRACING_BIT_ACTIVE(level);
+        }
+    }
+
+    /* save first, a migration in between re-applies the saved bits */
+    if (level == DART_TRACING_LEVEL_TASK) {
+        current->dart_tracing = bits;
+    }
+    dart_tracing_apply(level, bits);
+}
+
+/* called in the incoming task at the end of a schedule */
+static inline void dart_tracing_switch(void) {
+    dart_tracing_apply(DART_TRACING_LEVEL_TASK, current->dart_tracing);
+}
+
+static inline void dart_tracing_reset(void) {
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        *per_cpu_ptr(&DART_TRACING_VAR, cpu) = 0;
+    }
+}
+#else
+static inline void dart_tracing_mark(struct dart_cb *cb) {}
+
+static inline void dart_tracing_switch(void) {}
+
+static inline void dart_tracing_reset(void) {}
+#endif
+
+#ifdef DART_HOOK_PATCH
+/*
+ * patch table
+ *
+ * the patchable hooks of a function are skipped while its slot is set, the
+ * slots only flip when dart is not running so that the enter and exit hooks
+ * of a function never go out of pair, functions colliding in a slot are
+ * patched together (which only loses some tracing)
+ */
+extern u8 DART_PATCH_VAR[1ul << DART_PATCH_BITS];
+
+/* an hval of 0 restores every slot */
+static inline int dart_patch_set(hval_64_t hval, bool off) {
+    if (atomic_read(&dart_switch_meta)) {
+        return -EBUSY;
+    }
+
+    if (hval == 0) {
+        if (off) {
+            return -EINVAL;
+        }
+        memset(DART_PATCH_VAR, 0, sizeof(DART_PATCH_VAR));
+        return 0;
+    }
+
+    WRITE_ONCE(DART_PATCH_VAR[DART_PATCH_SLOT(hval)], off ? 1 : 0);
+    return 0;
+}
+#else
+static inline int dart_patch_set(hval_64_t hval, bool off) {
+    return -EINVAL;
+}
+#endif
+
 static inline bool dart_in_action(void) {
     ptid_32_t ptid;
     struct dart_cb *cb;
@@ -150,8 +662,7 @@ static inline bool dart_in_action(void) {
     }
 
     /* lookup the control block */
-    ptid = dart_ptid();
-    cb = dart_cb_find(ptid);
+    cb = dart_cb_current(&ptid);
     if (!cb) {
         return false;
     }
@@ -170,15 +681,28 @@ struct dart_async {
     struct dart_cb host;
 };
 
-DART_HMAP_DEFINE(dart_async, 16, 64);
+DART_HMAP_SELECT(dart_async, 16, 64, 4);
 extern struct __ht_dart_async *g_dart_async_ht;
 
+static inline bool dart_async_pending(struct dart_async *slot) {
+    return slot->func || slot->serving;
+}
+
+/* apply the change to the slot, tracking whether it is pending */
+#define DART_ASYNC_UPDATE(slot, change) \
+        do { \
+            bool __prev = dart_async_pending(slot); \
+            change; \
+            dart_count_update(&g_dart_async_pending, __prev, \
+                              dart_async_pending(slot)); \
+        } while (0)
+
 static inline void __dart_async_pending_count(
         data_64_t key, struct dart_async *val, void *arg
 ) {
     unsigned int *count;
     count = (unsigned int *) arg;
-    if (val->func || val->serving) {
+    if (dart_async_pending(val)) {
         *count += 1;
     }
 }
@@ -206,15 +730,27 @@ struct dart_event {
     struct dart_cb host;
 };
 
-DART_HMAP_DEFINE(dart_event, 16, 64);
+DART_HMAP_SELECT(dart_event, 16, 64, 4);
 extern struct __ht_dart_event *g_dart_event_ht;
 
+static inline bool dart_event_pending(struct dart_event *slot) {
+    return slot->func || slot->serving;
+}
+
+#define DART_EVENT_UPDATE(slot, change) \
+        do { \
+            bool __prev = dart_event_pending(slot); \
+            change; \
+            dart_count_update(&g_dart_event_pending, __prev, \
+                              dart_event_pending(slot)); \
+        } while (0)
+
 static inline void __dart_event_pending_count(
         data_64_t key, struct dart_event *val, void *arg
 ) {
     unsigned int *count;
     count = (unsigned int *) arg;
-    if (val->func || val->serving) {
+    if (dart_event_pending(val)) {
         *count += 1;
     }
 }
@@ -229,19 +765,134 @@ static inline unsigned int dart_event_pending_count(
     return count;
 }
 
-/* memory cell */
-struct dart_mc {
-    /* last access info */
-    ptid_32_t ptid;
-    hval_64_t ctxt;
-    hval_64_t inst;
+
+#ifdef DART_SHADOW_INVALIDATE
+#ifndef DART_HMAP_SHARDED
+#error "DART_SHADOW_INVALIDATE requires DART_HMAP_SHARDED"
+#endif
+
+/* live allocations, as frees do not come with the size */
+struct dart_alloc {
+    data_64_t size;
 };
 
-DART_HMAP_DEFINE(dart_mc, 24, 64);
-extern struct __ht_dart_mc *g_dart_mc_reader_ht;
-extern struct __ht_dart_mc *g_dart_mc_writer_ht;
+DART_HMAP_SELECT(dart_alloc, 20, 64, 6);
+extern struct __ht_dart_alloc *g_dart_alloc_ht;
+
+#ifdef DART_SHADOW_WORD
+static inline void __dart_mc_invalidate_bytes(
+        struct __ht_dart_mc *ht, data_64_t word, u8 bits
+) {
+    struct dart_mc *cell;
+
+    cell = ht_dart_mc_has_slot(ht, word);
+    if (cell) {
+        dart_mc_mask_update(cell, 0, bits);
+    }
+}
+#endif
+
+/* drop the owners of [addr, addr + size) */
+static inline void dart_mc_invalidate(
+        struct __ht_dart_mc *ht, data_64_t addr, data_64_t size
+) {
+#ifdef DART_SHADOW_WORD
+    data_64_t end, lo, hi;
+    u8 bits;
+
+    if (!size) {
+        return;
+    }
+
+    end = addr + size;
+    lo = ADDR_TO_SHADOW(addr);
+    hi = ADDR_TO_SHADOW(end);
+
+    /* the words partially covered only lose the bytes in range */
+    if (ADDR_TO_OFFSET(addr)) {
+        bits = (u8) (0xffu << ADDR_TO_OFFSET(addr));
+        if (lo == hi) {
+            bits &= (u8) (0xffu >> (SHADOW_SIZE - ADDR_TO_OFFSET(end)));
+            __dart_mc_invalidate_bytes(ht, lo, bits);
+            return;
+        }
+
+        __dart_mc_invalidate_bytes(ht, lo, bits);
+        lo += SHADOW_SIZE;
+    }
+
+    if (ADDR_TO_OFFSET(end)) {
+        bits = (u8) (0xffu >> (SHADOW_SIZE - ADDR_TO_OFFSET(end)));
+        __dart_mc_invalidate_bytes(ht, hi, bits);
+    }
+
+    /* the words fully covered go away */
+    if (lo < hi) {
+        ht_dart_mc_del_range(ht, lo, hi, SHADOW_SHIFT);
+    }
+#else
+    ht_dart_mc_del_range(ht, addr, addr + size, 0);
+#endif
+}
+
+static inline void dart_shadow_invalidate(data_64_t addr, data_64_t size) {
+    dart_mc_invalidate(g_dart_mc_reader_ht, addr, size);
+    dart_mc_invalidate(g_dart_mc_writer_ht, addr, size);
+}
+#endif
 
 /* ignored events TODO (for debug purpose only, removed later) */
 extern atomic_t g_dart_ignored_events;
 
+/*
+ * delay injection
+ *
+ * stalls the first hit of the chosen instruction for a while, which widens
+ * the window for the other threads to get in between, used to steer a run
+ * towards a specific racing pair, an hval of 0 disarms it
+ *
+ * the hit disarms it, as stalling a hot instruction on every hit would
+ * add up to lockups, and a hit in an atomic context (irqs, or irqs off)
+ * is passed over, leaving it armed for a hit in a task
+ */
+#define DART_DELAY_USEC_MAX             100000
+
+extern hval_64_t g_dart_delay_hval;
+extern unsigned long g_dart_delay_usec;
+
+/* the duration goes first, the hval then arms it */
+static inline void dart_delay_set_usec(unsigned long usec) {
+    WRITE_ONCE(g_dart_delay_usec,
+               min_t(unsigned long, usec, DART_DELAY_USEC_MAX));
+}
+
+static inline void dart_delay_set_hval(hval_64_t hval) {
+    smp_wmb();
+    WRITE_ONCE(g_dart_delay_hval, hval);
+}
+
+static inline void dart_delay_hit(hval_64_t hval) {
+    unsigned long usec;
+
+    if (likely(READ_ONCE(g_dart_delay_hval) != hval)) {
+        return;
+    }
+
+    if (!in_task() || irqs_disabled()) {
+        return;
+    }
+
+    /* only the one that disarms it stalls */
+    if (cmpxchg(&g_dart_delay_hval, hval, 0) != hval) {
+        return;
+    }
+
+    smp_rmb();
+    usec = READ_ONCE(g_dart_delay_usec);
+
+    /* udelay is only meant for short waits */
+    mdelay(usec / 1000);
+    udelay(usec % 1000);
+}
+
 #endif /* _DART_CTRL_H_ */
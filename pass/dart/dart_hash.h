@@ -25,6 +25,8 @@
 
 DART_HASH_DEFINE(32, 24)
 
+DART_HASH_DEFINE(32, 21)
+
 DART_HASH_DEFINE(32, 20)
 
 DART_HASH_DEFINE(16, 16)
@@ -35,17 +37,38 @@ DART_HASH_DEFINE(16, 12)
 #define atomic32_t atomic_t
 #define atomic32_read atomic_read
 #define atomic32_set atomic_set
+#define atomic32_read_acquire atomic_read_acquire
+#define atomic32_set_release atomic_set_release
 
 #define DART_HMAP_DEFINE(name, bits, klen) \
         /* typedef */ \
         typedef struct __ht_##name { \
+            u32 gen; \
             DECLARE_BITMAP(bmap, (1 << bits)); \
             struct  __htcell_##name { \
                 atomic##klen ## _t key; \
+                u32 gen; \
                 struct name val; \
             } cell[1 << bits]; \
         } ht_##name ## _t; \
         \
+        /* internals */ \
+        static inline uint##klen ## _t \
+        __ht_##name ## _key( \
+                struct __ht_##name *ht, hash##bits ## _t i \
+        ) { \
+            uint##klen ## _t e; \
+            u32 g; \
+            \
+            /* in case someone acquired the bit but has not set it yet, \
+             * the key is stale until the cell moves to this generation */ \
+            do { \
+                g = smp_load_acquire(&(ht->cell[i].gen)); \
+                e = atomic##klen ## _read(&(ht->cell[i].key)); \
+            } while (g != ht->gen || !e); \
+            return e; \
+        } \
+        \
         /* functions */ \
         static inline struct name * \
         ht_##name ## _get_slot( \
@@ -56,10 +79,7 @@ DART_HASH_DEFINE(16, 12)
             hash##bits ## _t o = 0; \
             \
             while (test_and_set_bit(i, ht->bmap)) { \
-                /* in case someone acquired the bit but has not set it yet */ \
-                do { \
-                    e = atomic##klen ## _read(&(ht->cell[i].key)); \
-                } while (!e); \
+                e = __ht_##name ## _key(ht, i); \
                 \
                 /* return an existing slot */ \
                 if (e == k) { \
@@ -71,11 +91,22 @@ DART_HASH_DEFINE(16, 12)
                 BUG_ON((++o) == (1 << bits)); \
             } \
             \
-            /* we are the first to set the bit */ \
+            /* we are the first to set the bit, the cell may be stale */ \
+            memset(&(ht->cell[i].val), 0, sizeof(struct name)); \
             atomic##klen ## _set(&(ht->cell[i].key), k); \
+            smp_store_release(&(ht->cell[i].gen), ht->gen); \
             return &(ht->cell[i].val); \
         } \
         \
+        /* whether a slot is the sink shared by the keys left out, which \
+         * this table never hands out (it bugs out when full) */ \
+        static inline bool \
+        ht_##name ## _is_sink( \
+                struct __ht_##name *ht, struct name *val \
+        ) { \
+            return false; \
+        } \
+        \
         static inline struct name * \
         ht_##name ## _has_slot( \
                 struct __ht_##name *ht, uint##klen ## _t k \
@@ -85,10 +116,7 @@ DART_HASH_DEFINE(16, 12)
             hash##bits ## _t o = 0; \
             \
             while (test_bit(i, ht->bmap)) { \
-                /* in case someone acquired the bit but has not set it yet */ \
-                do { \
-                    e = atomic##klen ## _read(&(ht->cell[i].key)); \
-                } while (!e); \
+                e = __ht_##name ## _key(ht, i); \
                 \
                 /* check existence */ \
                 if (e == k) { \
@@ -132,5 +160,849 @@ DART_HASH_DEFINE(16, 12)
                 } \
             } \
         } \
+        \
+        /* forget every key by clearing the claim bitmap, which is one bit \
+         * per cell (2^bits / 8 bytes), the cells themselves are claimed \
+         * again lazily and only zeroed when the generation wraps */ \
+        static inline void \
+        ht_##name ## _reset(struct __ht_##name *ht) { \
+            bitmap_zero(ht->bmap, (1 << bits)); \
+            \
+            /* a wrapped generation may match a stale cell */ \
+            if (unlikely(++ht->gen == 0)) { \
+                memset(ht->cell, 0, sizeof(ht->cell)); \
+            } \
+        } \
+
+/* sharded hash tables
+ *
+ * - keys are spread into (1 << sbits) shards by their address bits so that
+ *   contexts working on different memory regions do not contend
+ * - lookups (and hits on get_slot) are lock-free, insertions and removals
+ *   are serialized per shard
+ * - removal leaves a tombstone that is reused by later insertions
+ * - a shard overflows into a chain of nodes taken from a pre-allocated pool,
+ *   once the pool is exhausted, all further keys share a sink cell instead
+ *   of bugging out (the table reports it via the overflow counter)
+ * - an insertion from an nmi that finds its shard locked takes the sink
+ *   cell as well, instead of spinning on the code it interrupted
+ * - the sink only suits the tables whose entries may be lost (the memory
+ *   cells and allocations), the others check is_sink and fail explicitly
+ */
+#define DART_HMAP_KEY_EMPTY         0
+#define DART_HMAP_KEY_TOMB(klen)    ((uint##klen ## _t) -1)
+#define DART_HMAP_SHARD_SHIFT       12
+#define DART_HMAP_PROBE_LIMIT       32
+
+#define DART_HMAP_SHARD_DEFINE(name, bits, klen, sbits) \
+        /* typedef */ \
+        struct __htnode_##name { \
+            atomic##klen ## _t key; \
+            struct name val; \
+            struct __htnode_##name *next; \
+        }; \
+        \
+        typedef struct __ht_##name { \
+            /* cells of other generations read as empty */ \
+            u32 gen; \
+            \
+            struct __htshard_##name { \
+                atomic_t lock; \
+                struct __htnode_##name *chain; \
+                struct __htcell_##name { \
+                    atomic##klen ## _t key; \
+                    u32 gen; \
+                    struct name val; \
+                } cell[1 << ((bits) - (sbits))]; \
+            } shard[1 << (sbits)]; \
+            \
+            /* overflow */ \
+            atomic_t pool_used; \
+            atomic_t overflow; \
+            struct __htnode_##name pool[1 << ((bits) - 3)]; \
+            struct name sink; \
+        } ht_##name ## _t; \
+        \
+        /* internals */ \
+        static inline struct __htshard_##name * \
+        __ht_##name ## _shard( \
+                struct __ht_##name *ht, uint##klen ## _t k \
+        ) { \
+            return &ht->shard[ \
+                hash_##klen((k) >> DART_HMAP_SHARD_SHIFT, sbits) \
+            ]; \
+        } \
+        \
+        static inline unsigned long \
+        __ht_##name ## _lock(struct __htshard_##name *sh) { \
+            unsigned long flags; \
+            \
+            local_irq_save(flags); \
+            while (atomic_cmpxchg(&sh->lock, 0, 1)) { \
+                cpu_relax(); \
+            } \
+            return flags; \
+        } \
+        \
+        /* an nmi cannot wait for a lock whose holder may be the code it \
+         * interrupted on the same cpu, so it only tries once */ \
+        static inline bool \
+        __ht_##name ## _lock_nmi_safe( \
+                struct __htshard_##name *sh, unsigned long *flags \
+        ) { \
+            if (likely(!in_nmi())) { \
+                *flags = __ht_##name ## _lock(sh); \
+                return true; \
+            } \
+            \
+            local_irq_save(*flags); \
+            if (!atomic_cmpxchg(&sh->lock, 0, 1)) { \
+                return true; \
+            } \
+            local_irq_restore(*flags); \
+            return false; \
+        } \
+        \
+        static inline void \
+        __ht_##name ## _unlock( \
+                struct __htshard_##name *sh, unsigned long flags \
+        ) { \
+            atomic_set_release(&sh->lock, 0); \
+            local_irq_restore(flags); \
+        } \
+        \
+        static inline struct name * \
+        __ht_##name ## _find( \
+                struct __ht_##name *ht, struct __htshard_##name *sh, \
+                uint##klen ## _t k \
+        ) { \
+            uint##klen ## _t e; \
+            struct __htnode_##name *node; \
+            u32 i = hash_##klen(k, (bits) - (sbits)); \
+            u32 o; \
+            \
+            for (o = 0; o < DART_HMAP_PROBE_LIMIT; o++) { \
+                /* a stale cell is as good as an empty one */ \
+                if (smp_load_acquire(&(sh->cell[i].gen)) != ht->gen) { \
+                    return NULL; \
+                } \
+                e = atomic##klen ## _read_acquire(&(sh->cell[i].key)); \
+                \
+                /* return an existing slot */ \
+                if (e == k) { \
+                    return &(sh->cell[i].val); \
+                } \
+                \
+                /* empty cells never come back, so the key is not here */ \
+                if (e == DART_HMAP_KEY_EMPTY) { \
+                    return NULL; \
+                } \
+                \
+                /* move on */ \
+                i = (i + 1) % (1 << ((bits) - (sbits))); \
+            } \
+            \
+            /* the probe window is full, check the chain */ \
+            node = smp_load_acquire(&sh->chain); \
+            while (node) { \
+                if (atomic##klen ## _read(&node->key) == k) { \
+                    return &node->val; \
+                } \
+                node = node->next; \
+            } \
+            \
+            return NULL; \
+        } \
+        \
+        /* functions */ \
+        /* whether a slot is the sink shared by the keys left out, which \
+         * only tables tolerating lost updates (the cells) can write to */ \
+        static inline bool \
+        ht_##name ## _is_sink( \
+                struct __ht_##name *ht, struct name *val \
+        ) { \
+            return val == &ht->sink; \
+        } \
+        \
+        static inline struct name * \
+        ht_##name ## _has_slot( \
+                struct __ht_##name *ht, uint##klen ## _t k \
+        ) { \
+            return __ht_##name ## _find(ht, __ht_##name ## _shard(ht, k), k); \
+        } \
+        \
+        static inline struct name * \
+        ht_##name ## _get_slot( \
+                struct __ht_##name *ht, uint##klen ## _t k \
+        ) { \
+            uint##klen ## _t e; \
+            struct __htshard_##name *sh; \
+            struct __htnode_##name *node; \
+            struct name *val; \
+            atomic##klen ## _t *key; \
+            u32 *gen; \
+            unsigned long flags; \
+            u32 i, o; \
+            \
+            /* fast path, the key exists */ \
+            sh = __ht_##name ## _shard(ht, k); \
+            val = __ht_##name ## _find(ht, sh, k); \
+            if (likely(val)) { \
+                return val; \
+            } \
+            \
+            /* slow path, re-check and insert with the shard locked, or \
+             * fall back to the sink if an nmi cannot take the lock */ \
+            if (unlikely(!__ht_##name ## _lock_nmi_safe(sh, &flags))) { \
+                atomic_inc(&ht->overflow); \
+                return &ht->sink; \
+            } \
+            val = __ht_##name ## _find(ht, sh, k); \
+            if (val) { \
+                goto out; \
+            } \
+            \
+            /* take the first free cell in the probe window */ \
+            key = NULL; \
+            gen = NULL; \
+            i = hash_##klen(k, (bits) - (sbits)); \
+            for (o = 0; o < DART_HMAP_PROBE_LIMIT; o++) { \
+                e = atomic##klen ## _read(&(sh->cell[i].key)); \
+                if (e == DART_HMAP_KEY_EMPTY || \
+                    e == DART_HMAP_KEY_TOMB(klen) || \
+                    sh->cell[i].gen != ht->gen) { \
+                    key = &(sh->cell[i].key); \
+                    gen = &(sh->cell[i].gen); \
+                    val = &(sh->cell[i].val); \
+                    break; \
+                } \
+                i = (i + 1) % (1 << ((bits) - (sbits))); \
+            } \
+            \
+            /* or a removed node in the chain */ \
+            if (!key) { \
+                for (node = sh->chain; node; node = node->next) { \
+                    e = atomic##klen ## _read(&node->key); \
+                    if (e == DART_HMAP_KEY_TOMB(klen)) { \
+                        key = &node->key; \
+                        val = &node->val; \
+                        break; \
+                    } \
+                } \
+            } \
+            \
+            /* or a new node from the pool */ \
+            if (!key) { \
+                o = atomic_fetch_inc(&ht->pool_used); \
+                if (unlikely(o >= ARRAY_SIZE(ht->pool))) { \
+                    atomic_inc(&ht->overflow); \
+                    val = &ht->sink; \
+                    goto out; \
+                } \
+                \
+                node = &ht->pool[o]; \
+                memset(&node->val, 0, sizeof(struct name)); \
+                atomic##klen ## _set(&node->key, k); \
+                node->next = sh->chain; \
+                smp_store_release(&sh->chain, node); \
+                val = &node->val; \
+                goto out; \
+            } \
+            \
+            /* a stale cell may still hold this key, so hide it before \
+             * reviving the cell, then publish the key after the value is \
+             * cleared */ \
+            if (gen && *gen != ht->gen) { \
+                atomic##klen ## _set(key, DART_HMAP_KEY_TOMB(klen)); \
+                smp_store_release(gen, ht->gen); \
+            } \
+            memset(val, 0, sizeof(struct name)); \
+            atomic##klen ## _set_release(key, k); \
+            \
+        out: \
+            __ht_##name ## _unlock(sh, flags); \
+            return val; \
+        } \
+        \
+        /* with the shard locked */ \
+        static inline void \
+        __ht_##name ## _tomb( \
+                struct __ht_##name *ht, struct __htshard_##name *sh, \
+                uint##klen ## _t k \
+        ) { \
+            struct __htnode_##name *node; \
+            u32 i, o; \
+            \
+            i = hash_##klen(k, (bits) - (sbits)); \
+            for (o = 0; o < DART_HMAP_PROBE_LIMIT; o++) { \
+                if (sh->cell[i].gen == ht->gen && \
+                    atomic##klen ## _read(&(sh->cell[i].key)) == k) { \
+                    atomic##klen ## _set(&(sh->cell[i].key), \
+                                         DART_HMAP_KEY_TOMB(klen)); \
+                    return; \
+                } \
+                i = (i + 1) % (1 << ((bits) - (sbits))); \
+            } \
+            \
+            for (node = sh->chain; node; node = node->next) { \
+                if (atomic##klen ## _read(&node->key) == k) { \
+                    atomic##klen ## _set(&node->key, \
+                                         DART_HMAP_KEY_TOMB(klen)); \
+                    return; \
+                } \
+            } \
+        } \
+        \
+        /* with the shard locked, tomb the keys in [lo, hi) on step */ \
+        static inline void \
+        __ht_##name ## _sweep( \
+                struct __ht_##name *ht, struct __htshard_##name *sh, \
+                uint##klen ## _t lo, uint##klen ## _t hi, u32 step \
+        ) { \
+            uint##klen ## _t e; \
+            struct __htnode_##name *node; \
+            u32 i; \
+            \
+            for (i = 0; i < (1 << ((bits) - (sbits))); i++) { \
+                if (sh->cell[i].gen != ht->gen) { \
+                    continue; \
+                } \
+                e = atomic##klen ## _read(&(sh->cell[i].key)); \
+                if (e >= lo && e < hi && !(e & ((1ul << step) - 1))) { \
+                    atomic##klen ## _set(&(sh->cell[i].key), \
+                                         DART_HMAP_KEY_TOMB(klen)); \
+                } \
+            } \
+            \
+            for (node = sh->chain; node; node = node->next) { \
+                e = atomic##klen ## _read(&node->key); \
+                if (e >= lo && e < hi && !(e & ((1ul << step) - 1))) { \
+                    atomic##klen ## _set(&node->key, \
+                                         DART_HMAP_KEY_TOMB(klen)); \
+                } \
+            } \
+        } \
+        \
+        static inline void \
+        ht_##name ## _del_slot( \
+                struct __ht_##name *ht, uint##klen ## _t k \
+        ) { \
+            struct __htshard_##name *sh; \
+            unsigned long flags; \
+            \
+            sh = __ht_##name ## _shard(ht, k); \
+            flags = __ht_##name ## _lock(sh); \
+            __ht_##name ## _tomb(ht, sh, k); \
+            __ht_##name ## _unlock(sh, flags); \
+        } \
+        \
+        static inline void \
+        ht_##name ## _del_range( \
+                struct __ht_##name *ht, \
+                uint##klen ## _t lo, uint##klen ## _t hi, u32 step \
+        ) { \
+            uint##klen ## _t k, end; \
+            struct __htshard_##name *sh; \
+            unsigned long flags; \
+            bool locked; \
+            u32 s; \
+            \
+            /* a range wider than the table is cheaper to sweep */ \
+            if (((hi - lo) >> step) > (1 << (bits))) { \
+                for (s = 0; s < (1 << (sbits)); s++) { \
+                    sh = &ht->shard[s]; \
+                    flags = __ht_##name ## _lock(sh); \
+                    __ht_##name ## _sweep(ht, sh, lo, hi, step); \
+                    __ht_##name ## _unlock(sh, flags); \
+                } \
+                return; \
+            } \
+            \
+            /* keys in one page share a shard, probe them lock-free and \
+             * take the lock at most once per page, only if there is a hit */ \
+            k = lo; \
+            while (k < hi) { \
+                end = (k | ((1ul << DART_HMAP_SHARD_SHIFT) - 1)) + 1; \
+                if (end > hi || end < k) { \
+                    end = hi; \
+                } \
+                \
+                sh = __ht_##name ## _shard(ht, k); \
+                locked = false; \
+                flags = 0; \
+                \
+                for (; k < end; k += (1ul << step)) { \
+                    if (!__ht_##name ## _find(ht, sh, k)) { \
+                        continue; \
+                    } \
+                    if (!locked) { \
+                        flags = __ht_##name ## _lock(sh); \
+                        locked = true; \
+                    } \
+                    __ht_##name ## _tomb(ht, sh, k); \
+                } \
+                \
+                if (locked) { \
+                    __ht_##name ## _unlock(sh, flags); \
+                } \
+            } \
+        } \
+        \
+        static inline void \
+        ht_##name ## _for_each( \
+            struct __ht_##name *ht, \
+            void (*func)( \
+                uint##klen ## _t key, struct name *val, void *arg \
+            ), \
+            void *arg \
+        ) { \
+            uint##klen ## _t e; \
+            struct __htnode_##name *node; \
+            u32 s, i; \
+            \
+            for (s = 0; s < (1 << (sbits)); s++) { \
+                for (i = 0; i < (1 << ((bits) - (sbits))); i++) { \
+                    e = atomic##klen ## _read(&(ht->shard[s].cell[i].key)); \
+                    if (e == DART_HMAP_KEY_EMPTY || \
+                        e == DART_HMAP_KEY_TOMB(klen) || \
+                        ht->shard[s].cell[i].gen != ht->gen) { \
+                        continue; \
+                    } \
+                    func(e, &ht->shard[s].cell[i].val, arg); \
+                } \
+                \
+                node = smp_load_acquire(&ht->shard[s].chain); \
+                while (node) { \
+                    e = atomic##klen ## _read(&node->key); \
+                    if (e != DART_HMAP_KEY_TOMB(klen)) { \
+                        func(e, &node->val, arg); \
+                    } \
+                    node = node->next; \
+                } \
+            } \
+        } \
+        \
+        /* forget every key without touching the cells, which are revived \
+         * lazily, only the chains (from the pool) are dropped eagerly */ \
+        static inline void \
+        ht_##name ## _reset(struct __ht_##name *ht) { \
+            u32 s; \
+            \
+            /* a wrapped generation may match a stale cell */ \
+            if (unlikely(++ht->gen == 0)) { \
+                memset(ht->shard, 0, sizeof(ht->shard)); \
+            } \
+            \
+            for (s = 0; s < (1 << (sbits)); s++) { \
+                atomic_set(&ht->shard[s].lock, 0); \
+                ht->shard[s].chain = NULL; \
+            } \
+            \
+            atomic_set(&ht->pool_used, 0); \
+            atomic_set(&ht->overflow, 0); \
+            memset(&ht->sink, 0, sizeof(struct name)); \
+        } \
+
+/* grouped hash tables (swiss-table style)
+ *
+ * - each group packs a 64-bit control word and 7 keys into one cache line,
+ *   values are stored out of line so probing never touches them
+ * - a control byte is 0 for an empty slot or (0x80 | h2) for a used one,
+ *   where h2 is 7 bits of the hash that are not used to select the group
+ * - the control word is matched with SWAR arithmetic, i.e., one compare
+ *   checks every slot in the group without touching FPU/SIMD state, which
+ *   the hooks cannot afford to save and restore
+ * - slots are claimed by a cmpxchg on the control word, so concurrent
+ *   insertions of the same key always meet in the same group
+ */
+#define DART_HMAP_GROUP_SLOTS       7
+#define DART_HMAP_GROUPS(bits) \
+        DIV_ROUND_UP(1ul << (bits), DART_HMAP_GROUP_SLOTS)
+
+#define _DART_HMAP_CTRL_LSB         0x0001010101010101ull
+#define _DART_HMAP_CTRL_MSB         0x0080808080808080ull
+
+/* returns a mask with the msb set in every byte that equals b (may have
+ * false positives above a true match, which the key compare filters out) */
+static inline u64 __dart_hmap_ctrl_match(u64 ctrl, u8 b) {
+    u64 x = ctrl ^ (_DART_HMAP_CTRL_LSB * b);
+    return (x - _DART_HMAP_CTRL_LSB) & ~x & _DART_HMAP_CTRL_MSB;
+}
+
+/* an empty byte is exact since used bytes always have the msb set */
+static inline u64 __dart_hmap_ctrl_empty(u64 ctrl) {
+    return ~ctrl & _DART_HMAP_CTRL_MSB;
+}
+
+#define DART_HMAP_SWISS_DEFINE(name, bits, klen) \
+        /* typedef */ \
+        typedef struct __ht_##name { \
+            struct __htgroup_##name { \
+                atomic64_t ctrl; \
+                atomic##klen ## _t key[DART_HMAP_GROUP_SLOTS]; \
+            } __aligned(64) group[DART_HMAP_GROUPS(bits)]; \
+            struct name val[DART_HMAP_GROUPS(bits) * DART_HMAP_GROUP_SLOTS]; \
+        } ht_##name ## _t; \
+        \
+        /* internals */ \
+        static inline struct name * \
+        __ht_##name ## _probe( \
+                struct __ht_##name *ht, uint##klen ## _t k, bool insert \
+        ) { \
+            struct __htgroup_##name *grp; \
+            uint##klen ## _t e; \
+            u64 ctrl, m; \
+            u32 h = hash_##klen(k, 32); \
+            u32 g = ((u64) (h >> 7) * DART_HMAP_GROUPS(bits)) >> 25; \
+            u8 b = 0x80 | (h & 0x7f); \
+            u32 o = 0; \
+            unsigned int j; \
+            \
+            while (true) { \
+                grp = &ht->group[g]; \
+                ctrl = atomic64_read_acquire(&grp->ctrl); \
+                \
+        rescan: \
+                /* check every candidate in the group at once */ \
+                m = __dart_hmap_ctrl_match(ctrl, b); \
+                while (m) { \
+                    j = __ffs64(m) / 8; \
+                    \
+                    /* in case someone claimed the slot but has not set it */ \
+                    do { \
+                        e = atomic##klen ## _read(&grp->key[j]); \
+                    } while (!e); \
+                    \
+                    /* return an existing slot */ \
+                    if (e == k) { \
+                        return &ht->val[g * DART_HMAP_GROUP_SLOTS + j]; \
+                    } \
+                    m &= m - 1; \
+                } \
+                \
+                /* an empty slot terminates the probe sequence */ \
+                m = __dart_hmap_ctrl_empty(ctrl); \
+                if (m) { \
+                    if (!insert) { \
+                        return NULL; \
+                    } \
+                    \
+                    j = __ffs64(m) / 8; \
+                    m = atomic64_cmpxchg( \
+                        &grp->ctrl, ctrl, ctrl | ((u64) b << (j * 8)) \
+                    ); \
+                    if (m != ctrl) { \
+                        /* lost the race, the winner may hold our key */ \
+                        ctrl = m; \
+                        goto rescan; \
+                    } \
+                    \
+                    /* the value may be left from before a reset */ \
+                    memset(&ht->val[g * DART_HMAP_GROUP_SLOTS + j], 0, \
+                           sizeof(struct name)); \
+                    atomic##klen ## _set_release(&grp->key[j], k); \
+                    return &ht->val[g * DART_HMAP_GROUP_SLOTS + j]; \
+                } \
+                \
+                /* move on */ \
+                if (++g == DART_HMAP_GROUPS(bits)) { \
+                    g = 0; \
+                } \
+                BUG_ON((++o) == DART_HMAP_GROUPS(bits)); \
+            } \
+        } \
+        \
+        /* functions */ \
+        static inline struct name * \
+        ht_##name ## _get_slot( \
+                struct __ht_##name *ht, uint##klen ## _t k \
+        ) { \
+            return __ht_##name ## _probe(ht, k, true); \
+        } \
+        \
+        /* whether a slot is the sink shared by the keys left out, which \
+         * this table never hands out (it bugs out when full) */ \
+        static inline bool \
+        ht_##name ## _is_sink( \
+                struct __ht_##name *ht, struct name *val \
+        ) { \
+            return false; \
+        } \
+        \
+        static inline struct name * \
+        ht_##name ## _has_slot( \
+                struct __ht_##name *ht, uint##klen ## _t k \
+        ) { \
+            return __ht_##name ## _probe(ht, k, false); \
+        } \
+        \
+        static inline void \
+        ht_##name ## _for_each( \
+            struct __ht_##name *ht, \
+            void (*func)( \
+                uint##klen ## _t key, struct name *val, void *arg \
+            ), \
+            void *arg \
+        ) { \
+            u64 m; \
+            u32 g; \
+            unsigned int j; \
+            \
+            for (g = 0; g < DART_HMAP_GROUPS(bits); g++) { \
+                m = atomic64_read(&ht->group[g].ctrl); \
+                m &= _DART_HMAP_CTRL_MSB; \
+                while (m) { \
+                    j = __ffs64(m) / 8; \
+                    func( \
+                        atomic##klen ## _read(&ht->group[g].key[j]), \
+                        &ht->val[g * DART_HMAP_GROUP_SLOTS + j], \
+                        arg \
+                    ); \
+                    m &= m - 1; \
+                } \
+            } \
+        } \
+        \
+        /* forget every key by clearing every group (the control words and \
+         * the keys, not the values), linear in the size of the table, since \
+         * a claim in a stale group could expose the stale keys to probes */ \
+        static inline void \
+        ht_##name ## _reset(struct __ht_##name *ht) { \
+            memset(ht->group, 0, sizeof(ht->group)); \
+        } \
+
+/* folded tables (only for keys that are kernel addresses)
+ *
+ * - a set packs DART_HMAP_FOLD_WAYS cells into one cache line, a key selects
+ *   its set by its low bits xor-ed with a hash of its high bits, and only the
+ *   high bits are kept in the cell (the tag), which recovers the key exactly
+ *   together with the set index, i.e., the key costs 32 bits instead of 64
+ * - the tag also carries the generation, so that a reset turns every cell
+ *   stale at once, a tag of generation 0 is never valid, it marks a cell
+ *   being claimed (and a zeroed cell)
+ * - a key that finds its set full evicts one of the cells instead of probing
+ *   further (the table reports it via the evicted counter), and two racing
+ *   insertions of one key may claim two cells, lookups settle on the first
+ */
+#define DART_HMAP_FOLD_WAYS         4
+#define DART_HMAP_FOLD_KEY_BITS     47
+#define DART_HMAP_FOLD_GEN_BITS     6
+#define DART_HMAP_FOLD_GEN_MASK     ((1u << DART_HMAP_FOLD_GEN_BITS) - 1)
+#define DART_HMAP_FOLD_KEY_MASK     ((1ull << DART_HMAP_FOLD_KEY_BITS) - 1)
+
+/* the tag of a cell being claimed, no key has zero high bits */
+#define DART_HMAP_FOLD_TAG_BUSY     (1u << DART_HMAP_FOLD_GEN_BITS)
+
+#define DART_HMAP_FOLD_DEFINE(name, bits) \
+        /* typedef */ \
+        typedef struct __ht_##name { \
+            /* bumped on reset, the tags carry it modulo the gen mask */ \
+            u32 gen; \
+            atomic_t evicted; \
+            \
+            struct __htset_##name { \
+                struct __htcell_##name { \
+                    u32 tag; \
+                    struct name val; \
+                } cell[DART_HMAP_FOLD_WAYS]; \
+            } __aligned(64) set[1 << ((bits) - 2)]; \
+        } ht_##name ## _t; \
+        \
+        /* internals */ \
+        static inline u32 \
+        __ht_##name ## _gen(struct __ht_##name *ht) { \
+            return ht->gen % DART_HMAP_FOLD_GEN_MASK + 1; \
+        } \
+        \
+        static inline u32 \
+        __ht_##name ## _fold(u64 k, u32 *tag) { \
+            u64 w = k & DART_HMAP_FOLD_KEY_MASK; \
+            u32 hi = (u32) (w >> ((bits) - 2)); \
+            \
+            /* the high bits and the generation share the tag */ \
+            BUILD_BUG_ON(DART_HMAP_FOLD_KEY_BITS - ((bits) - 2) + \
+                         DART_HMAP_FOLD_GEN_BITS > 32); \
+            *tag = hi << DART_HMAP_FOLD_GEN_BITS; \
+            return ((u32) w & ((1u << ((bits) - 2)) - 1)) ^ \
+                   hash_32(hi, (bits) - 2); \
+        } \
+        \
+        static inline u64 \
+        __ht_##name ## _unfold(u32 s, u32 tag) { \
+            u32 hi = tag >> DART_HMAP_FOLD_GEN_BITS; \
+            u64 w = ((u64) hi << ((bits) - 2)) | \
+                    (s ^ hash_32(hi, (bits) - 2)); \
+            \
+            /* kernel addresses have every bit above the key bits set */ \
+            return w | ~DART_HMAP_FOLD_KEY_MASK; \
+        } \
+        \
+        static inline struct __htcell_##name * \
+        __ht_##name ## _find( \
+                struct __htset_##name *set, u32 tag \
+        ) { \
+            unsigned int j; \
+            \
+            for (j = 0; j < DART_HMAP_FOLD_WAYS; j++) { \
+                if (smp_load_acquire(&set->cell[j].tag) == tag) { \
+                    return &set->cell[j]; \
+                } \
+            } \
+            return NULL; \
+        } \
+        \
+        /* functions */ \
+        static inline struct name * \
+        ht_##name ## _get_slot( \
+                struct __ht_##name *ht, u64 k \
+        ) { \
+            struct __htset_##name *set; \
+            struct __htcell_##name *cell; \
+            u32 tag, old, g; \
+            unsigned int j; \
+            \
+            g = __ht_##name ## _gen(ht); \
+            set = &ht->set[__ht_##name ## _fold(k, &tag)]; \
+            tag |= g; \
+            \
+            while (true) { \
+                /* return an existing slot */ \
+                cell = __ht_##name ## _find(set, tag); \
+                if (cell) { \
+                    return &cell->val; \
+                } \
+                \
+                /* claim a stale cell if there is one, or evict one */ \
+                for (j = 0; j < DART_HMAP_FOLD_WAYS; j++) { \
+                    old = smp_load_acquire(&set->cell[j].tag); \
+                    if ((old & DART_HMAP_FOLD_GEN_MASK) != g && \
+                        old != DART_HMAP_FOLD_TAG_BUSY) { \
+                        break; \
+                    } \
+                } \
+                \
+                if (j == DART_HMAP_FOLD_WAYS) { \
+                    j = (u32) (k ^ (k >> 12)) % DART_HMAP_FOLD_WAYS; \
+                    old = smp_load_acquire(&set->cell[j].tag); \
+                    if (old == DART_HMAP_FOLD_TAG_BUSY) { \
+                        cpu_relax(); \
+                        continue; \
+                    } \
+                    atomic_inc(&ht->evicted); \
+                } \
+                \
+                /* lost the race, the winner may hold our key */ \
+                cell = &set->cell[j]; \
+                if (cmpxchg(&cell->tag, old, \
+                            DART_HMAP_FOLD_TAG_BUSY) != old) { \
+                    continue; \
+                } \
+                \
+                /* the value is from another key or another generation */ \
+                memset(&cell->val, 0, sizeof(struct name)); \
+                smp_store_release(&cell->tag, tag); \
+                return &cell->val; \
+            } \
+        } \
+        \
+        static inline struct name * \
+        ht_##name ## _has_slot( \
+                struct __ht_##name *ht, u64 k \
+        ) { \
+            struct __htcell_##name *cell; \
+            u32 s, tag; \
+            \
+            s = __ht_##name ## _fold(k, &tag); \
+            cell = __ht_##name ## _find( \
+                &ht->set[s], tag | __ht_##name ## _gen(ht) \
+            ); \
+            return cell ? &cell->val : NULL; \
+        } \
+        \
+        static inline void \
+        ht_##name ## _for_each( \
+            struct __ht_##name *ht, \
+            void (*func)(u64 key, struct name *val, void *arg), \
+            void *arg \
+        ) { \
+            u32 s, tag, g; \
+            unsigned int j; \
+            \
+            g = __ht_##name ## _gen(ht); \
+            for (s = 0; s < (1 << ((bits) - 2)); s++) { \
+                for (j = 0; j < DART_HMAP_FOLD_WAYS; j++) { \
+                    tag = smp_load_acquire(&ht->set[s].cell[j].tag); \
+                    if ((tag & DART_HMAP_FOLD_GEN_MASK) != g) { \
+                        continue; \
+                    } \
+                    func( \
+                        __ht_##name ## _unfold(s, tag), \
+                        &ht->set[s].cell[j].val, \
+                        arg \
+                    ); \
+                } \
+            } \
+        } \
+        \
+        static inline void \
+        ht_##name ## _del_range( \
+                struct __ht_##name *ht, u64 lo, u64 hi, u32 step \
+        ) { \
+            struct __htcell_##name *cell; \
+            u32 s, tag, g; \
+            unsigned int j; \
+            u64 k; \
+            \
+            g = __ht_##name ## _gen(ht); \
+            \
+            /* a range wider than the table is cheaper to sweep, as the \
+             * keys can be recovered from the cells */ \
+            if (((hi - lo) >> step) > (1 << (bits))) { \
+                for (s = 0; s < (1 << ((bits) - 2)); s++) { \
+                    for (j = 0; j < DART_HMAP_FOLD_WAYS; j++) { \
+                        cell = &ht->set[s].cell[j]; \
+                        tag = smp_load_acquire(&cell->tag); \
+                        if ((tag & DART_HMAP_FOLD_GEN_MASK) != g) { \
+                            continue; \
+                        } \
+                        k = __ht_##name ## _unfold(s, tag); \
+                        if (k >= lo && k < hi) { \
+                            cmpxchg(&cell->tag, tag, 0); \
+                        } \
+                    } \
+                } \
+                return; \
+            } \
+            \
+            for (k = lo; k < hi; k += (1ul << step)) { \
+                s = __ht_##name ## _fold(k, &tag); \
+                tag |= g; \
+                cell = __ht_##name ## _find(&ht->set[s], tag); \
+                if (cell) { \
+                    cmpxchg(&cell->tag, tag, 0); \
+                } \
+            } \
+        } \
+        \
+        /* forget every key in O(1), unless the generation wraps */ \
+        static inline void \
+        ht_##name ## _reset(struct __ht_##name *ht) { \
+            if (unlikely(++ht->gen % DART_HMAP_FOLD_GEN_MASK == 0)) { \
+                memset(ht->set, 0, sizeof(ht->set)); \
+            } \
+            atomic_set(&ht->evicted, 0); \
+        } \
+
+/* select the table template */
+#if defined(DART_HMAP_SHARDED)
+#define DART_HMAP_SELECT(name, bits, klen, sbits) \
+        DART_HMAP_SHARD_DEFINE(name, bits, klen, sbits)
+#elif defined(DART_HMAP_SWISS)
+#define DART_HMAP_SELECT(name, bits, klen, sbits) \
+        DART_HMAP_SWISS_DEFINE(name, bits, klen)
+#else
+#define DART_HMAP_SELECT(name, bits, klen, sbits) \
+        DART_HMAP_DEFINE(name, bits, klen)
+#endif
 
 #endif /* _DART_HASH_H_ */
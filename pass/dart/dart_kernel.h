@@ -4,6 +4,77 @@
 #define DART_DEBUG
 #define DART_ASSERT
 
+/* define DART_MC_COMPACT to track memory cells per byte in 16 bytes each,
+ * folding the address into the set and tag of the cell and interning the
+ * instruction, which halves the shadow memory but evicts on conflicts */
+
+/* track memory cells per shadow word (instead of per byte) */
+#ifndef DART_MC_COMPACT
+#define DART_SHADOW_WORD
+#endif
+
+/* count data switch holders per cpu (instead of in one global atomic) */
+#define DART_SWITCH_PERCPU
+
+/* cache the control block pointer of each context (task or per-cpu) */
+#define DART_CB_CACHE
+
+/* maintain the per-cpu tracing mask checked by the inline hook guards
+ * (required when the kernel is instrumented with -racer-guard) */
+#define DART_TRACING_GUARD
+
+/* provide the patch table checked by the inline guards of patchable hooks
+ * (required when the kernel is instrumented with -racer-patch) */
+#define DART_HOOK_PATCH
+
+/* use the sharded (deletable, overflowing) tables for async, event, and mc,
+ * alternatively, define DART_HMAP_SWISS (without DART_HMAP_SHARDED) to use
+ * the grouped cache-line layout for them */
+#define DART_HMAP_SHARDED
+
+/* define DART_COV_TREE to keep coverage in two-level maps of up to 2^32
+ * bits (DART_COV_TREE_BITS), a directory of pages over 4 KB leaves taken
+ * lazily from a pool, which the host must be configured for (COV_TREE) */
+
+/* record coverage into instance-local bitmaps and merge them on finish */
+#ifndef DART_COV_TREE
+#define DART_COV_LOCAL
+#endif
+
+/* track the locks held by each context and leave the racing pairs under a
+ * common lock out of the rtrace (the ledger still has everything) */
+#define DART_LOCKSET
+
+/* forget the owners of memory cells when the stack frame or the heap object
+ * covering them goes away, so that a reused address does not alias with its
+ * previous life (requires DART_HMAP_SHARDED, the only deletable tables) */
+#define DART_SHADOW_INVALIDATE
+
+/* keep the tables and buffers across runs instead of allocating (and
+ * zeroing) them on every launch, resetting a table by its generation (in
+ * O(1) for the sharded and folded tables, the flat ones still clear their
+ * claim bitmap and the swiss ones their groups) */
+#define DART_STATE_PERSIST
+
+/* sample the memory accesses per instruction, backing off on the hot ones
+ * (the policy is picked by the host through the rtinfo, full by default) */
+#define DART_SAMPLING
+
+/* define DART_HOOK_STATS to count, per api, where the wraps return and how
+ * many cycles the implementations take, reported in the rtinfo */
+
+/* define DART_RTRACE_DEDUP to keep one rtrace entry (with hit count and
+ * address range) per instruction pair instead of one per hit */
+
+/* define DART_LEDGER_PERCPU to split the ledger into per-cpu chunks with
+ * tsc-stamped entries, which the host merges back into one order */
+
+/* define DART_LEDGER_COMPACT to encode ledger entries with varints, which
+ * the host decodes back into the fixed-size format */
+
+/* define DART_LEDGER_RING to stream the ledger through a ring in the instance
+ * memory, which the host drains into the ledger file while the guest runs */
+
 #ifdef CONFIG_DART_DEVEL
 #define DART_LOGGING
 #endif
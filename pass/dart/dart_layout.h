@@ -0,0 +1,171 @@
+#ifndef _DART_LAYOUT_H_
+#define _DART_LAYOUT_H_
+
+/*
+ * ivshmem layout, shared by the kernel and the initramfs (mirrored in the
+ * host scripts, script/config.py), hence no kernel-only types in here
+ *
+ * |  4 MB | -> header   (region table, written by the host)
+ * |  4 MB | -> cov_cfg_edge   (40 MB each with DART_COV_TREE)
+ * |  4 MB | -> cov_dfg_edge
+ * |  4 MB | -> cov_alias_inst
+ * |240 MB | -> (reserved)     (132 MB with DART_COV_TREE)
+ *
+ * --------- (256 MB) header
+ *
+ * then the instances, each with a user part and a kernel part, the sizes of
+ * which are given by the region table, defaults to:
+ *
+ * |  2 MB | -> metadata (userspace: mount options, etc)
+ * | 48 MB | -> bytecode (userspace: program to interpret)
+ * | 12 MB | -> strace   (userspace: syscall logs)
+ * |  2 MB | -> rtinfo   (kernel   : runtime info)
+ * | 30 MB | -> rtrace   (kernel   : racing access logs)
+ * | 34 MB | -> ledger   (kernel   : ledger ring drained by the host)
+ *
+ * --------- (128 MB) instance
+ */
+
+#define _MB(i) ((i) * (1ul << 20))
+
+#ifdef DART_COV_TREE
+#define IVSHMEM_SIZE_COV                _MB(40)
+#else
+#define IVSHMEM_SIZE_COV                _MB(4)
+#endif
+
+#define IVSHMEM_OFFSET_HEADER           0
+#define IVSHMEM_OFFSET_COV_CFG_EDGE     (IVSHMEM_OFFSET_HEADER + _MB(4))
+#define IVSHMEM_OFFSET_COV_DFG_EDGE     \
+        (IVSHMEM_OFFSET_COV_CFG_EDGE + IVSHMEM_SIZE_COV)
+#define IVSHMEM_OFFSET_COV_ALIAS_INST   \
+        (IVSHMEM_OFFSET_COV_DFG_EDGE + IVSHMEM_SIZE_COV)
+#define IVSHMEM_OFFSET_RESERVED         \
+        (IVSHMEM_OFFSET_COV_ALIAS_INST + IVSHMEM_SIZE_COV)
+#define IVSHMEM_OFFSET_INSTANCES        (IVSHMEM_OFFSET_HEADER + _MB(256))
+
+#define IVSHMEM_SHARED                  IVSHMEM_OFFSET_RESERVED
+
+/* the default layout, used when the host gives no valid table */
+#define INSTMEM_OFFSET_USER             0
+#define INSTMEM_OFFSET_METADATA         0
+#define INSTMEM_OFFSET_BYTECODE         (INSTMEM_OFFSET_METADATA + _MB(2))
+#define INSTMEM_OFFSET_STRACE           (INSTMEM_OFFSET_BYTECODE + _MB(48))
+#define INSTMEM_SIZE_USER               (INSTMEM_OFFSET_STRACE + _MB(12))
+
+#define INSTMEM_OFFSET_KERN             (INSTMEM_OFFSET_USER + INSTMEM_SIZE_USER)
+#define INSTMEM_OFFSET_RTINFO           0
+#define INSTMEM_OFFSET_RTRACE           (INSTMEM_OFFSET_RTINFO + _MB(2))
+#define INSTMEM_OFFSET_LEDGER           (INSTMEM_OFFSET_RTRACE + _MB(30))
+#define INSTMEM_SIZE_KERN               (INSTMEM_OFFSET_LEDGER + _MB(34))
+
+#define INSTMEM_SIZE                    (INSTMEM_SIZE_USER + INSTMEM_SIZE_KERN)
+
+/* the initramfs maps the user part here, so that the host can relocate the
+ * pointers in the bytecode heap ahead of time */
+#define INSTMEM_USER_VADDR              0x200000000000ul
+
+/* region table */
+#define IVSHMEM_TABLE_MAGIC             0x454c424154524352ul /* RCRTABLE */
+#define IVSHMEM_TABLE_VERSION           1
+#define IVSHMEM_TABLE_ALIGN             4096ul
+
+enum instmem_region {
+    /* user part, the metadata always leads */
+    INSTMEM_REGION_METADATA = 0,
+    INSTMEM_REGION_BYTECODE,
+    INSTMEM_REGION_STRACE,
+    /* kernel part */
+    INSTMEM_REGION_RTINFO,
+    INSTMEM_REGION_RTRACE,
+    INSTMEM_REGION_LEDGER,
+    INSTMEM_REGION_NUM,
+};
+
+/* the offset is relative to the part (user or kernel) holding the region */
+struct instmem_region_desc {
+    unsigned long offset;
+    unsigned long size;
+};
+
+struct ivshmem_table {
+    unsigned long magic;
+    unsigned long version;
+    unsigned long instmem_base;     /* offset of the first instance */
+    unsigned long instmem_size;     /* stride between instances */
+    unsigned long user_size;        /* the user part leads */
+    unsigned long kern_size;        /* the kernel part follows */
+    struct instmem_region_desc regions[INSTMEM_REGION_NUM];
+};
+
+static inline void ivshmem_table_default(struct ivshmem_table *table) {
+    table->magic = IVSHMEM_TABLE_MAGIC;
+    table->version = IVSHMEM_TABLE_VERSION;
+    table->instmem_base = IVSHMEM_OFFSET_INSTANCES;
+    table->instmem_size = INSTMEM_SIZE;
+    table->user_size = INSTMEM_SIZE_USER;
+    table->kern_size = INSTMEM_SIZE_KERN;
+
+    table->regions[INSTMEM_REGION_METADATA].offset = INSTMEM_OFFSET_METADATA;
+    table->regions[INSTMEM_REGION_METADATA].size =
+            INSTMEM_OFFSET_BYTECODE - INSTMEM_OFFSET_METADATA;
+    table->regions[INSTMEM_REGION_BYTECODE].offset = INSTMEM_OFFSET_BYTECODE;
+    table->regions[INSTMEM_REGION_BYTECODE].size =
+            INSTMEM_OFFSET_STRACE - INSTMEM_OFFSET_BYTECODE;
+    table->regions[INSTMEM_REGION_STRACE].offset = INSTMEM_OFFSET_STRACE;
+    table->regions[INSTMEM_REGION_STRACE].size =
+            INSTMEM_SIZE_USER - INSTMEM_OFFSET_STRACE;
+
+    table->regions[INSTMEM_REGION_RTINFO].offset = INSTMEM_OFFSET_RTINFO;
+    table->regions[INSTMEM_REGION_RTINFO].size =
+            INSTMEM_OFFSET_RTRACE - INSTMEM_OFFSET_RTINFO;
+    table->regions[INSTMEM_REGION_RTRACE].offset = INSTMEM_OFFSET_RTRACE;
+    table->regions[INSTMEM_REGION_RTRACE].size =
+            INSTMEM_OFFSET_LEDGER - INSTMEM_OFFSET_RTRACE;
+    table->regions[INSTMEM_REGION_LEDGER].offset = INSTMEM_OFFSET_LEDGER;
+    table->regions[INSTMEM_REGION_LEDGER].size =
+            INSTMEM_SIZE_KERN - INSTMEM_OFFSET_LEDGER;
+}
+
+/* validate a table given by the host, every region must fit in its part */
+static inline int ivshmem_table_check(const struct ivshmem_table *table) {
+    int i;
+    unsigned long bound;
+
+    if (table->magic != IVSHMEM_TABLE_MAGIC ||
+        table->version != IVSHMEM_TABLE_VERSION) {
+        return 0;
+    }
+
+    if (table->instmem_base < IVSHMEM_OFFSET_INSTANCES ||
+        table->user_size + table->kern_size > table->instmem_size) {
+        return 0;
+    }
+
+    /* the parts are mapped on their own */
+    if ((table->instmem_base | table->instmem_size |
+         table->user_size | table->kern_size) & (IVSHMEM_TABLE_ALIGN - 1)) {
+        return 0;
+    }
+
+    if (table->regions[INSTMEM_REGION_METADATA].offset != 0) {
+        return 0;
+    }
+
+    for (i = 0; i < INSTMEM_REGION_NUM; i++) {
+        bound = i < INSTMEM_REGION_RTINFO ?
+                table->user_size : table->kern_size;
+
+        if (table->regions[i].offset > bound ||
+            table->regions[i].size > bound - table->regions[i].offset) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+#define IVSHMEM_TABLE_INSTMEM(table, i) \
+        ((table)->instmem_base + (table)->instmem_size * (i))
+
+#endif /* _DART_LAYOUT_H_ */
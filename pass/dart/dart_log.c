@@ -1,4 +1,13 @@
 #include "dart.h"
 
 struct dart_ledger *g_ledger = NULL;
-struct dart_reserve_ledger *g_reserve_ledger = NULL;
\ No newline at end of file
+struct dart_reserve_ledger *g_reserve_ledger = NULL;
+
+#ifdef DART_LEDGER_COMPACT
+struct __ht_dart_ledger_ptid *g_ledger_ptid_ht = NULL;
+atomic_t g_ledger_ptid_count = ATOMIC_INIT(0);
+#endif
+
+#ifdef DART_LEDGER_PERCPU
+DEFINE_PER_CPU(struct dart_ledger_segment, g_ledger_segment);
+#endif
@@ -2,6 +2,20 @@
 #define _DART_LOG_H_
 
 #include "dart_common.h"
+#include "dart_hash.h"
+
+#if defined(DART_LEDGER_PERCPU) && defined(DART_LEDGER_COMPACT)
+#error "compact entries need a single ledger order to be decoded"
+#endif
+
+#if defined(DART_LEDGER_PERCPU) && defined(DART_LEDGER_RING)
+#error "the ledger ring is drained by the host in a single order"
+#endif
+
+#ifdef DART_LEDGER_PERCPU
+#include <linux/percpu.h>
+#include <asm/msr.h>
+#endif
 
 /* ledger */
 #define LEDGER_SIZE _MB(256)
@@ -9,11 +23,43 @@
 #define RESERVE_LEDGER_SIZE (IVSHMEM_OFFSET_INSTANCES - IVSHMEM_OFFSET_RESERVED)
 
 /* structs */
+#ifdef DART_LEDGER_RING
+/* ledger ring
+ *
+ * the ledger lives in the instance memory instead of the guest heap, entries
+ * are reserved with the cursor and copied into a ring of fixed-size chunks,
+ * and the writers account the bytes they have copied in per-chunk counters
+ *
+ * the host drains a chunk into the ledger file once its counter reaches the
+ * chunk size, resets the counter, and advances the drained mark, writers
+ * that would overrun the ring spin until the host catches up
+ *
+ * on finish, the guest publishes the ledger file header and marks the ring
+ * closed, upon which the host drains the rest and writes out the header
+ */
+#define LEDGER_RING_HEAD_SIZE           4096
+#define LEDGER_RING_SIZE                _MB(32)
+#define LEDGER_RING_CHUNK_SIZE          (64 * 1024)
+#define LEDGER_RING_CHUNK_NUM \
+        (LEDGER_RING_SIZE / LEDGER_RING_CHUNK_SIZE)
+#define LEDGER_RING_ENTRY_MAX           128
+
+struct dart_ledger {
+    atomic64_t count;     /* number of entries in the ledger */
+    atomic64_t cursor;    /* bytes reserved by the guest */
+    atomic64_t drained;   /* bytes drained by the host */
+    atomic64_t length;    /* length in the ledger file header */
+    atomic64_t closed;    /* set when no more entries will be logged */
+    atomic_t commit[LEDGER_RING_CHUNK_NUM];     /* bytes copied per chunk */
+    char buffer[0] __aligned(LEDGER_RING_HEAD_SIZE);
+};
+#else
 struct dart_ledger {
     atomic64_t count;     /* number of entries in the ledger */
     atomic64_t cursor;    /* current offset into the buffer */
     char buffer[0];     /* buffer of unlimited size */
 };
+#endif
 
 struct dart_reserve_ledger {
     atomic64_t cursor;
@@ -24,8 +70,216 @@ struct dart_reserve_ledger {
 extern struct dart_ledger *g_ledger;
 extern struct dart_reserve_ledger *g_reserve_ledger;
 
+#ifdef DART_LEDGER_PERCPU
+/* segmented ledger
+ *
+ * the buffer is carved into fixed-size chunks that are handed out to cpus on
+ * demand (the only global atomic), each cpu appends to its own chunk with irqs
+ * disabled, and every entry is prefixed with a tsc stamp so that the host can
+ * merge the chunks back into one order
+ *
+ * the length in the ledger file header is tagged with LEDGER_FLAG_SEGMENTED
+ */
+#define LEDGER_CHUNK_SIZE _MB(1)
+#define LEDGER_CHUNK_NUM \
+        ((LEDGER_SIZE - sizeof(struct dart_ledger)) / LEDGER_CHUNK_SIZE)
+#define LEDGER_FLAG_SEGMENTED (1ul << 63)
+
+struct dart_ledger_chunk {
+    u32 cpu;            /* cpu that owns the chunk */
+    u32 used;           /* bytes of entries in the chunk */
+    u64 count;          /* number of entries in the chunk */
+    char buffer[0];
+};
+
+struct dart_ledger_segment {
+    struct dart_ledger_chunk *chunk;
+};
+
+DECLARE_PER_CPU(struct dart_ledger_segment, g_ledger_segment);
+
+static inline void dart_ledger_init(struct dart_ledger *ledger) {
+    int cpu;
+
+    atomic64_set(&ledger->count, 0);
+    atomic64_set(&ledger->cursor, 0);
+
+    for_each_possible_cpu(cpu) {
+        per_cpu_ptr(&g_ledger_segment, cpu)->chunk = NULL;
+    }
+}
+
+static inline size_t dart_ledger_chunks(struct dart_ledger *ledger) {
+    return min_t(size_t,
+                 atomic64_read(&ledger->cursor) / LEDGER_CHUNK_SIZE,
+                 LEDGER_CHUNK_NUM);
+}
+
+static inline s64 dart_ledger_count(struct dart_ledger *ledger) {
+    struct dart_ledger_chunk *chunk;
+    size_t i, n;
+    s64 count;
+
+    count = 0;
+    n = dart_ledger_chunks(ledger);
+    for (i = 0; i < n; i++) {
+        chunk = (struct dart_ledger_chunk *)
+                (ledger->buffer + i * LEDGER_CHUNK_SIZE);
+        count += chunk->count;
+    }
+    return count;
+}
+
+static inline s64 dart_ledger_length(struct dart_ledger *ledger) {
+    return dart_ledger_chunks(ledger) * LEDGER_CHUNK_SIZE;
+}
+
+static inline s64 dart_ledger_header_length(struct dart_ledger *ledger) {
+    return dart_ledger_length(ledger) | LEDGER_FLAG_SEGMENTED;
+}
+
 /* ledger manipulations */
 static inline char *
+dart_ledger_next_entry(struct dart_ledger *ledger, size_t size) {
+    struct dart_ledger_segment *seg;
+    struct dart_ledger_chunk *chunk;
+    unsigned long flags;
+    size_t offset;
+    char *entry;
+
+    /* make room for the stamp */
+    size += sizeof(u64);
+    entry = NULL;
+
+    local_irq_save(flags);
+    seg = this_cpu_ptr(&g_ledger_segment);
+    chunk = seg->chunk;
+
+    /* move to a new chunk when the entry does not fit into the current one */
+    if (unlikely(!chunk ||
+                 sizeof(struct dart_ledger_chunk) + chunk->used + size >
+                 LEDGER_CHUNK_SIZE)) {
+        offset = atomic64_fetch_add(LEDGER_CHUNK_SIZE, &ledger->cursor);
+
+        /* check if ledger may overflow */
+        if (offset / LEDGER_CHUNK_SIZE >= LEDGER_CHUNK_NUM) {
+            goto out;
+        }
+
+        chunk = (struct dart_ledger_chunk *) (ledger->buffer + offset);
+        chunk->cpu = smp_processor_id();
+        chunk->used = 0;
+        chunk->count = 0;
+        seg->chunk = chunk;
+    }
+
+    /* reserve the entry and stamp it while still on this cpu */
+    entry = chunk->buffer + chunk->used;
+    chunk->used += size;
+    chunk->count += 1;
+
+    *(u64 *) entry = rdtsc_ordered();
+    entry += sizeof(u64);
+
+out:
+    local_irq_restore(flags);
+    return entry;
+}
+#elif defined(DART_LEDGER_RING)
+static inline void dart_ledger_init(struct dart_ledger *ledger) {
+    size_t i;
+
+    atomic64_set(&ledger->count, 0);
+    atomic64_set(&ledger->cursor, 0);
+    atomic64_set(&ledger->drained, 0);
+    atomic64_set(&ledger->length, 0);
+    atomic64_set(&ledger->closed, 0);
+
+    for (i = 0; i < LEDGER_RING_CHUNK_NUM; i++) {
+        atomic_set(&ledger->commit[i], 0);
+    }
+}
+#else
+static inline void dart_ledger_init(struct dart_ledger *ledger) {
+    atomic64_set(&ledger->count, 0);
+    atomic64_set(&ledger->cursor, 0);
+}
+#endif
+
+#ifndef DART_LEDGER_PERCPU
+
+static inline s64 dart_ledger_count(struct dart_ledger *ledger) {
+    return atomic64_read(&ledger->count);
+}
+
+static inline s64 dart_ledger_length(struct dart_ledger *ledger) {
+    return atomic64_read(&ledger->cursor);
+}
+
+#ifdef DART_LEDGER_COMPACT
+#define LEDGER_FLAG_COMPACT (1ul << 62)
+
+static inline s64 dart_ledger_header_length(struct dart_ledger *ledger) {
+    return dart_ledger_length(ledger) | LEDGER_FLAG_COMPACT;
+}
+#else
+static inline s64 dart_ledger_header_length(struct dart_ledger *ledger) {
+    return dart_ledger_length(ledger);
+}
+#endif
+
+/* ledger manipulations */
+#ifdef DART_LEDGER_RING
+static inline void dart_ledger_push(
+        struct dart_ledger *ledger, const char *buf, size_t size
+) {
+    unsigned long flags;
+    size_t offset, pos, part;
+
+    /*
+     * irqs are disabled to not be preempted by a handler that logs on this
+     * cpu while holding a reservation the drain is waiting for
+     */
+    local_irq_save(flags);
+
+    atomic64_inc(&ledger->count);
+    offset = atomic64_fetch_add((int) size, &ledger->cursor);
+
+    /* wait for the host to make room */
+    while (offset + size - atomic64_read(&ledger->drained) >
+           LEDGER_RING_SIZE) {
+        cpu_relax();
+    }
+
+    /* copy chunk by chunk (which also handles the wrap-around) */
+    while (size) {
+        pos = offset & (LEDGER_RING_SIZE - 1);
+        part = LEDGER_RING_CHUNK_SIZE - (pos & (LEDGER_RING_CHUNK_SIZE - 1));
+        part = min_t(size_t, size, part);
+
+        memcpy(ledger->buffer + pos, buf, part);
+
+        /* the content must be visible before the host sees the commit */
+        smp_wmb();
+        atomic_add((int) part, &ledger->commit[pos / LEDGER_RING_CHUNK_SIZE]);
+
+        buf += part;
+        offset += part;
+        size -= part;
+    }
+
+    local_irq_restore(flags);
+}
+
+static inline void dart_ledger_close(struct dart_ledger *ledger) {
+    atomic64_set(&ledger->length, dart_ledger_header_length(ledger));
+
+    /* the header must be visible before the host sees the close */
+    smp_wmb();
+    atomic64_set(&ledger->closed, 1);
+}
+#else
+static inline char *
 dart_ledger_next_entry(struct dart_ledger *ledger, size_t size) {
     size_t offset;
 
@@ -39,7 +293,125 @@ dart_ledger_next_entry(struct dart_ledger *ledger, size_t size) {
 
     return ledger->buffer + offset;
 }
+#endif
+#endif /* DART_LEDGER_PERCPU */
+
+#ifndef DART_LEDGER_RING
+static inline void dart_ledger_push(
+        struct dart_ledger *ledger, const char *buf, size_t size
+) {
+    char *entry;
+
+    entry = dart_ledger_next_entry(ledger, size);
+    if (entry) {
+        /* log only when there is enough space */
+        memcpy(entry, buf, size);
+    }
+}
+#endif
+
+#ifdef DART_LEDGER_COMPACT
+/* compact ledger
+ *
+ * each entry is encoded as
+ *
+ *   flags (u8) | code (u8) | ptid index (varint) | [ptid (varint)] |
+ *   [info (varint)] | [hval (varint zigzag delta | raw u64)] |
+ *   args (varint zigzag) ...
+ *
+ * - ptids are replaced with a per-run index, the first entry of a ptid
+ *   carries the ptid itself (LEDGER_COMPACT_NEW_PTID)
+ * - info is omitted when it is zero (LEDGER_COMPACT_ZERO_INFO)
+ * - hval is coded against the last hval of the same ptid, which is safe as a
+ *   ptid is never logging concurrently with itself
+ */
+#define LEDGER_COMPACT_ENTRY_MAX        64
 
+#define LEDGER_COMPACT_NEW_PTID         (1u << 0)
+#define LEDGER_COMPACT_ZERO_INFO        (1u << 1)
+#define LEDGER_COMPACT_HVAL_SAME        (0u << 2)
+#define LEDGER_COMPACT_HVAL_DELTA       (1u << 2)
+#define LEDGER_COMPACT_HVAL_RAW         (2u << 2)
+
+/* deltas that would take more than 7 varint bytes are stored raw */
+#define LEDGER_COMPACT_DELTA_LIMIT      (1ull << 49)
+
+struct dart_ledger_ptid {
+    u32 idx;
+    hval_64_t hval;
+};
+
+DART_HMAP_DEFINE(dart_ledger_ptid, 16, 32);
+extern struct __ht_dart_ledger_ptid *g_ledger_ptid_ht;
+extern atomic_t g_ledger_ptid_count;
+
+static inline u64 dart_zigzag(s64 v) {
+    return ((u64) v << 1) ^ (u64) (v >> 63);
+}
+
+static inline char *dart_varint_put(char *buf, u64 v) {
+    while (v >= 0x80) {
+        *buf++ = (char) (v | 0x80);
+        v >>= 7;
+    }
+    *buf++ = (char) v;
+    return buf;
+}
+
+static inline char *dart_ledger_compact_head(
+        char *buf, int code, ptid_32_t ptid, info_64_t info, hval_64_t hval
+) {
+    struct dart_ledger_ptid *slot;
+    u8 *flags;
+    u64 delta;
+
+    flags = (u8 *) buf++;
+    *flags = 0;
+    *buf++ = (char) code;
+
+    /* ptid (shifted by one as zero keys mark empty cells) */
+    slot = ht_dart_ledger_ptid_get_slot(g_ledger_ptid_ht, ptid + 1);
+    if (unlikely(!slot->idx)) {
+        slot->idx = atomic_inc_return(&g_ledger_ptid_count);
+        *flags |= LEDGER_COMPACT_NEW_PTID;
+    }
+    buf = dart_varint_put(buf, slot->idx);
+    if (unlikely(*flags & LEDGER_COMPACT_NEW_PTID)) {
+        buf = dart_varint_put(buf, ptid);
+    }
+
+    /* info */
+    if (!info) {
+        *flags |= LEDGER_COMPACT_ZERO_INFO;
+    } else {
+        buf = dart_varint_put(buf, info);
+    }
+
+    /* hval */
+    if (hval != slot->hval) {
+        delta = dart_zigzag((s64) (hval - slot->hval));
+        if (delta < LEDGER_COMPACT_DELTA_LIMIT) {
+            *flags |= LEDGER_COMPACT_HVAL_DELTA;
+            buf = dart_varint_put(buf, delta);
+        } else {
+            *flags |= LEDGER_COMPACT_HVAL_RAW;
+            memcpy(buf, &hval, sizeof(hval_64_t));
+            buf += sizeof(hval_64_t);
+        }
+        slot->hval = hval;
+    }
+
+    return buf;
+}
+#endif
+
+#ifdef DART_LEDGER_RING
+static inline void dart_ledger_transfer_ro_reserve(
+        struct dart_ledger *ledger, struct dart_reserve_ledger *reserve
+) {
+    /* the ledger is already in the instance memory and the host drains it */
+}
+#else
 static inline void dart_ledger_transfer_ro_reserve(
         struct dart_ledger *ledger, struct dart_reserve_ledger *reserve
 ) {
@@ -47,7 +419,7 @@ static inline void dart_ledger_transfer_ro_reserve(
     char *cursor;
 
     /* find the cursor */
-    length = atomic64_read(&ledger->cursor);
+    length = dart_ledger_length(ledger);
     chunks = length + 8 + sizeof(struct dart_ledger);
     offset = atomic64_fetch_add(chunks, &reserve->cursor);
 
@@ -60,12 +432,15 @@ static inline void dart_ledger_transfer_ro_reserve(
     (*(long *) cursor) = dart_iseq;
     cursor += sizeof(long);
 
-    /* put the dart_ledger header there */
-    memcpy(cursor, ledger, sizeof(struct dart_ledger));
-    cursor += sizeof(struct dart_ledger);
+    /* put the dart_ledger header there (same as in the ledger file) */
+    (*(s64 *) cursor) = dart_ledger_count(ledger);
+    cursor += sizeof(s64);
+    (*(s64 *) cursor) = dart_ledger_header_length(ledger);
+    cursor += sizeof(s64);
 
     /* copy the content */
     memcpy(cursor, ledger->buffer, length);
 }
+#endif
 
 #endif /* _DART_LOG_H_ */
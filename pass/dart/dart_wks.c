@@ -1,10 +1,33 @@
 #include "dart.h"
 
 /* shared info */
-unsigned long *g_cov_cfg_edge = NULL;
-unsigned long *g_cov_dfg_edge = NULL;
-unsigned long *g_cov_alias_inst = NULL;
+dart_cov_map_t *g_cov_cfg_edge = NULL;
+dart_cov_map_t *g_cov_dfg_edge = NULL;
+dart_cov_map_t *g_cov_alias_inst = NULL;
+
+#ifdef DART_COV_LOCAL
+unsigned long *g_cov_cfg_edge_local = NULL;
+unsigned long *g_cov_dfg_edge_local = NULL;
+unsigned long *g_cov_alias_inst_local = NULL;
+#endif
 
 /* private info */
 struct dart_rtinfo *g_rtinfo = NULL;
-struct dart_rtrace *g_rtrace = NULL;
\ No newline at end of file
+struct dart_cov_delta *g_cov_delta = NULL;
+struct dart_rtrace *g_rtrace = NULL;
+unsigned long g_rtrace_entry_max = 0;
+
+#ifdef DART_RTRACE_DEDUP
+u32 *g_rtrace_index = NULL;
+#endif
+
+#ifdef DART_SAMPLING
+DEFINE_PER_CPU(struct dart_sampling, g_dart_sampling);
+
+u32 g_dart_sampling_period_max = 1;
+u32 g_dart_sampling_burst = DART_SAMPLING_BURST;
+#endif
+
+#ifdef DART_HOOK_STATS
+DEFINE_PER_CPU(struct dart_hook_stats, g_dart_hook_stats);
+#endif
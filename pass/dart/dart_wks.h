@@ -4,19 +4,118 @@
 #include "dart_common.h"
 #include "dart_hash.h"
 
+#if defined(DART_SAMPLING) || defined(DART_HOOK_STATS)
+#include <linux/percpu.h>
+#endif
+
+#ifdef DART_HOOK_STATS
+#include <linux/timex.h>
+#endif
+
 /* shared info */
-#define _COV_CFG_EDGE_BITS          (1 << 24)
-extern unsigned long *g_cov_cfg_edge;
+#ifdef DART_COV_TREE
+/*
+ * two-level coverage
+ *
+ * an index is split into a page (the high bits) and a bit in the 4 KB leaf
+ * of the page (the low bits), the directory maps each page to a leaf taken
+ * from the pool that follows it on first touch, so a map only occupies as
+ * much shared memory as the pages touched
+ *
+ * the maps are shared by all instances and persist across runs, the host
+ * writes the header and the kernel never frees a leaf, a page is claimed
+ * with a single cmpxchg on its directory slot (with the leaf taken from the
+ * pool beforehand, wasted if another claim wins), so that a vm killed at
+ * any point leaves no page behind for the others to wait on
+ */
+#ifndef DART_COV_TREE_BITS
+#define DART_COV_TREE_BITS          28
+#endif
 
-#define _COV_DFG_EDGE_BITS          (1 << 24)
-extern unsigned long *g_cov_dfg_edge;
+#define DART_COV_LEAF_SHIFT         15
+#define DART_COV_LEAF_BITS          (1ul << DART_COV_LEAF_SHIFT)
+#define DART_COV_LEAF_SIZE          (DART_COV_LEAF_BITS / 8)
+
+#define DART_COV_TREE_PAGES \
+        (1ul << (DART_COV_TREE_BITS - DART_COV_LEAF_SHIFT))
+#define DART_COV_TREE_MAGIC         0x45455254564f4352ul /* RCOVTREE */
+#define DART_COV_TREE_FULL          ((u32) -1)
+
+struct dart_cov_tree {
+    u64 magic;
+    u64 bits;               /* width of the index */
+    atomic64_t leaves;      /* leaves taken (or wasted), may overshoot */
+    atomic64_t dropped;     /* pages left out as the pool ran out */
+    u32 dir[DART_COV_TREE_PAGES];   /* leaf + 1 of each page, 0 if none */
+};
+
+#define DART_COV_TREE_HEAD \
+        ALIGN(sizeof(struct dart_cov_tree), DART_COV_LEAF_SIZE)
+#define DART_COV_TREE_POOL \
+        ((IVSHMEM_SIZE_COV - DART_COV_TREE_HEAD) / DART_COV_LEAF_SIZE)
+
+typedef struct dart_cov_tree dart_cov_map_t;
+typedef u32 cov_index_t;
 
+static inline cov_index_t cov_hash_chain(u64 n, u64 m) {
+    return (cov_index_t) hash_64(n * GOLDEN_RATIO_64 ^ m, DART_COV_TREE_BITS);
+}
+#else
+#define _COV_CFG_EDGE_BITS          (1 << 24)
+#define _COV_DFG_EDGE_BITS          (1 << 24)
 #define _COV_ALIAS_INST_BITS        (1 << 24)
-extern unsigned long *g_cov_alias_inst;
 
-#define _RTRACE_ENTRY_MAX           (14 * (1 << 20) / (4 * sizeof(u64)))
+typedef unsigned long dart_cov_map_t;
+typedef hash24_t cov_index_t;
+
+#define cov_hash_chain              hash_u64_into_h24_chain
+#endif
+
+extern dart_cov_map_t *g_cov_cfg_edge;
+extern dart_cov_map_t *g_cov_dfg_edge;
+extern dart_cov_map_t *g_cov_alias_inst;
+
+/*
+ * coverage delta
+ *
+ * every bit new to the shared maps is also appended, tagged with its map,
+ * to a list at a fixed offset of the rtinfo region, so that the host learns
+ * what an execution covered without looking at the maps
+ */
+enum dart_cov_kind {
+    DART_COV_CFG_EDGE = 0,
+    DART_COV_DFG_EDGE,
+    DART_COV_ALIAS_INST,
+};
+
+#define DART_COV_DELTA_OFFSET       (1ul << 20)
+#define DART_COV_DELTA_SIZE         (1ul << 20)
+#define DART_COV_DELTA_MAX \
+        ((DART_COV_DELTA_SIZE - sizeof(struct dart_cov_delta)) / sizeof(u64))
+
+struct dart_cov_delta {
+    atomic64_t count;       /* number of new bits, may overshoot the max */
+    u64 entries[0];         /* kind << 32 | index */
+};
+
+extern struct dart_cov_delta *g_cov_delta;
+
+#ifndef DART_RTRACE_DEDUP
+#define _RTRACE_ENTRY_SIZE          (4 * sizeof(u64))
+#define _RTRACE_ENTRY_MAX           (14 * (1 << 20) / _RTRACE_ENTRY_SIZE)
+#endif
 
 /* private info */
+#define DART_HOOK_HIST_BINS         32
+
+struct dart_hook_stat {
+    u64 calls;      /* calls into the implementation */
+    u64 ignored;    /* exits without a control block */
+    u64 untraced;   /* exits as the context is not tracing */
+    u64 paused;     /* exits as the context is paused */
+    u64 cycles[DART_HOOK_HIST_BINS];    /* log2 of the cycles per call */
+};
+
 struct dart_rtinfo {
     /* states */
     atomic64_t has_proper_exit;
@@ -26,34 +125,557 @@ struct dart_rtinfo {
     atomic64_t cov_cfg_edge_incr;
     atomic64_t cov_dfg_edge_incr;
     atomic64_t cov_alias_inst_incr;
+
+    /* sampling policy (set by the host) */
+    atomic64_t sampling_period_max;
+    atomic64_t sampling_burst;
+
+    /* memory accesses hooked and traced, i.e., the effective rate */
+    atomic64_t mem_access_seen;
+    atomic64_t mem_access_traced;
+
+    /* per-api hook stats, all zeros without DART_HOOK_STATS */
+    atomic64_t hook_stats_num;
+    struct dart_hook_stat hook_stats[DART_API_END_OF_ENUM];
+};
+
+#ifdef DART_RTRACE_DEDUP
+/*
+ * deduplicated rtrace
+ *
+ * one entry per (from, into) pair, recording the number of hits and the
+ * range of addresses hit, entries are appended densely into the rtrace
+ * region and located through a private open-addressing index of entry ids
+ *
+ * the count is tagged with RTRACE_FLAG_DEDUP for the host to tell formats
+ */
+#define RTRACE_FLAG_DEDUP           (1ul << 63)
+
+#define RTRACE_DEDUP_BITS           20
+#define RTRACE_DEDUP_SLOTS          (1 << RTRACE_DEDUP_BITS)
+#define RTRACE_DEDUP_PROBE          16
+#define RTRACE_DEDUP_BUSY           ((u32) -1)
+#define RTRACE_DEDUP_FULL           ((u32) -2)
+
+struct dart_rtrace_entry {
+    hval_64_t from;
+    hval_64_t into;
+    atomic64_t addr_lo;     /* lowest address hit */
+    atomic64_t addr_hi;     /* highest address hit (exclusive) */
+    atomic64_t hits;        /* number of hits */
+};
+
+#define _RTRACE_ENTRY_SIZE          sizeof(struct dart_rtrace_entry)
+#define _RTRACE_ENTRY_MAX           (28 * (1 << 20) / _RTRACE_ENTRY_SIZE)
+
+struct dart_rtrace {
+    atomic64_t count;       /* number of entries in the rtrace (tagged) */
+    atomic64_t dropped;     /* number of hits without an entry */
+    struct dart_rtrace_entry entries[0];
 };
 
+extern u32 *g_rtrace_index;
+#else
 struct dart_rtrace {
     atomic64_t count;       /* number of entries in the rtrace */
     u64 buffer[0];          /* buffer of unlimited size */
 };
+#endif
 
 extern struct dart_rtinfo *g_rtinfo;
 extern struct dart_rtrace *g_rtrace;
 
+/* capped by the size of the rtrace region */
+extern unsigned long g_rtrace_entry_max;
+
+#ifdef DART_SAMPLING
+/*
+ * adaptive sampling (in the style of LiteRace)
+ *
+ * every instruction starts fully traced, and after each burst of traced
+ * hits, the period between two traced hits doubles until it reaches the
+ * maximum given by the host, so rarely executed code stays fully traced
+ * while hot code is traced at a low rate
+ *
+ * instructions are tracked per cpu in a small direct-mapped table, where a
+ * collision merely shares the period, so no atomics are involved
+ */
+#define DART_SAMPLING_BITS          12
+#define DART_SAMPLING_SLOTS         (1 << DART_SAMPLING_BITS)
+#define DART_SAMPLING_BURST         64
+
+struct dart_sampling_slot {
+    u32 skip;
+    u32 period;
+    u32 burst;
+};
+
+struct dart_sampling {
+    struct dart_sampling_slot slot[DART_SAMPLING_SLOTS];
+    u64 seen;
+    u64 traced;
+};
+
+DECLARE_PER_CPU(struct dart_sampling, g_dart_sampling);
+
+/* period 1 means full tracing */
+extern u32 g_dart_sampling_period_max;
+extern u32 g_dart_sampling_burst;
+
+static inline bool dart_sampling_hit(hval_64_t hval) {
+    struct dart_sampling *ds;
+    struct dart_sampling_slot *slot;
+    bool hit;
+
+    ds = get_cpu_ptr(&g_dart_sampling);
+    ds->seen++;
+
+    if (likely(g_dart_sampling_period_max <= 1)) {
+        hit = true;
+        goto out;
+    }
+
+    slot = &ds->slot[hash_64(hval, DART_SAMPLING_BITS)];
+    if (slot->skip) {
+        slot->skip--;
+        hit = false;
+        goto out;
+    }
+
+    /* back off once the burst at this period is done */
+    hit = true;
+    if (!slot->period) {
+        slot->period = 1;
+    }
+    if (++slot->burst >= g_dart_sampling_burst &&
+        slot->period < g_dart_sampling_period_max) {
+        slot->period = min_t(u32, slot->period << 1,
+                             g_dart_sampling_period_max);
+        slot->burst = 0;
+    }
+    slot->skip = slot->period - 1;
+
+out:
+    if (hit) {
+        ds->traced++;
+    }
+    put_cpu_ptr(&g_dart_sampling);
+    return hit;
+}
+
+/* pick up the policy from the host and start afresh */
+static inline void dart_sampling_init(struct dart_rtinfo *rtinfo) {
+    int cpu;
+
+    g_dart_sampling_period_max =
+            (u32) min_t(s64, atomic64_read(&rtinfo->sampling_period_max),
+                        U32_MAX);
+    g_dart_sampling_burst =
+            (u32) min_t(s64, atomic64_read(&rtinfo->sampling_burst),
+                        U32_MAX);
+    if (!g_dart_sampling_burst) {
+        g_dart_sampling_burst = DART_SAMPLING_BURST;
+    }
+
+    for_each_possible_cpu(cpu) {
+        memset(per_cpu_ptr(&g_dart_sampling, cpu), 0,
+               sizeof(struct dart_sampling));
+    }
+
+    atomic64_set(&rtinfo->mem_access_seen, 0);
+    atomic64_set(&rtinfo->mem_access_traced, 0);
+}
+
+static inline void dart_sampling_fini(struct dart_rtinfo *rtinfo) {
+    struct dart_sampling *ds;
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        ds = per_cpu_ptr(&g_dart_sampling, cpu);
+        atomic64_add(ds->seen, &rtinfo->mem_access_seen);
+        atomic64_add(ds->traced, &rtinfo->mem_access_traced);
+    }
+}
+#else
+static inline bool dart_sampling_hit(hval_64_t hval) {
+    return true;
+}
+
+static inline void dart_sampling_init(struct dart_rtinfo *rtinfo) {
+    atomic64_set(&rtinfo->mem_access_seen, 0);
+    atomic64_set(&rtinfo->mem_access_traced, 0);
+}
+
+static inline void dart_sampling_fini(struct dart_rtinfo *rtinfo) {}
+#endif
+
+#ifdef DART_HOOK_STATS
+/*
+ * hook stats
+ *
+ * counted per cpu by the wraps (where in the wrap a call ends up, and for
+ * those reaching the implementation, how long it takes there) and summed
+ * into the rtinfo on finish, a call migrating in the middle of the
+ * implementation only skews its own sample
+ */
+struct dart_hook_stats {
+    struct dart_hook_stat stat[DART_API_END_OF_ENUM];
+};
+
+DECLARE_PER_CPU(struct dart_hook_stats, g_dart_hook_stats);
+
+#define dart_hook_stats_inc(api, field) \
+        this_cpu_inc(g_dart_hook_stats.stat[api].field)
+
+static inline void dart_hook_stats_cycles(unsigned int api, cycles_t cycles) {
+    unsigned int bin;
+
+    bin = min_t(unsigned int, fls64(cycles), DART_HOOK_HIST_BINS - 1);
+    this_cpu_inc(g_dart_hook_stats.stat[api].cycles[bin]);
+}
+
+static inline void dart_hook_stats_init(struct dart_rtinfo *rtinfo) {
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        memset(per_cpu_ptr(&g_dart_hook_stats, cpu), 0,
+               sizeof(struct dart_hook_stats));
+    }
+
+    atomic64_set(&rtinfo->hook_stats_num, DART_API_END_OF_ENUM);
+    memset(rtinfo->hook_stats, 0, sizeof(rtinfo->hook_stats));
+}
+
+static inline void dart_hook_stats_fini(struct dart_rtinfo *rtinfo) {
+    struct dart_hook_stats *hs;
+    struct dart_hook_stat *src, *dst;
+    int cpu, i, b;
+
+    for_each_possible_cpu(cpu) {
+        hs = per_cpu_ptr(&g_dart_hook_stats, cpu);
+        for (i = 0; i < DART_API_END_OF_ENUM; i++) {
+            src = &hs->stat[i];
+            dst = &rtinfo->hook_stats[i];
+
+            dst->calls += src->calls;
+            dst->ignored += src->ignored;
+            dst->untraced += src->untraced;
+            dst->paused += src->paused;
+            for (b = 0; b < DART_HOOK_HIST_BINS; b++) {
+                dst->cycles[b] += src->cycles[b];
+            }
+        }
+    }
+}
+#else
+static inline void dart_hook_stats_init(struct dart_rtinfo *rtinfo) {
+    atomic64_set(&rtinfo->hook_stats_num, 0);
+}
+
+static inline void dart_hook_stats_fini(struct dart_rtinfo *rtinfo) {}
+#endif
+
 /* operations */
-static inline void cov_cfg_add_edge(hash24_t edge) {
+static inline void cov_delta_init(void) {
+    atomic64_set(&g_cov_delta->count, 0);
+}
+
+static inline void cov_delta_add(enum dart_cov_kind kind, cov_index_t index) {
+    unsigned long offset;
+
+    offset = atomic64_fetch_inc(&g_cov_delta->count);
+    if (offset >= DART_COV_DELTA_MAX) {
+        return;
+    }
+    g_cov_delta->entries[offset] = (u64) kind << 32 | index;
+}
+
+#ifdef DART_COV_TREE
+static inline bool cov_tree_check(struct dart_cov_tree *tree) {
+    return tree->magic == DART_COV_TREE_MAGIC &&
+           tree->bits == DART_COV_TREE_BITS;
+}
+
+static inline unsigned long *cov_tree_leaf(
+        struct dart_cov_tree *tree, unsigned long page
+) {
+    unsigned long leaf;
+    u32 *slot;
+    u32 v, prev;
+
+    slot = &tree->dir[page];
+    v = smp_load_acquire(slot);
+    if (!v) {
+        /* take a leaf first and claim the page with it in one step */
+        leaf = atomic64_fetch_inc(&tree->leaves);
+        v = leaf < DART_COV_TREE_POOL ? (u32) leaf + 1 : DART_COV_TREE_FULL;
+
+        prev = cmpxchg(slot, 0, v);
+        if (prev) {
+            /* lost to another claim, the leaf taken is wasted */
+            v = prev;
+        } else if (v == DART_COV_TREE_FULL) {
+            atomic64_inc(&tree->dropped);
+        }
+    }
+
+    if (v == DART_COV_TREE_FULL) {
+        return NULL;
+    }
+
+    return (unsigned long *) ((char *) tree + DART_COV_TREE_HEAD +
+                              (v - 1) * DART_COV_LEAF_SIZE);
+}
+
+static inline void cov_tree_add(
+        struct dart_cov_tree *tree, cov_index_t index,
+        enum dart_cov_kind kind, atomic64_t *incr
+) {
+    unsigned long *leaf;
+    unsigned long bit;
+
+    leaf = cov_tree_leaf(tree, index >> DART_COV_LEAF_SHIFT);
+    if (!leaf) {
+        return;
+    }
+
+    /* only a read on the shared line for what is covered already */
+    bit = index & (DART_COV_LEAF_BITS - 1);
+    if (test_bit(bit, leaf) || test_and_set_bit(bit, leaf)) {
+        return;
+    }
+
+    atomic64_inc(incr);
+    cov_delta_add(kind, index);
+}
+
+static inline void cov_cfg_add_edge(cov_index_t edge) {
+    cov_tree_add(g_cov_cfg_edge, edge, DART_COV_CFG_EDGE,
+                 &g_rtinfo->cov_cfg_edge_incr);
+}
+
+static inline void cov_dfg_add_edge(cov_index_t edge) {
+    cov_tree_add(g_cov_dfg_edge, edge, DART_COV_DFG_EDGE,
+                 &g_rtinfo->cov_dfg_edge_incr);
+}
+
+static inline void cov_alias_add_pair(cov_index_t pair) {
+    cov_tree_add(g_cov_alias_inst, pair, DART_COV_ALIAS_INST,
+                 &g_rtinfo->cov_alias_inst_incr);
+}
+#elif defined(DART_COV_LOCAL)
+/*
+ * instance-local coverage
+ *
+ * new bits are recorded into private bitmaps (skipping those already in the
+ * shared maps, which is only a read on the shared lines) and merged into the
+ * shared maps word by word on finish, where the bits that turned out to be
+ * new to the shared maps are counted into the rtinfo and the delta
+ */
+extern unsigned long *g_cov_cfg_edge_local;
+extern unsigned long *g_cov_dfg_edge_local;
+extern unsigned long *g_cov_alias_inst_local;
+
+static inline void cov_local_add(
+        unsigned long bit, unsigned long *shared, unsigned long *local
+) {
+    if (test_bit(bit, shared) || test_bit(bit, local)) {
+        return;
+    }
+    set_bit(bit, local);
+}
+
+static inline void cov_cfg_add_edge(cov_index_t edge) {
+    cov_local_add(edge, g_cov_cfg_edge, g_cov_cfg_edge_local);
+}
+
+static inline void cov_dfg_add_edge(cov_index_t edge) {
+    cov_local_add(edge, g_cov_dfg_edge, g_cov_dfg_edge_local);
+}
+
+static inline void cov_alias_add_pair(cov_index_t pair) {
+    cov_local_add(pair, g_cov_alias_inst, g_cov_alias_inst_local);
+}
+
+static inline s64 cov_local_merge(
+        unsigned long *shared, unsigned long *local, unsigned long bits,
+        enum dart_cov_kind kind
+) {
+    unsigned long i, old, new;
+    s64 incr;
+
+    incr = 0;
+    for (i = 0; i < BITS_TO_LONGS(bits); i++) {
+        if (!local[i]) {
+            continue;
+        }
+
+        old = atomic_long_fetch_or(local[i], (atomic_long_t *) &shared[i]);
+        new = local[i] & ~old;
+        incr += hweight_long(new);
+
+        for (; new; new &= new - 1) {
+            cov_delta_add(kind, i * BITS_PER_LONG + __ffs(new));
+        }
+
+        /* ready for the next run */
+        local[i] = 0;
+    }
+    return incr;
+}
+
+static inline void cov_local_merge_all(void) {
+    atomic64_add(cov_local_merge(g_cov_cfg_edge, g_cov_cfg_edge_local,
+                                 _COV_CFG_EDGE_BITS, DART_COV_CFG_EDGE),
+                 &g_rtinfo->cov_cfg_edge_incr);
+    atomic64_add(cov_local_merge(g_cov_dfg_edge, g_cov_dfg_edge_local,
+                                 _COV_DFG_EDGE_BITS, DART_COV_DFG_EDGE),
+                 &g_rtinfo->cov_dfg_edge_incr);
+    atomic64_add(cov_local_merge(g_cov_alias_inst, g_cov_alias_inst_local,
+                                 _COV_ALIAS_INST_BITS, DART_COV_ALIAS_INST),
+                 &g_rtinfo->cov_alias_inst_incr);
+}
+#else
+static inline void cov_cfg_add_edge(cov_index_t edge) {
     if (!test_and_set_bit(edge, g_cov_cfg_edge)) {
         atomic64_inc(&g_rtinfo->cov_cfg_edge_incr);
+        cov_delta_add(DART_COV_CFG_EDGE, edge);
     }
 }
 
-static inline void cov_dfg_add_edge(hash24_t edge) {
+static inline void cov_dfg_add_edge(cov_index_t edge) {
     if (!test_and_set_bit(edge, g_cov_dfg_edge)) {
         atomic64_inc(&g_rtinfo->cov_dfg_edge_incr);
+        cov_delta_add(DART_COV_DFG_EDGE, edge);
     }
 }
 
-static inline void cov_alias_add_pair(hash24_t pair) {
+static inline void cov_alias_add_pair(cov_index_t pair) {
     if (!test_and_set_bit(pair, g_cov_alias_inst)) {
         atomic64_inc(&g_rtinfo->cov_alias_inst_incr);
+        cov_delta_add(DART_COV_ALIAS_INST, pair);
     }
 }
+#endif
+
+#ifdef DART_RTRACE_DEDUP
+static inline void rtrace_init(void) {
+    atomic64_set(&g_rtrace->count, RTRACE_FLAG_DEDUP);
+    atomic64_set(&g_rtrace->dropped, 0);
+}
+
+static inline s64 rtrace_count(void) {
+    return atomic64_read(&g_rtrace->count) & ~RTRACE_FLAG_DEDUP;
+}
+
+static inline struct dart_rtrace_entry *rtrace_claim(
+        u32 *slot, hval_64_t from, hval_64_t into, data_64_t addr, u64 size
+) {
+    struct dart_rtrace_entry *entry;
+    unsigned long flags, offset;
+
+    /* never be interrupted while others may be waiting on the slot */
+    local_irq_save(flags);
+    if (cmpxchg(slot, 0, RTRACE_DEDUP_BUSY) != 0) {
+        local_irq_restore(flags);
+        return NULL;
+    }
+
+    offset = atomic64_fetch_inc(&g_rtrace->count) & ~RTRACE_FLAG_DEDUP;
+    if (offset >= g_rtrace_entry_max) {
+        smp_store_release(slot, RTRACE_DEDUP_FULL);
+        local_irq_restore(flags);
+        return NULL;
+    }
+
+    entry = &g_rtrace->entries[offset];
+    entry->from = from;
+    entry->into = into;
+    atomic64_set(&entry->addr_lo, addr);
+    atomic64_set(&entry->addr_hi, addr + size);
+    atomic64_set(&entry->hits, 1);
+
+    smp_store_release(slot, (u32) offset + 1);
+    local_irq_restore(flags);
+    return entry;
+}
+
+static inline void rtrace_update(
+        struct dart_rtrace_entry *entry, data_64_t addr, u64 size
+) {
+    s64 cur, old;
+
+    atomic64_inc(&entry->hits);
+
+    cur = atomic64_read(&entry->addr_lo);
+    while ((s64) addr < cur) {
+        old = atomic64_cmpxchg(&entry->addr_lo, cur, addr);
+        if (old == cur) {
+            break;
+        }
+        cur = old;
+    }
+
+    cur = atomic64_read(&entry->addr_hi);
+    while ((s64) (addr + size) > cur) {
+        old = atomic64_cmpxchg(&entry->addr_hi, cur, addr + size);
+        if (old == cur) {
+            break;
+        }
+        cur = old;
+    }
+}
+
+static inline void rtrace_record(
+        hval_64_t from, hval_64_t into, data_64_t addr, u64 size
+) {
+    struct dart_rtrace_entry *entry;
+    hash20_t h;
+    u32 *slot;
+    u32 v;
+    int i;
+
+    h = hash_u64_into_h20_chain(from, into);
+    for (i = 0; i < RTRACE_DEDUP_PROBE; i++) {
+        slot = &g_rtrace_index[(h + i) & (RTRACE_DEDUP_SLOTS - 1)];
+
+        v = smp_load_acquire(slot);
+        if (!v) {
+            entry = rtrace_claim(slot, from, into, addr, size);
+            if (entry) {
+                return;
+            }
+            v = smp_load_acquire(slot);
+        }
+
+        /* the slot is being filled by someone else */
+        while (v == RTRACE_DEDUP_BUSY) {
+            cpu_relax();
+            v = smp_load_acquire(slot);
+        }
+
+        if (v == RTRACE_DEDUP_FULL) {
+            break;
+        }
+
+        entry = &g_rtrace->entries[v - 1];
+        if (entry->from == from && entry->into == into) {
+            rtrace_update(entry, addr, size);
+            return;
+        }
+    }
+
+    /* either the rtrace or the probe window is full */
+    atomic64_inc(&g_rtrace->dropped);
+}
+#else
+static inline void rtrace_init(void) {
+    atomic64_set(&g_rtrace->count, 0);
+}
+
+static inline s64 rtrace_count(void) {
+    return atomic64_read(&g_rtrace->count);
+}
 
 static inline void rtrace_record(
         hval_64_t from, hval_64_t into, data_64_t addr, u64 size
@@ -62,7 +684,7 @@ static inline void rtrace_record(
 
     /* calculate the offset */
     offset = atomic64_fetch_inc(&g_rtrace->count);
-    if (offset >= _RTRACE_ENTRY_MAX) {
+    if (offset >= g_rtrace_entry_max) {
         return;
     }
     offset *= 4;
@@ -73,5 +695,6 @@ static inline void rtrace_record(
     g_rtrace->buffer[offset + 2] = addr;
     g_rtrace->buffer[offset + 3] = size;
 }
+#endif
 
 #endif /* _DART_WKS_H_ */
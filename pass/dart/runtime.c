@@ -1,5 +1,7 @@
 #include "dart.h"
 
+#include <linux/unistd.h>
+
 /* globals */
 long dart_iseq = 0;
 EXPORT_SYMBOL(dart_iseq);
@@ -13,6 +15,9 @@ EXPORT_SYMBOL(dart_private);
 char *dart_reserved = NULL;
 EXPORT_SYMBOL(dart_reserved);
 
+struct ivshmem_table dart_layout;
+EXPORT_SYMBOL(dart_layout);
+
 /* define the implementations */
 #define DART_FUNC DART_FUNC_LIB_IMPL
 #include "rt_sys.inc"
@@ -62,6 +67,35 @@ SYSCALL_DEFINE2(dart, unsigned long, cmd, unsigned long, arg) {
                                     DART_FLAG_CTRL_CTXT_CHANGE, arg);
             break;
 
+        case CMD_DART_CTXT_SYSCALL_AUTO:
+            /* let the syscall entry and exit mark the context instead */
+            if (arg) {
+                current->dart_syscall_auto = DART_SYSCALL_AUTO_ON;
+            } else {
+                current->dart_syscall_auto = 0;
+            }
+            break;
+
+        case CMD_DART_DELAY_USEC:
+            dart_delay_set_usec(arg);
+            break;
+
+        case CMD_DART_DELAY_HVAL:
+            dart_delay_set_hval(arg);
+            break;
+
+        case CMD_DART_HOOK_PATCH:
+            if (dart_patch_set(arg, true)) {
+                return -1;
+            }
+            break;
+
+        case CMD_DART_HOOK_UNPATCH:
+            if (dart_patch_set(arg, false)) {
+                return -1;
+            }
+            break;
+
         default:
             dart_pr_err("invalid syscall command: %lu", cmd);
             return -1;
@@ -70,6 +104,57 @@ SYSCALL_DEFINE2(dart, unsigned long, cmd, unsigned long, arg) {
     return 0;
 }
 
+/* automatic syscall context marking, called from the syscall entry/exit */
+static inline bool dart_syscall_auto_skip(unsigned long sysno) {
+    switch (sysno) {
+        /* the commands to dart itself */
+        case __NR_dart:
+        /* never returns */
+        case __NR_exit:
+        case __NR_exit_group:
+        /* synchronization and placement of the harness threads */
+        case __NR_futex:
+        case __NR_sched_setaffinity:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void dart_syscall_auto_enter(unsigned long sysno) {
+    if (dart_syscall_auto_skip(sysno)) {
+        return;
+    }
+
+    /* only when dart is running, mirroring the wrapped apis */
+    if (!dart_switch_acq_data()) {
+        return;
+    }
+
+    DART_FUNC_LIB_CALL_IMPL(ctxt, syscall_enter,
+                            DART_FLAG_CTRL_CTXT_CHANGE, sysno);
+    current->dart_syscall_auto |= DART_SYSCALL_AUTO_INSIDE;
+
+    dart_switch_rel_data();
+}
+
+void dart_syscall_auto_exit(unsigned long sysno) {
+    /* a launch in the middle of a syscall does not count as an enter */
+    if (!(current->dart_syscall_auto & DART_SYSCALL_AUTO_INSIDE)) {
+        return;
+    }
+    current->dart_syscall_auto &= ~DART_SYSCALL_AUTO_INSIDE;
+
+    if (!dart_switch_acq_data()) {
+        return;
+    }
+
+    DART_FUNC_LIB_CALL_IMPL(ctxt, syscall_exit,
+                            DART_FLAG_CTRL_CTXT_CHANGE, sysno);
+
+    dart_switch_rel_data();
+}
+
 /* boot parameter */
 static __init int dart_instance_cmd(char *str) {
     if (kstrtol(str, 10, &dart_iseq)) {
@@ -1,5 +1,6 @@
 #include "base/Plugin.h"
 #include "analysis/Oracle.h"
+#include "util/Cache.h"
 #include "util/Logger.h"
 #include "util/Lower.h"
 
@@ -24,6 +25,21 @@ namespace racer {
     cl::opt<string> OUTPUT("racer-output",
                            cl::Required,
                            cl::desc("<racer output>"));
+    cl::opt<bool> COALESCE("racer-coalesce",
+                           cl::init(false),
+                           cl::desc("<coalesce adjacent memory accesses>"));
+    cl::opt<bool> GUARD("racer-guard",
+                        cl::init(false),
+                        cl::desc("<guard hooks with the tracing mask>"));
+    cl::opt<bool> PATCH("racer-patch",
+                        cl::init(false),
+                        cl::desc("<guard hooks with the patch table>"));
+    cl::opt<string> RECORD("racer-record",
+                           cl::init("json"),
+                           cl::desc("<record format: json, binary, or lite>"));
+    cl::opt<string> CACHE("racer-cache",
+                          cl::init(""),
+                          cl::desc("<instrumented module cache directory>"));
 
     static void interruptHandler(int signal) {
 #if defined(RACER_DEBUG) && defined(RACER_DEBUG_STATUS)
@@ -37,23 +53,34 @@ namespace racer {
 
     // class Racer
     Racer::Racer(
-            const string &_mode, const string &_input, const string &_output
+            const string &_mode, const string &_input, const string &_output,
+            const string &_format
     )
             : ModulePass(ID),
-              mode(_mode), input(_input), output(_output) {
+              mode(_mode), input(_input), output(_output), format(_format),
+              cached(false) {
 
         // register signal handlers
         signal(SIGINT, interruptHandler);
     }
 
     Racer::Racer()
-            : Racer(MODE.getValue(), INPUT.getValue(), OUTPUT.getValue()) {
+            : Racer(MODE.getValue(), INPUT.getValue(), OUTPUT.getValue(),
+                    RECORD.getValue()) {
     }
 
     Racer::~Racer() {
 #ifdef RACER_DEBUG
-        SLOG.dump(output);
+        // binary records are streamed to the output during the run
+        if (format == "json" && !cached) {
+            SLOG.dump(output);
+        }
 #endif
+
+        // the record is only complete after the dump
+        if (cache && !cached) {
+            cache->saveRecord(output);
+        }
     }
 
     void Racer::getAnalysisUsage(AnalysisUsage &au) const {
@@ -70,8 +97,50 @@ namespace racer {
         // check assumptions
         Lowering::checkAssumptions(m);
 
+        // hash the module before the instrumentor touches it
+        if (!CACHE.getValue().empty()) {
+            cache.reset(new InstrumentCache(CACHE.getValue(), m));
+        }
+
+        Instrumentor instrumentor(m, input);
+
+        // reuse the instrumented module if nothing has changed
+        if (cache) {
+            cache->lookup(formatv(
+                    "{0}|{1}|{2}|{3}|{4}|{5}",
+                    mode, format, COALESCE.getValue(), GUARD.getValue(),
+                    PATCH.getValue(), instrumentor.getProfileSlice()
+            ).str());
+
+            if (cache->restore(m, output)) {
+                cached = true;
+#if defined(RACER_DEBUG) && defined(RACER_DEBUG_STATUS)
+                STAT.show() << "Instrumentation restored from cache";
+                STAT.done();
+#endif
+                return true;
+            }
+        }
+
         // instrument
-        Instrumentor(m, input).run(mode);
+        if (format == "json") {
+            instrumentor.run(
+                    mode, COALESCE.getValue(), GUARD.getValue(),
+                    PATCH.getValue(), nullptr
+            );
+        } else if (format == "binary" || format == "lite") {
+            Recorder recorder(output, format == "lite");
+            instrumentor.run(
+                    mode, COALESCE.getValue(), GUARD.getValue(),
+                    PATCH.getValue(), &recorder
+            );
+        } else {
+            llvm_unreachable(("Invalid record format: " + format).c_str());
+        }
+
+        if (cache) {
+            cache->saveModule(m);
+        }
 
         // end of instrumentation
 #if defined(RACER_DEBUG) && defined(RACER_DEBUG_STATUS)
@@ -8,9 +8,11 @@ namespace racer {
     class FuncOracle {
     public:
         FuncOracle(Function &f, const DataLayout &dl, TargetLibraryInfo &tli)
-                : ac(f), dt(f), li(dt), se(f, tli, ac, dt, li) {
+                : dl(dl), ac(f), dt(f), li(dt), se(f, tli, ac, dt, li) {
+#ifdef RACER_DEBUG
             dt.verify();
             li.verify(dt);
+#endif
         }
 
         ~FuncOracle() = default;
@@ -21,8 +23,14 @@ namespace racer {
             return dt.dominates(dom, bb);
         }
 
+        bool dominates(Instruction *dom, Instruction *i) {
+            return dt.dominates(dom, i);
+        }
+
         BasicBlock *getIDom(BasicBlock *bb);
 
+        bool getDomOrder(BasicBlock *bb, unsigned &order);
+
         // loop
         Loop *getOuterLoopInScope(Loop *scope, BasicBlock *bb);
 
@@ -34,20 +42,47 @@ namespace racer {
             return getOuterLoopInScope(nullptr, bb);
         }
 
+        vector<Loop *> getInnermostLoops() {
+            vector<Loop *> loops;
+            for (Loop *l : li.getLoopsInPreorder()) {
+                if (l->empty()) {
+                    loops.push_back(l);
+                }
+            }
+            return loops;
+        }
+
         // scala evolution
         SCEV *getSCEV(Value *v) {
             assert(se.isSCEVable(v->getType()));
             return const_cast<SCEV *>(se.getSCEV(v));
         }
 
+        bool getConstantOffset(Value *ptr, Value *&base, int64_t &offset);
+
+        bool getLoopAccessRange(Loop *l, Value *ptr, uint64_t size,
+                                const SCEV *&start, const SCEV *&length);
+
+        Value *expandSCEV(const SCEV *expr, Instruction *at) {
+            SCEVExpander expander(se, dl, "racer");
+            return expander.expandCodeFor(expr, expr->getType(), at);
+        }
+
+        // escape
+        bool isLocalObject(Value *ptr);
+
     protected:
         // basics
+        const DataLayout &dl;
         AssumptionCache ac;
 
         // analysis
         DominatorTree dt;
         LoopInfo li;
         ScalarEvolution se;
+
+        // cache
+        map<AllocaInst *, bool> localObjects;
     };
 
     class ModuleOracle {
@@ -65,7 +100,11 @@ namespace racer {
             assert(sizeof(hash_code) == 8);
         }
 
-        ~ModuleOracle() = default;
+        ~ModuleOracle() {
+            for (auto &i : fos) {
+                delete i.second;
+            }
+        }
 
     public:
         // data layout
@@ -111,13 +150,14 @@ namespace racer {
                     ty->getIntegerBitWidth() == getPointerWidth());
         }
 
-        // function oracles
-        void addOracle(Function *f, FuncOracle *fo) {
-            fos[f] = fo;
-        }
-
+        // function oracles (built on demand)
         FuncOracle &getOracle(Function *f) {
-            return *fos[f];
+            auto it = fos.find(f);
+            if (it == fos.end()) {
+                assert(!f->isDeclaration());
+                it = fos.emplace(f, new FuncOracle(*f, dl, tli)).first;
+            }
+            return *it->second;
         }
 
         FuncOracle &getOracle(BasicBlock *b) {
@@ -132,6 +172,15 @@ namespace racer {
             return fos.size();
         }
 
+        // the analyses are stale once the function is transformed further
+        void releaseOracle(Function *f) {
+            auto it = fos.find(f);
+            if (it != fos.end()) {
+                delete it->second;
+                fos.erase(it);
+            }
+        }
+
     protected:
         // info provider
         const DataLayout &dl;
@@ -56,14 +56,60 @@ namespace racer {
     template<typename T>
     using APIPack = pair<const API *, const APIDesc<T> *>;
 
+    template<typename T>
+    using LOCPack = pair<const LOC *, const LOCDesc<T> *>;
+
+    /*
+     * resolves every registered descriptor table in one traversal, calls are
+     * dispatched by callee name and instructions by the (file, line, column)
+     * of each frame in their inlined-at chain
+     */
+    class Prober {
+    public:
+        Prober() = default;
+
+        ~Prober() = default;
+
+    public:
+        template<typename T>
+        void addAPIs(const vector<APIDesc<T>> &in,
+                     map<Instruction *, APIPack<T>> &out);
+
+        template<typename T>
+        void addLOCs(const vector<LOCDesc<T>> &in,
+                     map<Instruction *, LOCPack<T>> &out);
+
+        void run(Module &m);
+
+    protected:
+        typedef function<void(Instruction *)> Handler;
+
+        struct LOCEntry {
+            const LOC *loc;
+            Handler hit;
+        };
+
+        void probeCall(CallInst *i);
+
+        void probeFrames(Instruction *i);
+
+    protected:
+        // callee name -> handlers (in registration order)
+        StringMap<vector<Handler>> apis;
+
+        // file -> (line, column) -> handlers (in registration order)
+        StringMap<DenseMap<pair<unsigned, unsigned>, vector<LOCEntry>>> locs;
+
+        // per-descriptor summaries, called after the traversal
+        vector<function<void()>> reports;
+    };
+
+    // single-table shortcuts
     template<typename T>
     void probeAPIs(Module &m,
                    const vector<APIDesc<T>> &in,
                    map<Instruction *, APIPack<T>> &out);
 
-    template<typename T>
-    using LOCPack = pair<const LOC *, const LOCDesc<T> *>;
-
     template<typename T>
     void probeLOCs(Module &m,
                    const vector<LOCDesc<T>> &in,
@@ -4,6 +4,7 @@
 // c/c++ basics
 #include <string>
 #include <fstream>
+#include <functional>
 
 // stl data structs
 #include <list>
@@ -16,7 +17,9 @@
 #include <llvm/Pass.h>
 
 // llvm traits
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/GraphTraits.h>
+#include <llvm/ADT/StringMap.h>
 #include <llvm/ADT/iterator_range.h>
 #include <llvm/ADT/Hashing.h>
 
@@ -40,19 +43,25 @@
 #include <llvm/Analysis/AssumptionCache.h>
 #include <llvm/Analysis/CFG.h>
 #include <llvm/Analysis/CallGraph.h>
+#include <llvm/Analysis/CaptureTracking.h>
 #include <llvm/Analysis/LoopInfo.h>
 #include <llvm/Analysis/LoopInfoImpl.h>
 #include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpander.h>
 #include <llvm/Analysis/ScalarEvolutionExpressions.h>
 #include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/Analysis/ValueTracking.h>
 #include <llvm/IR/Dominators.h>
 #include <llvm/Support/GenericDomTree.h>
 
 // llvm instrumentation
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
 
 // llvm support
 #include <llvm/Support/FormatVariadic.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/raw_ostream.h>
 
 // used namespaces
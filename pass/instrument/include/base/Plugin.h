@@ -5,7 +5,10 @@
 #include "analysis/Oracle.h"
 #include "analysis/Probe.h"
 #include "dart/API.h"
+#include "util/Cache.h"
+#include "util/Index.h"
 #include "util/Logger.h"
+#include "util/Record.h"
 
 // main namespace
 namespace racer {
@@ -13,7 +16,8 @@ namespace racer {
     // pass
     class Racer : public ModulePass {
     public:
-        Racer(const string &_mode, const string &_input, const string &_output);
+        Racer(const string &_mode, const string &_input, const string &_output,
+              const string &_format);
         Racer();
         ~Racer() override;
 
@@ -29,6 +33,11 @@ namespace racer {
         string mode;
         string input;
         string output;
+        string format;
+
+        // instrumentation cache (if enabled)
+        std::unique_ptr<InstrumentCache> cache;
+        bool cached;
     };
 
     // exception
@@ -38,40 +47,47 @@ namespace racer {
         }
     };
 
+    // a ranged hook that covers a run of contiguous accesses
+    struct MemAccessRange {
+        Value *base;
+        int64_t offset;
+        uint64_t size;
+
+        // (offset from the start of the range, original instruction)
+        vector<pair<int64_t, Instruction *>> members;
+    };
+
     class Instrumentor {
     public:
         Instrumentor(Module &_module, const string &_input)
                 : module(_module),
                   ctxt(module.getContext()),
                   oracle(module),
+                  compileIndex(_input),
                   dart(module),
                   seed(hash_value(module.getName().str())) {
 
-            // build function oracles
-            for (Function &f : module) {
-                if (f.isIntrinsic() || f.isDeclaration()) {
-                    continue;
-                }
-
-                auto fo = new FuncOracle(
-                        f, oracle.getDataLayout(), oracle.getTargetLibraryInfo()
-                );
-                oracle.addOracle(&f, fo);
+            // load compile info database (if not given the binary index)
+            if (!compileIndex.isValid()) {
+                std::ifstream i(_input.c_str(), std::ifstream::in);
+                i >> compileDB;
             }
 
-            // load compile info database
-            std::ifstream i(_input.c_str(), std::ifstream::in);
-            i >> compileDB;
-
-            // probe APIS and LOCs
-            probeAPIs(module, MEMSET_APIS_AVAILS, memsetAPIs);
-            probeAPIs(module, MEMCPY_APIS_AVAILS, memcpyAPIs);
+            // probe APIS and LOCs (in one pass over the module)
+            Prober prober;
+            prober.addAPIs(MEMSET_APIS_AVAILS, memsetAPIs);
+            prober.addAPIs(MEMCPY_APIS_AVAILS, memcpyAPIs);
+            prober.run(module);
         }
 
         ~Instrumentor() = default;
 
     public:
-        void run(const string &mode);
+        void run(const string &mode, bool coalesce, bool guard, bool patch,
+                 Recorder *recorder);
+
+        // the parts of the compile profile that affect this module
+        string getProfileSlice();
 
     protected:
         // steps in instrumentation
@@ -88,15 +104,34 @@ namespace racer {
         void inst_cov_cfg();
 
         // MEM
+        void prune_mem_access(Function *func, FuncOracle &fo);
+        void prune_mem_redundant(Function *func, FuncOracle &fo);
+        void hoist_mem_loop(Function *func, FuncOracle &fo);
+        bool _hoist_candidates(Loop *l, vector<Instruction *> &accesses);
+        void coalesce_mem_access(Function *func, FuncOracle &fo);
+        void _coalesce_run(
+                FuncOracle &fo,
+                vector<pair<int64_t, Instruction *>> &run, Value *base
+        );
         void inst_mem_stack();
         void inst_mem_access();
 
         // record
         void record(Logger &L);
+        void record(Recorder &R);
 
     protected:
         // compile info database queries
         json *getSpecialProcedure() {
+            if (compileIndex.isValid()) {
+                StringRef value;
+                if (!compileIndex.getSpecial(module.getName(), value)) {
+                    return nullptr;
+                }
+                compileSpecial = json::parse(value.begin(), value.end());
+                return &compileSpecial;
+            }
+
             for (auto &i : compileDB["special"].items()) {
                 if (module.getName().endswith(i.key())) {
                     return &(i.value());
@@ -106,11 +141,86 @@ namespace racer {
         }
 
         bool isFunctionIgnored(Function *f) {
+            if (compileIndex.isValid()) {
+                return compileIndex.isIgnored(f->getName());
+            }
+
             auto it = compileDB["ignored"].find(f->getName().str());
             return (it != compileDB["ignored"].end()) &&
                    (it.value().get<bool>());
         }
 
+    protected:
+        // plain (non-atomic and non-volatile) accesses
+        Value *getPlainAccessPointer(Instruction *i) {
+            if (auto *i_load = dyn_cast<LoadInst>(i)) {
+                if (i_load->isSimple()) {
+                    return i_load->getPointerOperand();
+                }
+            }
+
+            if (auto *i_store = dyn_cast<StoreInst>(i)) {
+                if (i_store->isSimple()) {
+                    return i_store->getPointerOperand();
+                }
+            }
+
+            return nullptr;
+        }
+
+        unsigned getAccessSize(Instruction *i) {
+            if (auto *i_store = dyn_cast<StoreInst>(i)) {
+                return oracle.getTypeStoreSize(
+                        i_store->getValueOperand()->getType()
+                );
+            }
+
+            return oracle.getTypeStoreSize(i->getType());
+        }
+
+        // sync-free regions
+        bool isSyncPoint(Instruction *i) {
+            if (auto *i_call = dyn_cast<CallInst>(i)) {
+                // debug info and lifetime markers do not synchronize
+                return !isa<DbgInfoIntrinsic>(i_call) &&
+                       !i_call->isLifetimeStartOrEnd();
+            }
+
+            if (auto *i_load = dyn_cast<LoadInst>(i)) {
+                return !i_load->isSimple();
+            }
+
+            if (auto *i_store = dyn_cast<StoreInst>(i)) {
+                return !i_store->isSimple();
+            }
+
+            return isa<InvokeInst>(i) ||
+                   isa<FenceInst>(i) ||
+                   isa<AtomicRMWInst>(i) ||
+                   isa<AtomicCmpXchgInst>(i);
+        }
+
+        bool isSyncFreeRange(Instruction *from, Instruction *into) {
+            // check [from, into), or till the end of block if into is null
+            for (Instruction *c = from; c != into; c = c->getNextNode()) {
+                if (c == nullptr) {
+                    assert(into == nullptr);
+                    break;
+                }
+
+                // only the original instructions can synchronize
+                if (instHT.find(c) != instHT.end() && isSyncPoint(c)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool isSyncFreeBetween(
+                Instruction *from, Instruction *into,
+                map<BasicBlock *, set<BasicBlock *>> &reach
+        );
+
     protected:
         // utils
         bool isBlockHookMark(Instruction *i) {
@@ -210,7 +320,9 @@ namespace racer {
 
         // derived
         ModuleOracle oracle;
+        CompileIndex compileIndex;
         json compileDB;
+        json compileSpecial;
 
         // dart
         DartAPI dart;
@@ -224,6 +336,9 @@ namespace racer {
 
         // marked instructions
         set<Instruction *> ignoredMemAccess;
+        map<Function *, unsigned> prunedMemAccess;
+        map<Function *, unsigned> hoistedMemAccess;
+        map<Instruction *, MemAccessRange> coalescedMemAccess;
 
         // APIs and LOCs
         map<Instruction *, APIPack<MemSetInfo>> memsetAPIs;
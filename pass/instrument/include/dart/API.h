@@ -84,6 +84,11 @@ namespace racer {
 #include "apidef.inc"
 #undef DART_FUNC
 
+        // guard every hook emitted so far with the per-cpu tracing mask,
+        // and/or with the patch table slot of the function holding it
+        void guardHooks(Module &module, bool mask,
+                        const map<Function *, hash_code> *patch);
+
     protected:
         // context
         LLVMContext &ctxt;
@@ -99,6 +104,9 @@ namespace racer {
 #include "apidef.inc"
 #undef DART_FUNC
 
+        // emitted hooks
+        vector<CallInst *> hooks;
+
         // dummy
         bool end_of_fields;
     };
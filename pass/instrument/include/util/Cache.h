@@ -0,0 +1,51 @@
+#ifndef _RACER_UTIL_CACHE_H_
+#define _RACER_UTIL_CACHE_H_
+
+#include "base/Common.h"
+
+#include <llvm/Support/MD5.h>
+
+namespace racer {
+
+    /*
+     * cache of instrumented modules: the instrumentation is deterministic
+     * given the incoming bitcode, the pass build, the pass options, and the
+     * slice of the compile profile that applies to the module, hence these
+     * are hashed into the key of a <key>.bc and <key>.racer pair
+     */
+    class InstrumentCache {
+    public:
+        // hashes the module, which must not be modified before this
+        InstrumentCache(const string &_dir, Module &m);
+
+        ~InstrumentCache() = default;
+
+    public:
+        // finalize the key with the options and profile slice
+        void lookup(StringRef config);
+
+        // replace the module and the record with the cached ones (on hit)
+        bool restore(Module &m, const string &output);
+
+        // populate the cache (on miss)
+        void saveModule(Module &m);
+        void saveRecord(const string &output);
+
+    protected:
+        static StringRef getBuildID();
+
+        static void saveFile(const string &path, StringRef data);
+
+        static void clearModule(Module &m);
+
+    protected:
+        string dir;
+        MD5 hasher;
+
+        string pathModule;
+        string pathRecord;
+    };
+
+} /* namespace racer */
+
+#endif /* _RACER_UTIL_CACHE_H_ */
@@ -0,0 +1,85 @@
+#ifndef _RACER_UTIL_INDEX_H_
+#define _RACER_UTIL_INDEX_H_
+
+#include "base/Common.h"
+
+namespace racer {
+
+    /*
+     * memory-mapped compile profile index (built by the script
+     * racer_parse_compile_data.py from the json profile), layout:
+     *  - header
+     *  - ignored table: keyed by the function name
+     *  - special table: keyed by the module path suffix (reversed)
+     *  - string table
+     * tables are open-addressed with linear probing, a zero hash is empty
+     */
+    class CompileIndex {
+    public:
+        explicit CompileIndex(const string &path);
+
+        ~CompileIndex() = default;
+
+    public:
+        bool isValid() {
+            return head != nullptr;
+        }
+
+        bool isIgnored(StringRef name);
+
+        bool getSpecial(StringRef path, StringRef &value);
+
+    protected:
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t ignoredSlots;
+            uint32_t specialSlots;
+            uint32_t strtabSize;
+            uint32_t reserved[2];
+        };
+
+        struct Slot {
+            uint64_t hash;
+            uint32_t keyOff;
+            uint32_t keyLen;
+            uint32_t valOff;
+            uint32_t valLen;
+        };
+
+        // FNV-1a (64-bit), zero is reserved for empty slots
+        static uint64_t hashStep(uint64_t h, unsigned char c) {
+            return (h ^ c) * 0x100000001b3ull;
+        }
+
+        static uint64_t hashSeed() {
+            return 0xcbf29ce484222325ull;
+        }
+
+        static uint64_t hashFinal(uint64_t h) {
+            return h == 0 ? 1 : h;
+        }
+
+        StringRef getString(uint32_t off, uint32_t len) {
+            return StringRef(strtab + off, len);
+        }
+
+        const Slot *probe(const Slot *table, uint32_t slots,
+                          uint64_t hash, uint32_t &cursor);
+
+    protected:
+        std::unique_ptr<MemoryBuffer> buffer;
+
+        // views into the buffer
+        const Header *head;
+        const Slot *ignored;
+        const Slot *special;
+        const char *strtab;
+
+        // consts
+        static const uint32_t VERSION = 1;
+    };
+
+} /* namespace racer */
+
+#endif /* _RACER_UTIL_INDEX_H_ */
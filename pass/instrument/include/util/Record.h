@@ -0,0 +1,100 @@
+#ifndef _RACER_UTIL_RECORD_H_
+#define _RACER_UTIL_RECORD_H_
+
+#include "base/Common.h"
+
+namespace racer {
+
+    // which bytes of a ranged hook belong to which instruction
+    struct RecordCover {
+        int64_t offset;
+        uint64_t size;
+        uint64_t hash;
+    };
+
+    /*
+     * streaming binary record of the instrumentation (parsed by the script
+     * racer_parse_compile_data.py), layout:
+     *  - header: magic, version, flags
+     *  - records: u8 tag, u32 payload size, payload
+     * integers are little-endian, lists are prefixed with a u32 count, and
+     * strings are interned: a STR record precedes the first reference.
+     * in lite mode, only the hashes and the debug locations are recorded
+     */
+    class Recorder {
+    public:
+        Recorder(const string &fn, bool _lite);
+
+        ~Recorder();
+
+    public:
+        bool isLite() {
+            return lite;
+        }
+
+        void module(uint64_t seed,
+                    const vector<string> &apis,
+                    const vector<string> &gvar,
+                    const vector<string> &structs);
+
+        void func(StringRef name,
+                  uint64_t hash, uint64_t pruned, uint64_t hoisted);
+
+        void block(uint64_t hash,
+                   const vector<uint64_t> &pred,
+                   const vector<uint64_t> &succ);
+
+        void inst(uint64_t hash, StringRef repr, const DebugLoc &loc,
+                  const vector<RecordCover> &cover);
+
+    protected:
+        enum Tag : uint8_t {
+            TAG_STR = 1,
+            TAG_MODULE = 2,
+            TAG_FUNC = 3,
+            TAG_BLOCK = 4,
+            TAG_INST = 5,
+        };
+
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t flags;
+        };
+
+        // string interning (emits the STR record on first use)
+        uint32_t intern(StringRef str);
+
+        // payload construction
+        void begin(Tag tag);
+        void end();
+
+        template<typename T>
+        void put(T val) {
+            const char *p = reinterpret_cast<const char *>(&val);
+            payload.append(p, p + sizeof(T));
+        }
+
+        void putStrs(const vector<string> &strs);
+        void putHashes(const vector<uint64_t> &hashes);
+
+    protected:
+        error_code ec;
+        raw_fd_ostream stm;
+
+        bool lite;
+
+        StringMap<uint32_t> strings;
+
+        Tag cur;
+        SmallVector<char, 256> payload;
+
+        // consts
+        static const uint32_t VERSION = 1;
+        static const uint32_t FLAG_LITE = 1;
+        static const uint32_t NONE = UINT32_MAX;
+    };
+
+} /* namespace racer */
+
+#endif /* _RACER_UTIL_RECORD_H_ */
@@ -15,6 +15,19 @@ namespace racer {
         return idom->getBlock();
     }
 
+    bool FuncOracle::getDomOrder(BasicBlock *bb, unsigned &order) {
+        // preorder position in the dominator tree, false if unreachable
+        DomTreeNodeBase<BasicBlock> *node = dt.getNode(bb);
+        if (node == nullptr) {
+            return false;
+        }
+
+        // no-op once the numbers are valid
+        dt.updateDFSNumbers();
+        order = node->getDFSNumIn();
+        return true;
+    }
+
     // loop
     Loop *FuncOracle::getOuterLoopInScope(Loop *scope, BasicBlock *bb) {
         Loop *l = li.getLoopFor(bb);
@@ -28,4 +41,91 @@ namespace racer {
         return c;
     }
 
+    // scala evolution
+    bool FuncOracle::getConstantOffset(
+            Value *ptr, Value *&base, int64_t &offset
+    ) {
+        const SCEV *expr = getSCEV(ptr);
+
+        // the base must be an opaque pointer value
+        auto *unknown = dyn_cast<SCEVUnknown>(se.getPointerBase(expr));
+        if (unknown == nullptr) {
+            return false;
+        }
+
+        // and the distance from it must be a constant
+        auto *diff = dyn_cast<SCEVConstant>(se.getMinusSCEV(expr, unknown));
+        if (diff == nullptr) {
+            return false;
+        }
+
+        base = unknown->getValue();
+        offset = diff->getAPInt().getSExtValue();
+        return true;
+    }
+
+    bool FuncOracle::getLoopAccessRange(
+            Loop *l, Value *ptr, uint64_t size,
+            const SCEV *&start, const SCEV *&length
+    ) {
+        // the address must advance by exactly one access per iteration
+        auto *rec = dyn_cast<SCEVAddRecExpr>(getSCEV(ptr));
+        if (rec == nullptr || rec->getLoop() != l || !rec->isAffine()) {
+            return false;
+        }
+
+        auto *step = dyn_cast<SCEVConstant>(rec->getStepRecurrence(se));
+        if (step == nullptr) {
+            return false;
+        }
+
+        int64_t stride = step->getAPInt().getSExtValue();
+        if (stride != int64_t(size) && stride != -int64_t(size)) {
+            return false;
+        }
+
+        // the number of iterations must be known on loop entry
+        const SCEV *taken = se.getBackedgeTakenCount(l);
+        if (isa<SCEVCouldNotCompute>(taken) || !se.isLoopInvariant(taken, l)) {
+            return false;
+        }
+
+        Type *ty = se.getEffectiveSCEVType(ptr->getType());
+        taken = se.getNoopOrZeroExtend(taken, ty);
+
+        // the lowest address is reached at the last iteration if descending
+        start = rec->getStart();
+        if (stride < 0) {
+            start = se.getAddExpr(
+                    start, se.getMulExpr(taken, se.getConstant(ty, stride))
+            );
+        }
+
+        length = se.getMulExpr(
+                se.getAddExpr(taken, se.getOne(ty)), se.getConstant(ty, size)
+        );
+
+        // both must be materializable before the loop
+        return isSafeToExpand(start, se) && isSafeToExpand(length, se);
+    }
+
+    // escape
+    bool FuncOracle::isLocalObject(Value *ptr) {
+        // strip gep and casts to find the object being accessed
+        auto *obj = dyn_cast<AllocaInst>(GetUnderlyingObject(ptr, dl, 0));
+        if (obj == nullptr) {
+            return false;
+        }
+
+        auto it = localObjects.find(obj);
+        if (it != localObjects.end()) {
+            return it->second;
+        }
+
+        // an alloca whose address is never captured is thread-local
+        bool local = !PointerMayBeCaptured(obj, true, true);
+        localObjects.emplace(obj, local);
+        return local;
+    }
+
 } /* namespace racer */
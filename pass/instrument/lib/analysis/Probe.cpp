@@ -49,91 +49,22 @@ namespace racer {
             }
     };
 
-    // probers
-    template<typename T>
-    void probeAPIs(Module &m,
-                   const vector<APIDesc<T>> &in,
-                   map<Instruction *, APIPack<T>> &out) {
-
-        for (const auto &desc : in) {
-#ifdef RACER_DEBUG
-            set<const API *> actual;
-#endif
-            for (Function &f : m) {
-                // ignore functions without body
-                if (f.isIntrinsic() || f.isDeclaration()) {
-                    continue;
-                }
-
-                for (BasicBlock &bb : f) {
-                    for (Instruction &i : bb) {
-                        if (!isa<CallInst>(i)) {
-                            continue;
-                        }
-
-                        Function *func = cast<CallInst>(i).getCalledFunction();
-                        if (func == nullptr) {
-                            continue;
-                        }
-
-                        for (const auto &api : desc.apis) {
-                            if (func->getName().equals(api.func)) {
-#ifdef RACER_DEBUG
-                                actual.insert(&api);
-#endif
-                                out[&i] = make_pair(&api, &desc);
-                            }
-                        }
-                    }
-                }
-            }
-
-            // logging
-#if defined(RACER_DEBUG) && defined(RACER_DEBUG_STATUS)
-            STAT.show()
-                    << "API probe: " << desc.name
-                    << " (" << actual.size() << ") ";
-
-            STAT.cont() << "[";
-            for (auto const &i : actual) {
-                STAT.cont() << i->func << ",";
-            }
-            STAT.cont() << "]";
-
-            STAT.done();
-#endif
-        }
-    }
-
-    static bool locEquals(const DebugLoc &dl, const LOC &loc) {
+    // utils
+    static StringRef stripFilename(const DebugLoc &dl) {
         StringRef fn = cast<DIScope>(dl.getScope())->getFilename();
         if (fn.startswith("./")) {
             fn = fn.substr(2);
         }
+        return fn;
+    }
 
+    static bool locEquals(const DebugLoc &dl, const LOC &loc) {
         return
-                fn.equals(loc.file) &&
+                stripFilename(dl).equals(loc.file) &&
                 dl.getLine() == loc.line &&
                 dl.getCol() == loc.column;
     }
 
-    static bool locIncludes(const DebugLoc &dl, const LOC &loc) {
-        if (dl.isImplicitCode()) {
-            return false;
-        }
-
-        if (locEquals(dl, loc)) {
-            return true;
-        }
-
-        DILocation *inlined = dl.getInlinedAt();
-        if (inlined == nullptr) {
-            return false;
-        }
-
-        return locIncludes(DebugLoc(inlined), loc);
-    }
-
     static bool dlEquals(const DebugLoc &dl1, const DebugLoc &dl2) {
         StringRef fn1 = cast<DIScope>(dl1.getScope())->getFilename();
         StringRef fn2 = cast<DIScope>(dl2.getScope())->getFilename();
@@ -164,79 +95,229 @@ namespace racer {
         return dlMultiDef(DebugLoc(in1), DebugLoc(in2), loc);
     }
 
+    static bool opcodeMatches(Instruction *i, const LOC &loc) {
+        if (i->getOpcode() == loc.opcode) {
+            return true;
+        }
+
+        if (loc.opcode == LOC_OPCODE_CALL_ASM) {
+            return isa<CallInst>(i) && cast<CallInst>(i)->isInlineAsm();
+        }
+
+        return false;
+    }
+
+    // prober
     template<typename T>
-    void probeLOCs(Module &m,
-                   const vector<LOCDesc<T>> &in,
-                   map<Instruction *, LOCPack<T>> &out) {
+    void Prober::addAPIs(const vector<APIDesc<T>> &in,
+                         map<Instruction *, APIPack<T>> &out) {
 
         for (const auto &desc : in) {
 #ifdef RACER_DEBUG
-            map<const LOC *, const DebugLoc *> actual;
+            auto actual = std::make_shared<set<const API *>>();
+#endif
+            for (const auto &api : desc.apis) {
+                const API *pa = &api;
+                const APIDesc<T> *pd = &desc;
+
+                apis[api.func].push_back([=, &out](Instruction *i) {
+#ifdef RACER_DEBUG
+                    actual->insert(pa);
 #endif
-            for (Function &f : m) {
-                // ignore functions without body
-                if (f.isIntrinsic() || f.isDeclaration()) {
-                    continue;
+                    out[i] = make_pair(pa, pd);
+                });
+            }
+
+            // logging
+#if defined(RACER_DEBUG) && defined(RACER_DEBUG_STATUS)
+            const APIDesc<T> *pd = &desc;
+            reports.emplace_back([=]() {
+                STAT.show()
+                        << "API probe: " << pd->name
+                        << " (" << actual->size() << ") ";
+
+                STAT.cont() << "[";
+                for (auto const &i : *actual) {
+                    STAT.cont() << i->func << ",";
                 }
+                STAT.cont() << "]";
 
-                for (BasicBlock &bb : f) {
-                    for (Instruction &i : bb) {
-                        for (const auto &loc : desc.locs) {
-                            // opcode match
-                            bool match = (i.getOpcode() == loc.opcode);
-                            if (!match) {
-                                if (loc.opcode == LOC_OPCODE_CALL_ASM) {
-                                    match = (isa<CallInst>(i) &&
-                                             cast<CallInst>(i).isInlineAsm());
-                                }
-                            }
+                STAT.done();
+            });
+#endif
+        }
+    }
 
-                            // location match
-                            if (match && locIncludes(i.getDebugLoc(), loc)) {
+    template<typename T>
+    void Prober::addLOCs(const vector<LOCDesc<T>> &in,
+                         map<Instruction *, LOCPack<T>> &out) {
+
+        for (const auto &desc : in) {
 #ifdef RACER_DEBUG
-                                auto it = actual.find(&loc);
-                                if (it == actual.end()) {
-                                    actual[&loc] = &i.getDebugLoc();
-                                } else {
-                                    bool mdefs = dlMultiDef(
-                                            *(it->second), i.getDebugLoc(), loc
-                                    );
-                                    if (mdefs) {
-                                        DUMP.debugRepr(it->second);
-                                        DUMP.debugRepr(&i.getDebugLoc());
-                                        llvm_unreachable("Overlapped location");
-                                    }
-                                }
+            auto actual = std::make_shared<
+                    map<const LOC *, const DebugLoc *>
+            >();
 #endif
-                                out[&i] = make_pair(&loc, &desc);
-                            }
+            for (const auto &loc : desc.locs) {
+                const LOC *pl = &loc;
+                const LOCDesc<T> *pd = &desc;
+
+                Handler hit = [=, &out](Instruction *i) {
+#ifdef RACER_DEBUG
+                    auto it = actual->find(pl);
+                    if (it == actual->end()) {
+                        (*actual)[pl] = &i->getDebugLoc();
+                    } else {
+                        bool mdefs = dlMultiDef(
+                                *(it->second), i->getDebugLoc(), *pl
+                        );
+                        if (mdefs) {
+                            DUMP.debugRepr(it->second);
+                            DUMP.debugRepr(&i->getDebugLoc());
+                            llvm_unreachable("Overlapped location");
                         }
                     }
-                }
+#endif
+                    out[i] = make_pair(pl, pd);
+                };
+
+                locs[loc.file][make_pair(loc.line, loc.column)].push_back(
+                        {pl, hit}
+                );
             }
 
             // logging
 #if defined(RACER_DEBUG) && defined(RACER_DEBUG_STATUS)
-            STAT.show()
-                    << "LOC probe: " << desc.name
-                    << " (" << actual.size() << ") ";
-
-            STAT.cont() << "[";
-            for (auto const &i : actual) {
-                STAT.cont()
-                        << i.first->file << ":"
-                        << i.first->line << ":"
-                        << i.first->column
-                        << ",";
-            }
-            STAT.cont() << "]";
+            const LOCDesc<T> *pd = &desc;
+            reports.emplace_back([=]() {
+                STAT.show()
+                        << "LOC probe: " << pd->name
+                        << " (" << actual->size() << ") ";
+
+                STAT.cont() << "[";
+                for (auto const &i : *actual) {
+                    STAT.cont()
+                            << i.first->file << ":"
+                            << i.first->line << ":"
+                            << i.first->column
+                            << ",";
+                }
+                STAT.cont() << "]";
 
-            STAT.done();
+                STAT.done();
+            });
 #endif
         }
     }
 
+    void Prober::probeCall(CallInst *i) {
+        Function *func = i->getCalledFunction();
+        if (func == nullptr) {
+            return;
+        }
+
+        auto it = apis.find(func->getName());
+        if (it == apis.end()) {
+            return;
+        }
+
+        for (const auto &hit : it->second) {
+            hit(i);
+        }
+    }
+
+    void Prober::probeFrames(Instruction *i) {
+        // a location matches if any frame in the inlined-at chain matches
+        vector<const LOC *> matched;
+
+        DebugLoc dl = i->getDebugLoc();
+        while (dl && !dl.isImplicitCode()) {
+            auto fit = locs.find(stripFilename(dl));
+            if (fit != locs.end()) {
+                auto lit = fit->second.find(
+                        make_pair(dl.getLine(), dl.getCol())
+                );
+                if (lit != fit->second.end()) {
+                    for (const auto &entry : lit->second) {
+                        if (!opcodeMatches(i, *entry.loc)) {
+                            continue;
+                        }
+
+                        // hit each location once even with recursive inlining
+                        if (std::find(matched.begin(), matched.end(),
+                                      entry.loc) != matched.end()) {
+                            continue;
+                        }
+                        matched.push_back(entry.loc);
+
+                        entry.hit(i);
+                    }
+                }
+            }
+
+            DILocation *inlined = dl.getInlinedAt();
+            if (inlined == nullptr) {
+                break;
+            }
+            dl = DebugLoc(inlined);
+        }
+    }
+
+    void Prober::run(Module &m) {
+        for (Function &f : m) {
+            // ignore functions without body
+            if (f.isIntrinsic() || f.isDeclaration()) {
+                continue;
+            }
+
+            for (BasicBlock &bb : f) {
+                for (Instruction &i : bb) {
+                    if (!apis.empty() && isa<CallInst>(i)) {
+                        probeCall(cast<CallInst>(&i));
+                    }
+
+                    if (!locs.empty()) {
+                        probeFrames(&i);
+                    }
+                }
+            }
+        }
+
+        for (const auto &report : reports) {
+            report();
+        }
+    }
+
+    // probers
+    template<typename T>
+    void probeAPIs(Module &m,
+                   const vector<APIDesc<T>> &in,
+                   map<Instruction *, APIPack<T>> &out) {
+
+        Prober prober;
+        prober.addAPIs(in, out);
+        prober.run(m);
+    }
+
+    template<typename T>
+    void probeLOCs(Module &m,
+                   const vector<LOCDesc<T>> &in,
+                   map<Instruction *, LOCPack<T>> &out) {
+
+        Prober prober;
+        prober.addLOCs(in, out);
+        prober.run(m);
+    }
+
 #define INSTANTIATE_PROBE_TEMPLATE(type) \
+template void Prober::addAPIs<type>( \
+        const vector<APIDesc<type>> &in, \
+        map<Instruction *, APIPack<type>> &out); \
+        \
+template void Prober::addLOCs<type>( \
+        const vector<LOCDesc<type>> &in, \
+        map<Instruction *, LOCPack<type>> &out); \
+        \
 template void probeAPIs<type>( \
         Module &m, \
         const vector<APIDesc<type>> &in, \
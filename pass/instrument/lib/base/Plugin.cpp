@@ -2,7 +2,8 @@
 
 namespace racer {
 
-    void Instrumentor::run(const string &mode) {
+    void Instrumentor::run(const string &mode, bool coalesce, bool guard,
+                           bool patch, Recorder *recorder) {
         // collect functions, blocks, and instructions
         prepare();
 
@@ -41,7 +42,19 @@ namespace racer {
             // COV
             inst_cov_cfg();
 
-            // MEM
+            // MEM (the analyses are built and released per function)
+            for (auto &i : funcHT) {
+                FuncOracle &fo = oracle.getOracle(i.first);
+
+                prune_mem_access(i.first, fo);
+                prune_mem_redundant(i.first, fo);
+                hoist_mem_loop(i.first, fo);
+                if (coalesce) {
+                    coalesce_mem_access(i.first, fo);
+                }
+
+                oracle.releaseOracle(i.first);
+            }
             inst_mem_stack();
             inst_mem_access();
         }
@@ -52,7 +65,38 @@ namespace racer {
         }
 
         // dump the hooking information
-        record(SLOG);
+        if (recorder != nullptr) {
+            record(*recorder);
+        } else {
+            record(SLOG);
+        }
+
+        // guard the hooks at last, as it splits the blocks recorded above
+        if (guard || patch) {
+            dart.guardHooks(module, guard, patch ? &funcHT : nullptr);
+        }
+    }
+
+    string Instrumentor::getProfileSlice() {
+        string slice;
+        raw_string_ostream stm(slice);
+
+        json *special = getSpecialProcedure();
+        if (special != nullptr) {
+            stm << "special:" << special->dump() << "\n";
+        }
+
+        for (Function &f : module) {
+            if (f.isIntrinsic() || f.isDeclaration()) {
+                continue;
+            }
+            if (isFunctionIgnored(&f)) {
+                stm << "ignored:" << f.getName() << "\n";
+            }
+        }
+
+        stm.flush();
+        return slice;
     }
 
     void Instrumentor::prepare() {
@@ -244,6 +288,430 @@ namespace racer {
         }
     }
 
+    void Instrumentor::prune_mem_access(Function *func, FuncOracle &fo) {
+        /*
+         * NOTE: this has to run before inst_mem_stack, as the stack hooks
+         *       take the address of every alloca (i.e., capture them).
+         */
+        unsigned count = 0;
+
+        for (BasicBlock &bb : *func) {
+            for (Instruction &inst : bb) {
+                // should ignore the instrumented instructions
+                if (instHT.find(&inst) == instHT.end()) {
+                    continue;
+                }
+
+                Value *ptr;
+                if (auto *i_load = dyn_cast<LoadInst>(&inst)) {
+                    ptr = i_load->getPointerOperand();
+                } else if (auto *i_store = dyn_cast<StoreInst>(&inst)) {
+                    ptr = i_store->getPointerOperand();
+                } else {
+                    continue;
+                }
+
+                // accesses to non-escaping stack objects never race
+                if (fo.isLocalObject(ptr)) {
+                    ignoredMemAccess.insert(&inst);
+                    count++;
+                }
+            }
+        }
+
+        prunedMemAccess[func] = count;
+    }
+
+    bool Instrumentor::isSyncFreeBetween(
+            Instruction *from, Instruction *into,
+            map<BasicBlock *, set<BasicBlock *>> &reach
+    ) {
+        BasicBlock *head = from->getParent();
+        BasicBlock *tail = into->getParent();
+
+        // within the same block (from dominates into, hence comes first)
+        if (head == tail) {
+            return isSyncFreeRange(from->getNextNode(), into);
+        }
+
+        // rest of the head block
+        if (!isSyncFreeRange(from->getNextNode(), nullptr)) {
+            return false;
+        }
+
+        // blocks reachable from the head without passing the head again
+        // (computed once per head block and shared by all its queries)
+        auto it = reach.find(head);
+        if (it == reach.end()) {
+            set<BasicBlock *> blocks;
+            std::queue<BasicBlock *> pending;
+
+            for (BasicBlock *succ : successors(head)) {
+                if (succ != head && blocks.insert(succ).second) {
+                    pending.push(succ);
+                }
+            }
+            while (!pending.empty()) {
+                BasicBlock *cur = pending.front();
+                pending.pop();
+                for (BasicBlock *succ : successors(cur)) {
+                    if (succ != head && blocks.insert(succ).second) {
+                        pending.push(succ);
+                    }
+                }
+            }
+
+            it = reach.emplace(head, std::move(blocks)).first;
+        }
+        const set<BasicBlock *> &fwd = it->second;
+
+        if (fwd.find(tail) == fwd.end()) {
+            return false;
+        }
+
+        // out of them, the ones that also reach the tail
+        set<BasicBlock *> mid;
+        std::queue<BasicBlock *> todo;
+        mid.insert(tail);
+        todo.push(tail);
+        while (!todo.empty()) {
+            BasicBlock *cur = todo.front();
+            todo.pop();
+            for (BasicBlock *pred : predecessors(cur)) {
+                if (fwd.find(pred) != fwd.end() && mid.insert(pred).second) {
+                    todo.push(pred);
+                }
+            }
+        }
+
+        for (BasicBlock *bb : mid) {
+            if (bb != tail) {
+                if (!isSyncFreeRange(&bb->front(), nullptr)) {
+                    return false;
+                }
+                continue;
+            }
+
+            // the tail as a whole if it can be re-entered without the head
+            bool loop = false;
+            for (BasicBlock *succ : successors(tail)) {
+                if (mid.find(succ) != mid.end()) {
+                    loop = true;
+                    break;
+                }
+            }
+
+            if (!isSyncFreeRange(&tail->front(), loop ? nullptr : into)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void Instrumentor::prune_mem_redundant(Function *func, FuncOracle &fo) {
+        /*
+         * NOTE: a hook is dropped if it is dominated by a hook on the same
+         *       pointer that covers it (a write covers a read, and a larger
+         *       access covers a smaller one), with no synchronization point
+         *       on any path in between.
+         *
+         *       the accesses are walked in dominator-tree order and only the
+         *       nearest kept dominating hook that covers is tested, so each
+         *       access costs one check instead of one per dominating hook.
+         */
+        unsigned count = 0;
+
+        // collect plain accesses per (must-alias) pointer, in block order
+        map<Value *, vector<Instruction *>> accesses;
+        for (BasicBlock &bb : *func) {
+            for (Instruction &inst : bb) {
+                // should ignore the instrumented instructions
+                if (instHT.find(&inst) == instHT.end()) {
+                    continue;
+                }
+
+                if (ignoredMemAccess.count(&inst) != 0) {
+                    continue;
+                }
+
+                Value *ptr = getPlainAccessPointer(&inst);
+                if (ptr != nullptr) {
+                    accesses[ptr->stripPointerCasts()].push_back(&inst);
+                }
+            }
+        }
+
+        // blocks reachable from a head block, shared across pointers
+        map<BasicBlock *, set<BasicBlock *>> reach;
+
+        for (auto &a : accesses) {
+            // dominator-tree preorder (a stable sort keeps the order of the
+            // accesses within a block); unreachable blocks are left alone
+            vector<pair<unsigned, Instruction *>> order;
+            for (Instruction *i : a.second) {
+                unsigned pos;
+                if (fo.getDomOrder(i->getParent(), pos)) {
+                    order.emplace_back(pos, i);
+                }
+            }
+            std::stable_sort(
+                    order.begin(), order.end(),
+                    [](const pair<unsigned, Instruction *> &x,
+                       const pair<unsigned, Instruction *> &y) {
+                        return x.first < y.first;
+                    }
+            );
+
+            // kept hooks on the dominator-tree path to the current access
+            vector<Instruction *> chain;
+
+            for (auto &o : order) {
+                Instruction *cur = o.second;
+                while (!chain.empty() && !fo.dominates(chain.back(), cur)) {
+                    chain.pop_back();
+                }
+
+                // the nearest kept dominating hook that covers this one
+                Instruction *dom = nullptr;
+                for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+                    // a read does not cover a write
+                    if (isa<StoreInst>(cur) && !isa<StoreInst>(*it)) {
+                        continue;
+                    }
+                    if (getAccessSize(*it) < getAccessSize(cur)) {
+                        continue;
+                    }
+                    dom = *it;
+                    break;
+                }
+
+                if (dom != nullptr && isSyncFreeBetween(dom, cur, reach)) {
+                    ignoredMemAccess.insert(cur);
+                    count++;
+                    continue;
+                }
+
+                // only hooks that will be placed can cover others
+                chain.push_back(cur);
+            }
+        }
+
+        prunedMemAccess[func] += count;
+    }
+
+    bool Instrumentor::_hoist_candidates(
+            Loop *l, vector<Instruction *> &accesses
+    ) {
+        for (BasicBlock *bb : l->blocks()) {
+            for (Instruction &inst : *bb) {
+                // should ignore the instrumented instructions
+                if (instHT.find(&inst) == instHT.end()) {
+                    continue;
+                }
+
+                // no calls or synchronizations in the loop body
+                if (isSyncPoint(&inst)) {
+                    return false;
+                }
+
+                Value *ptr = getPlainAccessPointer(&inst);
+                if (ptr == nullptr) {
+                    if (inst.mayReadOrWriteMemory()) {
+                        return false;
+                    }
+                    continue;
+                }
+
+                if (ignoredMemAccess.count(&inst) == 0) {
+                    accesses.push_back(&inst);
+                }
+            }
+        }
+
+        return true;
+    }
+
+    void Instrumentor::hoist_mem_loop(Function *func, FuncOracle &fo) {
+        /*
+         * NOTE: as there is no synchronization in the loop, hooking the
+         *       whole range touched by an access before the loop starts is
+         *       equivalent to hooking it in every iteration
+         */
+        unsigned count = 0;
+
+        for (Loop *l : fo.getInnermostLoops()) {
+            // only rotated loops, where the latch is the only exit check
+            BasicBlock *preheader = l->getLoopPreheader();
+            BasicBlock *latch = l->getLoopLatch();
+            if (preheader == nullptr || latch == nullptr ||
+                l->getExitingBlock() != latch) {
+                continue;
+            }
+
+            vector<Instruction *> accesses;
+            if (!_hoist_candidates(l, accesses)) {
+                continue;
+            }
+
+            for (Instruction *inst : accesses) {
+                // the access must execute exactly once per iteration
+                if (!fo.dominates(inst->getParent(), latch)) {
+                    continue;
+                }
+
+                const SCEV *start;
+                const SCEV *length;
+                if (!fo.getLoopAccessRange(
+                        l, getPlainAccessPointer(inst),
+                        getAccessSize(inst), start, length
+                )) {
+                    continue;
+                }
+
+                Instruction *at = preheader->getTerminator();
+                Value *addr = fo.expandSCEV(start, at);
+                Value *size = fo.expandSCEV(length, at);
+
+                IRBuilder<> builder(at);
+                if (isa<StoreInst>(inst)) {
+                    dart.dart_hook_mem_write(
+                            builder,
+                            DART_FLAG_NONE, instHT[inst],
+                            addr, size
+                    );
+                } else {
+                    dart.dart_hook_mem_read(
+                            builder,
+                            DART_FLAG_NONE, instHT[inst],
+                            addr, size
+                    );
+                }
+
+                ignoredMemAccess.insert(inst);
+                count++;
+            }
+        }
+
+        hoistedMemAccess[func] = count;
+    }
+
+    void Instrumentor::_coalesce_run(
+            FuncOracle &fo,
+            vector<pair<int64_t, Instruction *>> &run, Value *base
+    ) {
+        if (run.size() < 2) {
+            run.clear();
+            return;
+        }
+
+        // order by offset while remembering the program order
+        vector<pair<int64_t, size_t>> order;
+        for (size_t k = 0; k < run.size(); k++) {
+            order.emplace_back(run[k].first, k);
+        }
+        std::sort(order.begin(), order.end());
+
+        // split into clusters of contiguous (or overlapping) accesses
+        size_t head = 0;
+        while (head < order.size()) {
+            int64_t lo = order[head].first;
+            int64_t hi = lo + getAccessSize(run[order[head].second].second);
+
+            size_t tail = head + 1;
+            while (tail < order.size() && order[tail].first <= hi) {
+                int64_t end = order[tail].first +
+                              getAccessSize(run[order[tail].second].second);
+                hi = std::max(hi, end);
+                tail++;
+            }
+
+            if (tail - head >= 2) {
+                // the hook is placed at the first access in program order
+                size_t first = order[head].second;
+                for (size_t k = head; k < tail; k++) {
+                    first = std::min(first, order[k].second);
+                }
+                Instruction *leader = run[first].second;
+
+                // which requires the base to be available there
+                auto *def = dyn_cast<Instruction>(base);
+                if (def == nullptr || fo.dominates(def, leader)) {
+                    MemAccessRange range{base, lo, uint64_t(hi - lo), {}};
+                    for (size_t k = head; k < tail; k++) {
+                        Instruction *inst = run[order[k].second].second;
+                        range.members.emplace_back(order[k].first - lo, inst);
+                        if (inst != leader) {
+                            ignoredMemAccess.insert(inst);
+                        }
+                    }
+                    coalescedMemAccess.emplace(leader, range);
+                }
+            }
+
+            head = tail;
+        }
+
+        run.clear();
+    }
+
+    void Instrumentor::coalesce_mem_access(Function *func, FuncOracle &fo) {
+        /*
+         * NOTE: a run is a sequence of plain accesses in the same direction on
+         *       the same base (at constant offsets), not interrupted by other
+         *       memory operations or synchronization points.
+         */
+        for (BasicBlock &bb : *func) {
+            vector<pair<int64_t, Instruction *>> run;
+            Value *runBase = nullptr;
+            bool runStore = false;
+
+            for (Instruction &inst : bb) {
+                // should ignore the instrumented instructions
+                if (instHT.find(&inst) == instHT.end()) {
+                    continue;
+                }
+
+                if (isSyncPoint(&inst)) {
+                    _coalesce_run(fo, run, runBase);
+                    continue;
+                }
+
+                // accesses that are not hooked do not matter
+                if (ignoredMemAccess.count(&inst) != 0) {
+                    continue;
+                }
+
+                Value *ptr = getPlainAccessPointer(&inst);
+                if (ptr == nullptr) {
+                    if (inst.mayReadOrWriteMemory()) {
+                        _coalesce_run(fo, run, runBase);
+                    }
+                    continue;
+                }
+
+                Value *base;
+                int64_t offset;
+                if (!fo.getConstantOffset(ptr, base, offset)) {
+                    _coalesce_run(fo, run, runBase);
+                    continue;
+                }
+
+                bool isStore = isa<StoreInst>(&inst);
+                if (!run.empty() &&
+                    (base != runBase || isStore != runStore)) {
+                    _coalesce_run(fo, run, runBase);
+                }
+
+                runBase = base;
+                runStore = isStore;
+                run.emplace_back(offset, &inst);
+            }
+
+            _coalesce_run(fo, run, runBase);
+        }
+    }
+
     void Instrumentor::inst_mem_access() {
         for (auto &i : instHT) {
             Instruction *inst = i.first;
@@ -253,6 +721,37 @@ namespace racer {
                 continue;
             }
 
+            // coalesced load and store instructions
+            {
+                auto it = coalescedMemAccess.find(inst);
+                if (it != coalescedMemAccess.end()) {
+                    const MemAccessRange &range = it->second;
+
+                    IRBuilder<> builder(inst);
+                    Value *addr = builder.CreateConstGEP1_64(
+                            builder.CreatePointerCast(
+                                    range.base, builder.getInt8PtrTy()
+                            ),
+                            uint64_t(range.offset)
+                    );
+
+                    if (isa<StoreInst>(inst)) {
+                        dart.dart_hook_mem_write(
+                                builder,
+                                DART_FLAG_NONE, instHT[inst],
+                                addr, dart.createDataValue(range.size)
+                        );
+                    } else {
+                        dart.dart_hook_mem_read(
+                                builder,
+                                DART_FLAG_NONE, instHT[inst],
+                                addr, dart.createDataValue(range.size)
+                        );
+                    }
+                    continue;
+                }
+            }
+
             // load and store instructions
             if (auto *i_load = dyn_cast<LoadInst>(inst)) {
                 IRBuilder<> builder(i_load);
@@ -363,6 +862,8 @@ namespace racer {
 
             L.map("meta");
             L.log("hash", size_t(i.second));
+            L.log("pruned", size_t(prunedMemAccess[i.first]));
+            L.log("hoisted", size_t(hoistedMemAccess[i.first]));
             L.pop();
 
             // record blocks
@@ -404,6 +905,20 @@ namespace racer {
                     L.log("hash", size_t(instHT[&inst]));
                     L.log("repr", Dumper::getValueRepr(&inst));
                     L.log("info", Dumper::getDebugRepr(&(inst.getDebugLoc())));
+
+                    // record which bytes of a ranged hook belong to whom
+                    auto it = coalescedMemAccess.find(&inst);
+                    if (it != coalescedMemAccess.end()) {
+                        L.vec("cover");
+                        for (auto &m : it->second.members) {
+                            L.map();
+                            L.log("offset", m.first);
+                            L.log("size", getAccessSize(m.second));
+                            L.log("hash", size_t(instHT[m.second]));
+                            L.pop();
+                        }
+                        L.pop();
+                    }
                     L.pop();
                 }
                 L.pop();
@@ -418,4 +933,82 @@ namespace racer {
         L.pop();
     }
 
-} /* namespace racer */
\ No newline at end of file
+    void Instrumentor::record(Recorder &R) {
+        bool lite = R.isLite();
+
+        // record meta information
+        vector<string> apis;
+        for (Function &f : module) {
+            if (f.isDeclaration() || f.isIntrinsic()) {
+                apis.push_back(f.getName().str());
+            }
+        }
+
+        vector<string> gvar;
+        if (!lite) {
+            for (GlobalVariable &g : module.globals()) {
+                gvar.push_back(Dumper::getValueRepr(&g));
+            }
+        }
+
+        vector<string> structs;
+        for (StructType *type : module.getIdentifiedStructTypes()) {
+            structs.push_back(type->getName().str());
+        }
+
+        R.module(seed, apis, gvar, structs);
+
+        // record functions, streamed in the same order as the json record
+        vector<uint64_t> pred, succ;
+        vector<RecordCover> cover;
+
+        for (auto &i : funcHT) {
+            R.func(i.first->getName(), size_t(i.second),
+                   prunedMemAccess[i.first], hoistedMemAccess[i.first]);
+
+            for (BasicBlock &bb : *i.first) {
+                // ignore blocks added for instrumentation
+                if (blockHT.find(&bb) == blockHT.end()) {
+                    continue;
+                }
+
+                // the cfg is not needed for locating hashes
+                pred.clear();
+                succ.clear();
+                if (!lite) {
+                    for (BasicBlock *p : predecessors(&bb)) {
+                        pred.push_back(size_t(blockHT[p]));
+                    }
+                    for (BasicBlock *s : successors(&bb)) {
+                        succ.push_back(size_t(blockHT[s]));
+                    }
+                }
+                R.block(size_t(blockHT[&bb]), pred, succ);
+
+                for (Instruction &inst : bb) {
+                    // ignore insts added for instrumentation
+                    if (instHT.find(&inst) == instHT.end()) {
+                        continue;
+                    }
+
+                    cover.clear();
+                    auto it = coalescedMemAccess.find(&inst);
+                    if (it != coalescedMemAccess.end()) {
+                        for (auto &m : it->second.members) {
+                            cover.push_back({
+                                    m.first,
+                                    getAccessSize(m.second),
+                                    size_t(instHT[m.second])
+                            });
+                        }
+                    }
+
+                    R.inst(size_t(instHT[&inst]),
+                           lite ? string() : Dumper::getValueRepr(&inst),
+                           inst.getDebugLoc(), cover);
+                }
+            }
+        }
+    }
+
+} /* namespace racer */
@@ -1 +1,98 @@
-#include "dart/API.h"
\ No newline at end of file
+#include "dart/API.h"
+
+namespace racer {
+
+    // x86_64 addresses per-cpu variables relative to the gs segment
+    static const unsigned PERCPU_ADDRESS_SPACE = 256;
+
+    void DartAPI::guardHooks(Module &module, bool mask,
+                             const map<Function *, hash_code> *patch) {
+        Type *mask_t = Type::getInt8Ty(ctxt);
+
+        Constant *ptr = nullptr;
+        if (mask) {
+            Constant *var = module.getOrInsertGlobal(
+                    __XSTR(DART_TRACING_VAR), mask_t
+            );
+            ptr = ConstantExpr::getIntToPtr(
+                    ConstantExpr::getPtrToInt(var, data_64_t),
+                    PointerType::get(mask_t, PERCPU_ADDRESS_SPACE)
+            );
+        }
+
+        Type *table_t = ArrayType::get(mask_t, 1ul << DART_PATCH_BITS);
+        Constant *table = nullptr;
+        if (patch != nullptr) {
+            table = module.getOrInsertGlobal(__XSTR(DART_PATCH_VAR), table_t);
+        }
+
+        // the slot of each function is loaded once at its entry
+        map<Function *, Value *> enabled;
+
+        // untraced execution dominates, predict the call as not taken
+        MDNode *weights = MDBuilder(ctxt).createBranchWeights(1, 1 << 20);
+
+        for (CallInst *call : hooks) {
+            // pause and resume have to be counted even when paused
+            Function *callee = call->getCalledFunction();
+            bool counted = callee == _DART_FUNC_NAME(func, exec, pause) ||
+                           callee == _DART_FUNC_NAME(func, exec, resume);
+
+            IRBuilder<> builder(call);
+            Value *cond = nullptr;
+
+            if (mask) {
+                unsigned bits = counted ?
+                                DART_TRACING_MASK_TRACE :
+                                DART_TRACING_MASK_ACTIVE;
+
+                LoadInst *val = builder.CreateLoad(mask_t, ptr, true);
+                cond = builder.CreateICmpNE(
+                        builder.CreateAnd(val, bits),
+                        ConstantInt::get(mask_t, 0)
+                );
+            }
+
+            // pause and resume come from the ignore list, not patchable
+            Function *func = call->getFunction();
+            if (patch != nullptr && !counted && patch->count(func) != 0) {
+                auto res = enabled.emplace(func, nullptr);
+                if (res.second) {
+                    Constant *idx[] = {
+                            ConstantInt::get(data_64_t, 0),
+                            ConstantInt::get(
+                                    data_64_t,
+                                    DART_PATCH_SLOT(size_t(patch->at(func)))
+                            ),
+                    };
+                    Constant *slot = ConstantExpr::getInBoundsGetElementPtr(
+                            table_t, table, idx
+                    );
+
+                    BasicBlock &entry = func->getEntryBlock();
+                    IRBuilder<> builderInit(&*entry.getFirstInsertionPt());
+                    res.first->second = builderInit.CreateICmpEQ(
+                            builderInit.CreateLoad(mask_t, slot, true),
+                            ConstantInt::get(mask_t, 0)
+                    );
+                }
+
+                Value *on = res.first->second;
+                cond = cond != nullptr ? builder.CreateAnd(cond, on) : on;
+            }
+
+            if (cond == nullptr) {
+                continue;
+            }
+
+            // move the call into the branch (rarely taken if masked)
+            Instruction *term = SplitBlockAndInsertIfThen(
+                    cond, call, false, mask ? weights : nullptr
+            );
+            call->moveBefore(term);
+        }
+
+        hooks.clear();
+    }
+
+} /* namespace racer */
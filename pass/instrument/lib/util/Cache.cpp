@@ -0,0 +1,176 @@
+#include "util/Cache.h"
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+
+#include <dlfcn.h>
+
+namespace racer {
+
+    // an address inside the pass library, to locate it
+    static char anchor;
+
+    InstrumentCache::InstrumentCache(const string &_dir, Module &m)
+            : dir(_dir) {
+
+        SmallVector<char, 0> buf;
+        raw_svector_ostream stm(buf);
+        WriteBitcodeToFile(m, stm);
+
+        // the seed of all hashes is derived from the module name
+        hasher.update(m.getName());
+        hasher.update(StringRef("\0", 1));
+        hasher.update(StringRef(buf.data(), buf.size()));
+        hasher.update(StringRef("\0", 1));
+        hasher.update(getBuildID());
+        hasher.update(StringRef("\0", 1));
+    }
+
+    void InstrumentCache::lookup(StringRef config) {
+        hasher.update(config);
+
+        MD5::MD5Result res;
+        hasher.final(res);
+
+        SmallString<32> key;
+        MD5::stringifyResult(res, key);
+
+        error_code ec = sys::fs::create_directories(dir);
+        assert(ec.value() == 0);
+
+        SmallString<256> path(dir);
+        sys::path::append(path, key);
+        pathModule = (path + ".bc").str();
+        pathRecord = (path + ".racer").str();
+    }
+
+    bool InstrumentCache::restore(Module &m, const string &output) {
+        // the record is saved after the module, so check it first
+        auto rec = MemoryBuffer::getFile(pathRecord, -1, false);
+        if (!rec) {
+            return false;
+        }
+
+        auto bc = MemoryBuffer::getFile(pathModule, -1, false);
+        if (!bc) {
+            return false;
+        }
+
+        auto cached = parseBitcodeFile(bc.get()->getMemBufferRef(),
+                                       m.getContext());
+        if (!cached) {
+            consumeError(cached.takeError());
+            return false;
+        }
+
+        // swap in the instrumented module
+        clearModule(m);
+        if (Linker::linkModules(m, std::move(cached.get()))) {
+            report_fatal_error("Failed to link the cached module: " +
+                               pathModule);
+        }
+
+        // and the record of it
+        error_code ec;
+        raw_fd_ostream stm(StringRef(output), ec, sys::fs::F_None);
+        assert(ec.value() == 0);
+
+        stm << rec.get()->getBuffer();
+        return true;
+    }
+
+    void InstrumentCache::saveModule(Module &m) {
+        SmallVector<char, 0> buf;
+        raw_svector_ostream stm(buf);
+        WriteBitcodeToFile(m, stm);
+
+        saveFile(pathModule, StringRef(buf.data(), buf.size()));
+    }
+
+    void InstrumentCache::saveRecord(const string &output) {
+        auto rec = MemoryBuffer::getFile(output, -1, false);
+        if (!rec) {
+            return;
+        }
+
+        saveFile(pathRecord, rec.get()->getBuffer());
+    }
+
+    StringRef InstrumentCache::getBuildID() {
+        static string id;
+        if (!id.empty()) {
+            return id;
+        }
+
+        // hash the pass library itself, so that a rebuild invalidates all
+        Dl_info info;
+        if (dladdr(&anchor, &info) != 0 && info.dli_fname != nullptr) {
+            auto lib = MemoryBuffer::getFile(info.dli_fname, -1, false);
+            if (lib) {
+                MD5 h;
+                h.update(lib.get()->getBuffer());
+
+                MD5::MD5Result res;
+                h.final(res);
+
+                SmallString<32> str;
+                MD5::stringifyResult(res, str);
+                id = str.str();
+                return id;
+            }
+        }
+
+        // fallback to the build time
+        id = string(__DATE__) + " " + __TIME__;
+        return id;
+    }
+
+    void InstrumentCache::saveFile(const string &path, StringRef data) {
+        // write to a unique file and rename, as modules compile in parallel
+        int fd;
+        SmallString<256> tmp;
+        if (sys::fs::createUniqueFile(path + ".%%%%%%", fd, tmp)) {
+            return;
+        }
+
+        {
+            raw_fd_ostream stm(fd, true);
+            stm << data;
+        }
+
+        if (sys::fs::rename(tmp, path)) {
+            sys::fs::remove(tmp);
+        }
+    }
+
+    void InstrumentCache::clearModule(Module &m) {
+        // detach every global value from its users before erasing
+        m.dropAllReferences();
+
+        for (GlobalValue &gv : m.global_values()) {
+            gv.replaceAllUsesWith(UndefValue::get(gv.getType()));
+        }
+
+        while (!m.empty()) {
+            m.begin()->eraseFromParent();
+        }
+        while (!m.global_empty()) {
+            m.global_begin()->eraseFromParent();
+        }
+        while (!m.alias_empty()) {
+            m.alias_begin()->eraseFromParent();
+        }
+        while (!m.ifunc_empty()) {
+            m.ifunc_begin()->eraseFromParent();
+        }
+        while (!m.named_metadata_empty()) {
+            m.named_metadata_begin()->eraseFromParent();
+        }
+
+        m.setModuleInlineAsm("");
+    }
+
+} /* namespace racer */
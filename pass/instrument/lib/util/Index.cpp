@@ -0,0 +1,120 @@
+#include "util/Index.h"
+
+namespace racer {
+
+    CompileIndex::CompileIndex(const string &path)
+            : head(nullptr), ignored(nullptr), special(nullptr),
+              strtab(nullptr) {
+
+        // large files are memory-mapped instead of read
+        auto mb = MemoryBuffer::getFile(path, -1, false);
+        if (!mb) {
+            return;
+        }
+        buffer = std::move(mb.get());
+
+        // not an index (e.g., the json profile)
+        size_t size = buffer->getBufferSize();
+        if (size < sizeof(Header)) {
+            return;
+        }
+
+        auto *h = reinterpret_cast<const Header *>(buffer->getBufferStart());
+        if (memcmp(h->magic, "RACERIDX", sizeof(h->magic)) != 0) {
+            return;
+        }
+        assert(h->version == VERSION);
+
+        // tables are sized in powers of two
+        assert((h->ignoredSlots & (h->ignoredSlots - 1)) == 0);
+        assert((h->specialSlots & (h->specialSlots - 1)) == 0);
+        assert(size == sizeof(Header) +
+                       sizeof(Slot) * (h->ignoredSlots + h->specialSlots) +
+                       h->strtabSize);
+
+        ignored = reinterpret_cast<const Slot *>(h + 1);
+        special = ignored + h->ignoredSlots;
+        strtab = reinterpret_cast<const char *>(special + h->specialSlots);
+        head = h;
+    }
+
+    const CompileIndex::Slot *CompileIndex::probe(
+            const Slot *table, uint32_t slots, uint64_t hash, uint32_t &cursor
+    ) {
+        // returns the next slot with the hash, starting from the cursor
+        while (cursor < slots) {
+            const Slot *slot = &table[(hash + cursor) & (slots - 1)];
+            cursor++;
+
+            if (slot->hash == 0) {
+                break;
+            }
+            if (slot->hash == hash) {
+                return slot;
+            }
+        }
+
+        cursor = slots;
+        return nullptr;
+    }
+
+    bool CompileIndex::isIgnored(StringRef name) {
+        if (head->ignoredSlots == 0) {
+            return false;
+        }
+
+        uint64_t h = hashSeed();
+        for (char c : name) {
+            h = hashStep(h, (unsigned char) c);
+        }
+        h = hashFinal(h);
+
+        // only the functions marked true are in the table
+        uint32_t cursor = 0;
+        while (const Slot *slot = probe(ignored, head->ignoredSlots,
+                                        h, cursor)) {
+            if (getString(slot->keyOff, slot->keyLen) == name) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool CompileIndex::getSpecial(StringRef path, StringRef &value) {
+        if (head->specialSlots == 0) {
+            return false;
+        }
+
+        /*
+         * NOTE: the hash of every suffix is derived in one backward scan,
+         *       and out of the matches, the smallest key is returned, which
+         *       is the one found first when iterating the json object
+         */
+        bool found = false;
+        StringRef best;
+
+        uint64_t h = hashSeed();
+        for (size_t n = 1; n <= path.size(); n++) {
+            h = hashStep(h, (unsigned char) path[path.size() - n]);
+            StringRef suffix = path.substr(path.size() - n);
+
+            uint32_t cursor = 0;
+            while (const Slot *slot = probe(special, head->specialSlots,
+                                            hashFinal(h), cursor)) {
+                StringRef key = getString(slot->keyOff, slot->keyLen);
+                if (key != suffix) {
+                    continue;
+                }
+
+                if (!found || key < best) {
+                    found = true;
+                    best = key;
+                    value = getString(slot->valOff, slot->valLen);
+                }
+            }
+        }
+
+        return found;
+    }
+
+} /* namespace racer */
@@ -0,0 +1,148 @@
+#include "util/Record.h"
+
+#include <llvm/Support/FileSystem.h>
+
+namespace racer {
+
+    Recorder::Recorder(const string &fn, bool _lite)
+            : stm(StringRef(fn), ec, sys::fs::F_None),
+              lite(_lite), cur(TAG_STR) {
+
+        assert(ec.value() == 0);
+
+        Header head;
+        memcpy(head.magic, "RACERREC", sizeof(head.magic));
+        head.version = VERSION;
+        head.flags = lite ? FLAG_LITE : 0;
+
+        stm.write(reinterpret_cast<const char *>(&head), sizeof(head));
+    }
+
+    Recorder::~Recorder() {
+        stm.flush();
+    }
+
+    uint32_t Recorder::intern(StringRef str) {
+        auto it = strings.find(str);
+        if (it != strings.end()) {
+            return it->second;
+        }
+
+        uint32_t id = strings.size();
+        strings.try_emplace(str, id);
+
+        // strings are written out of band, before the referencing record
+        uint32_t size = sizeof(id) + str.size();
+        stm.write(char(TAG_STR));
+        stm.write(reinterpret_cast<const char *>(&size), sizeof(size));
+        stm.write(reinterpret_cast<const char *>(&id), sizeof(id));
+        stm.write(str.data(), str.size());
+
+        return id;
+    }
+
+    void Recorder::begin(Tag tag) {
+        assert(payload.empty());
+        cur = tag;
+    }
+
+    void Recorder::end() {
+        uint32_t size = payload.size();
+        stm.write(char(cur));
+        stm.write(reinterpret_cast<const char *>(&size), sizeof(size));
+        stm.write(payload.data(), payload.size());
+
+        payload.clear();
+    }
+
+    void Recorder::putStrs(const vector<string> &strs) {
+        // intern before the record starts, so that STRs precede it
+        vector<uint32_t> ids;
+        for (const string &s : strs) {
+            ids.push_back(intern(s));
+        }
+
+        put<uint32_t>(ids.size());
+        for (uint32_t id : ids) {
+            put<uint32_t>(id);
+        }
+    }
+
+    void Recorder::putHashes(const vector<uint64_t> &hashes) {
+        put<uint32_t>(hashes.size());
+        for (uint64_t h : hashes) {
+            put<uint64_t>(h);
+        }
+    }
+
+    void Recorder::module(uint64_t seed,
+                          const vector<string> &apis,
+                          const vector<string> &gvar,
+                          const vector<string> &structs) {
+
+        begin(TAG_MODULE);
+        put<uint64_t>(seed);
+        putStrs(apis);
+        putStrs(gvar);
+        putStrs(structs);
+        end();
+    }
+
+    void Recorder::func(StringRef name,
+                        uint64_t hash, uint64_t pruned, uint64_t hoisted) {
+
+        uint32_t id = intern(name);
+
+        begin(TAG_FUNC);
+        put<uint32_t>(id);
+        put<uint64_t>(hash);
+        put<uint64_t>(pruned);
+        put<uint64_t>(hoisted);
+        end();
+    }
+
+    void Recorder::block(uint64_t hash,
+                         const vector<uint64_t> &pred,
+                         const vector<uint64_t> &succ) {
+
+        begin(TAG_BLOCK);
+        put<uint64_t>(hash);
+        putHashes(pred);
+        putHashes(succ);
+        end();
+    }
+
+    void Recorder::inst(uint64_t hash, StringRef repr, const DebugLoc &loc,
+                        const vector<RecordCover> &cover) {
+
+        uint32_t reprId = lite ? NONE : intern(repr);
+
+        // frames, from the innermost location to the inlined-at root
+        vector<tuple<uint32_t, uint32_t, uint32_t>> frames;
+        for (DILocation *dl = loc.get(); dl; dl = dl->getInlinedAt()) {
+            frames.emplace_back(
+                    intern(dl->getFilename()), dl->getLine(), dl->getColumn()
+            );
+        }
+
+        begin(TAG_INST);
+        put<uint64_t>(hash);
+        put<uint32_t>(reprId);
+
+        put<uint32_t>(frames.size());
+        for (auto &f : frames) {
+            put<uint32_t>(std::get<0>(f));
+            put<uint32_t>(std::get<1>(f));
+            put<uint32_t>(std::get<2>(f));
+        }
+
+        put<uint32_t>(cover.size());
+        for (auto &c : cover) {
+            put<int64_t>(c.offset);
+            put<uint64_t>(c.size);
+            put<uint64_t>(c.hash);
+        }
+        end();
+    }
+
+} /* namespace racer */
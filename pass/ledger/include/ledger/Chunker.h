@@ -0,0 +1,33 @@
+#ifndef _RACER_LEDGER_CHUNKER_H_
+#define _RACER_LEDGER_CHUNKER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace racer {
+
+    using std::vector;
+
+    /*
+     * content-defined chunking (gear hash, cut on the top bits so that a
+     * cut depends on the last 64 bytes), used by the result store to find
+     * the parts the artifacts of nearby executions share, mirrored by the
+     * python fallback in script/fuzz_store.py
+     */
+    class Chunker {
+    public:
+        static const size_t CHUNK_MIN = 2u << 10;
+        static const size_t CHUNK_MAX = 64u << 10;
+        static const unsigned CHUNK_BITS = 13;  // 8 KB on average
+
+        // the end offsets of the chunks, the last one being size
+        static vector<uint64_t> cut(const uint8_t *data, size_t size);
+
+    protected:
+        static const uint64_t *gear();
+    };
+
+} /* namespace racer */
+
+#endif /* _RACER_LEDGER_CHUNKER_H_ */
@@ -0,0 +1,97 @@
+#ifndef _RACER_LEDGER_DECODER_H_
+#define _RACER_LEDGER_DECODER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace racer {
+
+    using std::string;
+    using std::vector;
+
+    /*
+     * decoder of the ledger produced by the dart runtime into columns, so
+     * that the analyzer walks plain arrays instead of the byte stream:
+     *  - code/ptid/info/hval: one item per entry
+     *  - args: the arguments of all entries back to back, the ones of the
+     *    i-th entry are in [argOff[i], argOff[i + 1])
+     * the argument counts come from apidef.inc, the same list the runtime
+     * encodes the entries with, the ledger formats mirror dart_log.h
+     */
+    class LedgerDecoder {
+    public:
+        explicit LedgerDecoder(const string &path);
+
+        ~LedgerDecoder() = default;
+
+    public:
+        bool isValid() {
+            return error.empty();
+        }
+
+        const string &getError() {
+            return error;
+        }
+
+        // apidef.inc derived metadata, indexed by the enum
+        static uint32_t getEnumNum();
+        static uint32_t getArgc(uint32_t code);
+        static const char *getName(uint32_t code);
+
+    public:
+        vector<uint32_t> code;
+        vector<uint32_t> ptid;
+        vector<uint64_t> info;
+        vector<uint64_t> hval;
+        vector<uint64_t> argOff;
+        vector<uint64_t> args;
+
+    protected:
+        // mirrors dart_log.h
+        static const uint64_t FLAG_SEGMENTED = 1ull << 63;
+        static const uint64_t FLAG_COMPACT = 1ull << 62;
+        static const size_t CHUNK_SIZE = 1ul << 20;
+
+        static const uint8_t COMPACT_NEW_PTID = 1u << 0;
+        static const uint8_t COMPACT_ZERO_INFO = 1u << 1;
+        static const uint8_t COMPACT_HVAL_DELTA = 1u << 2;
+        static const uint8_t COMPACT_HVAL_RAW = 2u << 2;
+
+        struct Header {
+            uint64_t num;
+            uint64_t cur;
+        };
+
+        struct Entry {
+            uint32_t code;
+            uint32_t ptid;
+            uint64_t info;
+            uint64_t hval;
+        };
+
+        struct Chunk {
+            uint32_t cpu;
+            uint32_t used;
+            uint64_t count;
+        };
+
+        bool fail(const string &reason);
+
+        void reserve(uint64_t num);
+
+        // returns the size of the entry, or 0 if it is malformed
+        size_t putEntry(const char *cur, const char *end);
+
+        bool decodeFlat(const char *data, size_t size, uint64_t num);
+        bool decodeSegmented(const char *data, size_t size, uint64_t num);
+        bool decodeCompact(const char *data, size_t size, uint64_t num);
+
+    protected:
+        string error;
+    };
+
+} /* namespace racer */
+
+#endif /* _RACER_LEDGER_DECODER_H_ */
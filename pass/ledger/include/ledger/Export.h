@@ -0,0 +1,46 @@
+#ifndef _RACER_LEDGER_EXPORT_H_
+#define _RACER_LEDGER_EXPORT_H_
+
+#include <stdint.h>
+
+/*
+ * c interface of the decoder (loaded by script/dart.py through ctypes), the
+ * columns are owned by the handle and stay valid until it is closed, the
+ * handle is returned even on failure, with the reason in error
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct racer_ledger {
+    uint64_t num;
+    uint64_t nargs;
+    const uint32_t *code;
+    const uint32_t *ptid;
+    const uint64_t *info;
+    const uint64_t *hval;
+    const uint64_t *arg_off;
+    const uint64_t *args;
+    const char *error;
+    void *priv;
+};
+
+struct racer_ledger *racer_ledger_open(const char *path);
+void racer_ledger_close(struct racer_ledger *ledger);
+
+uint32_t racer_ledger_enum_num(void);
+uint32_t racer_ledger_enum_argc(uint32_t code);
+const char *racer_ledger_enum_name(uint32_t code);
+
+/*
+ * content-defined chunking for the result store, writes the end offsets of
+ * up to max chunks into cuts and returns how many chunks there are
+ */
+uint64_t racer_chunk_cuts(const uint8_t *data, uint64_t size,
+                          uint64_t *cuts, uint64_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RACER_LEDGER_EXPORT_H_ */
@@ -0,0 +1,58 @@
+#include "ledger/Chunker.h"
+
+namespace racer {
+
+    namespace {
+
+        // splitmix64 from zero, cheap to reproduce in the scripts
+        struct GearTable {
+            uint64_t items[256];
+
+            GearTable() {
+                uint64_t state = 0;
+                for (auto &item : items) {
+                    state += 0x9e3779b97f4a7c15ull;
+                    uint64_t z = state;
+                    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                    item = z ^ (z >> 31);
+                }
+            }
+        };
+
+    } /* anonymous namespace */
+
+    const uint64_t *Chunker::gear() {
+        static const GearTable table;
+        return table.items;
+    }
+
+    vector<uint64_t> Chunker::cut(const uint8_t *data, size_t size) {
+        const uint64_t *table = gear();
+        const unsigned shift = 64 - CHUNK_BITS;
+
+        vector<uint64_t> cuts;
+        cuts.reserve(size / (CHUNK_MIN << 2) + 1);
+
+        size_t base = 0;
+        while (base < size) {
+            size_t end = base + CHUNK_MAX < size ? base + CHUNK_MAX : size;
+            size_t pos = base + CHUNK_MIN < end ? base + CHUNK_MIN : end;
+
+            uint64_t h = 0;
+            for (; pos < end; pos++) {
+                h = (h << 1) + table[data[pos]];
+                if ((h >> shift) == 0) {
+                    pos++;
+                    break;
+                }
+            }
+
+            cuts.push_back(pos);
+            base = pos;
+        }
+
+        return cuts;
+    }
+
+} /* namespace racer */
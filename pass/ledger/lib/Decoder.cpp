@@ -0,0 +1,352 @@
+#include "ledger/Decoder.h"
+
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <tuple>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apidef.inc"
+
+namespace racer {
+
+    // per-enum metadata, generated from the same list as the runtime
+#define _LEDGER_ARGC_ITEM(T, V) + 1
+
+#define DART_FUNC(major, minor, ...) \
+        (0 VARDEF2(_LEDGER_ARGC_ITEM, , __VA_ARGS__)),
+    static const uint32_t ENUM_ARGC[] = {
+            0,
+#include "apidef.inc"
+    };
+#undef DART_FUNC
+
+#define DART_FUNC(major, minor, ...) \
+        __XSTR(major) "_" __XSTR(minor),
+    static const char *ENUM_NAME[] = {
+            "_BEGIN_OF_ENUM",
+#include "apidef.inc"
+    };
+#undef DART_FUNC
+
+    static const uint32_t ENUM_NUM = sizeof(ENUM_ARGC) / sizeof(ENUM_ARGC[0]);
+
+    uint32_t LedgerDecoder::getEnumNum() {
+        return ENUM_NUM;
+    }
+
+    uint32_t LedgerDecoder::getArgc(uint32_t code) {
+        return code < ENUM_NUM ? ENUM_ARGC[code] : 0;
+    }
+
+    const char *LedgerDecoder::getName(uint32_t code) {
+        return code < ENUM_NUM ? ENUM_NAME[code] : nullptr;
+    }
+
+    LedgerDecoder::LedgerDecoder(const string &path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            fail("unable to open " + path);
+            return;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Header)) {
+            close(fd);
+            fail("no ledger header in " + path);
+            return;
+        }
+
+        size_t size = st.st_size;
+        void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            fail("unable to map " + path);
+            return;
+        }
+
+        // the whole ledger is read once, front to back
+        madvise(addr, size, MADV_SEQUENTIAL);
+
+        const char *base = static_cast<const char *>(addr);
+        Header head;
+        memcpy(&head, base, sizeof(head));
+
+        const char *data = base + sizeof(head);
+        size_t avail = size - sizeof(head);
+
+        if (head.cur & FLAG_SEGMENTED) {
+            size_t length = head.cur & ~FLAG_SEGMENTED;
+            if (length <= avail) {
+                decodeSegmented(data, length, head.num);
+            } else {
+                fail("truncated segmented ledger");
+            }
+        } else if (head.cur & FLAG_COMPACT) {
+            size_t length = head.cur & ~FLAG_COMPACT;
+            if (length <= avail) {
+                decodeCompact(data, length, head.num);
+            } else {
+                fail("truncated compact ledger");
+            }
+        } else {
+            // the cursor of a flat ledger may run past what was saved
+            decodeFlat(data, avail, head.num);
+        }
+
+        munmap(addr, size);
+    }
+
+    bool LedgerDecoder::fail(const string &reason) {
+        if (error.empty()) {
+            error = reason;
+        }
+        return false;
+    }
+
+    void LedgerDecoder::reserve(uint64_t num) {
+        code.reserve(num);
+        ptid.reserve(num);
+        info.reserve(num);
+        hval.reserve(num);
+        argOff.reserve(num + 1);
+        // most entries carry two arguments (mem access), one at the least
+        args.reserve(num * 2);
+
+        argOff.push_back(0);
+    }
+
+    size_t LedgerDecoder::putEntry(const char *cur, const char *end) {
+        if (end - cur < ptrdiff_t(sizeof(Entry))) {
+            return 0;
+        }
+
+        Entry item;
+        memcpy(&item, cur, sizeof(item));
+        if (item.code >= ENUM_NUM) {
+            return 0;
+        }
+
+        size_t argc = getArgc(item.code);
+        size_t need = sizeof(Entry) + sizeof(uint64_t) * argc;
+        if (size_t(end - cur) < need) {
+            return 0;
+        }
+
+        code.push_back(item.code);
+        ptid.push_back(item.ptid);
+        info.push_back(item.info);
+        hval.push_back(item.hval);
+
+        size_t pos = args.size();
+        args.resize(pos + argc);
+        memcpy(args.data() + pos, cur + sizeof(Entry),
+               sizeof(uint64_t) * argc);
+        argOff.push_back(args.size());
+
+        return need;
+    }
+
+    bool LedgerDecoder::decodeFlat(const char *data, size_t size,
+                                   uint64_t num) {
+        reserve(num);
+
+        const char *cur = data;
+        const char *end = data + size;
+        for (uint64_t i = 0; i < num; i++) {
+            size_t step = putEntry(cur, end);
+            if (step == 0) {
+                return fail("malformed entry " + std::to_string(i));
+            }
+            cur += step;
+        }
+
+        return true;
+    }
+
+    bool LedgerDecoder::decodeSegmented(const char *data, size_t size,
+                                        uint64_t num) {
+        typedef std::pair<uint64_t, const char *> Item;
+
+        // each chunk is a sorted run of (tsc stamp, entry)
+        vector<vector<Item>> runs;
+        uint64_t count = 0;
+
+        for (size_t base = 0; base + sizeof(Chunk) <= size;
+             base += CHUNK_SIZE) {
+
+            Chunk chunk;
+            memcpy(&chunk, data + base, sizeof(chunk));
+
+            const char *cur = data + base + sizeof(Chunk);
+            const char *end = cur + chunk.used;
+            if (end > data + size) {
+                return fail("chunk overflows the ledger");
+            }
+
+            vector<Item> run;
+            run.reserve(chunk.count);
+            while (cur < end) {
+                if (end - cur < ptrdiff_t(sizeof(uint64_t) + sizeof(Entry))) {
+                    return fail("truncated entry in chunk");
+                }
+
+                uint64_t stamp;
+                uint32_t cval;
+                memcpy(&stamp, cur, sizeof(stamp));
+                memcpy(&cval, cur + sizeof(stamp), sizeof(cval));
+                if (cval >= ENUM_NUM) {
+                    return fail("unknown entry " + std::to_string(cval));
+                }
+
+                run.emplace_back(stamp, cur + sizeof(stamp));
+                cur += sizeof(stamp) + sizeof(Entry) +
+                       sizeof(uint64_t) * getArgc(cval);
+            }
+
+            if (run.size() != chunk.count) {
+                return fail("chunk count mismatch");
+            }
+
+            count += run.size();
+            runs.push_back(std::move(run));
+        }
+
+        if (count != num) {
+            return fail("ledger count mismatch");
+        }
+
+        reserve(num);
+
+        // k-way merge on the stamps, ties go to the earlier chunk
+        typedef std::tuple<uint64_t, size_t, size_t> Head;
+        std::priority_queue<Head, vector<Head>, std::greater<Head>> heap;
+        for (size_t i = 0; i < runs.size(); i++) {
+            if (!runs[i].empty()) {
+                heap.emplace(runs[i][0].first, i, 0);
+            }
+        }
+
+        const char *end = data + size;
+        while (!heap.empty()) {
+            Head top = heap.top();
+            heap.pop();
+
+            size_t r = std::get<1>(top);
+            size_t k = std::get<2>(top);
+            if (putEntry(runs[r][k].second, end) == 0) {
+                return fail("malformed entry in chunk");
+            }
+
+            if (++k < runs[r].size()) {
+                heap.emplace(runs[r][k].first, r, k);
+            }
+        }
+
+        return true;
+    }
+
+    // little-endian base-128, see dart_varint_put()
+    static inline bool getVarint(const uint8_t *&cur, const uint8_t *end,
+                                 uint64_t &val) {
+        val = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            if (cur == end) {
+                return false;
+            }
+
+            uint8_t b = *cur++;
+            val |= uint64_t(b & 0x7f) << shift;
+            if (b < 0x80) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static inline uint64_t unZigzag(uint64_t z) {
+        return (z >> 1) ^ (~(z & 1) + 1);
+    }
+
+    bool LedgerDecoder::decodeCompact(const char *data, size_t size,
+                                      uint64_t num) {
+        reserve(num);
+
+        // per-ptid state, referred to by the index of the ptid
+        vector<uint32_t> ptids;
+        vector<uint64_t> hvals;
+
+        const uint8_t *cur = reinterpret_cast<const uint8_t *>(data);
+        const uint8_t *end = cur + size;
+
+        for (uint64_t i = 0; i < num; i++) {
+            if (end - cur < 2) {
+                return fail("truncated entry " + std::to_string(i));
+            }
+
+            uint8_t flags = *cur++;
+            uint8_t cval = *cur++;
+            if (cval >= ENUM_NUM) {
+                return fail("unknown entry " + std::to_string(cval));
+            }
+
+            uint64_t pidx, val;
+            if (!getVarint(cur, end, pidx)) {
+                return fail("truncated ptid index " + std::to_string(i));
+            }
+
+            if (flags & COMPACT_NEW_PTID) {
+                if (!getVarint(cur, end, val)) {
+                    return fail("truncated ptid " + std::to_string(i));
+                }
+                if (pidx >= ptids.size()) {
+                    ptids.resize(pidx + 1);
+                    hvals.resize(pidx + 1);
+                }
+                ptids[pidx] = val;
+                hvals[pidx] = 0;
+            } else if (pidx >= ptids.size()) {
+                return fail("unknown ptid index " + std::to_string(i));
+            }
+
+            uint64_t einfo = 0;
+            if (!(flags & COMPACT_ZERO_INFO) && !getVarint(cur, end, einfo)) {
+                return fail("truncated info " + std::to_string(i));
+            }
+
+            if (flags & COMPACT_HVAL_RAW) {
+                if (end - cur < ptrdiff_t(sizeof(uint64_t))) {
+                    return fail("truncated hval " + std::to_string(i));
+                }
+                memcpy(&hvals[pidx], cur, sizeof(uint64_t));
+                cur += sizeof(uint64_t);
+            } else if (flags & COMPACT_HVAL_DELTA) {
+                if (!getVarint(cur, end, val)) {
+                    return fail("truncated hval " + std::to_string(i));
+                }
+                hvals[pidx] += unZigzag(val);
+            }
+
+            code.push_back(cval);
+            ptid.push_back(ptids[pidx]);
+            info.push_back(einfo);
+            hval.push_back(hvals[pidx]);
+
+            for (uint32_t k = 0; k < ENUM_ARGC[cval]; k++) {
+                if (!getVarint(cur, end, val)) {
+                    return fail("truncated args " + std::to_string(i));
+                }
+                args.push_back(unZigzag(val));
+            }
+            argOff.push_back(args.size());
+        }
+
+        return true;
+    }
+
+} /* namespace racer */
@@ -0,0 +1,61 @@
+#include "ledger/Export.h"
+#include "ledger/Decoder.h"
+#include "ledger/Chunker.h"
+
+#include <cstring>
+
+using racer::LedgerDecoder;
+using racer::Chunker;
+
+struct racer_ledger *racer_ledger_open(const char *path) {
+    LedgerDecoder *dec = new LedgerDecoder(path);
+
+    struct racer_ledger *ledger = new racer_ledger();
+    ledger->priv = dec;
+
+    if (!dec->isValid()) {
+        ledger->error = dec->getError().c_str();
+        return ledger;
+    }
+
+    ledger->num = dec->code.size();
+    ledger->nargs = dec->args.size();
+    ledger->code = dec->code.data();
+    ledger->ptid = dec->ptid.data();
+    ledger->info = dec->info.data();
+    ledger->hval = dec->hval.data();
+    ledger->arg_off = dec->argOff.data();
+    ledger->args = dec->args.data();
+    ledger->error = nullptr;
+    return ledger;
+}
+
+void racer_ledger_close(struct racer_ledger *ledger) {
+    if (ledger == nullptr) {
+        return;
+    }
+
+    delete static_cast<LedgerDecoder *>(ledger->priv);
+    delete ledger;
+}
+
+uint32_t racer_ledger_enum_num(void) {
+    return LedgerDecoder::getEnumNum();
+}
+
+uint32_t racer_ledger_enum_argc(uint32_t code) {
+    return LedgerDecoder::getArgc(code);
+}
+
+const char *racer_ledger_enum_name(uint32_t code) {
+    return LedgerDecoder::getName(code);
+}
+
+uint64_t racer_chunk_cuts(const uint8_t *data, uint64_t size,
+                          uint64_t *cuts, uint64_t max) {
+    std::vector<uint64_t> ends = Chunker::cut(data, size);
+    if (ends.size() <= max) {
+        memcpy(cuts, ends.data(), sizeof(uint64_t) * ends.size());
+    }
+    return ends.size();
+}
@@ -34,6 +34,24 @@ def _clang_wrap(mode: str, output: str) -> List[str]:
         racer.path_src, 'profile', 'linux.json'
     )
 
+    # prefer the binary index unless the profile is updated after indexing
+    path_racer_index = os.path.join(
+        racer.path_store, 'profile', 'linux.index'
+    )
+    if os.path.exists(path_racer_index) and \
+            os.path.getmtime(path_racer_index) >= \
+            os.path.getmtime(path_racer_profile):
+        path_racer_profile = path_racer_index
+
+    # guard the hooks inline if configured
+    guard = ['-mllvm', '-racer-guard'] if config.PASS_HOOK_GUARD else []
+    if config.PASS_HOOK_PATCH:
+        guard += ['-mllvm', '-racer-patch']
+
+    # reuse the instrumented modules if configured
+    cache = ['-mllvm', '-racer-cache', '-mllvm', config.PASS_CACHE_PATH] \
+        if config.PASS_CACHE else []
+
     return _clang() + [
         # KASAN, KTSAN needs this
         '-fno-experimental-new-pass-manager',
@@ -44,7 +62,8 @@ def _clang_wrap(mode: str, output: str) -> List[str]:
         '-mllvm', '-racer-mode', '-mllvm', mode,
         '-mllvm', '-racer-input', '-mllvm', path_racer_profile,
         '-mllvm', '-racer-output', '-mllvm', output,
-    ]
+        '-mllvm', '-racer-record', '-mllvm', config.PASS_RECORD_FORMAT,
+    ] + guard + cache
 
 
 def main(argv: List[str]) -> int:
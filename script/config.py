@@ -1,5 +1,6 @@
 import os
 import sys
+import struct
 import multiprocessing
 
 from config_option import Option
@@ -60,11 +61,32 @@ SCRIPT_PATH = os.path.join(PROJ_PATH, 'script')
 # pass configs
 PASS_PATH = os.path.join(PROJ_PATH, 'pass')
 
+# guard each hook inline with the per-cpu tracing mask (DART_TRACING_GUARD),
+# set to False to always call into the dart wrappers (for comparison)
+PASS_HOOK_GUARD = True
+
+# also guard each hook with the patch table slot of its function
+# (DART_HOOK_PATCH), so that the guest can turn functions off before launch
+PASS_HOOK_PATCH = False
+
+# format of the per-module instrumentation record: json (the full tree, for
+# debugging), binary (streamed, interned), or lite (hashes and locations)
+PASS_RECORD_FORMAT = 'binary'
+
+# reuse instrumented modules across kernel rebuilds (opt-in), keyed on the
+# incoming bitcode, the pass library, the options, and the profile slice
+PASS_CACHE = False
+PASS_CACHE_PATH = os.path.join(STUDIO_PATH, 'cache', 'instrument')
+
 # linux configs
 LINUX_VERSION = 'v5.4-rc5'
 LINUX_MOD_MAIN_MAX = 8
 LINUX_MOD_DEPS_MAX = 32
 
+# let the kernel mark the syscall contexts of the interpreting threads on its
+# syscall entry/exit, instead of two extra dart syscalls around each syscall
+INITRAMFS_SYSCALL_AUTO = False
+
 # virtex machine configs
 VIRTEX_SMP = 4
 VIRTEX_MEM_SIZE = 16 * (1 << 10)
@@ -83,44 +105,94 @@ VIRTEX_THREAD_NUM = 4
 # timeout
 VIRTEX_TIMEOUT = 120
 
+# snapshot mode: boot, load modules, and mount once, save the machine state
+# there, and restore it for every program instead of booting
+VIRTEX_SNAPSHOT = False
+VIRTEX_SNAPSHOT_DIR = os.path.join(VIRTEX_TMP_DIR, 'racer-snapshot')
+
+# persistent mode: keep the guest up and stream programs into it, the guest
+# is rebooted after this many programs or after a failed one
+VIRTEX_PERSISTENT = False
+VIRTEX_PERSISTENT_PROGRAMS = 500
+
+# guest status in the instance metadata (mirrors SHMEM_STATUS_* in common.h)
+SHMEM_STATUS_BOOT = 0
+SHMEM_STATUS_DONE = 1
+SHMEM_STATUS_SNAPSHOT = 2
+SHMEM_STATUS_RESUME = 3
+SHMEM_STATUS_WAITING = 4
+SHMEM_STATUS_PROGRAM = 5
+SHMEM_STATUS_SHUTDOWN = 6
+
 
 # instmem and ivshmem configs (all unit in MB)
 
 #
-# |  4 MB | -> header
-# |  4 MB | -> cov_cfg_edge
+# |  4 MB | -> header   (region table, read by the guest)
+# |  4 MB | -> cov_cfg_edge   (40 MB each with COV_TREE)
 # |  4 MB | -> cov_dfg_edge
 # |  4 MB | -> cov_alias_inst
-# |240 MB | -> (reserved)
+# |240 MB | -> (reserved)     (132 MB with COV_TREE)
 #
 # --------- (256 MB) header
 #
-# |  2 MB | -> metadata (userspace: mount options, etc)
-# | 48 MB | -> bytecode (userspace: program to interpret)
-# | 12 MB | -> strace   (userspace: syscall logs)
-# |  2 MB | -> rtinfo   (kernel   : runtime info)
-# | 64 MB | -> rtrace   (kernel   : racing access logs)
-#
-# --------- (128 MB) instance-specific workspace
+# then the instances, each with a user part and a kernel part, the sizes of
+# the regions are configured below and published in the region table
+# (mirrors struct ivshmem_table in pass/dart/dart_layout.h)
 #
 
 def _MB(i: int) -> int:
     return i * (1 << 20)
 
 
+# per-instance region sizes, in the order of enum instmem_region
+INSTMEM_REGIONS_USER = [
+    ('metadata', _MB(2)),   # userspace: mount options, etc
+    ('bytecode', _MB(48)),  # userspace: program to interpret
+    ('strace', _MB(12)),    # userspace: syscall logs
+]
+
+INSTMEM_REGIONS_KERN = [
+    ('rtinfo', _MB(2)),     # kernel: runtime info
+    ('rtrace', _MB(30)),    # kernel: racing access logs
+    ('ledger', _MB(34)),    # kernel: ledger ring drained by the host
+]
+
+INSTMEM_SIZE_USER = sum([size for _, size in INSTMEM_REGIONS_USER])
+INSTMEM_SIZE_KERN = sum([size for _, size in INSTMEM_REGIONS_KERN])
+INSTMEM_SIZE = INSTMEM_SIZE_USER + INSTMEM_SIZE_KERN
+
+# offsets within the instance (the kernel part follows the user part)
 INSTMEM_OFFSET_METADATA = 0
-INSTMEM_OFFSET_BYTECODE = INSTMEM_OFFSET_METADATA + _MB(2)
-INSTMEM_OFFSET_STRACE = INSTMEM_OFFSET_BYTECODE + _MB(48)
-INSTMEM_OFFSET_RTINFO = INSTMEM_OFFSET_STRACE + _MB(12)
-INSTMEM_OFFSET_RTRACE = INSTMEM_OFFSET_RTINFO + _MB(2)
-INSTMEM_SIZE = INSTMEM_OFFSET_RTRACE + _MB(64)
+INSTMEM_OFFSET_BYTECODE = INSTMEM_OFFSET_METADATA + INSTMEM_REGIONS_USER[0][1]
+INSTMEM_OFFSET_STRACE = INSTMEM_OFFSET_BYTECODE + INSTMEM_REGIONS_USER[1][1]
+INSTMEM_OFFSET_RTINFO = INSTMEM_SIZE_USER
+INSTMEM_OFFSET_RTRACE = INSTMEM_OFFSET_RTINFO + INSTMEM_REGIONS_KERN[0][1]
+INSTMEM_OFFSET_LEDGER = INSTMEM_OFFSET_RTRACE + INSTMEM_REGIONS_KERN[1][1]
+
+INSTMEM_SIZE_BYTECODE = INSTMEM_REGIONS_USER[1][1]
+INSTMEM_SIZE_STRACE = INSTMEM_REGIONS_USER[2][1]
+INSTMEM_SIZE_RTRACE = INSTMEM_REGIONS_KERN[1][1]
+INSTMEM_SIZE_LEDGER = INSTMEM_REGIONS_KERN[2][1]
+
+# the guest maps the user part at a fixed address, against which the
+# pointers in the bytecode heap are relocated by the host (mirrors
+# INSTMEM_USER_VADDR in pass/dart/dart_layout.h)
+INSTMEM_USER_VADDR = 0x200000000000
+BYTECODE_VADDR = INSTMEM_USER_VADDR + INSTMEM_OFFSET_BYTECODE
+
+# two-level coverage maps (mirrors DART_COV_TREE in pass/dart/dart_kernel.h)
+COV_TREE = False
+COV_TREE_BITS = 28
+
+IVSHMEM_SIZE_COV = _MB(40) if COV_TREE else _MB(4)
 
 IVSHMEM_OFFSET_HEADER = 0
 IVSHMEM_OFFSET_COV_CFG_EDGE = IVSHMEM_OFFSET_HEADER + _MB(4)
-IVSHMEM_OFFSET_COV_DFG_EDGE = IVSHMEM_OFFSET_COV_CFG_EDGE + _MB(4)
-IVSHMEM_OFFSET_COV_ALIAS_INST = IVSHMEM_OFFSET_COV_DFG_EDGE + _MB(4)
-IVSHMEM_OFFSET_RESERVED = IVSHMEM_OFFSET_COV_ALIAS_INST + _MB(4)
-IVSHMEM_OFFSET_INSTANCES = IVSHMEM_OFFSET_RESERVED + _MB(240)
+IVSHMEM_OFFSET_COV_DFG_EDGE = IVSHMEM_OFFSET_COV_CFG_EDGE + IVSHMEM_SIZE_COV
+IVSHMEM_OFFSET_COV_ALIAS_INST = IVSHMEM_OFFSET_COV_DFG_EDGE + IVSHMEM_SIZE_COV
+IVSHMEM_OFFSET_RESERVED = IVSHMEM_OFFSET_COV_ALIAS_INST + IVSHMEM_SIZE_COV
+IVSHMEM_OFFSET_INSTANCES = IVSHMEM_OFFSET_HEADER + _MB(256)
 IVSHMEM_SIZE = IVSHMEM_OFFSET_INSTANCES + INSTMEM_SIZE * FUZZ_INSTANCE_MAX
 
 
@@ -128,13 +200,136 @@ def INSTMEM_OFFSET(instance: int) -> int:
     return IVSHMEM_OFFSET_INSTANCES + INSTMEM_SIZE * instance
 
 
+# region table
+IVSHMEM_TABLE_MAGIC = b'RCRTABLE'
+IVSHMEM_TABLE_VERSION = 1
+IVSHMEM_TABLE_ALIGN = 4096
+
+
+def IVSHMEM_TABLE() -> bytes:
+    for _, size in INSTMEM_REGIONS_USER + INSTMEM_REGIONS_KERN:
+        assert size % IVSHMEM_TABLE_ALIGN == 0
+
+    data = struct.pack(
+        '<8sQQQQQ',
+        IVSHMEM_TABLE_MAGIC, IVSHMEM_TABLE_VERSION,
+        IVSHMEM_OFFSET_INSTANCES, INSTMEM_SIZE,
+        INSTMEM_SIZE_USER, INSTMEM_SIZE_KERN,
+    )
+
+    # offsets are relative to the part holding the region
+    for regions in [INSTMEM_REGIONS_USER, INSTMEM_REGIONS_KERN]:
+        offset = 0
+        for _, size in regions:
+            data += struct.pack('<QQ', offset, size)
+            offset += size
+
+    return data
+
+
 # runtime info
 BITMAP_COV_CFG_EDGE_SIZE = (1 << 24) // 8
 BITMAP_COV_DFG_EDGE_SIZE = (1 << 24) // 8
 BITMAP_COV_ALIAS_INST_SIZE = (1 << 24) // 8
 
+# coverage tree (mirrors struct dart_cov_tree in pass/dart/dart_wks.h): magic,
+# width, leaves taken (may overshoot the pool), pages dropped, the directory
+# with the leaf + 1 of each page, then the pool of leaves at the next page
+COV_TREE_MAGIC = b'RCOVTREE'
+COV_TREE_LEAF_SIZE = 4096
+COV_TREE_PAGES = 1 << (COV_TREE_BITS - 15)
+COV_TREE_HEAD = \
+    (32 + 4 * COV_TREE_PAGES + COV_TREE_LEAF_SIZE - 1) // \
+    COV_TREE_LEAF_SIZE * COV_TREE_LEAF_SIZE
+COV_TREE_POOL = (IVSHMEM_SIZE_COV - COV_TREE_HEAD) // COV_TREE_LEAF_SIZE
+
+
+def COV_MAP_INITIAL(size: int) -> bytes:
+    if not COV_TREE:
+        return bytes(size)
+
+    return struct.pack('<8sQQQ', COV_TREE_MAGIC, COV_TREE_BITS, 0, 0) + \
+        bytes(COV_TREE_HEAD - 32)
+
+
+def COV_MAP_EXTENT(head: bytes, size: int) -> int:
+    # a tree is only as large as the leaves taken
+    if not COV_TREE:
+        return size
+
+    leaves = struct.unpack_from('<Q', head, 16)[0]
+    return COV_TREE_HEAD + min(leaves, COV_TREE_POOL) * COV_TREE_LEAF_SIZE
+
+
+COV_MAP_SIZE_CFG_EDGE = \
+    IVSHMEM_SIZE_COV if COV_TREE else BITMAP_COV_CFG_EDGE_SIZE
+COV_MAP_SIZE_DFG_EDGE = \
+    IVSHMEM_SIZE_COV if COV_TREE else BITMAP_COV_DFG_EDGE_SIZE
+COV_MAP_SIZE_ALIAS_INST = \
+    IVSHMEM_SIZE_COV if COV_TREE else BITMAP_COV_ALIAS_INST_SIZE
+
 OUTPUT_LEDGER_SIZE = _MB(2048)
 
+# analysis: cross-check every happens-before query on the vector clocks with
+# the walk of the dependency graph (slow, for validating on recorded ledgers)
+ANALYZE_CHECK_HB = False
+
+# analysis: number of workers checking races over shards of addresses after
+# the sequential replay, 0 keeps the check inline with the replay
+ANALYZE_RACE_SHARDS = 0
+
+# analysis: sidecar indexing the ledger for dart_viz, which locates every
+# bucket of entries (of the whole ledger and of each thread) by its offset
+VIZ_INDEX_NAME = 'ledger-index'
+VIZ_INDEX_BUCKET = 4096
+
+# ledger format (mirrors pass/dart/dart_log.h)
+LEDGER_FLAG_SEGMENTED = 1 << 63
+LEDGER_FLAG_COMPACT = 1 << 62
+LEDGER_CHUNK_SIZE = _MB(1)
+
+LEDGER_COMPACT_NEW_PTID = 1 << 0
+LEDGER_COMPACT_ZERO_INFO = 1 << 1
+LEDGER_COMPACT_HVAL_DELTA = 1 << 2
+LEDGER_COMPACT_HVAL_RAW = 2 << 2
+
+# ledger streamed through a ring drained by the host (mirrors
+# DART_LEDGER_RING in pass/dart/dart_kernel.h)
+LEDGER_RING = False
+
+LEDGER_RING_HEAD_SIZE = 4096
+LEDGER_RING_SIZE = _MB(32)
+LEDGER_RING_CHUNK_SIZE = 64 * 1024
+LEDGER_RING_CHUNK_NUM = LEDGER_RING_SIZE // LEDGER_RING_CHUNK_SIZE
+
+# rtinfo format (mirrors pass/dart/dart_wks.h): states and coverage, then
+# the sampling policy (written by the host), then the accesses seen/traced,
+# then the number of apis followed by the hook stats of each api
+RTINFO_OFFSET_SAMPLING = 5 * 8
+RTINFO_OFFSET_HOOK_STATS = 9 * 8
+
+# coverage delta: at a fixed offset, the count of bits new to the maps, then
+# one (kind << 32 | index) per bit, with kinds in the order below
+RTINFO_OFFSET_COV_DELTA = _MB(1)
+RTINFO_COV_DELTA_MAX = (_MB(1) - 8) // 8
+RTINFO_COV_DELTA_KINDS = ['cfg_edge', 'dfg_edge', 'alias_inst']
+
+# hook stats per api: calls, ignored, untraced, paused, and the histogram of
+# cycles per call (bin i counts the calls taking [2^(i-1), 2^i) cycles)
+RTINFO_HOOK_STAT_HEAD = 4
+RTINFO_HOOK_HIST_BINS = 32
+
+# sampling of memory accesses: each instruction starts fully traced and the
+# period between traced hits doubles after every burst, up to the maximum,
+# a maximum of 1 traces every access (as needed for confirmation runs)
+SAMPLING_PERIOD_MAX = 1
+SAMPLING_BURST = 64
+
+# rtrace format (mirrors pass/dart/dart_wks.h)
+RTRACE_FLAG_DEDUP = 1 << 63
+RTRACE_ENTRY_MAX_PLAIN = min(_MB(14), INSTMEM_SIZE_RTRACE - 8) // (4 * 8)
+RTRACE_ENTRY_MAX_DEDUP = min(_MB(28), INSTMEM_SIZE_RTRACE - 16) // (5 * 8)
+
 # refresh rate
 REFRESH_RATE = 20
 
@@ -145,6 +340,26 @@ TTL_EXT_LOOP = 10
 TTL_MERGE_LOOP = 10
 TTL_CHECK_LOOP = 20
 
+# fuzzing: processes analyzing the ledgers while the next programs execute
+# (0 to skip the analysis), and the most results in flight per worker
+FUZZ_ANALYZE_PROCS = 0
+FUZZ_ANALYZE_DEPTH = 4
+
+# fuzzing: energy of seeds and loops, i.e., new coverage per second, with
+# the decay per execution and the prior (in both coverage and seconds)
+FUZZ_ENERGY_DECAY = 0.99
+FUZZ_ENERGY_PRIOR = 1.0
+
+# fuzzing: keep the artifacts of saved executions in the chunk store, with
+# the zstd level, the dictionary size and the bytes sampled to train it
+FUZZ_RESULT_STORE = False
+FUZZ_STORE_ZSTD_LEVEL = 3
+FUZZ_STORE_DICT_SIZE = 112 * 1024
+FUZZ_STORE_DICT_SAMPLE = _MB(8)
+
+# fuzzing: seeds the shared log holds before the master keeps them local
+FUZZ_SEED_LOG_MAX = 1 << 18
+
 # probe configs
 PROBE_SLICE_LEN = 1000
 
@@ -152,5 +367,9 @@ PROBE_SLICE_LEN = 1000
 VALIDATION_WORKER_PATH = os.path.join(VIRTEX_TMP_DIR, 'racer-validation')
 VALIDATION_FAILED_PATH = os.path.join(VIRTEX_TMP_DIR, 'racer-error')
 
+# steering configs: delays (in us) tried in order, and the runs per delay
+STEER_DELAY_USECS = [10, 100, 1000, 10000]
+STEER_TRIALS = 10
+
 # test configs
 TEST_RESULT_PATH = os.path.join(VIRTEX_TMP_DIR, 'racer-test')
@@ -1,5 +1,10 @@
-from typing import BinaryIO, NamedTuple, List, Dict, Set, Tuple, Optional, Union
+from typing import BinaryIO, NamedTuple, List, Dict, Set, Tuple, Optional, \
+    Union, Iterator, Sequence, Callable
 
+import io
+import os
+import ctypes
+import heapq
 import struct
 import logging
 
@@ -8,9 +13,11 @@ from collections import defaultdict
 from dataclasses import dataclass
 
 from pkg_linux import Package_LINUX
+from pkg_racer import Package_Racer
 from racer_parse_compile_data import CompileDatabase, ValueFunc, ValueInst
+from fuzz_store import open_artifact
 
-from util import read_source_location
+from util import read_source_location, parallelize
 
 import config
 
@@ -138,6 +145,353 @@ class LogType(IntEnum):
     _END_OF_ENUM = auto()
 
 
+# number of u64 arguments that follow the entry header (see apidef.inc)
+LOG_ARGC = {
+    LogType.MARK_V1: 1,
+    LogType.MARK_V2: 2,
+    LogType.MARK_V3: 3,
+    **{
+        t: 1 for t in [
+            LogType.CTXT_RCU_ENTER, LogType.CTXT_RCU_EXIT,
+            LogType.CTXT_WORK_ENTER, LogType.CTXT_WORK_EXIT,
+            LogType.CTXT_TASK_ENTER, LogType.CTXT_TASK_EXIT,
+            LogType.CTXT_TIMER_ENTER, LogType.CTXT_TIMER_EXIT,
+            LogType.CTXT_KRUN_ENTER, LogType.CTXT_KRUN_EXIT,
+            LogType.CTXT_BLOCK_ENTER, LogType.CTXT_BLOCK_EXIT,
+            LogType.CTXT_IPI_ENTER, LogType.CTXT_IPI_EXIT,
+            LogType.CTXT_CUSTOM_ENTER, LogType.CTXT_CUSTOM_EXIT,
+            LogType.EXEC_FUNC_ENTER, LogType.EXEC_FUNC_EXIT,
+            LogType.ASYNC_RCU_REGISTER,
+            LogType.ASYNC_WORK_REGISTER, LogType.ASYNC_WORK_CANCEL,
+            LogType.ASYNC_WORK_ATTACH,
+            LogType.ASYNC_TASK_REGISTER, LogType.ASYNC_TASK_CANCEL,
+            LogType.ASYNC_TIMER_REGISTER, LogType.ASYNC_TIMER_CANCEL,
+            LogType.ASYNC_TIMER_ATTACH,
+            LogType.ASYNC_KRUN_REGISTER,
+            LogType.ASYNC_BLOCK_REGISTER,
+            LogType.ASYNC_IPI_REGISTER,
+            LogType.ASYNC_CUSTOM_REGISTER, LogType.ASYNC_CUSTOM_ATTACH,
+            LogType.EVENT_WAIT_NOTIFY_ENTER, LogType.EVENT_WAIT_NOTIFY_EXIT,
+            LogType.EVENT_WAIT_PASS,
+            LogType.EVENT_SEMA_NOTIFY_ENTER, LogType.EVENT_SEMA_NOTIFY_EXIT,
+            LogType.EVENT_SEMA_PASS,
+            LogType.MEM_HEAP_FREE, LogType.MEM_PERCPU_FREE,
+            LogType.SYNC_GEN_LOCK, LogType.SYNC_GEN_UNLOCK,
+            LogType.SYNC_SEQ_LOCK, LogType.SYNC_SEQ_UNLOCK,
+            LogType.SYNC_RCU_LOCK, LogType.SYNC_RCU_UNLOCK,
+            LogType.ORDER_PS_PUBLISH, LogType.ORDER_PS_SUBSCRIBE,
+            LogType.ORDER_OBJ_CONSUME,
+        ]
+    },
+    **{
+        t: 2 for t in [
+            LogType.EVENT_WAIT_ARRIVE, LogType.EVENT_SEMA_ARRIVE,
+            LogType.MEM_STACK_PUSH, LogType.MEM_STACK_POP,
+            LogType.MEM_HEAP_ALLOC, LogType.MEM_PERCPU_ALLOC,
+            LogType.MEM_READ, LogType.MEM_WRITE,
+            LogType.ORDER_OBJ_DEPOSIT,
+        ]
+    },
+}  # type: Dict[LogType, int]
+
+
+def log_entry_size(cval: int) -> int:
+    return 24 + 8 * LOG_ARGC.get(LogType(cval), 0)
+
+
+# ledger loading
+def ledger_merge_segments(data: bytes) -> Tuple[int, bytes]:
+    """
+    Merge the per-cpu chunks of a segmented ledger into the flat format by
+    a k-way merge on the tsc stamp of each entry (chunks are sorted runs)
+    """
+    runs = []  # type: List[List[Tuple[int, int, int]]]
+    count = 0
+
+    for base in range(0, len(data), config.LEDGER_CHUNK_SIZE):
+        _, used, num = struct.unpack_from('IIQ', data, base)
+
+        run = []  # type: List[Tuple[int, int, int]]
+        cursor = base + 16
+        limit = cursor + used
+        while cursor < limit:
+            stamp, cval = struct.unpack_from('QI', data, cursor)
+            size = log_entry_size(cval)
+            run.append((stamp, cursor + 8, size))
+            cursor += 8 + size
+
+        assert len(run) == num
+        count += num
+        runs.append(run)
+
+    flat = b''.join([
+        data[offset:offset + size]
+        for _, offset, size in heapq.merge(*runs)
+    ])
+    return count, flat
+
+
+def ledger_decode_compact(data: bytes, count: int) -> bytes:
+    """
+    Decode a compact ledger (varint-coded entries, see dart_log.h) into the
+    flat format, this is on the hot path of analysis, hence the inlining
+    """
+    flag_new_ptid = config.LEDGER_COMPACT_NEW_PTID
+    flag_zero_info = config.LEDGER_COMPACT_ZERO_INFO
+    flag_hval_delta = config.LEDGER_COMPACT_HVAL_DELTA
+    flag_hval_raw = config.LEDGER_COMPACT_HVAL_RAW
+
+    mask64 = (1 << 64) - 1
+    argc = [0] * LogType._END_OF_ENUM
+    for k, v in LOG_ARGC.items():
+        argc[k] = v
+
+    ptids = {}  # type: Dict[int, int]
+    hvals = {}  # type: Dict[int, int]
+
+    pack_head = struct.Struct('IIQQ').pack
+    pack_arg = struct.Struct('Q').pack
+    unpack_raw = struct.Struct('Q').unpack_from
+
+    out = []  # type: List[bytes]
+    pos = 0
+
+    for _ in range(count):
+        flags = data[pos]
+        code = data[pos + 1]
+        pos += 2
+
+        # ptid
+        shift = 0
+        pidx = 0
+        while True:
+            b = data[pos]
+            pos += 1
+            pidx |= (b & 0x7f) << shift
+            if b < 0x80:
+                break
+            shift += 7
+
+        if flags & flag_new_ptid:
+            shift = 0
+            ptid = 0
+            while True:
+                b = data[pos]
+                pos += 1
+                ptid |= (b & 0x7f) << shift
+                if b < 0x80:
+                    break
+                shift += 7
+            ptids[pidx] = ptid
+            hvals[pidx] = 0
+        else:
+            ptid = ptids[pidx]
+
+        # info
+        if flags & flag_zero_info:
+            info = 0
+        else:
+            shift = 0
+            info = 0
+            while True:
+                b = data[pos]
+                pos += 1
+                info |= (b & 0x7f) << shift
+                if b < 0x80:
+                    break
+                shift += 7
+
+        # hval
+        if flags & flag_hval_raw:
+            hval = unpack_raw(data, pos)[0]
+            pos += 8
+            hvals[pidx] = hval
+        elif flags & flag_hval_delta:
+            shift = 0
+            z = 0
+            while True:
+                b = data[pos]
+                pos += 1
+                z |= (b & 0x7f) << shift
+                if b < 0x80:
+                    break
+                shift += 7
+            hval = (hvals[pidx] + ((z >> 1) ^ -(z & 1))) & mask64
+            hvals[pidx] = hval
+        else:
+            hval = hvals[pidx]
+
+        out.append(pack_head(code, ptid, info, hval))
+
+        # args
+        for _ in range(argc[code]):
+            shift = 0
+            z = 0
+            while True:
+                b = data[pos]
+                pos += 1
+                z |= (b & 0x7f) << shift
+                if b < 0x80:
+                    break
+                shift += 7
+            out.append(pack_arg(((z >> 1) ^ -(z & 1)) & mask64))
+
+    return b''.join(out)
+
+
+def ledger_flatten(f: BinaryIO) -> BinaryIO:
+    """
+    Return a stream of the ledger in the flat format (positioned at the
+    header), merging per-cpu segments or decoding compact entries if needed
+    """
+    entry_num, entry_cur = struct.unpack('QQ', f.read(16))
+
+    if entry_cur & config.LEDGER_FLAG_SEGMENTED:
+        length = entry_cur & ~config.LEDGER_FLAG_SEGMENTED
+        count, flat = ledger_merge_segments(f.read(length))
+        assert count == entry_num
+
+    elif entry_cur & config.LEDGER_FLAG_COMPACT:
+        length = entry_cur & ~config.LEDGER_FLAG_COMPACT
+        count = entry_num
+        flat = ledger_decode_compact(f.read(length), count)
+
+    else:
+        f.seek(0)
+        return f
+
+    b = io.BytesIO()
+    b.write(struct.pack('QQ', count, len(flat)))
+    b.write(flat)
+    b.seek(0)
+    return b
+
+
+# (cval, ptid, info, hval, args) of a log entry
+LogEntry = Tuple[int, int, int, int, Sequence[int]]
+
+
+def ledger_entries_stream(n: int, b: BinaryIO) -> Iterator[LogEntry]:
+    """
+    Walk the entries of a flat ledger stream (positioned after the header)
+    """
+    argc = [0] * LogType._END_OF_ENUM
+    for k, v in LOG_ARGC.items():
+        argc[k] = v
+
+    for _ in range(n):
+        cval, ptid, info, hval = struct.unpack('IIQQ', b.read(24))
+        args = struct.unpack('{}Q'.format(argc[cval]), b.read(8 * argc[cval]))
+        yield cval, ptid, info, hval, args
+
+
+class _NativeLedger(ctypes.Structure):
+    # mirrors struct racer_ledger in pass/ledger/include/ledger/Export.h
+    _fields_ = [
+        ('num', ctypes.c_uint64),
+        ('nargs', ctypes.c_uint64),
+        ('code', ctypes.c_void_p),
+        ('ptid', ctypes.c_void_p),
+        ('info', ctypes.c_void_p),
+        ('hval', ctypes.c_void_p),
+        ('arg_off', ctypes.c_void_p),
+        ('args', ctypes.c_void_p),
+        ('error', ctypes.c_char_p),
+        ('priv', ctypes.c_void_p),
+    ]
+
+
+class LedgerColumns(object):
+    """
+    Columns of a ledger decoded by the native library (libRacerLedger), the
+    columns are views into the memory of the library, valid until closed
+    """
+
+    _lib = None  # type: Optional[ctypes.CDLL]
+
+    @classmethod
+    def library(cls) -> Optional[ctypes.CDLL]:
+        if cls._lib is not None:
+            return cls._lib
+
+        path = os.path.join(Package_Racer().path_store, 'lib',
+                            'libRacerLedger.so')
+        if not os.path.exists(path):
+            return None
+
+        lib = ctypes.CDLL(path)
+        lib.racer_ledger_open.argtypes = [ctypes.c_char_p]
+        lib.racer_ledger_open.restype = ctypes.POINTER(_NativeLedger)
+        lib.racer_ledger_close.argtypes = [ctypes.POINTER(_NativeLedger)]
+        lib.racer_ledger_close.restype = None
+        lib.racer_ledger_enum_num.restype = ctypes.c_uint32
+        lib.racer_ledger_enum_argc.argtypes = [ctypes.c_uint32]
+        lib.racer_ledger_enum_argc.restype = ctypes.c_uint32
+        lib.racer_ledger_enum_name.argtypes = [ctypes.c_uint32]
+        lib.racer_ledger_enum_name.restype = ctypes.c_char_p
+
+        # the library follows apidef.inc, make sure we do too
+        assert lib.racer_ledger_enum_num() == LogType._END_OF_ENUM
+        for t in LogType:
+            if t == LogType._END_OF_ENUM:
+                continue
+            name = lib.racer_ledger_enum_name(t.value).decode('utf-8')
+            assert name.upper() == t.name
+            assert lib.racer_ledger_enum_argc(t.value) == LOG_ARGC.get(t, 0)
+
+        cls._lib = lib
+        return lib
+
+    def __init__(self, path: str) -> None:
+        lib = LedgerColumns.library()
+        assert lib is not None
+
+        self._lib = lib
+        self._handle = lib.racer_ledger_open(path.encode('utf-8'))
+        item = self._handle.contents
+
+        if item.error is not None:
+            reason = item.error.decode('utf-8')
+            self.close()
+            raise DartAssertFailure('ledger malformed: ' + reason, '')
+
+        self.num = item.num
+        self.code = self._view(item.code, 'I', item.num)
+        self.ptid = self._view(item.ptid, 'I', item.num)
+        self.info = self._view(item.info, 'Q', item.num)
+        self.hval = self._view(item.hval, 'Q', item.num)
+        self.arg_off = self._view(item.arg_off, 'Q', item.num + 1)
+        self.args = self._view(item.args, 'Q', item.nargs)
+
+    @staticmethod
+    def _view(addr: Optional[int], fmt: str, num: int) -> memoryview:
+        if num == 0 or addr is None:
+            return memoryview(b'').cast(fmt)
+
+        kind = ctypes.c_uint32 if fmt == 'I' else ctypes.c_uint64
+        data = (kind * num).from_address(addr)
+        return memoryview(data).cast('B').cast(fmt)
+
+    def entries(self) -> Iterator[LogEntry]:
+        args = self.args
+        off = self.arg_off
+        for i, (cval, ptid, info, hval) in enumerate(
+                zip(self.code, self.ptid, self.info, self.hval)
+        ):
+            yield cval, ptid, info, hval, args[off[i]:off[i + 1]]
+
+    def close(self) -> None:
+        if self._handle is not None:
+            self._lib.racer_ledger_close(self._handle)
+            self._handle = None
+
+    def __enter__(self) -> 'LedgerColumns':
+        return self
+
+    def __exit__(self, *args: object) -> None:
+        self.close()
+
+
 class CtxtType(Enum):
     TASK = 1
     SOFTIRQ = 2
@@ -195,6 +549,16 @@ class OrderType(Enum):
     OBJ = auto()
 
 
+# the latest (seq, clk) known of each ptid
+Clock = Dict[int, Tuple[int, int]]
+
+
+def _clock_merge(into: Clock, other: Clock) -> None:
+    for ptid, mark in other.items():
+        if ptid not in into or into[ptid] < mark:
+            into[ptid] = mark
+
+
 @dataclass
 class ExecUnit(object):
     ptid: int
@@ -204,6 +568,11 @@ class ExecUnit(object):
     clk: int
     deps: Dict[int, 'ExecUnit']
 
+    # vector clocks of what is learned from the base and from the deps, the
+    # units being linked are snapshots (clones), so these stay valid
+    clock_base: Clock
+    clock_deps: Clock
+
     @classmethod
     def create(cls, ptid: int) -> 'ExecUnit':
         return ExecUnit(
@@ -213,6 +582,8 @@ class ExecUnit(object):
             seq=0,
             clk=0,
             deps={},
+            clock_base={},
+            clock_deps={},
         )
 
     def clone(self) -> 'ExecUnit':
@@ -223,11 +594,23 @@ class ExecUnit(object):
             seq=self.seq,
             clk=self.clk,
             deps={k: v for k, v in self.deps.items()},
+            # clocks are replaced, never updated in place, hence shared
+            clock_base=self.clock_base,
+            clock_deps=self.clock_deps,
         )
 
     def coordinate(self) -> str:
         return '{}-{}-{}'.format(self.ptid, self.seq, self.clk)
 
+    def clock(self) -> Clock:
+        """
+        returns the vector clock of this unit, including itself
+        """
+        vc = dict(self.clock_deps)
+        _clock_merge(vc, self.clock_base)
+        _clock_merge(vc, {self.ptid: (self.seq, self.clk)})
+        return vc
+
     def _happens_before_in_task(self, unit: 'ExecUnit') -> bool:
         """
         returns whether this --> happens-before --> unit
@@ -240,12 +623,13 @@ class ExecUnit(object):
 
         return False
 
-    def _happens_before(self, unit: 'ExecUnit', hist: Dict[str, bool]) -> bool:
+    def _happens_before(self, unit: 'ExecUnit', hist: Dict[int, bool]) -> bool:
         """
         returns whether this --> happens-before --> unit
         """
-        # return cached results
-        cord = unit.coordinate()
+        # return cached results (by identity, as a snapshot and the unit it
+        # was taken from share a coordinate but not necessarily the deps)
+        cord = id(unit)
         if cord in hist:
             return hist[cord]
 
@@ -277,16 +661,61 @@ class ExecUnit(object):
         hist[cord] = retv
         return retv
 
-    def happens_before(self, unit: 'ExecUnit') -> bool:
+    def happens_before_walk(self, unit: 'ExecUnit') -> bool:
+        """
+        the reference implementation, walking the dependency graph
+        """
         return self._happens_before(unit, {})
 
+    def happens_before(self, unit: 'ExecUnit') -> bool:
+        """
+        returns whether this --> happens-before --> unit, by looking up this
+        ptid in the vector clock of the unit, O(1) instead of a graph walk
+        """
+        # same-task comparison is strictly ordered
+        if self.ptid == unit.ptid:
+            return self._happens_before_in_task(unit)
+
+        mark = (self.seq, self.clk)
+
+        known = unit.clock_base.get(self.ptid)
+        if known is not None and mark <= known:
+            return True
+
+        known = unit.clock_deps.get(self.ptid)
+        if known is not None and mark <= known:
+            return True
+
+        return False
+
+    def set_base(self, base: Optional['ExecUnit']) -> None:
+        self.base = base
+        self.clock_base = {} if base is None else base.clock()
+
+    def reset_deps(self) -> None:
+        # the clock goes along with the deps, or it keeps ordering the unit
+        # after what it no longer depends on
+        self.deps = {}
+        self.clock_deps = {}
+
     def add_dep(self, dep: 'ExecUnit') -> None:
         if dep.ptid not in self.deps:
             self.deps[dep.ptid] = dep
 
+            # a new dep only adds to what is known
+            vc = dict(self.clock_deps)
+            _clock_merge(vc, dep.clock())
+            self.clock_deps = vc
+
         elif self.deps[dep.ptid]._happens_before_in_task(dep):
             self.deps[dep.ptid] = dep
 
+            # a replaced dep takes what it brought in along with it
+            vc = {}  # type: Clock
+            for item in self.deps.values():
+                _clock_merge(vc, item.clock())
+            self.clock_deps = vc
+
 
 class LogMeta(NamedTuple):
     ptid: int
@@ -465,6 +894,103 @@ class MemCell(object):
         self.writers = {}  # type: Dict[int, List[MemAccess]]
 
 
+# (addr, is_write, ptid, in task ctxt, access, indentation) of a memory event
+MemEvent = Tuple[int, bool, int, bool, MemAccess, str]
+
+
+def mem_cell_races(
+        cell: MemCell, event: MemEvent,
+        hb: Callable[[ExecUnit, ExecUnit], bool]
+) -> List[Tuple[MemAccess, bool]]:
+    """
+    Check an access against the prior accesses on the cell and log it in,
+    returns the racing accesses, each with whether the blacklist applies
+    """
+    _, is_w, ptid, is_task, access, _ = event
+    races = []  # type: List[Tuple[MemAccess, bool]]
+
+    # a read races with the writes, a write with the reads and the writes
+    if is_w:
+        groups = [(cell.readers, True), (cell.writers, False)]
+    else:
+        groups = [(cell.writers, True)]
+
+    for accesses, is_rw in groups:
+        for other_ptid, vals in accesses.items():
+            # a task does not race against itself
+            if other_ptid == ptid:
+                continue
+
+            another = vals[-1]
+
+            # TODO (simply ignore races when both parties are in interrupt)
+            if not is_task and \
+                    CtxtType.from_ptid(another.unit.ptid) != CtxtType.TASK:
+                continue
+
+            # it is not a race if we can establish happens-before relation
+            if hb(another.unit, access.unit):
+                continue
+
+            # it is not a race if protected by the lock
+            if len(another.sync_locks.intersection(access.sync_locks)) != 0:
+                continue
+
+            # transaction does not apply to writer-writer race, so report
+            if not is_rw:
+                races.append((another, False))
+                continue
+
+            # find the pending transaction that may invalidate the race
+            pending = access.sync_trans.intersection(another.sync_trans)
+
+            # no locks and no transaction, definitely a race
+            if len(pending) == 0:
+                races.append((another, True))
+                continue
+
+            # save to candidate pool if we cannot confirm now
+            # TODO
+
+    # put the access to log
+    log = cell.writers if is_w else cell.readers
+    if ptid not in log:
+        log[ptid] = []
+    log[ptid].append(access)
+
+    return races
+
+
+# memory events of the sharded race check, set before forking the workers
+_RACE_EVENTS = []  # type: List[MemEvent]
+
+
+def _race_shard(index: List[int]) -> List[Tuple[int, int, int, bool]]:
+    """
+    Replay the memory events of a shard (a disjoint set of addresses), and
+    returns the races as (event of the access, rank, event of the other,
+    whether the blacklist applies)
+    """
+    cells = {}  # type: Dict[int, MemCell]
+    owner = {}  # type: Dict[int, int]
+    races = []  # type: List[Tuple[int, int, int, bool]]
+
+    for i in index:
+        event = _RACE_EVENTS[i]
+        addr = event[0]
+        if addr not in cells:
+            cells[addr] = MemCell()
+
+        for k, (another, filtered) in enumerate(mem_cell_races(
+                cells[addr], event, ExecUnit.happens_before
+        )):
+            races.append((i, k, owner[id(another)], filtered))
+
+        owner[id(event[4])] = i
+
+    return races
+
+
 class DartAssertFailure(Exception):
 
     def __init__(self, reason: str, ledger: str) -> None:
@@ -539,10 +1065,20 @@ class RaceAlias(NamedTuple):
 
 class ExecAnalyzer(object):
 
-    def __init__(self, compdb: CompileDatabase) -> None:
+    def __init__(
+            self, compdb: CompileDatabase,
+            check_hb: bool = False, race_shards: int = 0
+    ) -> None:
         # deps
         self.compdb = compdb
 
+        # cross-check the vector clocks against the graph walk
+        self.check_hb = check_hb
+
+        # defer the race check to a pass over shards of addresses (if set)
+        self.race_shards = race_shards
+        self.mem_events = []  # type: List[MemEvent]
+
         # runtime states
         self.main_ptid = 0
         self.tasks = {}  # type: Dict[int, TaskState]
@@ -595,6 +1131,18 @@ class ExecAnalyzer(object):
     def _record_divider(self) -> None:
         self._record('-' * 80)
 
+    # happens-before
+    def _happens_before(self, src: ExecUnit, dst: ExecUnit) -> bool:
+        retv = src.happens_before(dst)
+        if self.check_hb:
+            self._assert(
+                retv == src.happens_before_walk(dst),
+                'happens-before mismatch: {} --> {}, clock says {}'.format(
+                    src.coordinate(), dst.coordinate(), retv
+                )
+            )
+        return retv
+
     # record warning
     def _record_warning(
             self, meta: LogMeta, task: TaskState, msg: str
@@ -852,11 +1400,11 @@ class ExecAnalyzer(object):
 
     # record race
     def _record_race(
-            self, task: TaskState, a1: MemAccess, a2: MemAccess, addr: int
+            self, tab: str, a1: MemAccess, a2: MemAccess, addr: int
     ) -> None:
         self._record(
             '{}[*] RACE <{}-{}-{} |=| {}-{}-{}> [{}:{}] {}'.format(
-                _tab(task.stack),
+                tab,
                 a1.unit.ptid, a1.unit.seq, a1.unit.clk,
                 a2.unit.ptid, a2.unit.seq, a2.unit.clk,
                 a1.hval, a2.hval,
@@ -867,7 +1415,7 @@ class ExecAnalyzer(object):
         inst_src = self.compdb.insts[a1.hval]
         self._record(
             '{}[*] SRC: [{}-{}-{}] <{}> {}: {} [{}] |{}| {}'.format(
-                _tab(task.stack),
+                tab,
                 a1.unit.ptid, a1.unit.seq, a1.unit.clk,
                 CtxtType.from_ptid(a1.unit.ptid).name,
                 a1.hval,
@@ -881,7 +1429,7 @@ class ExecAnalyzer(object):
         inst_dst = self.compdb.insts[a2.hval]
         self._record(
             '{}[*] DST: [{}-{}-{}] <{}> {}: {} [{}] |{}| {}'.format(
-                _tab(task.stack),
+                tab,
                 a2.unit.ptid, a2.unit.seq, a2.unit.clk,
                 CtxtType.from_ptid(a2.unit.ptid).name,
                 a2.hval,
@@ -1036,7 +1584,7 @@ class ExecAnalyzer(object):
         # reset exec unit
         task.unit.clk = 0
         task.unit.ctxt = None
-        task.unit.deps = {}
+        task.unit.reset_deps()
 
         # restore the task (if stolen)
         if slot is not None and slot.host is not None:
@@ -1105,7 +1653,7 @@ class ExecAnalyzer(object):
                 meta.ptid, task.unit.seq
             )
         )
-        task.unit.base = slot.unit.clone()
+        task.unit.set_base(slot.unit.clone())
 
         # link with attachments
         for item in slot.others:
@@ -1153,7 +1701,7 @@ class ExecAnalyzer(object):
                 meta.ptid, task.unit.seq
             )
         )
-        task.unit.base = None
+        task.unit.set_base(None)
 
         # mark that we have done with serving the callback
         slot.serving = 0
@@ -1538,7 +2086,7 @@ class ExecAnalyzer(object):
                 meta.ptid, task.unit.seq
             )
         )
-        task.unit.base = slot.unit.clone()
+        task.unit.set_base(slot.unit.clone())
 
         # mark that we are serving the callback
         dep = task.unit.clone()
@@ -1597,7 +2145,7 @@ class ExecAnalyzer(object):
                 meta.ptid, task.unit.seq
             )
         )
-        task.unit.base = None
+        task.unit.set_base(None)
 
         # mark that we have done with serving the callback
         slot.servers[meta.ptid] = (0, n_unit)
@@ -1835,154 +2383,85 @@ class ExecAnalyzer(object):
         self._log_mem_del(meta, task, self.mem_pcpus, addr, size, 'P')
 
     # MEM (access)
-    def _log_mem_cell_reader(
-            self, meta: LogMeta, task: TaskState, addr: int
+    def _log_mem_cell(
+            self, meta: LogMeta, task: TaskState, addr: int, is_w: bool
     ) -> None:
-        # ignore memory reads on stack and percpu
+        # ignore memory accesses on stack and percpu
         if addr in task.stack_mem:
             return
 
         if addr in self.mem_pcpus:
             return
 
-        # need to analyze the memory read
-        if addr not in self.cells:
-            self.cells[addr] = MemCell()
-
-        cell = self.cells[addr]
-        if meta.ptid not in cell.readers:
-            cell.readers[meta.ptid] = []
-
         # construct the access
-        access = MemAccess(
-            hval=meta.hval,
-            unit=task.unit.clone(),
-            sync_locks=task.sync_locks.lockset_r(),
-            sync_trans=task.sync_trans.transet_r(),
-        )
-
-        # check for race candidates
-        for ptid, vals in cell.writers.items():
-            # a task does not race against itself
-            if ptid == meta.ptid:
-                continue
-
-            another = vals[-1]
-
-            # TODO (simply ignore races when both parties are in interrupt)
-            if meta.ctxt != CtxtType.TASK and \
-                    CtxtType.from_ptid(another.unit.ptid) != CtxtType.TASK:
-                continue
-
-            # it is not a race if we can establish happens-before relation
-            if another.unit.happens_before(access.unit):
-                continue
-
-            # it is not a race if protected by the lock
-            if len(another.sync_locks.intersection(access.sync_locks)) != 0:
-                continue
-
-            # find the pending transaction that may invalidate the race
-            pending = set()
-            for trans_key in another.sync_trans:
-                if trans_key in access.sync_trans:
-                    pending.add(trans_key)
-
-            # no locks and no transaction, definitely a race
-            if len(pending) == 0 and not self.race_blacklist(another, access):
-                self._record_race(task, another, access, addr)
-                continue
-
-            # save to candidate pool if we cannot confirm now
-            # TODO
-
-        # put the access to log
-        cell.readers[meta.ptid].append(access)
+        if is_w:
+            access = MemAccess(
+                hval=meta.hval,
+                unit=task.unit.clone(),
+                sync_locks=task.sync_locks.lockset_w(),
+                sync_trans=task.sync_trans.transet_w(),
+            )
+        else:
+            access = MemAccess(
+                hval=meta.hval,
+                unit=task.unit.clone(),
+                sync_locks=task.sync_locks.lockset_r(),
+                sync_trans=task.sync_trans.transet_r(),
+            )
 
-    def _log_mem_cell_writer(
-            self, meta: LogMeta, task: TaskState, addr: int
-    ) -> None:
-        # ignore memory writes on stack and percpu
-        if addr in task.stack_mem:
-            return
+        event = (
+            addr, is_w, meta.ptid, meta.ctxt == CtxtType.TASK,
+            access, _tab(task.stack)
+        )  # type: MemEvent
 
-        if addr in self.mem_pcpus:
+        # defer the race check to the sharded pass
+        if self.race_shards != 0:
+            self.mem_events.append(event)
             return
 
-        # need to analyze the memory write
+        # need to analyze the memory access
         if addr not in self.cells:
             self.cells[addr] = MemCell()
 
-        cell = self.cells[addr]
-        if meta.ptid not in cell.writers:
-            cell.writers[meta.ptid] = []
-
-        # construct the access
-        access = MemAccess(
-            hval=meta.hval,
-            unit=task.unit.clone(),
-            sync_locks=task.sync_locks.lockset_w(),
-            sync_trans=task.sync_trans.transet_w(),
-        )
-
-        # check for race candidates
-        for ptid, vals in cell.readers.items():
-            if ptid == meta.ptid:
-                continue
-
-            another = vals[-1]
-
-            # TODO (simply ignore races when both parties are in interrupt)
-            if meta.ctxt != CtxtType.TASK and \
-                    CtxtType.from_ptid(another.unit.ptid) != CtxtType.TASK:
-                continue
-
-            # it is not a race if we can establish happens-before relation
-            if another.unit.happens_before(access.unit):
-                continue
-
-            # it is not a race if protected by the lock
-            if len(another.sync_locks.intersection(access.sync_locks)) != 0:
-                continue
-
-            # find the pending transaction that may invalidate the race
-            pending = set()
-            for trans_key in access.sync_trans:
-                if trans_key in another.sync_trans:
-                    pending.add(trans_key)
-
-            # no locks and no transaction, definitely a race
-            if len(pending) == 0 and not self.race_blacklist(another, access):
-                self._record_race(task, another, access, addr)
-                continue
-
-            # save to candidate pool if we cannot confirm now
-            # TODO
-
-        for ptid, vals in cell.writers.items():
-            if ptid == meta.ptid:
+        for another, filtered in mem_cell_races(
+                self.cells[addr], event, self._happens_before
+        ):
+            if filtered and self.race_blacklist(another, access):
                 continue
+            self._record_race(event[5], another, access, addr)
 
-            another = vals[-1]
+    def _analyze_races(self) -> None:
+        """
+        The race check is independent across addresses once the units, the
+        clocks, and the lock and transaction sets are captured in the memory
+        events, hence replay them in shards of addresses in parallel
+        """
+        global _RACE_EVENTS
 
-            # TODO (simply ignore races when both parties are in interrupt)
-            if meta.ctxt != CtxtType.TASK and \
-                    CtxtType.from_ptid(another.unit.ptid) != CtxtType.TASK:
-                continue
+        shards = [[] for _ in range(self.race_shards)]  # type: List[List[int]]
+        for i, event in enumerate(self.mem_events):
+            shards[(event[0] >> 3) % self.race_shards].append(i)
 
-            # it is not a race if we can establish happens-before relation
-            if another.unit.happens_before(access.unit):
-                continue
+        # the workers inherit the events on fork
+        _RACE_EVENTS = self.mem_events
+        try:
+            if self.race_shards == 1:
+                results = [_race_shard(shards[0])]
+            else:
+                results = parallelize(_race_shard, shards, self.race_shards)
+        finally:
+            _RACE_EVENTS = []
 
-            # it is not a race if protected by the lock
-            if len(another.sync_locks.intersection(access.sync_locks)) != 0:
+        # report in the order of the ledger, as the sequential check does
+        races = sorted([r for result in results for r in result])
+        for i, _, j, filtered in races:
+            addr, _, _, _, access, tab = self.mem_events[i]
+            another = self.mem_events[j][4]
+            if filtered and self.race_blacklist(another, access):
                 continue
+            self._record_race(tab, another, access, addr)
 
-            # transaction does not apply to writer-writer race, so report
-            self._record_race(task, another, access, addr)
-
-        # put the access to log
-        cell.writers[meta.ptid].append(access)
+        self.mem_events = []
 
     def log_mem_read(
             self, meta: LogMeta, task: TaskState, addr: int, size: int
@@ -1995,7 +2474,7 @@ class ExecAnalyzer(object):
 
         # race check
         for i in range(size):
-            self._log_mem_cell_reader(meta, task, addr + i)
+            self._log_mem_cell(meta, task, addr + i, False)
 
     def log_mem_write(
             self, meta: LogMeta, task: TaskState, addr: int, size: int
@@ -2009,7 +2488,7 @@ class ExecAnalyzer(object):
 
         # race check
         for i in range(size):
-            self._log_mem_cell_writer(meta, task, addr + i)
+            self._log_mem_cell(meta, task, addr + i, True)
 
     # SYNC (generic lock)
     def log_sync_gen_lock(
@@ -2268,13 +2747,15 @@ class ExecAnalyzer(object):
 
     # iterate over the logs
     def iterate_log(self, n: int, b: BinaryIO) -> None:
+        self.iterate_entries(n, ledger_entries_stream(n, b))
+
+    def iterate_entries(self, n: int, entries: Iterator[LogEntry]) -> None:
         log_types = {i.value: i for i in LogType}
 
-        # read log entry by entry
+        # walk log entry by entry
         unhandled = 0
 
-        for i in range(n):
-            cval, ptid, info, hval = struct.unpack('IIQQ', b.read(24))
+        for i, (cval, ptid, info, hval, args) in enumerate(entries):
             code = log_types[cval]
             meta = LogMeta(ptid, info, hval)
 
@@ -2314,93 +2795,93 @@ class ExecAnalyzer(object):
                 continue
 
             if code == LogType.CTXT_RCU_ENTER:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_ctxt_rcu_enter(meta, func)
                 continue
 
             if code == LogType.CTXT_RCU_EXIT:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_ctxt_rcu_exit(meta, func)
                 continue
 
             if code == LogType.CTXT_WORK_ENTER:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_ctxt_work_enter(meta, func)
                 continue
 
             if code == LogType.CTXT_WORK_EXIT:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_ctxt_work_exit(meta, func)
                 continue
 
             if code == LogType.CTXT_TASK_ENTER:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_ctxt_task_enter(meta, func)
                 continue
 
             if code == LogType.CTXT_TASK_EXIT:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_ctxt_task_exit(meta, func)
                 continue
 
             if code == LogType.CTXT_TIMER_ENTER:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_ctxt_timer_enter(meta, func)
                 continue
 
             if code == LogType.CTXT_TIMER_EXIT:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_ctxt_timer_exit(meta, func)
                 continue
 
             if code == LogType.CTXT_KRUN_ENTER:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_ctxt_krun_enter(meta, func)
                 continue
 
             if code == LogType.CTXT_KRUN_EXIT:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_ctxt_krun_exit(meta, func)
                 continue
 
             if code == LogType.CTXT_BLOCK_ENTER:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_ctxt_block_enter(meta, func)
                 continue
 
             if code == LogType.CTXT_BLOCK_EXIT:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_ctxt_block_exit(meta, func)
                 continue
 
             if code == LogType.CTXT_IPI_ENTER:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_ctxt_ipi_enter(meta, func)
                 continue
 
             if code == LogType.CTXT_IPI_EXIT:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_ctxt_ipi_exit(meta, func)
                 continue
 
             # EVENT (notifier part only)
             if code == LogType.EVENT_WAIT_NOTIFY_ENTER:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_event_wait_notify_enter(meta, func)
                 continue
 
             if code == LogType.EVENT_WAIT_NOTIFY_EXIT:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_event_wait_notify_exit(meta, func)
                 continue
 
             if code == LogType.EVENT_SEMA_NOTIFY_ENTER:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_event_sema_notify_enter(meta, func)
                 continue
 
             if code == LogType.EVENT_SEMA_NOTIFY_EXIT:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_event_sema_notify_exit(meta, func)
                 continue
 
@@ -2432,68 +2913,68 @@ class ExecAnalyzer(object):
                 continue
 
             if code == LogType.EXEC_FUNC_ENTER:
-                addr = struct.unpack('Q', b.read(8))[0]
+                addr = args[0]
                 self.log_exec_func_enter(meta, task, addr)
                 continue
 
             if code == LogType.EXEC_FUNC_EXIT:
-                addr = struct.unpack('Q', b.read(8))[0]
+                addr = args[0]
                 self.log_exec_func_exit(meta, task, addr)
                 continue
 
             # ASYNC
             if code == LogType.ASYNC_RCU_REGISTER:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_async_rcu_register(meta, task, func)
                 continue
 
             if code == LogType.ASYNC_WORK_REGISTER:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_async_work_register(meta, task, func)
                 continue
 
             if code == LogType.ASYNC_WORK_CANCEL:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_async_work_cancel(meta, task, func)
                 continue
 
             if code == LogType.ASYNC_WORK_ATTACH:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_async_work_attach(meta, task, func)
                 continue
 
             if code == LogType.ASYNC_TASK_REGISTER:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_async_task_register(meta, task, func)
                 continue
 
             if code == LogType.ASYNC_TASK_CANCEL:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_async_task_cancel(meta, task, func)
                 continue
 
             if code == LogType.ASYNC_TIMER_REGISTER:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_async_timer_register(meta, task, func)
                 continue
 
             if code == LogType.ASYNC_TIMER_CANCEL:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_async_timer_cancel(meta, task, func)
                 continue
 
             if code == LogType.ASYNC_KRUN_REGISTER:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_async_krun_register(meta, task, func)
                 continue
 
             if code == LogType.ASYNC_BLOCK_REGISTER:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_async_block_register(meta, task, func)
                 continue
 
             if code == LogType.ASYNC_IPI_REGISTER:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_async_ipi_register(meta, task, func)
                 continue
 
@@ -2507,22 +2988,22 @@ class ExecAnalyzer(object):
                 continue
 
             if code == LogType.EVENT_WAIT_ARRIVE:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_event_wait_arrive(meta, task, func)
                 continue
 
             if code == LogType.EVENT_WAIT_PASS:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_event_wait_pass(meta, task, func)
                 continue
 
             if code == LogType.EVENT_SEMA_ARRIVE:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_event_sema_arrive(meta, task, func)
                 continue
 
             if code == LogType.EVENT_SEMA_PASS:
-                func = struct.unpack('Q', b.read(8))[0]
+                func = args[0]
                 self.log_event_sema_pass(meta, task, func)
                 continue
 
@@ -2533,94 +3014,94 @@ class ExecAnalyzer(object):
 
             # MEM
             if code == LogType.MEM_STACK_PUSH:
-                addr, size = struct.unpack('QQ', b.read(16))
+                addr, size = args
                 self.log_mem_stack_push(meta, task, addr, size)
                 continue
 
             if code == LogType.MEM_STACK_POP:
-                addr, size = struct.unpack('QQ', b.read(16))
+                addr, size = args
                 self.log_mem_stack_pop(meta, task, addr, size)
                 continue
 
             if code == LogType.MEM_HEAP_ALLOC:
-                addr, size = struct.unpack('QQ', b.read(16))
+                addr, size = args
                 self.log_mem_heap_alloc(meta, task, addr, size)
                 continue
 
             if code == LogType.MEM_HEAP_FREE:
-                addr = struct.unpack('Q', b.read(8))[0]
+                addr = args[0]
                 self.log_mem_heap_free(meta, task, addr)
                 continue
 
             if code == LogType.MEM_PERCPU_ALLOC:
-                addr, size = struct.unpack('QQ', b.read(16))
+                addr, size = args
                 self.log_mem_percpu_alloc(meta, task, addr, size)
                 continue
 
             if code == LogType.MEM_PERCPU_FREE:
-                addr = struct.unpack('Q', b.read(8))[0]
+                addr = args[0]
                 self.log_mem_percpu_free(meta, task, addr)
                 continue
 
             if code == LogType.MEM_READ:
-                addr, size = struct.unpack('QQ', b.read(16))
+                addr, size = args
                 self.log_mem_read(meta, task, addr, size)
                 continue
 
             if code == LogType.MEM_WRITE:
-                addr, size = struct.unpack('QQ', b.read(16))
+                addr, size = args
                 self.log_mem_write(meta, task, addr, size)
                 continue
 
             # SYNC
             if code == LogType.SYNC_GEN_LOCK:
-                lock = struct.unpack('Q', b.read(8))[0]
+                lock = args[0]
                 self.log_sync_gen_lock(meta, task, lock)
                 continue
 
             if code == LogType.SYNC_GEN_UNLOCK:
-                lock = struct.unpack('Q', b.read(8))[0]
+                lock = args[0]
                 self.log_sync_gen_unlock(meta, task, lock)
                 continue
 
             if code == LogType.SYNC_SEQ_LOCK:
-                lock = struct.unpack('Q', b.read(8))[0]
+                lock = args[0]
                 self.log_sync_seq_lock(meta, task, lock)
                 continue
 
             if code == LogType.SYNC_SEQ_UNLOCK:
-                lock = struct.unpack('Q', b.read(8))[0]
+                lock = args[0]
                 self.log_sync_seq_unlock(meta, task, lock)
                 continue
 
             if code == LogType.SYNC_RCU_LOCK:
-                lock = struct.unpack('Q', b.read(8))[0]
+                lock = args[0]
                 self.log_sync_rcu_lock(meta, task, lock)
                 continue
 
             if code == LogType.SYNC_RCU_UNLOCK:
-                lock = struct.unpack('Q', b.read(8))[0]
+                lock = args[0]
                 self.log_sync_rcu_unlock(meta, task, lock)
                 continue
 
             # ORDER
             if code == LogType.ORDER_PS_PUBLISH:
-                addr = struct.unpack('Q', b.read(8))[0]
+                addr = args[0]
                 self.log_order_ps_publish(meta, task, addr)
                 continue
 
             if code == LogType.ORDER_PS_SUBSCRIBE:
-                addr = struct.unpack('Q', b.read(8))[0]
+                addr = args[0]
                 self.log_order_ps_subscribe(meta, task, addr)
                 continue
 
             if code == LogType.ORDER_OBJ_DEPOSIT:
-                addr, objv = struct.unpack('QQ', b.read(16))
+                addr, objv = args
                 self.log_order_obj_deposit(meta, task, addr, objv)
                 continue
 
             if code == LogType.ORDER_OBJ_CONSUME:
-                addr = struct.unpack('Q', b.read(8))[0]
+                addr = args[0]
                 self.log_order_obj_consume(meta, task, addr)
                 continue
 
@@ -2629,19 +3110,20 @@ class ExecAnalyzer(object):
                 continue
 
             if code == LogType.MARK_V1:
-                b.read(8)
                 continue
 
             if code == LogType.MARK_V2:
-                b.read(16)
                 continue
 
             if code == LogType.MARK_V3:
-                b.read(24)
                 continue
 
             unhandled += 1
 
+        # run the deferred race check
+        if self.race_shards != 0:
+            self._analyze_races()
+
         # warn if we have left any messages unhandled (TODO change to assert)
         if unhandled != 0:
             logging.warning('{} log messages not handled'.format(unhandled))
@@ -2800,16 +3282,28 @@ class ExecAnalyzer(object):
     @classmethod
     def validate(cls, logfile: str) -> str:
         # construct the analyzer
-        analyzer = ExecAnalyzer(CompileDatabase(Package_LINUX().path_build))
+        analyzer = ExecAnalyzer(
+            CompileDatabase(Package_LINUX().path_build),
+            check_hb=config.ANALYZE_CHECK_HB,
+            race_shards=config.ANALYZE_RACE_SHARDS
+        )
 
         # parse and validate the log entries
-        with open(logfile, 'rb') as f:
+        with open_artifact(logfile) as r:
+            f = ledger_flatten(r)
             n, s = analyzer.process_log(f)
             if s > config.OUTPUT_LEDGER_SIZE:
                 raise DartAssertFailure('ledger overflowed', '')
 
             try:
-                analyzer.iterate_log(n, f)
+                # decode natively when the library is built (and the ledger
+                # is a plain file, not one in the result store)
+                if LedgerColumns.library() is not None and \
+                        os.path.isfile(logfile):
+                    with LedgerColumns(logfile) as cols:
+                        analyzer.iterate_entries(cols.num, cols.entries())
+                else:
+                    analyzer.iterate_log(n, f)
             except DartAssertFailure as ae:
                 raise ae
             except Exception as ex:
@@ -2821,11 +3315,11 @@ class ExecAnalyzer(object):
 
     # blacklist
     def race_blacklist(self, a1: MemAccess, a2: MemAccess) -> bool:
-        i1 = self.compdb.insts[a1.hval]
-        i2 = self.compdb.insts[a2.hval]
+        l1 = self.compdb.get_locs(a1.hval)
+        l2 = self.compdb.get_locs(a2.hval)
 
         for i in RACE_BLACKLIST:
-            if i in i1.get_locs() or i in i2.get_locs():
+            if i in l1 or i in l2:
                 return True
 
         return False
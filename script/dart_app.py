@@ -43,10 +43,17 @@ from dart_viz import \
     VizItemMemAlloc, VizItemMemFree, \
     VizItemMemRead, VizItemMemWrite, \
     VizItemMark, VizItemStep, \
-    VizSlotFork, VizSlotJoin, VizSlotOrder, VizSlotQueue
+    VizSlotFork, VizSlotJoin, VizSlotOrder, VizSlotQueue, \
+    VizIndex
 
+from dart import ledger_flatten
+from pkg_linux import Package_LINUX
+from racer_parse_compile_data import CompileDatabase
+from fuzz_store import open_artifact
 from util import execute
 
+import config
+
 
 class OverLay(QWidget):
 
@@ -1040,7 +1047,10 @@ def rerun_analysis(ledger: str) -> None:
     # parse the ledger
     runtime = VizRuntime()
     try:
-        runtime.process(ledger)
+        runtime.process(
+            ledger,
+            os.path.join(os.path.dirname(ledger), config.VIZ_INDEX_NAME)
+        )
     except Exception as ex:
         with open(os.path.join(path + '-error'), 'w') as t:
             t.write(repr(ex))
@@ -1056,6 +1066,46 @@ def rerun_analysis(ledger: str) -> None:
     runtime.dump_races(path + '-racer')
 
 
+def show_window(
+        ledger: str, depth: str,
+        ptids: List[int], span: Optional[str], func: Optional[int],
+        start: int, num: int,
+) -> None:
+    index = VizIndex.load(
+        os.path.join(os.path.dirname(ledger), config.VIZ_INDEX_NAME)
+    )
+
+    with open(depth) as f:
+        limit = json.load(f).get('fold')
+
+    with open_artifact(ledger) as f:
+        b = ledger_flatten(f)
+
+        # a single thread, counted in its own entries
+        if len(ptids) == 1 and span is None and func is None:
+            entries = index.thread(b, ptids[0], start, num)
+
+        # a window of the whole ledger, or the first call of a function
+        else:
+            if func is not None:
+                calls = index.calls(ptids[0], func) if len(ptids) != 0 else []
+                if len(calls) == 0:
+                    raise RuntimeError('No call of {} found'.format(func))
+                lo, hi = calls[0][0], calls[0][1] + 1
+            elif span is not None:
+                lo, hi = [int(i) for i in span.split(':')]
+            else:
+                lo, hi = start, start + num
+
+            entries = index.window(
+                b, lo, hi, None if len(ptids) == 0 else set(ptids)
+            )
+
+        funcs = CompileDatabase(Package_LINUX().path_build).funcs
+        for line in index.fold(entries, limit, funcs):
+            print(line)
+
+
 def main(argv: List[str]) -> int:
     # setup argument parser
     parser = ArgumentParser()
@@ -1104,6 +1154,39 @@ def main(argv: List[str]) -> int:
         help='Selected ptid-seq-clk to show'
     )
 
+    # window
+    sub_window = subs.add_parser(
+        'window',
+        help='Print a window of the trace (needs the ledger index)',
+    )
+    sub_window.add_argument(
+        '-p', '--ptid', type=int, action='append', default=[],
+        help='Selected threads to show (all if not set)'
+    )
+    sub_window.add_argument(
+        '-r', '--range', type=str, default=None,
+        help='Range <lo>:<hi> of the ledger entries to show'
+    )
+    sub_window.add_argument(
+        '-f', '--func', type=int, default=None,
+        help='Show the first call of the function (hval) in the thread'
+    )
+    sub_window.add_argument(
+        '-s', '--start', type=int, default=0,
+        help='First entry to show (of the thread, if only one is selected)'
+    )
+    sub_window.add_argument(
+        '-n', '--num', type=int, default=1000,
+        help='Number of entries to show'
+    )
+    sub_window.add_argument(
+        '-d', '--depth', type=str,
+        default=os.path.join(
+            os.path.dirname(os.path.abspath(__file__)), 'dart_viz_depth.json'
+        ),
+        help='Depth of the trace (configuration file)'
+    )
+
     # parse
     args = parser.parse_args(argv)
 
@@ -1112,6 +1195,14 @@ def main(argv: List[str]) -> int:
         rerun_analysis(args.input)
         return 0
 
+    # action: window
+    if args.cmd == 'window':
+        show_window(
+            args.input, args.depth,
+            args.ptid, args.range, args.func, args.start, args.num
+        )
+        return 0
+
     # cache
     cache = os.path.join(os.path.dirname(args.input), 'visual')
     if not os.path.exists(cache) or args.clean:
@@ -1,20 +1,24 @@
 from typing import cast, Any, BinaryIO, NamedTuple, Union, Optional, \
-    List, Dict, Set, Tuple
+    List, Dict, Set, Tuple, Iterator, Callable
 
+import io
 import struct
 import pickle
 
+from array import array
+
 from enum import Enum
 from abc import ABC, abstractmethod
 from dataclasses import dataclass
 from collections import defaultdict
 
-from dart import SyncInfo, \
+from dart import SyncInfo, ledger_flatten, LogEntry, LOG_ARGC, \
     LogType, CtxtType, ExecUnitType, MemType, LockType, QueueType, OrderType
 from pkg_linux import Package_LINUX
 from racer_parse_compile_data import CompileDatabase, \
     ValueFunc, ValueBlock, ValueInst
 
+from fuzz_store import open_artifact
 from util import read_source_location
 
 import config
@@ -1154,9 +1158,14 @@ class VizRuntime(object):
         # records
         self.records = []  # type: List[str]
 
-    def process(self, path: str) -> None:
-        with open(path, 'rb') as f:
-            self._process(f)
+    def process(self, path: str, path_index: Optional[str] = None) -> None:
+        index = None if path_index is None else VizIndex()
+        with open_artifact(path) as f:
+            self._process(ledger_flatten(f), index)
+
+        # only a complete pass makes a valid index
+        if index is not None:
+            index.save(path_index)
 
     # look-up by point
     def _get_task(self, point: VizPoint) -> VizTask:
@@ -2102,7 +2111,7 @@ class VizRuntime(object):
         item.record()
 
     # main processing function
-    def _process(self, b: BinaryIO) -> None:
+    def _process(self, b: BinaryIO, index: Optional['VizIndex']) -> None:
         # parse meta
         n, _ = struct.unpack('QQ', b.read(16))
 
@@ -2110,9 +2119,14 @@ class VizRuntime(object):
         log_types = {i.value: i for i in LogType}
 
         for i in range(n):
+            if index is not None:
+                pos = b.tell()
             cval, ptid, info, hval = struct.unpack('IIQQ', b.read(24))
             code = log_types[cval]
 
+            if index is not None:
+                index.feed(i, pos, ptid, code, hval)
+
             # SYS
             if code == LogType.SYS_LAUNCH:
                 assert i == 0
@@ -2555,6 +2569,9 @@ class VizRuntime(object):
         for mobj in set(self.mem_info_heap.values()):
             mobj.site_alloc.add_error('dangling')
 
+        if index is not None:
+            index.close(n)
+
     def dump_races(self, path: str) -> None:
         with open(path, 'w') as f:
             table = {}  # type: Dict[Tuple[int, int], int]
@@ -2782,6 +2799,229 @@ class VizPack(object):
         return hist, node, edge
 
 
+class VizIndex(object):
+    """
+    Sidecar of a ledger produced along with the analysis, locating the events
+    of a window or a thread without replaying (or even parsing) the rest:
+      - buckets: offset of every VIZ_INDEX_BUCKET-th entry of the ledger
+      - marks: per ptid, (seq, offset) of every VIZ_INDEX_BUCKET-th entry
+        of that ptid
+      - spans: per ptid, (enter seq, exit seq, depth, hval) of every call
+    seq is the position of an entry in the flat ledger, offset is the byte
+    position of the entry in the stream returned by ledger_flatten
+    """
+
+    def __init__(self) -> None:
+        self.total = 0
+        self.buckets = array('Q')
+        self.counts = defaultdict(int)  # type: Dict[int, int]
+        self.marks = {}  # type: Dict[int, array]
+        self.spans = {}  # type: Dict[int, array]
+
+        # only needed while building
+        # (enter seq, hval) of the calls pending on each ptid
+        self._stack = defaultdict(list)  # type: Dict[int, List[Tuple]]
+
+    def feed(
+            self, seq: int, pos: int, ptid: int, code: LogType, hval: int
+    ) -> None:
+        if seq % config.VIZ_INDEX_BUCKET == 0:
+            self.buckets.append(pos)
+
+        count = self.counts[ptid]
+        if count % config.VIZ_INDEX_BUCKET == 0:
+            if ptid not in self.marks:
+                self.marks[ptid] = array('Q')
+            self.marks[ptid].extend((seq, pos))
+        self.counts[ptid] = count + 1
+
+        if code == LogType.EXEC_FUNC_ENTER:
+            self._stack[ptid].append((seq, hval))
+
+        elif code == LogType.EXEC_FUNC_EXIT:
+            stack = self._stack[ptid]
+            enter, func = stack.pop()
+            assert func == hval
+            self._add_span(ptid, enter, seq, len(stack), hval)
+
+    def _add_span(
+            self, ptid: int, enter: int, exit: int, depth: int, hval: int
+    ) -> None:
+        if ptid not in self.spans:
+            self.spans[ptid] = array('Q')
+        self.spans[ptid].extend((enter, exit, depth, hval))
+
+    def close(self, total: int) -> None:
+        self.total = total
+
+        # calls that never returned span till the end of the ledger
+        for ptid, stack in self._stack.items():
+            while len(stack) != 0:
+                enter, hval = stack.pop()
+                self._add_span(ptid, enter, total, len(stack), hval)
+
+        self._stack.clear()
+        self.counts = dict(self.counts)
+
+    def save(self, path: str) -> None:
+        with open(path, 'wb') as f:
+            pickle.dump(self, f)
+
+    @classmethod
+    def load(cls, path: str) -> 'VizIndex':
+        with open(path, 'rb') as f:
+            return cast(VizIndex, pickle.load(f))
+
+    # calls
+    def calls(
+            self, ptid: int, hval: Optional[int] = None
+    ) -> List[Tuple[int, int, int, int]]:
+        if ptid not in self.spans:
+            return []
+
+        spans = self.spans[ptid]
+        result = [
+            (spans[i], spans[i + 1], spans[i + 2], spans[i + 3])
+            for i in range(0, len(spans), 4)
+            if hval is None or spans[i + 3] == hval
+        ]
+        return sorted(result)
+
+    def depth_at(self, ptid: int, seq: int) -> int:
+        if ptid not in self.spans:
+            return 0
+
+        spans = self.spans[ptid]
+        return sum(
+            1 for i in range(0, len(spans), 4)
+            if spans[i] < seq <= spans[i + 1]
+        )
+
+    # loading
+    @staticmethod
+    def _scan(
+            b: BinaryIO, seq: int, pos: int, end: int,
+            accept: Callable[[int, int], bool],
+    ) -> Iterator[Tuple[int, LogEntry]]:
+        argc = [0] * LogType._END_OF_ENUM
+        for k, v in LOG_ARGC.items():
+            argc[k] = v
+
+        b.seek(pos)
+        while seq < end:
+            cval, ptid, info, hval = struct.unpack('IIQQ', b.read(24))
+            if not accept(seq, ptid):
+                b.seek(8 * argc[cval], io.SEEK_CUR)
+                seq += 1
+                continue
+
+            args = struct.unpack(
+                '{}Q'.format(argc[cval]), b.read(8 * argc[cval])
+            )
+            yield seq, (cval, ptid, info, hval, args)
+            seq += 1
+
+    def window(
+            self, b: BinaryIO, lo: int, hi: int,
+            ptids: Optional[Set[int]] = None,
+    ) -> Iterator[Tuple[int, LogEntry]]:
+        """
+        Entries in [lo, hi) of the ledger, optionally of selected threads
+        """
+        hi = min(hi, self.total)
+        if lo >= hi:
+            return
+
+        k = lo // config.VIZ_INDEX_BUCKET
+        yield from VizIndex._scan(
+            b, k * config.VIZ_INDEX_BUCKET, self.buckets[k], hi,
+            lambda seq, ptid: seq >= lo and (ptids is None or ptid in ptids)
+        )
+
+    def thread(
+            self, b: BinaryIO, ptid: int, lo: int, num: int
+    ) -> Iterator[Tuple[int, LogEntry]]:
+        """
+        The lo-th to (lo + num)-th entries of one thread
+        """
+        if ptid not in self.marks or lo >= self.counts[ptid]:
+            return
+
+        k = lo // config.VIZ_INDEX_BUCKET
+        seq, pos = self.marks[ptid][2 * k], self.marks[ptid][2 * k + 1]
+        skip = lo - k * config.VIZ_INDEX_BUCKET
+
+        for item in VizIndex._scan(
+                b, seq, pos, self.total, lambda _, p: p == ptid
+        ):
+            if skip != 0:
+                skip -= 1
+                continue
+
+            yield item
+
+            num -= 1
+            if num == 0:
+                return
+
+    def fold(
+            self,
+            entries: Iterator[Tuple[int, LogEntry]],
+            limit: Optional[int],
+            funcs: Dict[int, ValueFunc],
+    ) -> List[str]:
+        """
+        Render the entries as call trees, folding calls deeper than limit
+        """
+        fill = '' if limit is None else '  ' * (limit + 1)
+        depths = {}  # type: Dict[int, int]
+        folded = {}  # type: Dict[int, int]
+        lines = []  # type: List[str]
+
+        for seq, (cval, ptid, _, hval, args) in entries:
+            if ptid not in depths:
+                depths[ptid] = self.depth_at(ptid, seq)
+                folded[ptid] = 0
+
+            code = LogType(cval)
+            if code == LogType.EXEC_FUNC_EXIT:
+                depths[ptid] -= 1
+
+            depth = depths[ptid]
+            if code == LogType.EXEC_FUNC_ENTER:
+                depths[ptid] += 1
+
+            if limit is not None and depth > limit:
+                folded[ptid] += 1
+                continue
+
+            if folded[ptid] != 0:
+                lines.append('{:>10} [{}] {}... {} folded'.format(
+                    '', ptid, fill, folded[ptid]
+                ))
+                folded[ptid] = 0
+
+            if code in (LogType.EXEC_FUNC_ENTER, LogType.EXEC_FUNC_EXIT) \
+                    and hval in funcs:
+                desc = funcs[hval].name
+            else:
+                desc = '{:#x}'.format(hval)
+
+            lines.append('{:>10} [{}] {}{} {}{}'.format(
+                seq, ptid, '  ' * depth, code.name, desc,
+                '' if len(args) == 0 else
+                ' ' + ' '.join('{:#x}'.format(a) for a in args)
+            ))
+
+        for ptid, count in folded.items():
+            if count != 0:
+                lines.append('{:>10} [{}] {}... {} folded'.format(
+                    '', ptid, fill, count
+                ))
+
+        return lines
+
+
 # source code
 def load_source(inst: ValueInst) -> str:
     return ' @@ '.join([
@@ -1,8 +1,15 @@
-from typing import List, Tuple, Optional, Iterator
+from typing import cast, Any, BinaryIO, Dict, List, Tuple, Optional, \
+    Iterator
 
 import os
+import json
+import time
 import uuid
+import shlex
+import socket
+import struct
 import shutil
+import subprocess
 
 from contextlib import contextmanager
 
@@ -10,10 +17,53 @@ from pkg_qemu import Package_QEMU
 from pkg_linux import Package_LINUX
 from pkg_initramfs import Package_INITRAMFS
 
+from emu_drain import LedgerDrainer
 from util import execute0, prepdn, touch
 
 import config
 
+# chunk size when moving the kernel part of an instance around
+_MB_COPY = 1 << 20
+
+
+class QMPClient(object):
+
+    def __init__(self, path: str) -> None:
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(path)
+        self.file = self.sock.makefile('r')
+
+        # greeting, then leave the negotiation mode
+        self._recv()
+        self.execute('qmp_capabilities')
+
+    def _recv(self) -> Dict[str, Any]:
+        line = self.file.readline()
+        if len(line) == 0:
+            raise RuntimeError('QMP connection closed')
+        return json.loads(line)
+
+    def execute(self, cmd: str, args: Optional[Dict[str, Any]] = None) -> Any:
+        msg = {'execute': cmd}  # type: Dict[str, Any]
+        if args is not None:
+            msg['arguments'] = args
+        self.sock.sendall(json.dumps(msg).encode('utf-8') + b'\n')
+
+        while True:
+            res = self._recv()
+            # skip asynchronous events
+            if 'event' in res:
+                continue
+            if 'error' in res:
+                raise RuntimeError('QMP {} failed: {}'.format(
+                    cmd, res['error'].get('desc', '')
+                ))
+            return res['return']
+
+    def close(self) -> None:
+        self.file.close()
+        self.sock.close()
+
 
 class Emulator(object):
 
@@ -35,6 +85,11 @@ class Emulator(object):
         # session
         self.session_sid = uuid.uuid4()
 
+        # persistent mode
+        self.persist = None  # type: Optional[subprocess.Popen]
+        self.persist_log = None  # type: Optional[BinaryIO]
+        self.persist_runs = 0
+
         self.session_shm = os.path.join(
             config.VIRTEX_SHM_DIR,
             'racer-ivshmem-{}'.format(config.OPTION().label),
@@ -97,6 +152,20 @@ class Emulator(object):
             'earlyprintk=ttyS0',
         ]
 
+        # snapshot mode: the disk is given as a block device (instead of via
+        # the 9p share, which blocks migration) and the shared ivshmem is
+        # neither saved nor restored, so that it carries the new program
+        self.qemu_args_snapshot = [
+            '-drive', ','.join([
+                'file={}'.format(os.path.join(
+                    self.session_tmp, config.VIRTEX_DISK_IMG_NAME
+                )),
+                'format=raw',
+                'if=virtio',
+            ]),
+            '-global', 'migration.x-ignore-shared=true',
+        ]
+
     @staticmethod
     def _run(qemu_path: str, qemu_args: List[str],
              boot_kernel: str, boot_initrd: str, boot_args: List[str],
@@ -109,13 +178,21 @@ class Emulator(object):
             *qemu_args,
         ], timeout=timeout, timeout_allowed=True)
 
+    def virtex_create_shm(self) -> None:
+        # create an empty ivshmem shm
+        if os.path.exists(self.session_shm):
+            os.unlink(self.session_shm)
+
+        touch(self.session_shm, config.IVSHMEM_SIZE)
+
+        # publish the layout of instances for the guests
+        with open(self.session_shm, 'r+b') as f:
+            f.seek(config.IVSHMEM_OFFSET_HEADER)
+            f.write(config.IVSHMEM_TABLE())
+
     def virtex_set_up(self, oneoff: bool) -> None:
         if oneoff:
-            # create the ivshmem shm
-            if os.path.exists(self.session_shm):
-                os.unlink(self.session_shm)
-
-            touch(self.session_shm, config.IVSHMEM_SIZE)
+            self.virtex_create_shm()
 
         # create the fsshare dir
         prepdn(self.session_tmp)
@@ -130,7 +207,7 @@ class Emulator(object):
         if os.path.exists(self.session_tmp):
             shutil.rmtree(self.session_tmp)
 
-    def launch(self) -> Tuple[str, str]:
+    def _qemu_args(self, snapshot: bool) -> List[str]:
         qemu_args = \
             self.qemu_args_machine + \
             self.qemu_args_ivshmem + \
@@ -138,13 +215,284 @@ class Emulator(object):
             self.qemu_args_pvpanic + \
             self.qemu_args_monitor
 
+        if snapshot:
+            qemu_args = qemu_args + self.qemu_args_snapshot
+
+        return qemu_args
+
+    def _guest_status(self, iseq: int) -> int:
+        with open(self.session_shm, 'rb') as f:
+            f.seek(config.INSTMEM_OFFSET(iseq) +
+                   config.INSTMEM_OFFSET_METADATA + 8)
+            return struct.unpack('Q', f.read(8))[0]
+
+    def _guest_signal(self, iseq: int, status: int) -> None:
+        with open(self.session_shm, 'r+b') as f:
+            f.seek(config.INSTMEM_OFFSET(iseq) +
+                   config.INSTMEM_OFFSET_METADATA + 8)
+            f.write(struct.pack('Q', status))
+
+    def _guest_wait(self, iseq: int, status: int) -> bool:
+        # wait for the guest to reach the status, or to exit / timeout
+        assert self.persist is not None
+
+        deadline = time.time() + config.VIRTEX_TIMEOUT
+        while self._guest_status(iseq) != status:
+            if self.persist.poll() is not None:
+                return False
+            if time.time() > deadline:
+                return False
+            time.sleep(0.001)
+
+        return True
+
+    def _copy_instmem_kern(self, iseq: int, path: str, save: bool) -> None:
+        # the kernel part of an instance, which the migration leaves out
+        offset = config.INSTMEM_OFFSET(iseq) + config.INSTMEM_OFFSET_RTINFO
+        with open(self.session_shm, 'r+b') as shm, \
+                open(path, 'wb' if save else 'rb') as img:
+            shm.seek(offset)
+            remain = config.INSTMEM_SIZE_KERN
+            while remain:
+                size = min(remain, _MB_COPY)
+                if save:
+                    img.write(shm.read(size))
+                else:
+                    shm.write(img.read(size))
+                remain -= size
+
+    def snapshot_restore(self, iseq: int, path_snap: str) -> None:
+        # the restored guest continues from the kernel regions of the
+        # instance as they were at the snapshot point, not as the previous
+        # execution left them
+        shutil.copy2(
+            path_snap + '.disk',
+            os.path.join(self.session_tmp, config.VIRTEX_DISK_IMG_NAME)
+        )
+        self._copy_instmem_kern(iseq, path_snap + '.kern', False)
+
+    def snapshot(self, iseq: int, path_snap: str) -> None:
+        path_qmp = self.session_tmp + '.qmp'
+        path_tmp = path_snap + '.tmp'
+
+        qemu_args = self._qemu_args(True) + [
+            '-qmp', 'unix:{},server,nowait'.format(path_qmp),
+        ]
+
+        cmd = [
+            self.path_qemu,
+            '-kernel', self.path_kernel,
+            '-initrd', self.path_initrd,
+            '-append', ' '.join(self.boot_args),
+            *qemu_args,
+        ]
+
+        # drain the ledger ring during the boot too, or a boot that logs more
+        # than the ring holds stalls the guest; what is drained up to the
+        # snapshot point is kept along with the snapshot
+        path_ledger = path_snap + '.ledger'
+        if os.path.exists(path_ledger):
+            os.unlink(path_ledger)
+
+        drainer = None
+        if config.LEDGER_RING:
+            drainer = LedgerDrainer(
+                self.session_shm, iseq, path_ledger, partial=True
+            )
+            drainer.start()
+
+        path_log = os.path.join(self.session_tmp, 'snapshot.log')
+        with open(path_log, 'w') as log, subprocess.Popen(
+                cmd, stdout=log, stderr=subprocess.STDOUT
+        ) as p:
+            try:
+                # wait for the guest to reach the snapshot point
+                deadline = time.time() + config.VIRTEX_TIMEOUT
+                while self._guest_status(iseq) != config.SHMEM_STATUS_SNAPSHOT:
+                    if p.poll() is not None:
+                        raise RuntimeError('Guest exited before the snapshot')
+                    if time.time() > deadline:
+                        raise RuntimeError('Guest timeout before the snapshot')
+                    time.sleep(0.1)
+
+                # save the machine state, the disk is saved below
+                qmp = QMPClient(path_qmp)
+                try:
+                    qmp.execute('stop')
+
+                    # the ring header, saved with the kernel regions below,
+                    # must match what has been drained
+                    if drainer is not None:
+                        drainer.stop()
+                        drainer = None
+
+                    qmp.execute('migrate', {
+                        'uri': 'exec:cat > {}'.format(shlex.quote(path_tmp))
+                    })
+
+                    while True:
+                        info = qmp.execute('query-migrate')
+                        status = info.get('status', '')
+                        if status == 'completed':
+                            break
+                        if status in ['failed', 'cancelled']:
+                            raise RuntimeError(
+                                'Snapshot migration {}'.format(status)
+                            )
+                        time.sleep(0.1)
+
+                    # the guest is stopped, so the kernel regions are stable
+                    self._copy_instmem_kern(iseq, path_snap + '.kern', True)
+
+                    qmp.execute('quit')
+                finally:
+                    qmp.close()
+
+                p.wait(timeout=config.VIRTEX_TIMEOUT)
+            except BaseException:
+                p.kill()
+                if drainer is not None:
+                    drainer.stop()
+                if os.path.exists(path_tmp):
+                    os.unlink(path_tmp)
+                if os.path.exists(path_ledger):
+                    os.unlink(path_ledger)
+                raise
+            finally:
+                if os.path.exists(path_qmp):
+                    os.unlink(path_qmp)
+
+        # the snapshot is only valid with the disk as of the snapshot point
+        shutil.copy2(
+            os.path.join(self.session_tmp, config.VIRTEX_DISK_IMG_NAME),
+            path_snap + '.disk'
+        )
+        os.rename(path_tmp, path_snap)
+
+    def launch(self, iseq: Optional[int] = None,
+               snapshot: Optional[str] = None) -> Tuple[str, str]:
+        qemu_args = self._qemu_args(snapshot is not None)
+
+        # restore from the snapshot instead of booting
+        if snapshot is not None:
+            qemu_args = qemu_args + [
+                '-incoming', 'exec:cat {}'.format(shlex.quote(snapshot)),
+            ]
+
         boot_args = self.boot_args
 
-        return Emulator._run(
-            self.path_qemu, qemu_args,
-            self.path_kernel, self.path_initrd, boot_args,
-            timeout=config.VIRTEX_TIMEOUT
+        # drain the ledger ring of the instance while the guest runs, a
+        # restored guest picks up the ring as of the snapshot point, after
+        # the entries drained while creating the snapshot
+        drainer = None
+        if config.LEDGER_RING and iseq is not None:
+            prefix = None
+            if snapshot is not None and \
+                    os.path.exists(snapshot + '.ledger'):
+                prefix = snapshot + '.ledger'
+
+            drainer = LedgerDrainer(
+                self.session_shm, iseq,
+                os.path.join(self.session_tmp, config.VIRTEX_LEDGER_NAME),
+                reset=snapshot is None, prefix=prefix
+            )
+            drainer.start()
+
+        try:
+            return Emulator._run(
+                self.path_qemu, qemu_args,
+                self.path_kernel, self.path_initrd, boot_args,
+                timeout=config.VIRTEX_TIMEOUT
+            )
+        finally:
+            if drainer is not None:
+                drainer.stop()
+
+
+    def persist_launch(self, iseq: int) -> bool:
+        cmd = [
+            self.path_qemu,
+            '-kernel', self.path_kernel,
+            '-initrd', self.path_initrd,
+            '-append', ' '.join(self.boot_args),
+            *self._qemu_args(False),
+        ]
+
+        # the console is kept out of the 9p share and sliced per program,
+        # appending only, so that reading it does not move the writes
+        self.persist_log = cast(
+            BinaryIO, open(self.session_tmp + '.console', 'ab')
+        )
+
+        # the guest only rings the doorbell once it is up
+        self._guest_signal(iseq, config.SHMEM_STATUS_BOOT)
+        self.persist = subprocess.Popen(
+            cmd, stdout=self.persist_log, stderr=subprocess.STDOUT
         )
+        self.persist_runs = 0
+
+        return self._guest_wait(iseq, config.SHMEM_STATUS_WAITING)
+
+    def persist_execute(self, iseq: int) -> Tuple[str, str]:
+        # (re)boot the guest when needed, the program is already in place
+        if self.persist is None or self.persist.poll() is not None or \
+                self.persist_runs >= config.VIRTEX_PERSISTENT_PROGRAMS:
+            self.persist_halt(iseq)
+            if not self.persist_launch(iseq):
+                outs = self._persist_output(0)
+                self.persist_halt(iseq, False)
+                return outs, ''
+
+        mark = os.path.getsize(self.session_tmp + '.console')
+
+        drainer = None
+        if config.LEDGER_RING:
+            drainer = LedgerDrainer(
+                self.session_shm, iseq,
+                os.path.join(self.session_tmp, config.VIRTEX_LEDGER_NAME)
+            )
+            drainer.start()
+
+        try:
+            self._guest_signal(iseq, config.SHMEM_STATUS_PROGRAM)
+            done = self._guest_wait(iseq, config.SHMEM_STATUS_WAITING)
+        finally:
+            if drainer is not None:
+                drainer.stop()
+
+        self.persist_runs += 1
+
+        # a guest that hangs or stops is rebooted for the next program
+        outs = self._persist_output(mark)
+        if not done:
+            self.persist_halt(iseq, False)
+
+        return outs, ''
+
+    def persist_halt(self, iseq: int, graceful: bool = True) -> None:
+        if self.persist is not None:
+            if graceful and self.persist.poll() is None:
+                self._guest_signal(iseq, config.SHMEM_STATUS_SHUTDOWN)
+                try:
+                    self.persist.wait(timeout=config.VIRTEX_TIMEOUT)
+                except subprocess.TimeoutExpired:
+                    pass
+
+            if self.persist.poll() is None:
+                self.persist.kill()
+                self.persist.wait()
+
+            self.persist = None
+
+        if self.persist_log is not None:
+            self.persist_log.close()
+            os.unlink(self.persist_log.name)
+            self.persist_log = None
+
+    def _persist_output(self, mark: int) -> str:
+        with open(self.session_tmp + '.console', 'rb') as f:
+            f.seek(mark)
+            return f.read().decode('charmap')
 
 
 @contextmanager
@@ -0,0 +1,158 @@
+from typing import cast, BinaryIO, Optional
+
+import os
+import mmap
+import shutil
+import struct
+import logging
+import threading
+
+import config
+
+# ring header layout (mirrors struct dart_ledger in pass/dart/dart_log.h)
+_RING_OFFSET_COUNT = 0
+_RING_OFFSET_CURSOR = 8
+_RING_OFFSET_DRAINED = 16
+_RING_OFFSET_LENGTH = 24
+_RING_OFFSET_CLOSED = 32
+_RING_OFFSET_COMMIT = 40
+
+# how long to sleep when there is nothing to drain
+_DRAIN_INTERVAL = 0.001
+
+
+class LedgerDrainer(threading.Thread):
+
+    def __init__(
+            self, path_shm: str, iseq: int, path_ledger: str,
+            reset: bool = True, prefix: Optional[str] = None,
+            partial: bool = False
+    ) -> None:
+        super().__init__(daemon=True)
+
+        self.path_ledger = path_ledger
+
+        # the entries drained before the snapshot point, which go ahead of
+        # the ring in the ledger of a restored guest
+        self.prefix = prefix
+
+        # keep what is drained even if the ring is not closed (i.e., up to
+        # the snapshot point)
+        self.partial = partial
+
+        # map the ledger ring of the instance
+        self.fd = os.open(path_shm, os.O_RDWR)
+        self.mm = mmap.mmap(
+            self.fd,
+            config.LEDGER_RING_HEAD_SIZE + config.LEDGER_RING_SIZE,
+            offset=config.INSTMEM_OFFSET(iseq) + config.INSTMEM_OFFSET_LEDGER,
+        )
+
+        # reset the ring header before the guest boots, or resume from the
+        # header as restored along with a snapshot
+        if reset:
+            self.mm[0:config.LEDGER_RING_HEAD_SIZE] = \
+                b'\x00' * config.LEDGER_RING_HEAD_SIZE
+
+        # drain states
+        self.done = threading.Event()
+        self.drained = self._u64(_RING_OFFSET_DRAINED)
+        self.closed = False
+        self.output = None  # type: Optional[BinaryIO]
+
+    def _u64(self, offset: int) -> int:
+        return struct.unpack_from('Q', self.mm, offset)[0]
+
+    def _commit_offset(self, chunk: int) -> int:
+        return _RING_OFFSET_COMMIT + 4 * chunk
+
+    def _write(self, pos: int, size: int) -> None:
+        if self.output is None:
+            # the ledger file is only created when the guest uses the ring,
+            # leaving space for the header which is written on close
+            self.output = cast(BinaryIO, open(self.path_ledger, 'wb'))
+            self.output.write(b'\x00' * 16)
+
+            if self.prefix is not None:
+                with open(self.prefix, 'rb') as f:
+                    f.seek(16)
+                    shutil.copyfileobj(f, self.output)
+
+        base = config.LEDGER_RING_HEAD_SIZE + pos
+        self.output.write(self.mm[base:base + size])
+
+    def _drain_chunks(self) -> bool:
+        progress = False
+
+        while True:
+            pos = self.drained % config.LEDGER_RING_SIZE
+            chunk = pos // config.LEDGER_RING_CHUNK_SIZE
+            commit = self._commit_offset(chunk)
+
+            if struct.unpack_from('I', self.mm, commit)[0] != \
+                    config.LEDGER_RING_CHUNK_SIZE:
+                break
+
+            self._write(pos, config.LEDGER_RING_CHUNK_SIZE)
+
+            # release the chunk before letting the guest reuse it
+            struct.pack_into('I', self.mm, commit, 0)
+            self.drained += config.LEDGER_RING_CHUNK_SIZE
+            struct.pack_into('Q', self.mm, _RING_OFFSET_DRAINED, self.drained)
+
+            progress = True
+
+        return progress
+
+    def _drain_close(self) -> None:
+        # every writer has finished, so the tail is fully committed
+        remain = self._u64(_RING_OFFSET_CURSOR) - self.drained
+        if remain:
+            self._write(self.drained % config.LEDGER_RING_SIZE, remain)
+            self.drained += remain
+
+        # in case the ring was closed without any entries
+        if self.output is None:
+            self._write(0, 0)
+
+        assert self.output is not None
+        self.output.seek(0)
+        self.output.write(struct.pack(
+            'QQ',
+            self._u64(_RING_OFFSET_COUNT),
+            self._u64(_RING_OFFSET_LENGTH),
+        ))
+
+    def _finish(self) -> None:
+        self._drain_chunks()
+        self._drain_close()
+        self.closed = True
+
+    def run(self) -> None:
+        while not self.done.is_set():
+            if self._u64(_RING_OFFSET_CLOSED):
+                self._finish()
+                return
+
+            if not self._drain_chunks():
+                self.done.wait(_DRAIN_INTERVAL)
+
+    def stop(self) -> None:
+        self.done.set()
+        self.join()
+
+        # the guest may have closed the ring right before exiting
+        if not self.closed and self._u64(_RING_OFFSET_CLOSED):
+            self._finish()
+
+        if self.output is not None:
+            self.output.close()
+            self.output = None
+
+            if not self.closed and not self.partial:
+                # the guest did not finish, a truncated ledger is not parsable
+                logging.warning('Ledger ring not closed, discarding the ledger')
+                os.unlink(self.path_ledger)
+
+        self.mm.close()
+        os.close(self.fd)
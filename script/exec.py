@@ -19,7 +19,7 @@ from emu import Emulator, create_emulator, attach_emulator
 from fuzz_exec import ExecResolver
 from dart_viz import VizRuntime
 
-from util import prepdn, touch, ascii_encode, enable_coloring_in_logging
+from util import prepdn, ascii_encode, enable_coloring_in_logging
 
 import config
 
@@ -144,7 +144,7 @@ class TestExec(object):
             f.write(case.pack())
 
         # launch
-        stdout, stderr = emu.launch()
+        stdout, stderr = emu.launch(self.iseq)
 
         # outputs
         with open(emu.session_shm, 'rb') as f:
@@ -193,14 +193,19 @@ class TestExec(object):
                         struct.unpack('QQQ', f.read(24))
 
                     cursor += 24
+                    l_size = l_len & ~(
+                        config.LEDGER_FLAG_SEGMENTED |
+                        config.LEDGER_FLAG_COMPACT
+                    )
                     if l_seq != self.iseq:
-                        cursor += l_len
+                        cursor += l_size
+                        f.seek(l_size, os.SEEK_CUR)
                         continue
 
                     # migrate the ledger
                     with open(ledger_dst, 'wb') as b:
                         b.write(struct.pack('QQ', l_cnt, l_len))
-                        b.write(f.read(l_len))
+                        b.write(f.read(l_size))
 
                     cursor = -1
                     break
@@ -216,7 +221,9 @@ class TestExec(object):
         failure = False
 
         try:
-            runtime.process(ledger_dst)
+            runtime.process(
+                ledger_dst, os.path.join(base, config.VIZ_INDEX_NAME)
+            )
         except Exception as ex:
             failure = True
             with open(os.path.join(console + '-error'), 'w') as t:
@@ -254,10 +261,7 @@ class TestRunner(object):
         # initialize the shared stuff
         with attach_emulator() as emulator:
             # create an empty ivshmem file
-            if os.path.exists(emulator.session_shm):
-                os.unlink(emulator.session_shm)
-
-            touch(emulator.session_shm, config.IVSHMEM_SIZE)
+            emulator.virtex_create_shm()
 
         # run the workers
         worker = TestExec(0, self.fswork, self.sample, fast)
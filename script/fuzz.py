@@ -9,7 +9,7 @@ from fs import FSWorker
 from fs_ext4 import FS_CONFIGS_EXT4, FSWorker_EXT4
 from fs_btrfs import FS_CONFIGS_BTRFS, FSWorker_BTRFS
 from fs_xfs import FS_CONFIGS_XFS, FSWorker_XFS
-from fuzz_check import ValidatorMaster
+from fuzz_check import ValidatorMaster, Steerer
 from fuzz_probe import ProbeMaster
 from fuzz_engine import FuzzMaster, FuzzBase, Seed
 
@@ -123,6 +123,34 @@ def main(argv: List[str]) -> int:
         help='Process the seeds in recency order (default: discovery order)'
     )
 
+    # steer
+    sub_steer = subs.add_parser(
+        'steer',
+        help='Steer a seed towards a racing pair'
+    )
+
+    # steer: target selection
+    sub_steer.add_argument(
+        'seed',
+        help='Seed to re-run, in the form of sketch:digest:bucket'
+    )
+    sub_steer.add_argument(
+        'src', type=lambda x: int(x, 0),
+        help='Instruction (hval) expected to access first'
+    )
+    sub_steer.add_argument(
+        'dst', type=lambda x: int(x, 0),
+        help='Instruction (hval) expected to access second, to be delayed'
+    )
+
+    # steer: overall setting
+    sub_steer.add_argument(
+        '-n', '--ntrial', type=int, default=None,
+        help='Number of runs per delay (default to {})'.format(
+            config.STEER_TRIALS
+        )
+    )
+
     # parse
     args = parser.parse_args(argv)
 
@@ -177,6 +205,16 @@ def main(argv: List[str]) -> int:
         validator = ValidatorMaster()
         validator.launch(args.nproc, args.nstep, args.recency)
 
+    elif cmd == 'steer':
+        toks = args.seed.split(':')
+        steerer = Steerer(fswork, args.img)
+        result = steerer.steer(
+            0, Seed(toks[0], toks[1], int(toks[2])),
+            args.src, args.dst, args.ntrial
+        )
+        if result is None:
+            return 1
+
     else:
         parser.print_help()
         return -1
@@ -9,10 +9,13 @@ from queue import Empty
 from dataclasses import dataclass
 from multiprocessing import Event, Queue, Process
 
+from fs import FSWorker
 from fuzz_stat import iter_seed_exec_inc, iter_seed_exec_dec
+from fuzz_exec import FuzzUnit, FuzzExec, Seed, SeedBase
+from spec_basis import Schedule
 from dart_viz import VizRuntime
 
-from util import disable_interrupt
+from util import disable_interrupt, prepdn
 
 import config
 
@@ -168,3 +171,71 @@ def validation_process(iseq: int, sync: ValidatorSync) -> None:
     worker = ValidatorWorker(iseq, sync)
     with disable_interrupt():
         worker.run()
+
+
+class Steerer(FuzzUnit):
+    """
+    Re-runs a seed with its interleaving steered towards a (src, dst) pair:
+    the dst instruction is stalled in the kernel so that the src one gets to
+    run first, with increasing delays, until the pair shows up as a race
+    """
+
+    def __init__(self, fswork: FSWorker, sample: str) -> None:
+        super().__init__(fswork, sample)
+
+    @classmethod
+    def _confirm(cls, path_ledger: str, src: int, dst: int) -> bool:
+        runtime = VizRuntime()
+        runtime.process(path_ledger)
+
+        for race in runtime.races:
+            if race.src.inst.hval == src and race.dst.inst.hval == dst:
+                return True
+
+        return False
+
+    def steer(
+            self, iseq: int, seed: Seed, src: int, dst: int,
+            ntrial: Optional[int] = None
+    ) -> Optional[int]:
+        if ntrial is None:
+            ntrial = config.STEER_TRIALS
+
+        program = self._load_program(None, SeedBase.QUEUE, seed)
+        staging = os.path.join(config.VALIDATION_WORKER_PATH, str(iseq))
+
+        count = 0
+        for usec in config.STEER_DELAY_USECS:
+            schedule = Schedule.steer(program, dst, usec, config.VIRTEX_SMP)
+
+            for _ in range(ntrial):
+                prepdn(staging, override=True)
+                # confirmations need every access traced
+                runner = FuzzExec(
+                    iseq, self.fswork, self.sample, True, staging=staging,
+                    sampling_period_max=1
+                )
+                runner.run(program, schedule)
+                count += 1
+
+                path_ledger = os.path.join(staging, 'ledger')
+                if not os.path.exists(path_ledger):
+                    continue
+
+                try:
+                    confirmed = Steerer._confirm(path_ledger, src, dst)
+                except Exception as ex:
+                    logging.error('[{}] analysis failed: {}'.format(iseq, ex))
+                    continue
+
+                if confirmed:
+                    logging.warning(
+                        '[{}] race confirmed with {} us delay in {} runs'
+                        .format(iseq, usec, count)
+                    )
+                    return count
+
+        logging.warning('[{}] race not reproduced in {} runs'.format(
+            iseq, count
+        ))
+        return None
@@ -1,4 +1,4 @@
-from typing import cast, Dict, List, Set, FrozenSet, Tuple, Optional
+from typing import cast, Any, Dict, Set, FrozenSet, Tuple, Optional
 
 import os
 import json
@@ -13,7 +13,11 @@ from multiprocessing import Event, Queue, Lock, Process
 from fs import FSWorker
 from spec_basis import Program
 from spec_random import SPEC_RANDOM
-from fuzz_exec import FuzzUnit, FuzzExec, Seed, SeedBase
+from emu import create_emulator, attach_emulator, Emulator
+from fuzz_exec import FuzzUnit, FuzzExec, Seed, SeedBase, ResultPack, \
+    AnalyzePipeline
+from fuzz_shm import SeedLog, CovStore
+from fuzz_store import open_artifact
 
 from util import prepdn, mkdir_seq, is_error_code, \
     disable_sigterm, disable_interrupt
@@ -21,14 +25,81 @@ from util import prepdn, mkdir_seq, is_error_code, \
 import config
 
 
+class EnergyStat(object):
+    """
+    New coverage per second of the executions credited to a seed or a loop,
+    both sums decay per execution so that a seed that plateaued loses its
+    share over time, the prior gives the unexplored ones a fair start
+    """
+
+    def __init__(self) -> None:
+        self.gain = 0.0
+        self.cost = 0.0
+        self.runs = 0
+
+    # raw sums, for the deltas reported by the workers
+    def record(self, gain: float, cost: float) -> None:
+        self.gain += gain
+        self.cost += cost
+        self.runs += 1
+
+    def update(self, gain: float, cost: float, runs: int) -> None:
+        decay = config.FUZZ_ENERGY_DECAY ** runs
+        self.gain = self.gain * decay + gain
+        self.cost = self.cost * decay + cost
+        self.runs += runs
+
+    def energy(self) -> float:
+        return (self.gain + config.FUZZ_ENERGY_PRIOR) / \
+            (self.cost + config.FUZZ_ENERGY_PRIOR)
+
+
 class GlobalStatus(object):
 
     def __init__(self) -> None:
-        pass
+        self.seeds = {}  # type: Dict[Seed, EnergyStat]
+        self.loops = {}  # type: Dict[str, EnergyStat]
+
+    # runtimes pickled before the stats existed
+    def __setstate__(self, state: Dict[str, object]) -> None:
+        self.__init__()  # type: ignore
+        self.__dict__.update(state)
+
+    @staticmethod
+    def _stat(table: Dict[Any, EnergyStat], key: Any) -> EnergyStat:
+        if key not in table:
+            table[key] = EnergyStat()
+        return table[key]
+
+    # an execution, credited to its origin seeds and to the loop producing it
+    def record(
+            self, seeds: Tuple[Seed, ...], loop: str, gain: int, cost: float
+    ) -> None:
+        for seed in seeds:
+            self._stat(self.seeds, seed).record(gain, cost)
+        self._stat(self.loops, loop).record(gain, cost)
 
     # merge (happens when we load runtime info from instance)
     def merge(self, other: 'GlobalStatus') -> None:
-        pass
+        for k, v in other.seeds.items():
+            self._stat(self.seeds, k).update(v.gain, v.cost, v.runs)
+        for n, v in other.loops.items():
+            self._stat(self.loops, n).update(v.gain, v.cost, v.runs)
+
+    def seed_energy(self, seed: Seed) -> float:
+        if seed not in self.seeds:
+            return 1.0
+        return self.seeds[seed].energy()
+
+    def loop_ttl(self, loop: str, base: int) -> int:
+        if loop not in self.loops:
+            return base
+
+        # scaled by how the loop fares against the average of all loops
+        mean = sum([v.energy() for v in self.loops.values()]) / \
+            len(self.loops)
+        ttl = round(base * self.loops[loop].energy() / mean)
+        return min(max(ttl, max(base // 2, 1)), base * 2)
 
 
 class Summary(object):
@@ -36,18 +107,21 @@ class Summary(object):
     def __init__(self) -> None:
         self.primes = set()  # type: Set[Seed]
 
-    # seed addition
-    def add(self, seeds: Set[Seed]) -> None:
-        self.primes.update(seeds)
+    # seed addition, returns the ones not seen before
+    def add(self, seeds: Set[Seed]) -> Set[Seed]:
+        fresh = seeds - self.primes
+        self.primes.update(fresh)
+        return fresh
 
-    # seed selection
-    def pick_for_start(self) -> Seed:
-        # TODO (select one seed with cov_cfg_edge_incr > 0 randomly)
-        return SPEC_RANDOM.choice(sorted(self.primes))
+    # seed selection, weighted by the energy of each seed
+    def pick_for_start(self, runtime: GlobalStatus) -> Seed:
+        seeds = sorted(self.primes)
+        return SPEC_RANDOM.choices(
+            seeds, [runtime.seed_energy(s) for s in seeds]
+        )[0]
 
-    def pick_for_merge(self) -> Tuple[Seed, Seed]:
-        # TODO (select two seeds with cov_cfg_edge_incr > 0 randomly)
-        return self.pick_for_start(), self.pick_for_start()
+    def pick_for_merge(self, runtime: GlobalStatus) -> Tuple[Seed, Seed]:
+        return self.pick_for_start(runtime), self.pick_for_start(runtime)
 
 
 @dataclass
@@ -55,8 +129,7 @@ class SyncPack(object):
     event_interrupted: Event  # type: ignore
     event_resume: Event  # type: ignore
     queue_update: Queue
-    queue_seed_get: Queue
-    queue_seed_put: Queue
+    seed_log: SeedLog
     lock_runtime: Lock  # type: ignore
 
 
@@ -128,6 +201,13 @@ class FuzzMaster(FuzzBase):
         runtime = self._load_runtime(None)
         self._cov_recover()
 
+        # the bitmaps stay mapped, checkpoints are taken in the background
+        with attach_emulator() as emulator:
+            covstore = CovStore(
+                emulator.session_shm, self.path_cov_cfg_edge,
+                self.path_cov_dfg_edge, self.path_cov_alias_inst
+            )
+
         # set the refresh counter
         refresh = config.REFRESH_RATE
 
@@ -140,17 +220,16 @@ class FuzzMaster(FuzzBase):
         # queue: queues the runtime status refreshing requests
         queue_update = Queue()  # type: Queue
 
-        # queue: queues the seed get requests
-        queue_seed_get = Queue()  # type: Queue
-
-        # queue: queues the seed put responses
-        queue_seed_puts = [Queue() for _ in range(nproc)]  # type: List[Queue]
+        # log: all the seeds, shared with (and read by) every worker
+        seed_log = SeedLog(config.FUZZ_SEED_LOG_MAX)
+        for seed in sorted(summary.primes):
+            self._publish(seed_log, seed)
 
         # lock: protects access to the global runtime
         lock_runtime = Lock()
 
         # assign a random seed for each of the fuzzer instance
-        seeds = [summary.pick_for_start() for _ in range(nproc)]
+        seeds = [summary.pick_for_start(runtime) for _ in range(nproc)]
 
         # build the fuzzing processes
         processes = [
@@ -161,8 +240,7 @@ class FuzzMaster(FuzzBase):
                         event_interrupted,
                         event_resumes[i],
                         queue_update,
-                        queue_seed_get,
-                        queue_seed_puts[i],
+                        seed_log,
                         lock_runtime,
                     ), seeds[i]
                 )
@@ -182,14 +260,6 @@ class FuzzMaster(FuzzBase):
         while True:
 
             try:
-                # check if there are pending requests for seeds
-                while True:
-                    try:
-                        iseq = queue_seed_get.get(block=False)
-                        queue_seed_puts[iseq].put(summary.pick_for_merge())
-                    except Empty:
-                        break
-
                 # wait for an update from the workers
                 try:
                     iseq = queue_update.get(timeout=1)
@@ -217,9 +287,10 @@ class FuzzMaster(FuzzBase):
                     self._save_runtime(None, runtime)
                     lock_runtime.release()
 
-                    # transfer interesting instances from worker
-                    self._transfer(iseq, summary)
-                    self._save_summary(summary)
+                    # transfer interesting instances from worker, only the
+                    # new seeds get published, the summary is checkpointed
+                    for seed in sorted(self._transfer(iseq, summary)):
+                        self._publish(seed_log, seed)
 
                     # resume the worker instance
                     event_resumes[iseq].set()
@@ -231,7 +302,9 @@ class FuzzMaster(FuzzBase):
                 refresh -= 1
                 if refresh == 0:
                     with disable_interrupt():
-                        self._cov_checkpoint()
+                        covstore.checkpoint(
+                            [(self._path_summary(), pickle.dumps(summary))]
+                        )
                     refresh = config.REFRESH_RATE
 
                 # abort if we limit the execution by nstep
@@ -249,7 +322,10 @@ class FuzzMaster(FuzzBase):
 
         # on breaking the main loop, checkpoint first
         with disable_interrupt():
-            self._cov_checkpoint()
+            covstore.checkpoint(
+                [(self._path_summary(), pickle.dumps(summary))], wait=True
+            )
+            covstore.close()
 
         # exit procedure
         limit = 3
@@ -270,6 +346,11 @@ class FuzzMaster(FuzzBase):
                 logging.warning('killing instance {}'.format(i))
                 p.kill()
 
+    @staticmethod
+    def _publish(seed_log: SeedLog, seed: Seed) -> None:
+        if not seed_log.append(seed):
+            logging.warning('seed log is full, {} kept local'.format(seed))
+
     def _bootstrap(self) -> None:
         # use the bootstrap sequence as seed
         program = Program(config.VIRTEX_THREAD_NUM)
@@ -296,7 +377,7 @@ class FuzzMaster(FuzzBase):
     # extract primitives
     def _extract_primitives(self, prog: Program, path: str) -> Set[Seed]:
         # get return values
-        with open(os.path.join(path, 'outcome')) as t:
+        with open_artifact(os.path.join(path, 'outcome'), False) as t:
             retv = json.load(t)['subs']
 
         # check pairings thread by thread
@@ -367,7 +448,8 @@ class FuzzMaster(FuzzBase):
         return seeds
 
     # transfer of instance states
-    def _transfer(self, iseq: int, summary: Summary) -> None:
+    def _transfer(self, iseq: int, summary: Summary) -> Set[Seed]:
+        fresh = set()  # type: Set[Seed]
         for base in SeedBase:
             path = self._path_program(iseq, base)
             if not os.path.exists(path):
@@ -393,7 +475,9 @@ class FuzzMaster(FuzzBase):
                             rpack = os.path.join(opath, res)
 
                             # extract primitives
-                            summary.add(self._extract_primitives(p, rpack))
+                            fresh.update(summary.add(
+                                self._extract_primitives(p, rpack)
+                            ))
 
                             # migrate the contents in the result pack
                             rpath = mkdir_seq(spath)
@@ -403,6 +487,8 @@ class FuzzMaster(FuzzBase):
             # done with the migration, remove all
             shutil.rmtree(path)
 
+        return fresh
+
 
 class FuzzWorker(FuzzBase):
 
@@ -413,6 +499,24 @@ class FuzzWorker(FuzzBase):
         self.iseq = iseq
         self.sync = sync
 
+        # persistent mode session
+        self.persist = None  # type: Optional[Emulator]
+
+        # local view of the seeds, caught up from the shared log
+        self.summary = Summary()
+        self.seed_cursor = 0
+
+        # latest runtime, and the energy spent since the last report
+        self.runtime = GlobalStatus()
+        self.delta = GlobalStatus()
+
+        # where the program being evolved comes from
+        self.origin = ()  # type: Tuple[Seed, ...]
+        self.stage = 'rep'
+
+        # background analysis of the executed programs
+        self.pipeline = None  # type: Optional[AnalyzePipeline]
+
         # prep
         path_private = self._path_instance(iseq)
         prepdn(path_private)
@@ -435,6 +539,7 @@ class FuzzWorker(FuzzBase):
 
         # load the seed
         program = self._load_program(None, SeedBase.PRIME, seed)
+        self.origin = (seed,)
 
         # initial sync
         runtime = self._sync()
@@ -443,8 +548,35 @@ class FuzzWorker(FuzzBase):
         if runtime is None:
             return
 
+        if config.FUZZ_ANALYZE_PROCS != 0:
+            self.pipeline = AnalyzePipeline(
+                config.FUZZ_ANALYZE_PROCS, config.FUZZ_ANALYZE_DEPTH
+            )
+
+        try:
+            self._run_evolve(runtime, program)
+        finally:
+            if self.pipeline is not None:
+                self.pipeline.close()
+                self._check_analyzed()
+                self.pipeline = None
+
+    def _run_evolve(self, runtime: GlobalStatus, program: Program) -> None:
         # main worker loop
-        self._evolve(runtime, program)
+        if not config.VIRTEX_PERSISTENT:
+            self._evolve(runtime, program)
+            return
+
+        # in persistent mode, stream all executions into one guest
+        with create_emulator(False) as emu:
+            emu.boot_args.append('dart_instance={}'.format(self.iseq))
+
+            self.persist = emu
+            try:
+                self._evolve(runtime, program)
+            finally:
+                emu.persist_halt(self.iseq)
+                self.persist = None
 
     def _sync(self) -> Optional[GlobalStatus]:
         while not self.sync.event_interrupted.is_set():  # type: ignore
@@ -460,13 +592,15 @@ class FuzzWorker(FuzzBase):
             runtime = self._load_runtime(None)
             self.sync.lock_runtime.release()  # type: ignore
 
+            self.runtime = runtime
             return runtime
 
         return None
 
-    def _report(self, runtime: GlobalStatus) -> Optional[GlobalStatus]:
-        # save the updated runtime after finding a new seed
-        self._save_runtime(self.iseq, runtime)
+    def _report(self) -> Optional[GlobalStatus]:
+        # save the runtime delta after finding a new seed
+        self._save_runtime(self.iseq, self.delta)
+        self.delta = GlobalStatus()
 
         # inform the master
         self.sync.queue_update.put(self.iseq)
@@ -474,12 +608,62 @@ class FuzzWorker(FuzzBase):
         # sync the latest runtime back
         return self._sync()
 
+    def _pull_seeds(self) -> None:
+        seeds = self.sync.seed_log.read(self.seed_cursor)
+        self.seed_cursor += len(seeds)
+        self.summary.add(set(seeds))
+
+    def _save_ledger(self, rpath: str) -> None:
+        path_ledger = os.path.join(self._path_instance(self.iseq), 'ledger')
+
+        store = self._result_store()
+        if store is None:
+            shutil.move(path_ledger, os.path.join(rpath, 'ledger'))
+            return
+
+        with open(path_ledger, 'rb') as f:
+            store.put_artifacts(rpath, {'ledger': f.read()})
+        os.unlink(path_ledger)
+
+    def _credit(self, result: ResultPack) -> None:
+        gain = result.feedback.cov_incr
+        cost = result.feedback.exec_time
+
+        # reported later, but already steering the picks of this worker
+        self.delta.record(self.origin, self.stage, gain, cost)
+
+        step = GlobalStatus()
+        step.record(self.origin, self.stage, gain, cost)
+        self.runtime.merge(step)
+
+        # until the program changes, the executions are plain re-runs
+        self.stage = 'rep'
+
+    def _check_analyzed(self) -> bool:
+        assert self.pipeline is not None
+
+        # the verdicts arrive late, the program is the snapshot taken then
+        found = False
+        for program, result in self.pipeline.collect():
+            if result.error is None:
+                continue
+
+            rpath = self._save_result(
+                self.iseq, SeedBase.DEBUG, program, result
+            )
+            logging.critical('analysis error: {}'.format(rpath))
+            self.logger.info('\t\t\t[x] analysis')
+            found = True
+
+        return found
+
     def _evolve_rep_loop(
             self, runtime: GlobalStatus, program: Program
     ) -> bool:
         useful = False
         epoch = 0
         stall = 0
+        ttl = self.runtime.loop_ttl('rep', config.TTL_REP_LOOP)
 
         while not self.sync.event_interrupted.is_set():  # type: ignore
             # log event
@@ -489,13 +673,20 @@ class FuzzWorker(FuzzBase):
             # execute
             runner = FuzzExec(
                 self.iseq, self.fswork, self.sample, False,
-                staging=self._path_instance(self.iseq), staging_check=False
+                staging=self._path_instance(self.iseq), staging_check=False,
+                analyze=self.pipeline is not None,
+                persist=self.persist, pipeline=self.pipeline
             )
             result = runner.run(program)
+            self._credit(result)
 
             # save unexpected errors
             check = False
 
+            # verdicts of the earlier executions, done in the background
+            if self.pipeline is not None and self._check_analyzed():
+                useful = True
+
             if result.error is not None:
                 rpath = self._save_result(
                     self.iseq, SeedBase.DEBUG, program, result
@@ -535,7 +726,13 @@ class FuzzWorker(FuzzBase):
                 rpath = self._save_result(
                     self.iseq, SeedBase.QUEUE, program, result
                 )
-                self.logger.info('\t\t\t[^] seed')
+                self.logger.info(
+                    '\t\t\t[^] seed (dfg {}, alias {}, {:.1%} traced)'.format(
+                        result.feedback.cov_dfg_edge_incr,
+                        result.feedback.cov_alias_inst_incr,
+                        result.feedback.sampling_rate
+                    )
+                )
 
                 stall = 0  # give it a few more trials
                 useful = True
@@ -545,7 +742,7 @@ class FuzzWorker(FuzzBase):
                 stall += 1
                 self.logger.info('\t\t\t[-] covered')
 
-                if stall == config.TTL_REP_LOOP:
+                if stall == ttl:
                     break
 
                 # nothing else to do
@@ -557,10 +754,7 @@ class FuzzWorker(FuzzBase):
 
             # upon reaching here, rpath cannot be None
             assert rpath is not None
-            shutil.move(
-                os.path.join(self._path_instance(self.iseq), 'ledger'),
-                os.path.join(rpath, 'ledger')
-            )
+            self._save_ledger(rpath)
 
         # inform upper level on whether this loop is useful
         return useful
@@ -571,6 +765,7 @@ class FuzzWorker(FuzzBase):
         useful = False
         epoch = 0
         stall = 0
+        ttl = self.runtime.loop_ttl('mod', config.TTL_MOD_LOOP)
 
         while not self.sync.event_interrupted.is_set():  # type: ignore
             # log event
@@ -586,13 +781,14 @@ class FuzzWorker(FuzzBase):
                     break
 
                 program.mod_syscall(None)
+                self.stage = 'mod'
 
             # inner loop
             inner = self._evolve_rep_loop(runtime, program)
 
             # if anything useful happened, inform the master
             if inner:
-                package = self._report(runtime)
+                package = self._report()
                 if package is None:
                     # master requested stop, break loop
                     break
@@ -604,7 +800,7 @@ class FuzzWorker(FuzzBase):
 
             # stalled
             stall += 1
-            if stall == config.TTL_MOD_LOOP:
+            if stall == ttl:
                 break
 
         # inform upper level on whether this loop is useful
@@ -616,6 +812,7 @@ class FuzzWorker(FuzzBase):
         useful = False
         epoch = 0
         stall = 0
+        ttl = self.runtime.loop_ttl('ext', config.TTL_EXT_LOOP)
 
         while not self.sync.event_interrupted.is_set():  # type: ignore
             # log event
@@ -631,6 +828,7 @@ class FuzzWorker(FuzzBase):
                     program.add_syscall(self.spec.syscall_generate())
                 else:
                     program.del_syscall(None)
+                self.stage = 'ext'
 
             # inner loop
             inner = self._evolve_mod_loop(runtime, program, True)
@@ -641,7 +839,7 @@ class FuzzWorker(FuzzBase):
 
             # stalled
             stall += 1
-            if stall == config.TTL_EXT_LOOP:
+            if stall == ttl:
                 break
 
         # inform upper level on whether this ext_loop is useful
@@ -653,24 +851,20 @@ class FuzzWorker(FuzzBase):
         program = self._load_program(None, SeedBase.PRIME, seed1)
         another = self._load_program(None, SeedBase.PRIME, seed2)
         program.merge(another)
+
+        self.origin = (seed1, seed2)
+        self.stage = 'merge'
         return program
 
     def _evolve(self, runtime: GlobalStatus, program: Program) -> None:
         while not self.sync.event_interrupted.is_set():  # type: ignore
             self._evolve_ext_loop(runtime, program, True)
 
-            # on exit of the ext_loop, we start to combined seeds
-            self.sync.queue_seed_get.put(self.iseq)
-            while not self.sync.event_interrupted.is_set():  # type: ignore
-                # wait for the master to distribute the seed pair
-                try:
-                    seed1, seed2 = self.sync.queue_seed_put.get(timeout=1)
-                except Empty:
-                    continue
-
-                # start to merging the seeds
-                program = self._evolve_merge_loop(runtime, seed1, seed2)
-                break
+            # on exit of the ext_loop, we start to combined seeds, picked
+            # from the seeds published so far without asking the master
+            self._pull_seeds()
+            seed1, seed2 = self.summary.pick_for_merge(self.runtime)
+            program = self._evolve_merge_loop(runtime, seed1, seed2)
 
 
 def fuzzing_process(
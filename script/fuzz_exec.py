@@ -1,23 +1,35 @@
-from typing import cast, BinaryIO, NamedTuple, Optional
+from typing import cast, BinaryIO, NamedTuple, Optional, Dict, List, Tuple, \
+    Deque
 
 import os
 import sys
 import json
+import mmap
 import shutil
 import struct
+import hashlib
 import pickle
+import time
+import logging
 import traceback
 
 from enum import Enum
-from dataclasses import dataclass, asdict
+from collections import deque
+from multiprocessing import Pool
+from multiprocessing.pool import AsyncResult
+from dataclasses import dataclass, asdict, field
 
 from fs import FSWorker
+from fuzz_strace import format_strace
+from fuzz_store import ResultStore, open_artifact
 from emu import create_emulator, attach_emulator, Emulator
-from spec_basis import Program, Outcome
+from spec_basis import Program, Outcome, Schedule, Executable
 from spec_factory import Spec
+from spec_packer import NativePacker
+from dart import LogType
 from dart_viz import VizRuntime
 
-from util import touch, prepdn, mkdir_seq, ascii_encode, dump_execute_outputs
+from util import prepdn, mkdir_seq, ascii_encode, dump_execute_outputs
 
 import config
 
@@ -33,12 +45,36 @@ class Feedback(object):
     cov_dfg_edge_incr: int
     cov_alias_inst_incr: int
 
+    # sampling
+    mem_access_seen: int = 0
+    mem_access_traced: int = 0
+
+    # hook stats (see config.RTINFO_HOOK_*), keyed by api, only if non-zero
+    hook_stats: Dict[str, List[int]] = field(default_factory=dict)
+
+    # indices new to the coverage maps, keyed by map, only if non-empty
+    cov_delta: Dict[str, List[int]] = field(default_factory=dict)
+
+    # cost: wall time (in seconds) of the execution, measured by the host
+    exec_time: float = 0.0
+
+    @property
+    def cov_incr(self) -> int:
+        return self.cov_cfg_edge_incr + self.cov_dfg_edge_incr + \
+            self.cov_alias_inst_incr
+
+    @property
+    def sampling_rate(self) -> float:
+        if self.mem_access_seen == 0:
+            return 1.0
+        return self.mem_access_traced / self.mem_access_seen
+
     def json(self) -> str:
         return json.dumps(asdict(self), indent=2)
 
     @classmethod
     def load(cls, path: str) -> 'Feedback':
-        with open(path, 'r') as f:
+        with open_artifact(path, binary=False) as f:
             data = json.load(f)
             return Feedback(
                 has_proper_exit=data['has_proper_exit'],
@@ -46,6 +82,11 @@ class Feedback(object):
                 cov_cfg_edge_incr=data['cov_cfg_edge_incr'],
                 cov_dfg_edge_incr=data['cov_dfg_edge_incr'],
                 cov_alias_inst_incr=data['cov_alias_inst_incr'],
+                mem_access_seen=data.get('mem_access_seen', 0),
+                mem_access_traced=data.get('mem_access_traced', 0),
+                hook_stats=data.get('hook_stats', {}),
+                cov_delta=data.get('cov_delta', {}),
+                exec_time=data.get('exec_time', 0.0),
             )
 
     def merge(self, feedback: 'Feedback') -> None:
@@ -58,6 +99,25 @@ class Feedback(object):
         self.cov_dfg_edge_incr += feedback.cov_dfg_edge_incr
         self.cov_alias_inst_incr += feedback.cov_alias_inst_incr
 
+        for k, d in feedback.cov_delta.items():
+            self.cov_delta.setdefault(k, []).extend(d)
+
+        # sampling
+        self.mem_access_seen += feedback.mem_access_seen
+        self.mem_access_traced += feedback.mem_access_traced
+
+        # hook stats
+        for k, v in feedback.hook_stats.items():
+            if k not in self.hook_stats:
+                self.hook_stats[k] = list(v)
+            else:
+                self.hook_stats[k] = [
+                    a + b for a, b in zip(self.hook_stats[k], v)
+                ]
+
+        # cost
+        self.exec_time += feedback.exec_time
+
 
 @dataclass
 class ResultPack(object):
@@ -81,7 +141,20 @@ class ResultPack(object):
             feedback=self.feedback.json()
         )
 
-    def save(self, path: str) -> None:
+    def save(self, path: str, store: Optional[ResultStore] = None) -> None:
+        # in the store, only the manifest is left in the result dir
+        if store is not None:
+            store.put_artifacts(path, {
+                'stdout': self.stdout.encode('utf-8'),
+                'stderr': self.stderr.encode('utf-8'),
+                'strace': self.strace.encode('utf-8'),
+                'rtrace': self.rtrace,
+                'outcome': self.outcome.json().encode('utf-8'),
+                'readable': self.readable.encode('utf-8'),
+                'feedback': self.feedback.json().encode('utf-8'),
+            })
+            return
+
         with open(os.path.join(path, 'stdout'), 'w') as f:
             f.write(self.stdout)
 
@@ -108,15 +181,69 @@ class ExecResolver(object):
 
     @classmethod
     def process_wks(cls, f: BinaryIO) -> Feedback:
-        pack = struct.unpack('QQQQQ', f.read(40))
+        base = f.tell()
+
+        # skip the sampling policy, which is ours
+        pack = struct.unpack('QQQQQ16xQQ', f.read(72))
+
+        # the kernel tells how many apis it has stats for
+        width = config.RTINFO_HOOK_STAT_HEAD + config.RTINFO_HOOK_HIST_BINS
+        count = struct.unpack('Q', f.read(8))[0]
+
+        stats = {}  # type: Dict[str, List[int]]
+        for i in range(min(count, LogType._END_OF_ENUM)):
+            data = f.read(width * 8)
+            if len(data) != width * 8:
+                break
+
+            row = list(struct.unpack('{}Q'.format(width), data))
+            if any(row):
+                stats[LogType(i).name] = row
+
+        # only the bits new to the maps, not the maps
+        f.seek(base + config.RTINFO_OFFSET_COV_DELTA)
+        count = struct.unpack('Q', f.read(8))[0]
+        if count > config.RTINFO_COV_DELTA_MAX:
+            logging.debug('coverage delta dropped {} bits'.format(
+                count - config.RTINFO_COV_DELTA_MAX
+            ))
+            count = config.RTINFO_COV_DELTA_MAX
+
+        delta = {}  # type: Dict[str, List[int]]
+        for item in struct.unpack('{}Q'.format(count), f.read(count * 8)):
+            kind = config.RTINFO_COV_DELTA_KINDS[item >> 32]
+            delta.setdefault(kind, []).append(item & 0xffffffff)
+
         return Feedback(
             has_proper_exit=pack[0],
             has_warning_or_error=pack[1],
             cov_cfg_edge_incr=pack[2],
             cov_dfg_edge_incr=pack[3],
             cov_alias_inst_incr=pack[4],
+            mem_access_seen=pack[5],
+            mem_access_traced=pack[6],
+            hook_stats=stats,
+            cov_delta=delta,
         )
 
+    @classmethod
+    def process_rtrace(cls, f: BinaryIO) -> bytes:
+        count = struct.unpack('Q', f.read(8))[0]
+
+        # plain form: (from, into, addr, size) per hit
+        if not count & config.RTRACE_FLAG_DEDUP:
+            length = min(count, config.RTRACE_ENTRY_MAX_PLAIN)
+            return f.read(length * 4 * 8)
+
+        # deduplicated form: (from, into, addr_lo, addr_hi, hits) per pair
+        count &= ~config.RTRACE_FLAG_DEDUP
+        dropped = struct.unpack('Q', f.read(8))[0]
+        if dropped:
+            logging.debug('rtrace dropped {} hits'.format(dropped))
+
+        length = min(count, config.RTRACE_ENTRY_MAX_DEDUP)
+        return f.read(length * 5 * 8)
+
     # a naive way to find signals in stdout
     @classmethod
     def has_bug_signal(cls, stdout: str) -> bool:
@@ -156,7 +283,10 @@ class FuzzExec(object):
     def __init__(
             self, iseq: int, fswork: FSWorker, sample: str, oneshot: bool,
             staging: Optional[str] = None, staging_check: bool = False,
-            analyze: bool = False, analyze_fast: bool = False
+            analyze: bool = False, analyze_fast: bool = False,
+            persist: Optional[Emulator] = None,
+            sampling_period_max: int = config.SAMPLING_PERIOD_MAX,
+            pipeline: Optional['AnalyzePipeline'] = None
     ) -> None:
         # basics
         self.iseq = iseq
@@ -168,69 +298,201 @@ class FuzzExec(object):
         self.staging = staging
         self.staging_check = staging_check
 
-        # analyze
+        # analyze (in the background if given a pipeline)
         self.analyze = analyze
         self.analyze_fast = analyze_fast
+        self.pipeline = pipeline
 
-    def run(self, program: Program) -> ResultPack:
-        with create_emulator(self.oneshot) as emu:
-            # pass the instance id via kernel boot parameters
-            emu.boot_args.append('dart_instance={}'.format(self.iseq))
+        # persistent mode (the session is owned by the caller)
+        self.persist = persist
 
-            # execute
-            result = self._run_execute(emu, program)
+        # sampling of memory accesses in the kernel
+        self.sampling_period_max = sampling_period_max
 
-            # analyze
-            if self.analyze:
-                self._run_analyze(emu, result)
+    def run(
+            self, program: Program, schedule: Optional[Schedule] = None
+    ) -> ResultPack:
+        start = time.time()
 
-            # staging
-            if self.staging_check and not result.feedback.has_proper_exit:
+        if self.persist is not None:
+            result = self._run_session(self.persist, program, schedule)
+        else:
+            with create_emulator(self.oneshot) as emu:
+                # pass the instance id via kernel boot parameters
+                emu.boot_args.append('dart_instance={}'.format(self.iseq))
+                result = self._run_session(emu, program, schedule)
+
+        # the whole session counts, including the boot if not persistent
+        result.feedback.exec_time = time.time() - start
+        return result
+
+    def _run_session(
+            self, emu: Emulator, program: Program,
+            schedule: Optional[Schedule]
+    ) -> ResultPack:
+        # execute
+        result = self._run_execute(emu, program, schedule)
+
+        # analyze
+        if self.analyze or \
+                self.staging_check and not result.feedback.has_proper_exit:
+            if self.pipeline is not None:
+                self._run_analyze_async(emu, program, result)
+            else:
                 self._run_analyze(emu, result)
 
-            if self.staging is not None:
-                path_ledger = os.path.join(emu.session_tmp, 'ledger')
-                if os.path.exists(path_ledger):
-                    os.rename(
-                        os.path.join(emu.session_tmp, 'ledger'),
-                        os.path.join(self.staging, 'ledger')
-                    )
+        if self.staging is not None:
+            path_ledger = os.path.join(emu.session_tmp, 'ledger')
+            if os.path.exists(path_ledger):
+                os.rename(
+                    os.path.join(emu.session_tmp, 'ledger'),
+                    os.path.join(self.staging, 'ledger')
+                )
 
-            # return with the result pack
-            return result
+        # return with the result pack
+        return result
 
-    def _run_execute(self, emu: Emulator, program: Program) -> ResultPack:
-        # copy over the image
-        shutil.copy2(
-            self.fswork.path_sample(self.sample),
-            os.path.join(emu.session_tmp, config.VIRTEX_DISK_IMG_NAME)
-        )
-
-        # inputs
+    def _put_metadata(self, emu: Emulator, command: str, status: int) -> None:
         with open(emu.session_shm, 'r+b') as f:
-            # put the metadata
             f.seek(config.INSTMEM_OFFSET(
                 self.iseq
             ) + config.INSTMEM_OFFSET_METADATA)
 
             f.write(struct.pack(
                 '@c7sQ',
-                ascii_encode('f'),
+                ascii_encode(command),
                 ascii_encode('fuzz'),
-                0,
+                status,
             ))
             f.write(self.fswork.pack_mount())
 
+    def _offset_sampling(self) -> int:
+        return config.INSTMEM_OFFSET(
+            self.iseq
+        ) + config.INSTMEM_OFFSET_RTINFO + config.RTINFO_OFFSET_SAMPLING
+
+    def _pack_sampling(self) -> bytes:
+        return struct.pack(
+            'QQ', self.sampling_period_max, config.SAMPLING_BURST
+        )
+
+    def _put_sampling(self, emu: Emulator) -> None:
+        with open(emu.session_shm, 'r+b') as f:
+            f.seek(self._offset_sampling())
+            f.write(self._pack_sampling())
+
+    def _put_image(self, emu: Emulator) -> None:
+        path_disk = os.path.join(emu.session_tmp, config.VIRTEX_DISK_IMG_NAME)
+        if os.path.exists(path_disk):
+            return
+
+        # the guest only reads the image into a copy-on-write ram disk, so
+        # the sample is shared as it is instead of being copied per run
+        try:
+            os.link(self.fswork.path_sample(self.sample), path_disk)
+        except OSError:
+            shutil.copy2(self.fswork.path_sample(self.sample), path_disk)
+
+    def _put_bytecode(
+            self, f: BinaryIO, program: Program, schedule: Optional[Schedule]
+    ) -> Tuple[Executable, int, int]:
+        offset = config.INSTMEM_OFFSET(
+            self.iseq
+        ) + config.INSTMEM_OFFSET_BYTECODE
+
+        # the native packer writes straight into the mapped region
+        if NativePacker.library() is not None:
+            parts = program.gen_parts(schedule)
+            with mmap.mmap(
+                    f.fileno(), config.INSTMEM_SIZE_BYTECODE, offset=offset
+            ) as mm:
+                with memoryview(mm) as region:
+                    size, heap_at = NativePacker.pack(
+                        region, config.BYTECODE_VADDR, parts
+                    )
+            return parts.inst, size, heap_at
+
+        inst, mach = program.gen_bytecode(schedule)
+        if len(mach) > config.INSTMEM_SIZE_BYTECODE:
+            raise RuntimeError('Bytecode overflows its region: {}'.format(
+                len(mach)
+            ))
+
+        f.seek(offset)
+        f.write(mach)
+        return inst, len(mach), len(mach) - len(inst.heap)
+
+    def _prep_snapshot(self, emu: Emulator) -> str:
+        # a snapshot is specific to the machine, the instance, and the sample
+        h = hashlib.sha1()
+        for item in [emu.path_kernel, emu.path_initrd]:
+            h.update(item.encode('utf-8'))
+            h.update(struct.pack('d', os.path.getmtime(item)))
+        h.update(' '.join(emu.boot_args).encode('utf-8'))
+        h.update(self.fswork.path_sample(self.sample).encode('utf-8'))
+        h.update(self.fswork.pack_mount())
+        h.update(self._pack_sampling())
+
+        os.makedirs(config.VIRTEX_SNAPSHOT_DIR, exist_ok=True)
+        path_snap = os.path.join(config.VIRTEX_SNAPSHOT_DIR, h.hexdigest())
+
+        if not os.path.exists(path_snap):
+            shutil.copy2(
+                self.fswork.path_sample(self.sample),
+                os.path.join(emu.session_tmp, config.VIRTEX_DISK_IMG_NAME)
+            )
+            self._put_metadata(emu, 's', config.SHMEM_STATUS_BOOT)
+            self._put_sampling(emu)
+            emu.snapshot(self.iseq, path_snap)
+
+        return path_snap
+
+    def _run_execute(
+            self, emu: Emulator, program: Program,
+            schedule: Optional[Schedule]
+    ) -> ResultPack:
+        snapshot = None  # type: Optional[str]
+
+        if config.VIRTEX_SNAPSHOT:
+            # restore the disk and the kernel regions (launched already, with
+            # the sampling policy in the key) along with the machine state
+            snapshot = self._prep_snapshot(emu)
+            emu.snapshot_restore(self.iseq, snapshot)
+
+            # the restored guest resumes once it sees the status
+            self._put_metadata(emu, 's', config.SHMEM_STATUS_RESUME)
+        elif self.persist is not None:
+            # the guest keeps the image in memory for all programs
+            self._put_image(emu)
+
+            # the guest waits in the loop, signaled only after the inputs
+            self._put_metadata(emu, 'l', config.SHMEM_STATUS_WAITING)
+
+            # a program may leave no ledger, drop the one from the last
+            path_ledger = os.path.join(emu.session_tmp, 'ledger')
+            if os.path.exists(path_ledger):
+                os.unlink(path_ledger)
+        else:
+            self._put_image(emu)
+            self._put_metadata(emu, 'f', config.SHMEM_STATUS_BOOT)
+
+        # inputs
+        with open(emu.session_shm, 'r+b') as f:
+
             # put the bytecode
-            f.seek(config.INSTMEM_OFFSET(
-                self.iseq
-            ) + config.INSTMEM_OFFSET_BYTECODE)
+            inst, size, heap_at = self._put_bytecode(f, program, schedule)
 
-            inst, mach = program.gen_bytecode()
-            f.write(mach)
+            # put the sampling policy, picked up by the kernel on launch (a
+            # restored guest is launched already, with the one it was given)
+            if snapshot is None:
+                f.seek(self._offset_sampling())
+                f.write(self._pack_sampling())
 
         # launch
-        stdout, stderr = emu.launch()
+        if self.persist is not None:
+            stdout, stderr = emu.persist_execute(self.iseq)
+        else:
+            stdout, stderr = emu.launch(self.iseq, snapshot)
 
         # outputs
         with open(emu.session_shm, 'rb') as f:
@@ -239,8 +501,12 @@ class FuzzExec(object):
                 self.iseq
             ) + config.INSTMEM_OFFSET_STRACE))
 
-            length = struct.unpack('Q', f.read(8))[0]
-            strace = f.read(length).decode('charmap')
+            # entries beyond the console are dropped by the guest
+            length = min(
+                struct.unpack('Q', f.read(8))[0],
+                config.INSTMEM_SIZE_STRACE - 8
+            )
+            strace = format_strace(f.read(length))
 
             # analyze the rtinfo
             f.seek(config.INSTMEM_OFFSET(
@@ -254,16 +520,14 @@ class FuzzExec(object):
                 self.iseq
             ) + config.INSTMEM_OFFSET_RTRACE)
 
-            length = struct.unpack('Q', f.read(8))[0]
-            rtrace = f.read(length * 4 * 8)
+            rtrace = ExecResolver.process_rtrace(f)
 
             # inspect the outcome
             f.seek(config.INSTMEM_OFFSET(
                 self.iseq
             ) + config.INSTMEM_OFFSET_BYTECODE)
 
-            offs = len(mach) - len(inst.heap)
-            outcome = program.inspect(inst, f.read(len(mach))[offs:])
+            outcome = program.inspect(inst, f.read(size)[heap_at:])
 
         # check bug signals in stdout
         if ExecResolver.has_bug_signal(stdout):
@@ -287,9 +551,37 @@ class FuzzExec(object):
         path = os.path.join(config.VALIDATION_WORKER_PATH, str(self.iseq))
         prepdn(path, override=True)
 
-        # save the result pack
-        result.save(path)
+        path_ledger = self._get_ledger(emu, result)
+        analyze_result(path, path_ledger, self.analyze_fast, result)
+
+    def _run_analyze_async(
+            self, emu: Emulator, program: Program, result: ResultPack
+    ) -> None:
+        assert self.pipeline is not None
+
+        # each job holds its own directory, as the next program is running
+        path = os.path.join(
+            config.VALIDATION_WORKER_PATH,
+            '{}.{}'.format(self.iseq, self.pipeline.next_job())
+        )
+        prepdn(path, override=True)
+
+        # hand the ledger over to the job, the staging keeps a link to it
+        path_ledger = self._get_ledger(emu, result)
+        path_job_ledger = os.path.join(path, 'ledger')
+        os.rename(path_ledger, path_job_ledger)
 
+        if self.staging is not None:
+            try:
+                os.link(path_job_ledger, path_ledger)
+            except OSError:
+                shutil.copy2(path_job_ledger, path_ledger)
+
+        self.pipeline.submit(
+            path, path_job_ledger, self.analyze_fast, program, result
+        )
+
+    def _get_ledger(self, emu: Emulator, result: ResultPack) -> str:
         # copy over the raw ledger (or copy from memory)
         path_ledger = os.path.join(emu.session_tmp, 'ledger')
 
@@ -332,37 +624,141 @@ class FuzzExec(object):
                     with open(path_ledger, 'wb') as b:
                         b.write(struct.pack('QQ', 0, 0))
 
-        # run the offline validation
+        return path_ledger
+
+
+def analyze_result(
+        path: str, path_ledger: str, analyze_fast: bool, result: ResultPack
+) -> ResultPack:
+    """
+    The offline part of the analysis, which needs nothing from the emulator
+    and hence may run while the next program executes
+    """
+    # save the result pack
+    result.save(path)
+
+    # run the offline validation (on the copy, unless already handed over)
+    if os.path.abspath(path_ledger) != \
+            os.path.abspath(os.path.join(path, 'ledger')):
         shutil.copy2(path_ledger, path)
 
-        # if analyze_fast is set, skip analysis if execution succeeds
-        if self.analyze_fast and result.error is None:
-            return
+    # if analyze_fast is set, skip analysis if execution succeeds
+    if analyze_fast and result.error is None:
+        return result
 
-        # do the very expensive validation
-        runtime = VizRuntime()
+    # do the very expensive validation
+    runtime = VizRuntime()
 
-        try:
-            runtime.process(path_ledger)
-        except AssertionError as ex:
-            with open(os.path.join(path, 'error'), 'w') as t:
-                t.write('\n-------- EXCEPTION --------\n')
-                traceback.print_tb(sys.exc_info()[2], file=t)
+    try:
+        runtime.process(
+            path_ledger, os.path.join(path, config.VIZ_INDEX_NAME)
+        )
+    except AssertionError as ex:
+        with open(os.path.join(path, 'error'), 'w') as t:
+            t.write('\n-------- EXCEPTION --------\n')
+            traceback.print_tb(sys.exc_info()[2], file=t)
+
+        if result.error is None:
+            result.error = ex
+
+    # save the console output
+    console = '\n'.join(runtime.records)
+    with open(os.path.join(path, 'console'), 'w') as t:
+        t.write(console)
+
+    # if validation failed, save the whole package to error dir
+    if result.error is not None:
+        prepdn(config.VALIDATION_FAILED_PATH)
+        path_rescue = mkdir_seq(config.VALIDATION_FAILED_PATH)
+        for item in os.listdir(path):
+            shutil.copy2(os.path.join(path, item), path_rescue)
+
+    return result
+
+
+def _analyze_job(
+        job: Tuple[str, str, bool, ResultPack]
+) -> Tuple[str, ResultPack]:
+    path, path_ledger, analyze_fast, result = job
+    return path, analyze_result(path, path_ledger, analyze_fast, result)
+
+
+class AnalyzePipeline(object):
+    """
+    Analyze the result packs in a pool of processes while the emulator goes
+    on with the next programs, staleness is bounded: at most depth results
+    are in flight, a submission beyond that waits for the oldest one
+    """
+
+    def __init__(self, nproc: int, depth: int) -> None:
+        self.pool = Pool(nproc)
+        self.depth = depth
+        self.jobs = 0
+        self.pending = \
+            deque()  # type: Deque[Tuple[AsyncResult, bytes, ResultPack]]
+        self.done = []  # type: List[Tuple[Program, ResultPack]]
+
+        # merged feedback of all the analyzed results
+        self.feedback = None  # type: Optional[Feedback]
+
+    def next_job(self) -> int:
+        self.jobs += 1
+        return self.jobs
+
+    def submit(
+            self, path: str, path_ledger: str, analyze_fast: bool,
+            program: Program, result: ResultPack
+    ) -> None:
+        while len(self.pending) >= self.depth:
+            self._reap(True)
+
+        # the program keeps evolving, hence a snapshot of it
+        self.pending.append((self.pool.apply_async(
+            _analyze_job, ((path, path_ledger, analyze_fast, result),)
+        ), pickle.dumps(program), result))
+
+    def _reap(self, block: bool) -> None:
+        while len(self.pending) != 0:
+            handle, program, origin = self.pending[0]
+            if not block and not handle.ready():
+                break
 
-            if result.error is None:
-                result.error = ex
+            self.pending.popleft()
+            try:
+                _, result = handle.get()
+            except Exception as ex:
+                origin.error = ex
+                result = origin
+
+            if self.feedback is None:
+                self.feedback = Feedback(**asdict(result.feedback))
+            else:
+                self.feedback.merge(result.feedback)
+
+            self.done.append((cast(Program, pickle.loads(program)), result))
+            block = False
+
+    def collect(
+            self, wait: bool = False
+    ) -> List[Tuple[Program, ResultPack]]:
+        """
+        Returns the results analyzed since the last call, in the order of
+        submission, waiting for all in flight if asked to
+        """
+        if wait:
+            while len(self.pending) != 0:
+                self._reap(True)
+        else:
+            self._reap(False)
 
-        # save the console output
-        console = '\n'.join(runtime.records)
-        with open(os.path.join(path, 'console'), 'w') as t:
-            t.write(console)
+        done = self.done
+        self.done = []
+        return done
 
-        # if validation failed, save the whole package to error dir
-        if result.error is not None:
-            prepdn(config.VALIDATION_FAILED_PATH)
-            path_rescue = mkdir_seq(config.VALIDATION_FAILED_PATH)
-            for item in os.listdir(path):
-                shutil.copy2(os.path.join(path, item), path_rescue)
+    def close(self) -> None:
+        self.collect(True)
+        self.pool.close()
+        self.pool.join()
 
 
 class Seed(NamedTuple):
@@ -405,6 +801,10 @@ class FuzzUnit(object):
         self.path_cov_dfg_edge = os.path.join(self.path_cov, 'dfg_edge')
         self.path_cov_alias_inst = os.path.join(self.path_cov, 'alias_inst')
 
+        # paths: artifacts of the saved executions (opened on first use)
+        self.path_store = os.path.join(self.wks_base, 'store')
+        self.store = None  # type: Optional[ResultStore]
+
     # instance path
     def _path_instance(self, iseq: Optional[int]) -> str:
         if iseq is None:
@@ -462,51 +862,66 @@ class FuzzUnit(object):
     ) -> str:
         spath = self._save_program(iseq, base, program)
         rpath = mkdir_seq(spath)
-        result.save(rpath)
+        result.save(rpath, self._result_store())
         return rpath
 
+    def _result_store(self) -> Optional[ResultStore]:
+        if not config.FUZZ_RESULT_STORE:
+            return None
+
+        if self.store is None:
+            self.store = ResultStore(self.path_store)
+        return self.store
+
     # persistent states
     def _cov_initialie(self) -> None:
-        # init the coverage bitmaps (all empty)
-        touch(self.path_cov_cfg_edge, config.BITMAP_COV_CFG_EDGE_SIZE)
-        touch(self.path_cov_dfg_edge, config.BITMAP_COV_DFG_EDGE_SIZE)
-        touch(self.path_cov_alias_inst, config.BITMAP_COV_ALIAS_INST_SIZE)
+        # init the coverage maps (all empty)
+        for path, size in [
+            (self.path_cov_cfg_edge, config.COV_MAP_SIZE_CFG_EDGE),
+            (self.path_cov_dfg_edge, config.COV_MAP_SIZE_DFG_EDGE),
+            (self.path_cov_alias_inst, config.COV_MAP_SIZE_ALIAS_INST),
+        ]:
+            with open(path, 'wb') as f:
+                f.write(config.COV_MAP_INITIAL(size))
 
     def _cov_recover(self) -> None:
         # load the coverage bitmaps
         with attach_emulator() as emulator:
             # create an empty ivshmem file
-            if os.path.exists(emulator.session_shm):
-                os.unlink(emulator.session_shm)
-
-            touch(emulator.session_shm, config.IVSHMEM_SIZE)
+            emulator.virtex_create_shm()
 
-            # load the saved coverage
+            # load the saved coverage (a tree is saved as far as it is used)
             with open(emulator.session_shm, 'r+b') as f:
                 f.seek(config.IVSHMEM_OFFSET_COV_CFG_EDGE)
                 with open(self.path_cov_cfg_edge, 'rb') as g:
-                    f.write(g.read(config.BITMAP_COV_CFG_EDGE_SIZE))
+                    f.write(g.read(config.COV_MAP_SIZE_CFG_EDGE))
 
                 f.seek(config.IVSHMEM_OFFSET_COV_DFG_EDGE)
                 with open(self.path_cov_dfg_edge, 'rb') as g:
-                    f.write(g.read(config.BITMAP_COV_DFG_EDGE_SIZE))
+                    f.write(g.read(config.COV_MAP_SIZE_DFG_EDGE))
 
                 f.seek(config.IVSHMEM_OFFSET_COV_ALIAS_INST)
                 with open(self.path_cov_alias_inst, 'rb') as g:
-                    f.write(g.read(config.BITMAP_COV_ALIAS_INST_SIZE))
+                    f.write(g.read(config.COV_MAP_SIZE_ALIAS_INST))
 
     def _cov_checkpoint(self) -> None:
-        # save the coverage bitmaps
+        # save the coverage maps
         with attach_emulator() as emulator:
             with open(emulator.session_shm, 'rb') as f:
-                f.seek(config.IVSHMEM_OFFSET_COV_CFG_EDGE)
-                with open(self.path_cov_cfg_edge, 'wb') as g:
-                    g.write(f.read(config.BITMAP_COV_CFG_EDGE_SIZE))
-
-                f.seek(config.IVSHMEM_OFFSET_COV_DFG_EDGE)
-                with open(self.path_cov_dfg_edge, 'wb') as g:
-                    g.write(f.read(config.BITMAP_COV_DFG_EDGE_SIZE))
-
-                f.seek(config.IVSHMEM_OFFSET_COV_ALIAS_INST)
-                with open(self.path_cov_alias_inst, 'wb') as g:
-                    g.write(f.read(config.BITMAP_COV_ALIAS_INST_SIZE))
+                for path, offset, size in [
+                    (self.path_cov_cfg_edge,
+                     config.IVSHMEM_OFFSET_COV_CFG_EDGE,
+                     config.COV_MAP_SIZE_CFG_EDGE),
+                    (self.path_cov_dfg_edge,
+                     config.IVSHMEM_OFFSET_COV_DFG_EDGE,
+                     config.COV_MAP_SIZE_DFG_EDGE),
+                    (self.path_cov_alias_inst,
+                     config.IVSHMEM_OFFSET_COV_ALIAS_INST,
+                     config.COV_MAP_SIZE_ALIAS_INST),
+                ]:
+                    f.seek(offset)
+                    size = config.COV_MAP_EXTENT(f.read(32), size)
+
+                    f.seek(offset)
+                    with open(path, 'wb') as g:
+                        g.write(f.read(size))
@@ -12,6 +12,7 @@ from argparse import ArgumentParser
 
 from fuzz_exec import Seed
 from fuzz_stat import iter_seed_exec_inc
+from fuzz_store import open_artifact
 from spec_basis import Syscall, Program
 
 from util import enable_coloring_in_logging
@@ -29,7 +30,7 @@ def collect_syscall_primitives_from_probe() -> None:
                 progs[base] = pickle.load(f)
 
         prog = progs[base]
-        with open(os.path.join(pack.path, 'outcome')) as t:
+        with open_artifact(os.path.join(pack.path, 'outcome'), False) as t:
             retv = json.load(t)['subs']
 
         assert len(prog.thread_subs) == len(retv)
@@ -0,0 +1,128 @@
+from typing import List, Tuple, Optional
+
+import os
+import mmap
+import struct
+import logging
+import threading
+
+from multiprocessing import RawArray, RawValue
+
+from fuzz_exec import Seed
+
+import config
+
+# a seed in the log: sha1 of the sketch, sha1 of the bytecode, bucket
+SEED_RECORD = '<20s20sQ'
+_SEED_RECORD_SIZE = struct.calcsize(SEED_RECORD)
+
+
+class SeedLog(object):
+    """
+    Append-only log of seeds in shared memory, created by the master before
+    forking the workers. The master is the only writer and a record is
+    filled before the count covering it is published, so the readers walk
+    [cursor, count) without taking any lock
+    """
+
+    def __init__(self, capacity: int) -> None:
+        self.capacity = capacity
+        self.data = RawArray('B', capacity * _SEED_RECORD_SIZE)
+        self.count = RawValue('Q', 0)
+
+    def append(self, seed: Seed) -> bool:
+        num = self.count.value
+        if num == self.capacity:
+            return False
+
+        struct.pack_into(
+            SEED_RECORD, self.data, num * _SEED_RECORD_SIZE,
+            bytes.fromhex(seed.sketch), bytes.fromhex(seed.digest),
+            seed.bucket
+        )
+        self.count.value = num + 1
+        return True
+
+    def read(self, cursor: int) -> List[Seed]:
+        seeds = []  # type: List[Seed]
+        for i in range(cursor, self.count.value):
+            sketch, digest, bucket = struct.unpack_from(
+                SEED_RECORD, self.data, i * _SEED_RECORD_SIZE
+            )
+            seeds.append(Seed(sketch.hex(), digest.hex(), bucket))
+        return seeds
+
+
+class CovStore(object):
+    """
+    The coverage maps, mapped once from the ivshmem file the instances
+    update in place, with the on-disk checkpoints written in the background
+    (a tree is only checkpointed as far as its leaves are taken)
+    """
+
+    def __init__(
+            self, path_shm: str,
+            path_cfg_edge: str, path_dfg_edge: str, path_alias_inst: str
+    ) -> None:
+        with open(path_shm, 'r+b') as f:
+            self.mm = mmap.mmap(f.fileno(), config.IVSHMEM_OFFSET_RESERVED)
+
+        self.layout = [
+            (path_cfg_edge,
+             config.IVSHMEM_OFFSET_COV_CFG_EDGE,
+             config.COV_MAP_SIZE_CFG_EDGE),
+            (path_dfg_edge,
+             config.IVSHMEM_OFFSET_COV_DFG_EDGE,
+             config.COV_MAP_SIZE_DFG_EDGE),
+            (path_alias_inst,
+             config.IVSHMEM_OFFSET_COV_ALIAS_INST,
+             config.COV_MAP_SIZE_ALIAS_INST),
+        ]  # type: List[Tuple[str, int, int]]
+
+        self.worker = None  # type: Optional[threading.Thread]
+
+    def recover(self) -> None:
+        for path, offset, size in self.layout:
+            with open(path, 'rb') as g:
+                data = g.read(size)
+                self.mm[offset:offset + len(data)] = data
+
+    def checkpoint(
+            self, extra: List[Tuple[str, bytes]], wait: bool = False
+    ) -> None:
+        # the previous snapshot should have long finished
+        self.join()
+
+        # copying the maps out is quick, the file writes are not
+        items = []  # type: List[Tuple[str, bytes]]
+        for path, offset, size in self.layout:
+            size = config.COV_MAP_EXTENT(self.mm[offset:offset + 32], size)
+            items.append((path, self.mm[offset:offset + size]))
+        items.extend(extra)
+
+        self.worker = threading.Thread(target=_snapshot, args=(items,))
+        self.worker.start()
+
+        if wait:
+            self.join()
+
+    def join(self) -> None:
+        if self.worker is not None:
+            self.worker.join()
+            self.worker = None
+
+    def close(self) -> None:
+        self.join()
+        self.mm.close()
+
+
+def _snapshot(items: List[Tuple[str, bytes]]) -> None:
+    # replace the files as a whole, a crash then keeps the older snapshot
+    for path, data in items:
+        temp = path + '.tmp'
+        try:
+            with open(temp, 'wb') as f:
+                f.write(data)
+            os.replace(temp, path)
+        except OSError as ex:
+            logging.warning('checkpoint of {} failed: {}'.format(path, ex))
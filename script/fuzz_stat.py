@@ -13,6 +13,8 @@ from argparse import ArgumentParser
 
 from spec_basis import Syscall, Program
 from fuzz_engine import Seed
+from fuzz_exec import Feedback
+from fuzz_store import has_artifact, open_artifact
 
 import config
 
@@ -103,7 +105,7 @@ def parse_strace(base: str) -> StraceLedger:
     records = []  # type: List[StraceRecord]
     tseqset = set()  # type: Set[int]
 
-    with open(os.path.join(base, 'strace'), 'r') as f:
+    with open_artifact(os.path.join(base, 'strace'), False) as f:
         r = None  # type: Optional[StraceRecord]
         for l in f:
             counted = False
@@ -256,7 +258,7 @@ def show_execution_evolution() -> None:
     for pack in iter_seed_exec_inc():
         print('---------------- {} ----------------'.format(i))
 
-        with open(os.path.join(pack.path, 'readable'), 'r') as f:
+        with open_artifact(os.path.join(pack.path, 'readable'), False) as f:
             print(f.read())
 
         i += 1
@@ -292,11 +294,56 @@ def show_syscall_stats() -> None:
         ))
 
 
+def _hook_cycles(hist: List[int]) -> Tuple[float, int]:
+    # (mean, median) over the log2 bins, taking the middle of each bin
+    total = sum(hist)
+    if total == 0:
+        return 0.0, 0
+
+    mean = sum(
+        n * (0 if b == 0 else 1.5 * (1 << (b - 1)))
+        for b, n in enumerate(hist)
+    ) / total
+
+    half = 0
+    for b, n in enumerate(hist):
+        half += n
+        if half * 2 >= total:
+            return mean, 0 if b == 0 else 1 << (b - 1)
+
+    return mean, 0
+
+
+def show_hook_stats() -> None:
+    head = config.RTINFO_HOOK_STAT_HEAD
+
+    for pack in iter_seed_exec_inc():
+        path = os.path.join(pack.path, 'feedback')
+        if not has_artifact(path):
+            continue
+
+        feedback = Feedback.load(path)
+        if len(feedback.hook_stats) == 0:
+            continue
+
+        print('- {} -'.format(pack.path))
+        print('{:24} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10}'.format(
+            'api', 'calls', 'ignored', 'untraced', 'paused', 'mean', 'p50'
+        ))
+        for k in sorted(feedback.hook_stats.keys()):
+            row = feedback.hook_stats[k]
+            mean, median = _hook_cycles(row[head:])
+            print('{:24} {:10} {:10} {:10} {:10} {:10.0f} {:>10}'.format(
+                k.lower(), row[0], row[1], row[2], row[3],
+                mean, '>={}'.format(median)
+            ))
+
+
 def find_in_program(needle: str) -> None:
     regex = re.compile(needle)
 
     for pack in iter_seed_exec_inc():
-        with open(os.path.join(pack.path, 'readable'), 'r') as f:
+        with open_artifact(os.path.join(pack.path, 'readable'), False) as f:
             if regex.search(f.read()) is not None:
                 print(pack.path)
 
@@ -305,7 +352,7 @@ def find_in_strace(needle: str) -> None:
     regex = re.compile(needle)
 
     for pack in iter_seed_exec_inc():
-        with open(os.path.join(pack.path, 'strace'), 'r') as f:
+        with open_artifact(os.path.join(pack.path, 'strace'), False) as f:
             if regex.search(f.read()) is not None:
                 print(pack.path)
 
@@ -327,7 +374,7 @@ def main(argv: List[str]) -> int:
 
     # show
     sub_show = subs.add_parser('show')
-    sub_show.add_argument('type', choices={'e', 'p', 's'})
+    sub_show.add_argument('type', choices={'e', 'p', 's', 'h'})
 
     # list
     sub_list = subs.add_parser('list')
@@ -359,6 +406,9 @@ def main(argv: List[str]) -> int:
         elif args.type == 's':
             show_syscall_stats()
 
+        elif args.type == 'h':
+            show_hook_stats()
+
     elif args.cmd == 'list':
         if args.type == 's':
             list_syscall_strace(args.item)
@@ -0,0 +1,554 @@
+from typing import cast, IO, List, Dict, Tuple, Optional
+
+import io
+import os
+import json
+import struct
+import ctypes
+import ctypes.util
+import hashlib
+
+from pkg_racer import Package_Racer
+
+from util import prepdn
+
+import config
+
+# chunking, mirrors pass/ledger/include/ledger/Chunker.h
+CHUNK_MIN = 2 << 10
+CHUNK_MAX = 64 << 10
+CHUNK_BITS = 13
+
+# an index record: sha1 of the chunk, offset in the pack, compressed size,
+# uncompressed size, flags
+INDEX_RECORD = '<20sQIIB3x'
+_INDEX_RECORD_SIZE = struct.calcsize(INDEX_RECORD)
+
+INDEX_FLAG_DICT = 1 << 0
+
+# the per-execution list of the artifacts, in the result dir
+MANIFEST_NAME = 'manifest'
+
+# (sha1 in hex, uncompressed size) of a chunk in an artifact
+ChunkRef = Tuple[str, int]
+
+
+def _gear_table() -> List[int]:
+    # splitmix64 from zero, same as the native chunker
+    mask = (1 << 64) - 1
+    table = []  # type: List[int]
+
+    state = 0
+    for _ in range(256):
+        state = (state + 0x9e3779b97f4a7c15) & mask
+        z = state
+        z = ((z ^ (z >> 30)) * 0xbf58476d1ce4e5b9) & mask
+        z = ((z ^ (z >> 27)) * 0x94d049bb133111eb) & mask
+        table.append(z ^ (z >> 31))
+
+    return table
+
+
+_GEAR = _gear_table()
+
+
+def _chunk_cuts_py(data: bytes) -> List[int]:
+    mask = (1 << 64) - 1
+    shift = 64 - CHUNK_BITS
+
+    cuts = []  # type: List[int]
+    base = 0
+    while base < len(data):
+        end = min(base + CHUNK_MAX, len(data))
+        pos = min(base + CHUNK_MIN, end)
+
+        h = 0
+        while pos < end:
+            h = ((h << 1) + _GEAR[data[pos]]) & mask
+            pos += 1
+            if (h >> shift) == 0:
+                break
+
+        cuts.append(pos)
+        base = pos
+
+    return cuts
+
+
+class _Native(object):
+    """
+    The chunker in libRacerLedger, the python one is a (slow) fallback
+    """
+
+    _lib = None  # type: Optional[ctypes.CDLL]
+    _tried = False
+
+    @classmethod
+    def library(cls) -> Optional[ctypes.CDLL]:
+        if cls._tried:
+            return cls._lib
+        cls._tried = True
+
+        path = os.path.join(Package_Racer().path_store, 'lib',
+                            'libRacerLedger.so')
+        if not os.path.exists(path):
+            return None
+
+        lib = ctypes.CDLL(path)
+        lib.racer_chunk_cuts.argtypes = [
+            ctypes.c_char_p, ctypes.c_uint64,
+            ctypes.POINTER(ctypes.c_uint64), ctypes.c_uint64,
+        ]
+        lib.racer_chunk_cuts.restype = ctypes.c_uint64
+
+        cls._lib = lib
+        return lib
+
+
+def chunk_cuts(data: bytes) -> List[int]:
+    lib = _Native.library()
+    if lib is None:
+        return _chunk_cuts_py(data)
+
+    # no chunk is ever shorter than the minimum except for the last one
+    limit = len(data) // CHUNK_MIN + 1
+    cuts = (ctypes.c_uint64 * limit)()
+    num = lib.racer_chunk_cuts(data, len(data), cuts, limit)
+    assert num <= limit
+    return list(cuts[:num])
+
+
+class _Zstd(object):
+    """
+    Just enough of libzstd (through ctypes), with an optional dictionary
+    """
+
+    _lib = None  # type: Optional[ctypes.CDLL]
+
+    @classmethod
+    def library(cls) -> ctypes.CDLL:
+        if cls._lib is not None:
+            return cls._lib
+
+        name = ctypes.util.find_library('zstd')
+        if name is None:
+            raise RuntimeError('libzstd not found')
+
+        lib = ctypes.CDLL(name)
+        p = ctypes.c_void_p
+        n = ctypes.c_size_t
+
+        for func, args, ret in [
+            ('ZSTD_compressBound', [n], n),
+            ('ZSTD_isError', [n], ctypes.c_uint),
+            ('ZSTD_createCCtx', [], p),
+            ('ZSTD_freeCCtx', [p], n),
+            ('ZSTD_createDCtx', [], p),
+            ('ZSTD_freeDCtx', [p], n),
+            ('ZSTD_compressCCtx', [p, p, n, p, n, ctypes.c_int], n),
+            ('ZSTD_decompressDCtx', [p, p, n, p, n], n),
+            ('ZSTD_createCDict', [p, n, ctypes.c_int], p),
+            ('ZSTD_freeCDict', [p], n),
+            ('ZSTD_createDDict', [p, n], p),
+            ('ZSTD_freeDDict', [p], n),
+            ('ZSTD_compress_usingCDict', [p, p, n, p, n, p], n),
+            ('ZSTD_decompress_usingDDict', [p, p, n, p, n, p], n),
+            ('ZDICT_trainFromBuffer', [p, n, p, p, ctypes.c_uint], n),
+            ('ZDICT_isError', [n], ctypes.c_uint),
+        ]:
+            getattr(lib, func).argtypes = args
+            getattr(lib, func).restype = ret
+
+        cls._lib = lib
+        return lib
+
+    def __init__(self, level: int, dictionary: Optional[bytes]) -> None:
+        lib = _Zstd.library()
+        self.lib = lib
+        self.level = level
+
+        self.cctx = lib.ZSTD_createCCtx()
+        self.dctx = lib.ZSTD_createDCtx()
+
+        self.cdict = None  # type: Optional[int]
+        self.ddict = None  # type: Optional[int]
+        if dictionary is not None:
+            self.cdict = lib.ZSTD_createCDict(
+                dictionary, len(dictionary), level
+            )
+            self.ddict = lib.ZSTD_createDDict(dictionary, len(dictionary))
+
+    def __del__(self) -> None:
+        lib = self.lib
+        lib.ZSTD_freeCCtx(self.cctx)
+        lib.ZSTD_freeDCtx(self.dctx)
+        if self.cdict is not None:
+            lib.ZSTD_freeCDict(self.cdict)
+        if self.ddict is not None:
+            lib.ZSTD_freeDDict(self.ddict)
+
+    def compress(self, data: bytes) -> bytes:
+        lib = self.lib
+        cap = lib.ZSTD_compressBound(len(data))
+        dst = ctypes.create_string_buffer(cap)
+
+        if self.cdict is not None:
+            size = lib.ZSTD_compress_usingCDict(
+                self.cctx, dst, cap, data, len(data), self.cdict
+            )
+        else:
+            size = lib.ZSTD_compressCCtx(
+                self.cctx, dst, cap, data, len(data), self.level
+            )
+
+        if lib.ZSTD_isError(size):
+            raise RuntimeError('zstd compression failed')
+        return dst.raw[:size]
+
+    def decompress(self, blob: bytes, size: int, use_dict: bool) -> bytes:
+        lib = self.lib
+        dst = ctypes.create_string_buffer(size)
+
+        if use_dict:
+            assert self.ddict is not None
+            done = lib.ZSTD_decompress_usingDDict(
+                self.dctx, dst, size, blob, len(blob), self.ddict
+            )
+        else:
+            done = lib.ZSTD_decompressDCtx(
+                self.dctx, dst, size, blob, len(blob)
+            )
+
+        if lib.ZSTD_isError(done) or done != size:
+            raise RuntimeError('zstd decompression failed')
+        return dst.raw
+
+    @classmethod
+    def train(cls, samples: List[bytes], capacity: int) -> Optional[bytes]:
+        lib = _Zstd.library()
+
+        data = b''.join(samples)
+        sizes = (ctypes.c_size_t * len(samples))(*[len(s) for s in samples])
+        dst = ctypes.create_string_buffer(capacity)
+
+        size = lib.ZDICT_trainFromBuffer(
+            dst, capacity, data, sizes, len(samples)
+        )
+        if lib.ZDICT_isError(size):
+            return None
+        return dst.raw[:size]
+
+
+class ResultStore(object):
+    """
+    Content-addressed store of the artifacts of executions (ledger, rtrace,
+    strace, ...), shared by all the processes of a campaign:
+     - artifacts are cut into content-defined chunks, deduplicated by sha1
+     - chunks are compressed by zstd, with a dictionary trained on the
+       first chunks each writer sees
+     - each writer (process) appends to its own pack, index and dictionary,
+       hence no locking, the readers pick up new records on a miss
+     - a result dir keeps a manifest, listing the chunks of its artifacts
+    """
+
+    def __init__(self, path: str, writable: bool = True) -> None:
+        self.path = path
+        self.writable = writable
+
+        # hash -> (writer, offset, csize, usize, flags)
+        self.index = {}  # type: Dict[bytes, Tuple[str, int, int, int, int]]
+        self.loaded = {}  # type: Dict[str, int]
+
+        # per writer codec (with its dictionary)
+        self.codecs = {}  # type: Dict[str, _Zstd]
+        self.packs = {}  # type: Dict[str, int]
+
+        # own files
+        self.writer = None  # type: Optional[str]
+        self.f_pack = None  # type: Optional[IO[bytes]]
+        self.f_index = None  # type: Optional[IO[bytes]]
+        self.samples = []  # type: List[bytes]
+        self.sampled = 0
+
+        if writable:
+            prepdn(path)
+
+            # a pid is only reused once the previous owner is gone
+            self.writer = str(os.getpid())
+            self.f_pack = open(self._path('pack', self.writer), 'ab')
+            self.f_index = open(self._path('index', self.writer), 'ab')
+
+        self.refresh()
+
+    def _path(self, kind: str, writer: str) -> str:
+        return os.path.join(self.path, '{}.{}'.format(kind, writer))
+
+    def close(self) -> None:
+        if self.f_pack is not None:
+            self.f_pack.close()
+            self.f_pack = None
+        if self.f_index is not None:
+            self.f_index.close()
+            self.f_index = None
+
+        for fd in self.packs.values():
+            os.close(fd)
+        self.packs.clear()
+
+    # index
+    def refresh(self) -> None:
+        if not os.path.isdir(self.path):
+            return
+
+        for name in os.listdir(self.path):
+            kind, _, writer = name.partition('.')
+            if kind != 'index':
+                continue
+
+            with open(os.path.join(self.path, name), 'rb') as f:
+                f.seek(self.loaded.get(writer, 0))
+                data = f.read()
+
+            # a record being written is picked up next time
+            size = len(data) - len(data) % _INDEX_RECORD_SIZE
+            for pos in range(0, size, _INDEX_RECORD_SIZE):
+                digest, offset, csize, usize, flags = struct.unpack_from(
+                    INDEX_RECORD, data, pos
+                )
+                self.index[digest] = (writer, offset, csize, usize, flags)
+
+            self.loaded[writer] = self.loaded.get(writer, 0) + size
+
+    def _codec(self, writer: str) -> _Zstd:
+        if writer not in self.codecs:
+            dictionary = None  # type: Optional[bytes]
+            path = self._path('dict', writer)
+            if os.path.exists(path):
+                with open(path, 'rb') as f:
+                    dictionary = f.read()
+
+            self.codecs[writer] = _Zstd(
+                config.FUZZ_STORE_ZSTD_LEVEL, dictionary
+            )
+
+        return self.codecs[writer]
+
+    # write
+    def _train(self, chunk: bytes) -> None:
+        assert self.writer is not None
+
+        if self.sampled >= config.FUZZ_STORE_DICT_SAMPLE:
+            return
+
+        self.samples.append(chunk)
+        self.sampled += len(chunk)
+        if self.sampled < config.FUZZ_STORE_DICT_SAMPLE:
+            return
+
+        # only the chunks from now on are compressed with the dictionary
+        dictionary = _Zstd.train(self.samples, config.FUZZ_STORE_DICT_SIZE)
+        self.samples = []
+        if dictionary is None:
+            return
+
+        path = self._path('dict', self.writer)
+        with open(path + '.tmp', 'wb') as f:
+            f.write(dictionary)
+        os.replace(path + '.tmp', path)
+
+        self.codecs[self.writer] = _Zstd(
+            config.FUZZ_STORE_ZSTD_LEVEL, dictionary
+        )
+
+    def put(self, data: bytes) -> List[ChunkRef]:
+        assert self.writer is not None
+        assert self.f_pack is not None and self.f_index is not None
+
+        refs = []  # type: List[ChunkRef]
+
+        base = 0
+        for end in chunk_cuts(data):
+            chunk = data[base:end]
+            base = end
+
+            digest = hashlib.sha1(chunk).digest()
+            refs.append((digest.hex(), len(chunk)))
+            if digest in self.index:
+                continue
+
+            codec = self._codec(self.writer)
+            blob = codec.compress(chunk)
+            flags = INDEX_FLAG_DICT if codec.cdict is not None else 0
+
+            offset = self.f_pack.tell()
+            self.f_pack.write(blob)
+
+            item = (self.writer, offset, len(blob), len(chunk), flags)
+            self.index[digest] = item
+            self.f_index.write(struct.pack(INDEX_RECORD, digest, *item[1:]))
+
+            self._train(chunk)
+
+        return refs
+
+    def put_artifacts(self, path: str, items: Dict[str, bytes]) -> None:
+        assert self.f_pack is not None and self.f_index is not None
+
+        manifest = load_manifest(path)
+        if manifest is None:
+            manifest = {'store': os.path.abspath(self.path), 'artifacts': {}}
+
+        for name, data in items.items():
+            manifest['artifacts'][name] = self.put(data)
+
+        # the chunks go out before any index record or manifest naming them
+        self.f_pack.flush()
+        self.f_index.flush()
+
+        path_manifest = os.path.join(path, MANIFEST_NAME)
+        with open(path_manifest + '.tmp', 'w') as f:
+            json.dump(manifest, f)
+        os.replace(path_manifest + '.tmp', path_manifest)
+
+    # read
+    def get(self, digest_hex: str) -> bytes:
+        digest = bytes.fromhex(digest_hex)
+        if digest not in self.index:
+            self.refresh()
+        if digest not in self.index:
+            raise KeyError('chunk {} not in store'.format(digest_hex))
+
+        writer, offset, csize, usize, flags = self.index[digest]
+
+        if writer == self.writer:
+            # might still be buffered
+            assert self.f_pack is not None
+            self.f_pack.flush()
+
+        if writer not in self.packs:
+            self.packs[writer] = os.open(
+                self._path('pack', writer), os.O_RDONLY
+            )
+
+        blob = os.pread(self.packs[writer], csize, offset)
+        return self._codec(writer).decompress(
+            blob, usize, (flags & INDEX_FLAG_DICT) != 0
+        )
+
+
+class StoredArtifact(io.RawIOBase):
+    """
+    Random access to an artifact in the store, decompressing only the
+    chunks that are actually read
+    """
+
+    def __init__(self, store: ResultStore, refs: List[ChunkRef]) -> None:
+        super().__init__()
+        self.store = store
+        self.refs = refs
+
+        # start offset of each chunk, plus the total size
+        self.offsets = [0]
+        for _, size in refs:
+            self.offsets.append(self.offsets[-1] + size)
+
+        self.pos = 0
+        self.cached = -1
+        self.chunk = b''
+
+    def readable(self) -> bool:
+        return True
+
+    def seekable(self) -> bool:
+        return True
+
+    def tell(self) -> int:
+        return self.pos
+
+    def seek(self, offset: int, whence: int = io.SEEK_SET) -> int:
+        if whence == io.SEEK_SET:
+            self.pos = offset
+        elif whence == io.SEEK_CUR:
+            self.pos += offset
+        elif whence == io.SEEK_END:
+            self.pos = self.offsets[-1] + offset
+        else:
+            raise ValueError('invalid whence {}'.format(whence))
+
+        self.pos = max(self.pos, 0)
+        return self.pos
+
+    def _locate(self, pos: int) -> int:
+        # binary search for the chunk holding pos
+        lo, hi = 0, len(self.refs) - 1
+        while lo < hi:
+            mid = (lo + hi + 1) // 2
+            if self.offsets[mid] <= pos:
+                lo = mid
+            else:
+                hi = mid - 1
+        return lo
+
+    def readinto(self, b: bytearray) -> int:  # type: ignore
+        if self.pos >= self.offsets[-1]:
+            return 0
+
+        i = self._locate(self.pos)
+        if i != self.cached:
+            self.chunk = self.store.get(self.refs[i][0])
+            self.cached = i
+
+        view = self.chunk[self.pos - self.offsets[i]:]
+        size = min(len(b), len(view))
+        b[:size] = view[:size]
+        self.pos += size
+        return size
+
+
+def load_manifest(path: str) -> Optional[Dict]:
+    path_manifest = os.path.join(path, MANIFEST_NAME)
+    if not os.path.exists(path_manifest):
+        return None
+
+    with open(path_manifest) as f:
+        return cast(Dict, json.load(f))
+
+
+_READERS = {}  # type: Dict[str, ResultStore]
+
+
+def _locate_artifact(
+        path: str
+) -> Optional[Tuple[ResultStore, List[ChunkRef]]]:
+    base, name = os.path.split(path)
+    manifest = load_manifest(base)
+    if manifest is None or name not in manifest['artifacts']:
+        return None
+
+    store_path = manifest['store']
+    if store_path not in _READERS:
+        _READERS[store_path] = ResultStore(store_path, writable=False)
+
+    refs = [(h, s) for h, s in manifest['artifacts'][name]]
+    return _READERS[store_path], refs
+
+
+def has_artifact(path: str) -> bool:
+    return os.path.exists(path) or _locate_artifact(path) is not None
+
+
+def open_artifact(path: str, binary: bool = True) -> IO:
+    """
+    Open <result dir>/<name>, either a plain file or one in the store
+    """
+    if os.path.exists(path):
+        return open(path, 'rb' if binary else 'r')
+
+    item = _locate_artifact(path)
+    if item is None:
+        raise FileNotFoundError(path)
+
+    f = io.BufferedReader(StoredArtifact(*item))
+    if binary:
+        return f
+    return io.TextIOWrapper(f, encoding='utf-8')
@@ -0,0 +1,156 @@
+from typing import List, Callable
+
+import struct
+
+# binary strace records (mirrors kernel/initramfs/strace.h)
+STRACE_BINARY_MAGIC = b'STRACEB\x00'
+STRACE_RECORD_HEAD = '<IBBBBqqqQ16s'
+STRACE_RECORD_ARG = '<qBB6x'
+
+_STRACE_RECORD_HEAD_SIZE = struct.calcsize(STRACE_RECORD_HEAD)
+_STRACE_RECORD_ARG_SIZE = struct.calcsize(STRACE_RECORD_ARG)
+
+
+def _u64(val: int) -> int:
+    return val & 0xffffffffffffffff
+
+
+def _s32(val: int) -> int:
+    val &= 0xffffffff
+    return val - (1 << 32) if val & 0x80000000 else val
+
+
+def _words(blob: bytes) -> List[int]:
+    return list(struct.unpack('<{}q'.format(len(blob) // 8), blob))
+
+
+# printers, producing the same text as the ones in strace.c
+def _print_ptr_hex(val: int, blob: bytes) -> str:
+    return '[0x{:x}]'.format(_u64(val))
+
+
+def _print_int_hex(val: int, blob: bytes) -> str:
+    return '0x{:x}'.format(_u64(val))
+
+
+def _print_int_oct(val: int, blob: bytes) -> str:
+    return '0{:o}'.format(_u64(val))
+
+
+def _print_int_signed(val: int, blob: bytes) -> str:
+    return '{}'.format(val)
+
+
+def _print_int_unsigned(val: int, blob: bytes) -> str:
+    return '{}'.format(_u64(val))
+
+
+def _print_ref_int_signed(val: int, blob: bytes) -> str:
+    if val == 0:
+        return '<null>'
+    return '{}'.format(_words(blob)[0])
+
+
+def _print_ref_int_unsigned(val: int, blob: bytes) -> str:
+    if val == 0:
+        return '<null>'
+    return '{}'.format(_u64(_words(blob)[0]))
+
+
+def _print_fd(val: int, blob: bytes) -> str:
+    return '<fd: {}>'.format(_s32(val))
+
+
+def _print_str(val: int, blob: bytes) -> str:
+    if val == 0:
+        return '<null>'
+    return blob.decode('charmap')
+
+
+def _print_buf(val: int, blob: bytes) -> str:
+    if val == 0:
+        return '<null>'
+    return '[...buf...]'
+
+
+def _print_struct_stat(val: int, blob: bytes) -> str:
+    if val == 0:
+        return '<null>'
+    return '{{ino={}, size={}, nlink={}, ...}}'.format(*_words(blob))
+
+
+def _print_struct_linux_dirent(val: int, blob: bytes) -> str:
+    if val == 0:
+        return '<null>'
+    return '{{d_ino={}, d_off={}, ...}}'.format(*_words(blob))
+
+
+def _print_vector_struct_iovec(val: int, blob: bytes) -> str:
+    if val == 0:
+        return '<null>'
+    base, size = _words(blob)
+    return '[{{iov_base=0x{}, iov_len={}}}, ,..]'.format(
+        '0x{:x}'.format(_u64(base)) if base != 0 else '(nil)', size
+    )
+
+
+# indexed by enum strace_kind
+_STRACE_PRINTERS = [
+    _print_ptr_hex,
+    _print_int_hex,
+    _print_int_oct,
+    _print_int_signed,
+    _print_int_unsigned,
+    _print_ref_int_signed,
+    _print_ref_int_unsigned,
+    _print_fd,
+    _print_str,
+    _print_buf,
+    _print_struct_stat,
+    _print_struct_linux_dirent,
+    _print_struct_linux_dirent,
+    _print_vector_struct_iovec,
+]  # type: List[Callable[[int, bytes], str]]
+
+
+def format_strace_binary(data: bytes) -> str:
+    lines = []  # type: List[str]
+
+    pos = len(STRACE_BINARY_MAGIC)
+    while pos + _STRACE_RECORD_HEAD_SIZE <= len(data):
+        size, argc, exit, kret, _, tid, _, retv, _, call = \
+            struct.unpack_from(STRACE_RECORD_HEAD, data, pos)
+
+        # a zero size marks where the console ran out of space
+        if size == 0 or pos + size > len(data):
+            break
+
+        args = []  # type: List[str]
+        blob = pos + _STRACE_RECORD_HEAD_SIZE + _STRACE_RECORD_ARG_SIZE * argc
+        for i in range(argc):
+            word, kind, blen = struct.unpack_from(
+                STRACE_RECORD_ARG, data,
+                pos + _STRACE_RECORD_HEAD_SIZE + _STRACE_RECORD_ARG_SIZE * i
+            )
+            args.append(_STRACE_PRINTERS[kind](word, data[blob:blob + blen]))
+            blob += blen
+
+        lines.append('[strace:{:4d}] {} {}({}) = <ret: {}>\n'.format(
+            tid,
+            '<-' if exit else '->',
+            call.rstrip(b'\x00').decode('charmap'),
+            ''.join([a + ', ' for a in args]),
+            _STRACE_PRINTERS[kret](retv, b''),
+        ))
+
+        pos += size
+
+    return ''.join(lines)
+
+
+def format_strace(data: bytes) -> str:
+    if data.startswith(STRACE_BINARY_MAGIC):
+        return format_strace_binary(data)
+
+    # the text console, which may also end early with a zero marker
+    return data.split(b'\x00', 1)[0].decode('charmap')
@@ -32,6 +32,9 @@ class Package_INITRAMFS(Package):
                 '-DCMAKE_BUILD_TYPE=Release',
                 '-DLINUX_FLAVOR={}'.format(self.flavor),
                 '-DLINUX_INTENT={}'.format(self.intent),
+                '-DRACER_SYSCALL_AUTO={}'.format(
+                    'ON' if config.INITRAMFS_SYSCALL_AUTO else 'OFF'
+                ),
             ])
 
     def _build_impl(self, override: bool = False) -> None:
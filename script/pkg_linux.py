@@ -8,6 +8,8 @@ from pkg import Package
 
 from util import cd, execute, execute0, find_all_files
 
+from racer_parse_compile_data import COMPILE_LOCATION_FILE, merge_compile_logs
+
 import config
 
 
@@ -163,6 +165,12 @@ class Package_LINUX(Package):
         ):
             os.unlink(item)
 
+        # merge the per-module records into one location database
+        merge_compile_logs(
+            self.path_build,
+            os.path.join(self.path_build, COMPILE_LOCATION_FILE)
+        )
+
     def _store_impl(self, override: bool = False) -> None:
         with cd(self.path_build):
             # install headers and modules
@@ -2,7 +2,9 @@ import os
 
 from pkg import Package
 
-from util import cd, execute
+from util import cd, execute, prepdn, prepfn
+
+from racer_parse_compile_data import build_compile_index
 
 import config
 
@@ -15,6 +17,9 @@ class Package_Racer(Package):
             os.path.join(config.PROJ_PATH, 'pass')
         )
 
+        self.path_src_spec = os.path.join(config.PROJ_PATH, 'kernel', 'spec')
+        self.path_build_spec = os.path.join(self.path_build, 'spec')
+
     def _setup_impl(self, override: bool = False) -> None:
         with cd(self.path_build):
             execute([
@@ -25,14 +30,42 @@ class Package_Racer(Package):
                 self.path_src,
             ])
 
+        # the program packer from the spec prototype
+        prepdn(self.path_build_spec)
+        with cd(self.path_build_spec):
+            execute([
+                'cmake', self.path_src_spec,
+                '-G', 'Unix Makefiles',
+                '-DCMAKE_INSTALL_PREFIX={}'.format(self.path_store),
+                '-DCMAKE_BUILD_TYPE=Release',
+            ])
+
     def _build_impl(self, override: bool = False) -> None:
         with cd(self.path_build):
             execute([
                 'make', '-j{}'.format(config.NCPU),
             ])
 
+        with cd(self.path_build_spec):
+            execute([
+                'make', '-j{}'.format(config.NCPU), 'RacerSpec',
+            ])
+
     def _store_impl(self, override: bool = False) -> None:
         with cd(self.path_build):
             execute([
                 'make', 'install',
             ])
+
+        # only the packer, the rest of the prototype is not installed
+        with cd(self.path_build_spec):
+            execute([
+                'cmake', '-DCOMPONENT=packer', '-P', 'cmake_install.cmake',
+            ])
+
+        # index the compile profile for the pass to memory-map
+        path_index = os.path.join(self.path_store, 'profile', 'linux.index')
+        prepfn(path_index, override=True)
+        build_compile_index(
+            os.path.join(self.path_src, 'profile', 'linux.json'), path_index
+        )
@@ -1,13 +1,17 @@
 #!/usr/bin/env python3
 
-from typing import List, Set, Dict, Iterator, cast, Optional
+from typing import List, Set, Dict, Iterator, Tuple, cast, Optional
 
 import re
 import os
 import sys
 import json
+import mmap
+import struct
 import pickle
 
+from argparse import ArgumentParser
+
 from collections import OrderedDict
 
 from util import find_all_files
@@ -157,65 +161,205 @@ class ValueModule(Value):
         return None
 
 
-def iter_compile_logs_by_module(path: str) -> Iterator[ValueModule]:
-    for fn in find_all_files(path, RE_RACER_COMPILE_LOG_FILE):
-        with open(fn) as f:
-            data = json.load(f)
+def _load_compile_json(fn: str, name: str) -> ValueModule:
+    with open(fn) as f:
+        data = json.load(f)
 
-            # pass 1: create the nodes
-            meta = data['meta']
-            module = ValueModule(
-                meta['seed'],
-                fn[len(path):],
-                meta['apis'], meta['gvar'], meta['structs']
-            )
-            for k, v in data['funcs'].items():
-                func = ValueFunc(v['meta']['hash'], k)
-                module.add_func(func)
+    # pass 1: create the nodes
+    meta = data['meta']
+    module = ValueModule(
+        meta['seed'],
+        name,
+        meta['apis'], meta['gvar'], meta['structs']
+    )
+    for k, v in data['funcs'].items():
+        func = ValueFunc(v['meta']['hash'], k)
+        module.add_func(func)
+
+        for b in v['blocks']:
+            block = ValueBlock(b['hash'])
+            func.add_block(block)
+
+            for i in b['inst']:
+                # parse source locations
+                info = []  # type: List[str]
+                locs = i['info']
+                while '@' in locs:
+                    m = RE_RACER_COMPILE_INST_LOC.match(locs)
+                    assert m is not None
+                    info.insert(0, m.group(1))
+                    locs = m.group(2)
+                info.insert(0, locs)
+
+                inst = ValueInst(i['hash'], info, i['repr'])
+                block.add_inst(inst)
+
+    # pass 2: create the edges
+    for k, v in data['funcs'].items():
+        func = module.funcsByName[k]
+
+        for b in v['blocks']:
+            block = func.blocks[b['hash']]
+
+            for x in b['pred']:
+                block.add_pred(func.blocks[x])
+
+    # pass 3: check the edges
+    for k, v in data['funcs'].items():
+        func = module.funcsByName[k]
+
+        for b in v['blocks']:
+            block = func.blocks[b['hash']]
+
+            for x in b['succ']:
+                block.add_succ(func.blocks[x])
+
+        func.set_entry()
+        func.set_exits()
+
+    return module
+
+
+
+
+# binary record of the instrumentation (mirrors pass/instrument/util/Record.h)
+COMPILE_RECORD_MAGIC = b'RACERREC'
+COMPILE_RECORD_VERSION = 1
+COMPILE_RECORD_HEADER = '<8sII'
+COMPILE_RECORD_FLAG_LITE = 1
+COMPILE_RECORD_NONE = 0xffffffff
+
+COMPILE_RECORD_TAG_STR = 1
+COMPILE_RECORD_TAG_MODULE = 2
+COMPILE_RECORD_TAG_FUNC = 3
+COMPILE_RECORD_TAG_BLOCK = 4
+COMPILE_RECORD_TAG_INST = 5
 
-                for b in v['blocks']:
-                    block = ValueBlock(b['hash'])
-                    func.add_block(block)
 
-                    for i in b['inst']:
-                        # parse source locations
-                        info = []  # type: List[str]
-                        locs = i['info']
-                        while '@' in locs:
-                            m = RE_RACER_COMPILE_INST_LOC.match(locs)
-                            assert m is not None
-                            info.insert(0, m.group(1))
-                            locs = m.group(2)
-                        info.insert(0, locs)
+# a block with hashes of its preds and succs, resolved after all nodes exist
+RecordEdges = Tuple[ValueBlock, List[int], List[int]]
 
-                        inst = ValueInst(i['hash'], info, i['repr'])
-                        block.add_inst(inst)
 
-            # pass 2: create the edges
-            for k, v in data['funcs'].items():
-                func = module.funcsByName[k]
+def _record_list(data: bytes, pos: int, fmt: str) -> Tuple[List[int], int]:
+    count = struct.unpack_from('<I', data, pos)[0]
+    pos += 4
+    items = list(struct.unpack_from('<' + fmt * count, data, pos))
+    return items, pos + struct.calcsize('<' + fmt * count)
 
-                for b in v['blocks']:
-                    block = func.blocks[b['hash']]
 
-                    for x in b['pred']:
-                        block.add_pred(func.blocks[x])
+def _load_compile_record(fn: str, name: str) -> ValueModule:
+    with open(fn, 'rb') as f:
+        data = f.read()
 
-            # pass 3: check the edges
-            for k, v in data['funcs'].items():
-                func = module.funcsByName[k]
+    magic, version, flags = \
+        struct.unpack_from(COMPILE_RECORD_HEADER, data, 0)
+    assert magic == COMPILE_RECORD_MAGIC
+    assert version == COMPILE_RECORD_VERSION
 
-                for b in v['blocks']:
-                    block = func.blocks[b['hash']]
+    # lite records carry no cfg edges and no reprs
+    lite = (flags & COMPILE_RECORD_FLAG_LITE) != 0
 
-                    for x in b['succ']:
-                        block.add_succ(func.blocks[x])
+    strs = []  # type: List[str]
+    module = None  # type: Optional[ValueModule]
+    func = None  # type: Optional[ValueFunc]
+    block = None  # type: Optional[ValueBlock]
+    edges = OrderedDict()  # type: OrderedDict[ValueFunc, List[RecordEdges]]
 
-                func.set_entry()
-                func.set_exits()
+    # pass 1: create the nodes (records are streamed in a pre-order)
+    pos = struct.calcsize(COMPILE_RECORD_HEADER)
+    while pos < len(data):
+        tag, size = struct.unpack_from('<BI', data, pos)
+        pos += 5
+        end = pos + size
 
-            # finish
-            yield module
+        if tag == COMPILE_RECORD_TAG_STR:
+            sid = struct.unpack_from('<I', data, pos)[0]
+            assert sid == len(strs)
+            strs.append(data[pos + 4:end].decode('utf-8'))
+
+        elif tag == COMPILE_RECORD_TAG_MODULE:
+            seed = struct.unpack_from('<Q', data, pos)[0]
+            apis, cur = _record_list(data, pos + 8, 'I')
+            gvar, cur = _record_list(data, cur, 'I')
+            structs, cur = _record_list(data, cur, 'I')
+            module = ValueModule(
+                seed,
+                name,
+                [strs[i] for i in apis],
+                [strs[i] for i in gvar],
+                [strs[i] for i in structs],
+            )
+
+        elif tag == COMPILE_RECORD_TAG_FUNC:
+            assert module is not None
+            sid, hval = struct.unpack_from('<IQ', data, pos)
+            func = ValueFunc(hval, strs[sid])
+            module.add_func(func)
+            edges[func] = []
+
+        elif tag == COMPILE_RECORD_TAG_BLOCK:
+            assert func is not None
+            hval = struct.unpack_from('<Q', data, pos)[0]
+            preds, cur = _record_list(data, pos + 8, 'Q')
+            succs, cur = _record_list(data, cur, 'Q')
+            block = ValueBlock(hval)
+            func.add_block(block)
+            edges[func].append((block, preds, succs))
+
+        elif tag == COMPILE_RECORD_TAG_INST:
+            assert block is not None
+            hval, rid = struct.unpack_from('<QI', data, pos)
+            frames, cur = _record_list(data, pos + 12, '3I')
+
+            # frames are innermost first, while info is outermost first
+            info = []  # type: List[str]
+            for i in range(0, len(frames), 3):
+                loc = '{}:{}'.format(strs[frames[i]], frames[i + 1])
+                if frames[i + 2] != 0:
+                    loc += ':{}'.format(frames[i + 2])
+                info.insert(0, loc)
+            if len(info) == 0:
+                info.append('')
+
+            text = '' if rid == COMPILE_RECORD_NONE else strs[rid]
+            block.add_inst(ValueInst(hval, info, text))
+
+        else:
+            raise RuntimeError('Invalid record tag: {}'.format(tag))
+
+        pos = end
+
+    assert module is not None
+    if lite:
+        return module
+
+    # pass 2: create the edges
+    for func, items in edges.items():
+        for block, preds, _ in items:
+            for x in preds:
+                block.add_pred(func.blocks[x])
+
+    # pass 3: check the edges
+    for func, items in edges.items():
+        for block, _, succs in items:
+            for x in succs:
+                block.add_succ(func.blocks[x])
+
+        func.set_entry()
+        func.set_exits()
+
+    return module
+
+
+def iter_compile_logs_by_module(path: str) -> Iterator[ValueModule]:
+    for fn in find_all_files(path, RE_RACER_COMPILE_LOG_FILE):
+        with open(fn, 'rb') as f:
+            magic = f.read(len(COMPILE_RECORD_MAGIC))
+
+        if magic == COMPILE_RECORD_MAGIC:
+            yield _load_compile_record(fn, fn[len(path):])
+        else:
+            yield _load_compile_json(fn, fn[len(path):])
 
 
 def iter_compile_logs_by_func(path: str) -> Iterator[ValueFunc]:
@@ -312,9 +456,224 @@ def hmap_compile_logs_by_func(path: str) -> Dict[int, ValueFunc]:
     return data
 
 
+# merged hash -> location database of all instructions, layout:
+#  - header: magic, version, count
+#  - entries: sorted by the hash, with (func, locs, text) in the string table
+#  - string table
+COMPILE_LOCATION_FILE = 'racer-compile-database.index'
+COMPILE_LOCATION_MAGIC = b'RACERLOC'
+COMPILE_LOCATION_VERSION = 1
+COMPILE_LOCATION_HEADER = '<8sII'
+COMPILE_LOCATION_ENTRY = '<QIIIIII'
+
+
+def merge_compile_logs(path: str, path_db: str) -> None:
+    strtab = bytearray()
+    strmap = {}  # type: Dict[str, Tuple[int, int]]
+
+    def intern(s: str) -> Tuple[int, int]:
+        if s not in strmap:
+            b = s.encode('utf-8')
+            strmap[s] = (len(strtab), len(b))
+            strtab.extend(b)
+        return strmap[s]
+
+    entries = {}  # type: Dict[int, Tuple[int, ...]]
+    for module in iter_compile_logs_by_module(path):
+        for func in module.funcsByName.values():
+            name = intern(func.name)
+
+            for block in func.blocks.values():
+                for inst in block.insts.values():
+                    if inst.hval in entries:
+                        print('Conflicting hash code for instruction: {}'
+                              .format(inst.hval))
+
+                    entries[inst.hval] = \
+                        name + intern(inst.get_locs()) + intern(inst.text)
+
+    with open(path_db, 'wb') as f:
+        f.write(struct.pack(
+            COMPILE_LOCATION_HEADER,
+            COMPILE_LOCATION_MAGIC, COMPILE_LOCATION_VERSION, len(entries)
+        ))
+        for hval in sorted(entries):
+            f.write(struct.pack(
+                COMPILE_LOCATION_ENTRY, hval, *entries[hval]
+            ))
+        f.write(strtab)
+
+
+class CompileLocations(object):
+
+    def __init__(self, path_db: str) -> None:
+        with open(path_db, 'rb') as f:
+            self.mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+
+        magic, version, self.count = \
+            struct.unpack_from(COMPILE_LOCATION_HEADER, self.mm, 0)
+        assert magic == COMPILE_LOCATION_MAGIC
+        assert version == COMPILE_LOCATION_VERSION
+
+        self.base = struct.calcsize(COMPILE_LOCATION_HEADER)
+        self.size = struct.calcsize(COMPILE_LOCATION_ENTRY)
+        self.strtab = self.base + self.size * self.count
+
+    def _entry(self, i: int) -> Tuple[int, ...]:
+        return struct.unpack_from(
+            COMPILE_LOCATION_ENTRY, self.mm, self.base + self.size * i
+        )
+
+    def _string(self, off: int, size: int) -> str:
+        pos = self.strtab + off
+        return self.mm[pos:pos + size].decode('utf-8')
+
+    def get(self, hval: int) -> Optional[Tuple[str, str, str]]:
+        # binary search over the sorted entries
+        lo, hi = 0, self.count
+        while lo < hi:
+            mid = (lo + hi) // 2
+            item = self._entry(mid)
+            if item[0] < hval:
+                lo = mid + 1
+            elif item[0] > hval:
+                hi = mid
+            else:
+                return (
+                    self._string(item[1], item[2]),
+                    self._string(item[3], item[4]),
+                    self._string(item[5], item[6]),
+                )
+
+        return None
+
+
 class CompileDatabase(object):
 
     def __init__(self, path: str) -> None:
         self.insts = hmap_compile_logs_by_inst(path)
         self.funcs = hmap_compile_logs_by_func(path)
         self.blocks = hmap_compile_logs_by_block(path)
+
+        # merged locations (if built after compilation)
+        path_db = os.path.join(path, COMPILE_LOCATION_FILE)
+        self.locs = CompileLocations(path_db) \
+            if os.path.exists(path_db) else None
+
+    def get_locs(self, hval: int) -> str:
+        if self.locs is not None:
+            item = self.locs.get(hval)
+            if item is not None:
+                return item[1]
+
+        return self.insts[hval].get_locs()
+
+
+# binary index of the compile profile (mirrors pass/instrument/util/Index.h)
+COMPILE_INDEX_MAGIC = b'RACERIDX'
+COMPILE_INDEX_VERSION = 1
+COMPILE_INDEX_HEADER = '<8sIIIIII'
+COMPILE_INDEX_SLOT = '<QIIII'
+
+
+def _index_hash(data: bytes) -> int:
+    # FNV-1a (64-bit), zero is reserved for empty slots
+    h = 0xcbf29ce484222325
+    for c in data:
+        h = ((h ^ c) * 0x100000001b3) & 0xffffffffffffffff
+    return h if h != 0 else 1
+
+
+def _index_table(entries: List[Tuple[int, int, int, int, int]]) -> bytes:
+    if len(entries) == 0:
+        return b''
+
+    # keep the load factor under a half
+    slots = 1
+    while slots < len(entries) * 2:
+        slots *= 2
+
+    table = [None] * slots  # type: List[Optional[Tuple[int, ...]]]
+    for item in entries:
+        pos = item[0] & (slots - 1)
+        while table[pos] is not None:
+            pos = (pos + 1) & (slots - 1)
+        table[pos] = item
+
+    return b''.join([
+        struct.pack(COMPILE_INDEX_SLOT, *(t if t is not None else (0,) * 5))
+        for t in table
+    ])
+
+
+def build_compile_index(path_json: str, path_index: str) -> None:
+    with open(path_json) as f:
+        data = json.load(f)
+
+    strtab = bytearray()
+
+    def intern(s: bytes) -> Tuple[int, int]:
+        off = len(strtab)
+        strtab.extend(s)
+        return off, len(s)
+
+    # functions are keyed by name, only the ones marked true are kept
+    ignored = []  # type: List[Tuple[int, int, int, int, int]]
+    for k, v in data['ignored'].items():
+        if v:
+            key = k.encode('utf-8')
+            ignored.append((_index_hash(key),) + intern(key) + (0, 0))
+
+    # modules are keyed by the path suffix, hashed backward
+    special = []  # type: List[Tuple[int, int, int, int, int]]
+    for k, v in data['special'].items():
+        key = k.encode('utf-8')
+        val = json.dumps(v).encode('utf-8')
+        special.append(
+            (_index_hash(key[::-1]),) + intern(key) + intern(val)
+        )
+
+    table_ignored = _index_table(ignored)
+    table_special = _index_table(special)
+    slot_size = struct.calcsize(COMPILE_INDEX_SLOT)
+
+    with open(path_index, 'wb') as f:
+        f.write(struct.pack(
+            COMPILE_INDEX_HEADER,
+            COMPILE_INDEX_MAGIC, COMPILE_INDEX_VERSION,
+            len(table_ignored) // slot_size,
+            len(table_special) // slot_size,
+            len(strtab), 0, 0
+        ))
+        f.write(table_ignored)
+        f.write(table_special)
+        f.write(strtab)
+
+
+def main(argv: List[str]) -> int:
+    parser = ArgumentParser()
+    subs = parser.add_subparsers(dest='cmd')
+
+    parser_index = subs.add_parser('index')
+    parser_index.add_argument('profile', help='json compile profile')
+    parser_index.add_argument('index', help='binary index to generate')
+
+    parser_merge = subs.add_parser('merge')
+    parser_merge.add_argument('path', help='build dir with the .racer logs')
+    parser_merge.add_argument('db', help='location database to generate')
+
+    args = parser.parse_args(argv)
+
+    if args.cmd == 'index':
+        build_compile_index(args.profile, args.index)
+    elif args.cmd == 'merge':
+        merge_compile_logs(args.path, args.db)
+    else:
+        parser.print_help()
+        return -1
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
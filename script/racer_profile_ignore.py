@@ -0,0 +1,261 @@
+#!/usr/bin/env python3
+
+from typing import BinaryIO, List, Dict, Set, Tuple, Optional
+
+import os
+import sys
+import json
+import struct
+import logging
+
+from argparse import ArgumentParser
+
+from pkg_linux import Package_LINUX
+from pkg_racer import Package_Racer
+
+from racer_parse_compile_data import CompileDatabase, ValueFunc
+from dart import LogType, LOG_ARGC, ledger_flatten
+
+# hooks whose hval is an instruction that only exists to be traced, these
+# are safe to drop along with the function holding them, every other hook
+# placed in a function carries semantics (sync, async, ctxt, ...) and stops
+# the function from being ignored
+_HOOKS_BY_INST = {
+    LogType.MEM_READ, LogType.MEM_WRITE,
+    LogType.MEM_STACK_PUSH, LogType.MEM_STACK_POP,
+}
+_HOOKS_BY_BLOCK = {
+    LogType.COV_CFG,
+}
+_HOOKS_BY_FUNC = {
+    LogType.EXEC_FUNC_ENTER, LogType.EXEC_FUNC_EXIT,
+}
+_HOOKS_TRACED = _HOOKS_BY_INST | _HOOKS_BY_BLOCK | _HOOKS_BY_FUNC
+
+# an edge of the dfg (writer, reader) or of the alias coverage (a, b)
+Edge = Tuple[int, int]
+
+
+class FuncProfile(object):
+
+    def __init__(self, func: ValueFunc) -> None:
+        self.func = func
+        self.events = 0
+        self.pinned = False
+        self.edges = set()  # type: Set[Edge]
+
+
+class ProfileAnalyzer(object):
+
+    def __init__(self, compdb: CompileDatabase) -> None:
+        self.compdb = compdb
+        self.funcs = {}  # type: Dict[int, FuncProfile]
+        self.edges_dfg = set()  # type: Set[Edge]
+        self.edges_alias = set()  # type: Set[Edge]
+
+    def _func_of(self, code: LogType, hval: int) -> Optional[ValueFunc]:
+        if code in _HOOKS_BY_FUNC:
+            return self.compdb.funcs.get(hval)
+
+        if code in _HOOKS_BY_BLOCK:
+            block = self.compdb.blocks.get(hval)
+            return None if block is None else block.get_parent()
+
+        inst = self.compdb.insts.get(hval)
+        return None if inst is None else inst.get_parent().get_parent()
+
+    def _profile(self, func: ValueFunc) -> FuncProfile:
+        if func.hval not in self.funcs:
+            self.funcs[func.hval] = FuncProfile(func)
+        return self.funcs[func.hval]
+
+    def _add_edge(self, edges: Set[Edge], a: int, b: int) -> None:
+        edge = (a, b)
+        if edge in edges:
+            return
+        edges.add(edge)
+
+        # both ends are needed for the edge to show up in the coverage
+        for hval in edge:
+            inst = self.compdb.insts.get(hval)
+            if inst is not None:
+                func = inst.get_parent().get_parent()
+                self._profile(func).edges.add(edge)
+
+    def process(self, f: BinaryIO) -> None:
+        b = ledger_flatten(f)
+        entry_num, _ = struct.unpack('QQ', b.read(16))
+
+        log_types = {i.value: i for i in LogType}
+
+        # the last writer and the last accessor per address, based on the
+        # start address of the access (close enough for ranking purposes)
+        last_w = {}  # type: Dict[int, Tuple[int, int]]
+        last_a = {}  # type: Dict[int, Tuple[int, int, bool]]
+
+        for _ in range(entry_num):
+            cval, ptid, _, hval = struct.unpack('IIQQ', b.read(24))
+            code = log_types[cval]
+            args = b.read(8 * LOG_ARGC.get(code, 0))
+
+            func = self._func_of(code, hval)
+            if func is None:
+                continue
+
+            item = self._profile(func)
+            item.events += 1
+
+            if code not in _HOOKS_TRACED:
+                item.pinned = True
+                continue
+
+            if code != LogType.MEM_READ and code != LogType.MEM_WRITE:
+                continue
+
+            addr = struct.unpack('QQ', args)[0]
+            is_w = code == LogType.MEM_WRITE
+
+            # dfg: the reader depends on the last writer
+            if not is_w and addr in last_w:
+                self._add_edge(self.edges_dfg, last_w[addr][1], hval)
+
+            # alias: two threads touching the same address, one writing
+            if addr in last_a:
+                prev_ptid, prev_hval, prev_w = last_a[addr]
+                if prev_ptid != ptid and (prev_w or is_w):
+                    self._add_edge(self.edges_alias, prev_hval, hval)
+
+            if is_w:
+                last_w[addr] = (ptid, hval)
+            last_a[addr] = (ptid, hval, is_w)
+
+    def select(
+            self, budget: float, max_loss: float
+    ) -> Tuple[List[FuncProfile], int, int]:
+        total_events = sum([i.events for i in self.funcs.values()])
+        total_edges = len(self.edges_dfg) + len(self.edges_alias)
+
+        goal = total_events / budget
+        loss_cap = int(total_edges * max_loss)
+
+        # the most events per unit of coverage come first
+        candidates = sorted(
+            [i for i in self.funcs.values() if not i.pinned],
+            key=lambda i: i.events / (1 + len(i.edges)),
+            reverse=True
+        )
+
+        chosen = []  # type: List[FuncProfile]
+        lost = set()  # type: Set[Edge]
+        remaining = total_events
+
+        for item in candidates:
+            if remaining <= goal:
+                break
+
+            delta = item.edges - lost
+            if len(lost) + len(delta) > loss_cap:
+                continue
+
+            chosen.append(item)
+            lost.update(delta)
+            remaining -= item.events
+
+        return chosen, remaining, len(lost)
+
+
+def _find_ledgers(paths: List[str]) -> List[str]:
+    result = []  # type: List[str]
+    for path in paths:
+        if os.path.isfile(path):
+            result.append(path)
+            continue
+
+        # an exec dir (or a tree of them), each with its own ledger
+        for root, _, files in os.walk(path):
+            if 'ledger' in files:
+                result.append(os.path.join(root, 'ledger'))
+
+    return sorted(result)
+
+
+def update_profile(path_json: str, chosen: List[FuncProfile]) -> None:
+    with open(path_json) as f:
+        data = json.load(f)
+
+    ignored = data['ignored']  # type: Dict[str, bool]
+    for item in chosen:
+        ignored[item.func.name] = True
+
+    with open(path_json, 'w') as f:
+        json.dump(data, f, indent=4, sort_keys=True)
+        f.write('\n')
+
+
+def main(argv: List[str]) -> int:
+    parser = ArgumentParser()
+    parser.add_argument('ledger', nargs='+',
+                        help='ledgers (or exec dirs) from a profiling run')
+    parser.add_argument('-b', '--budget', type=float, default=3.0,
+                        help='target reduction of the hook event rate')
+    parser.add_argument('-l', '--max-loss', type=float, default=0.05,
+                        help='fraction of the dfg/alias edges to give up')
+    parser.add_argument('-p', '--profile', default=None,
+                        help='json compile profile to update')
+    parser.add_argument('-n', '--dry', action='store_true',
+                        help='show the selection only')
+
+    args = parser.parse_args(argv)
+
+    ledgers = _find_ledgers(args.ledger)
+    if len(ledgers) == 0:
+        logging.error('No ledger found')
+        return -1
+
+    analyzer = ProfileAnalyzer(CompileDatabase(Package_LINUX().path_build))
+    for path in ledgers:
+        with open(path, 'rb') as f:
+            analyzer.process(f)
+
+    total_events = sum([i.events for i in analyzer.funcs.values()])
+    if total_events == 0:
+        logging.error('No hook event found')
+        return -1
+
+    chosen, remaining, lost = analyzer.select(args.budget, args.max_loss)
+
+    for item in chosen:
+        print('{:10d} events {:6d} edges  {}'.format(
+            item.events, len(item.edges), item.func.name
+        ))
+
+    print('-' * 40)
+    print('Functions: {} ignored / {} profiled ({} pinned)'.format(
+        len(chosen), len(analyzer.funcs),
+        len([i for i in analyzer.funcs.values() if i.pinned])
+    ))
+    print('Events: {} -> {} ({:.2f}x)'.format(
+        total_events, remaining, total_events / max(remaining, 1)
+    ))
+    print('Edges: {} dfg + {} alias, {} lost'.format(
+        len(analyzer.edges_dfg), len(analyzer.edges_alias), lost
+    ))
+
+    if remaining > total_events / args.budget:
+        logging.warning('Budget not met within the coverage loss cap')
+
+    if args.dry:
+        return 0
+
+    path_json = args.profile
+    if path_json is None:
+        path_json = os.path.join(
+            Package_Racer().path_src, 'profile', 'linux.json'
+        )
+
+    update_profile(path_json, chosen)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -5,6 +5,8 @@ import json
 import struct
 import hashlib
 
+from array import array
+
 from abc import ABC, abstractmethod
 from enum import Enum
 from functools import cmp_to_key
@@ -15,6 +17,8 @@ from spec_pack import pack_ptr
 from spec_random import SPEC_RANDOM
 from util_bean import Bean, BeanRef
 
+import config
+
 
 class Rand(Bean):
     """
@@ -840,6 +844,83 @@ class Synopsis(object):
         return True
 
 
+# bytecode ops (mirrors enum bytecode_op in fuzzer.inc), an instruction is
+# the op followed by three operands, with the sizes of the slots in the op
+BYTECODE_MAGIC = b'bytecod2'
+BYTECODE_SLOT_SIZES = [8, 4, 2, 1]
+
+BYTECODE_OPS = \
+    ['END'] + \
+    ['MOV_{}_{}'.format(d, s)
+     for d in BYTECODE_SLOT_SIZES for s in BYTECODE_SLOT_SIZES] + \
+    ['COPY'] + \
+    ['ARG_{}'.format(s) for s in BYTECODE_SLOT_SIZES] + \
+    ['SYSCALL_{}'.format(n) for n in range(7)] + \
+    ['RET_{}'.format(s) for s in BYTECODE_SLOT_SIZES] + \
+    ['CLOSE_{}'.format(s) for s in BYTECODE_SLOT_SIZES] + \
+    ['WAIT', 'POST', 'SPIN', 'PIN', 'DELAY']
+
+BYTECODE_OP = {name: i for i, name in enumerate(BYTECODE_OPS)}
+
+Insn = Tuple[int, int, int, int]
+
+
+def insn(op: str, a: int = 0, b: int = 0, c: int = 0) -> Insn:
+    return BYTECODE_OP[op], a, b, c
+
+
+# interleaving directives, run as ops of the same names
+class DirectiveKind(Enum):
+    WAIT = 1
+    POST = 2
+    SPIN = 3
+    PIN = 4
+    DELAY = 5
+
+
+@dataclass(frozen=True)
+class Directive(object):
+    kind: DirectiveKind
+    arg0: int = 0
+    arg1: int = 0
+
+    def pack(self) -> Insn:
+        return insn(self.kind.name, self.arg0, self.arg1)
+
+
+class Schedule(object):
+    """
+    Directives to run in between the syscalls of a program, keyed by the
+    thread (-1 for main) and the index of the syscall they precede
+    """
+
+    def __init__(self) -> None:
+        self.slots = {}  # type: Dict[Tuple[int, int], List[Directive]]
+
+    def add(self, tid: int, pos: int, directive: Directive) -> None:
+        self.slots.setdefault((tid, pos), []).append(directive)
+
+    def get(self, tid: int, pos: int) -> List[Directive]:
+        return self.slots.get((tid, pos), [])
+
+    @classmethod
+    def steer(
+            cls, prog: 'Program', hval: int, usec: int, ncpu: int
+    ) -> 'Schedule':
+        sched = Schedule()
+
+        # stall the instruction, armed by main before the subs are released
+        sched.add(-1, prog.syscalls_start, Directive(
+            DirectiveKind.DELAY, hval, usec
+        ))
+
+        # spread the subs over the cpus so that they do run in parallel
+        for i in range(len(prog.thread_subs)):
+            sched.add(i, 0, Directive(DirectiveKind.PIN, i % ncpu))
+
+        return sched
+
+
 class Program(object):
     """
     Holds the references and internal data of the generated program
@@ -1055,92 +1136,61 @@ class Program(object):
         return '\n'.join(code)
 
     # blob
-    def _pack_thread(
-            self, inst: 'Executable', syscalls: List[Syscall]
-    ) -> bytearray:
-        code = bytearray(pack_ptr(len(syscalls)))
+    @staticmethod
+    def _pack_move(dst: 'Hole', src: 'Hole') -> Insn:
+        if dst.size in BYTECODE_SLOT_SIZES and \
+                src.size in BYTECODE_SLOT_SIZES:
+            return insn(
+                'MOV_{}_{}'.format(dst.size, src.size), dst.addr, src.addr
+            )
 
-        for syscall in syscalls:
-            prep_list = inst.prep.get(syscall, [])
+        assert dst.size == src.size
+        return insn('COPY', dst.addr, src.addr, dst.size)
+
+    def _pack_thread(
+            self, inst: 'Executable', syscalls: List[Syscall],
+            tid: int, schedule: Optional[Schedule]
+    ) -> array:
+        # instructions of the thread, ending with END
+        code = array('Q')
+
+        for pos, syscall in enumerate(syscalls):
+            # directives preceding the syscall
+            if schedule is not None:
+                for directive in schedule.get(tid, pos):
+                    code.extend(directive.pack())
 
             # syscall prep
-            code += pack_ptr(len(prep_list))
-            for prep_item in prep_list:
-                code += pack_ptr(prep_item[0].addr)
-                code += pack_ptr(prep_item[0].size)
-                code += pack_ptr(prep_item[1].addr)
-                code += pack_ptr(prep_item[1].size)
+            for src, dst in inst.prep.get(syscall, []):
+                code.extend(self._pack_move(dst, src))
+
+            # syscall args
+            for i, arg in enumerate(syscall.args):
+                hole = inst.get_hole(arg.lego)
+                assert hole.size in BYTECODE_SLOT_SIZES
+                code.extend(insn('ARG_{}'.format(hole.size), hole.addr, i))
 
             # syscall id
-            code += pack_ptr(syscall.snum)
+            code.extend(insn(
+                'SYSCALL_{}'.format(len(syscall.args)), syscall.snum
+            ))
 
             # syscall retv
             hole = inst.get_hole(syscall.retv.lego)
-            code += pack_ptr(hole.addr)
-            code += pack_ptr(hole.size)
+            assert hole.size in BYTECODE_SLOT_SIZES
+            code.extend(insn('RET_{}'.format(hole.size), hole.addr))
 
-            # syscall args
-            code += pack_ptr(len(syscall.args))
-            for arg in syscall.args:
-                hole = inst.get_hole(arg.lego)
-                code += pack_ptr(hole.addr)
-                code += pack_ptr(hole.size)
+        # directives after the last syscall
+        if schedule is not None:
+            for directive in schedule.get(tid, len(syscalls)):
+                code.extend(directive.pack())
 
+        code.extend(insn('END'))
         return code
 
-    def gen_bytecode(self) -> Tuple['Executable', bytearray]:
-        # NOTE: general executable layout:
-        #   - head
-        #       - (8) magic string (bytecode)
-        #       - (8) meta offset
-        #       - (8) code offset
-        #       - (8) heap offset
-        #   - meta
-        #       - (8) number of pointers
-        #       - (*) offset to heap of each pointer
-        #       - (8) number of fds
-        #       - (*) per each fd
-        #           - (8) fd addr
-        #           - (8) fd size
-        #   - code
-        #       - (8) number of threads
-        #       - (8) offset to main thread
-        #       - (*) offset to each of the sub threads
-        #       - (*) per each thread (main and subs)
-        #           - (8) number of syscalls
-        #           - (*) per syscall
-        #               - (8) number of prep entries
-        #               - (*) per prep entry
-        #                   - (8) src addr
-        #                   - (8) src size
-        #                   - (8) dst addr
-        #                   - (8) dst size
-        #               - (8) syscall id
-        #               - (8) retv addr
-        #               - (8) retv size
-        #               - (8) number of syscall args
-        #               - (*) per each arg
-        #                   - (8) arg addr
-        #                   - (8) arg size
-        #   - heap
-
-        # build component: heap
-        inst = Executable()
-
-        for syscall in self.syscalls:
-            syscall.blob(inst)
-
-        inst.check()
-        region_heap = inst.heap
-
-        # build component: meta
-        region_meta = bytearray(pack_ptr(len(inst.ptrs)))
-
-        # save all ptr locations so we could adjust it with actual value
-        for ptr in sorted(inst.ptrs, key=lambda h: h.addr):
-            region_meta += pack_ptr(ptr.addr)
-
-        # save all fd used so we could close all of them at the end
+    @staticmethod
+    def _pack_fini(inst: 'Executable') -> array:
+        # close all fds ever used, each once
         all_fd = {}  # type: Dict[int, int]
         for fd in inst.fds:
             if fd.addr in all_fd:
@@ -1148,50 +1198,66 @@ class Program(object):
             else:
                 all_fd[fd.addr] = fd.size
 
-        region_meta += pack_ptr(len(all_fd))
+        code = array('Q')
         for fd_addr in sorted(all_fd.keys()):
-            region_meta += pack_ptr(fd_addr)
-            region_meta += pack_ptr(all_fd[fd_addr])
-
-        # build component: code
-        region_code = bytearray(pack_ptr(self.ncpu))
+            fd_size = all_fd[fd_addr]
+            assert fd_size in BYTECODE_SLOT_SIZES
+            code.extend(insn('CLOSE_{}'.format(fd_size), fd_addr))
 
-        # pre-build the bytecode for main and subs
-        thread_main = self._pack_thread(
-            inst, self.syscalls[:self.syscalls_start]
-        )
-        thread_subs = [
-            self._pack_thread(inst, thread) for thread in self.thread_subs
-        ]
-
-        # derive cursors
-        cursor = (1 + 1 + self.ncpu) * SPEC_PTR_SIZE
-        region_code += pack_ptr(cursor)
+        code.extend(insn('END'))
+        return code
 
-        cursor += len(thread_main)
-        for sub in thread_subs:
-            region_code += pack_ptr(cursor)
-            cursor += len(sub)
+    def gen_parts(
+            self, schedule: Optional[Schedule] = None
+    ) -> 'BytecodeParts':
+        # build component: heap
+        inst = Executable()
 
-        # add thread bytecode
-        region_code += thread_main
-        for sub in thread_subs:
-            region_code += sub
+        for syscall in self.syscalls:
+            syscall.blob(inst)
 
-        # build component: head
-        region_head = bytearray('bytecode'.encode('charmap'))
+        inst.check()
 
-        cursor = 4 * SPEC_PTR_SIZE
-        region_head += pack_ptr(cursor)  # meta offset
+        # pre-build the bytecode for main and subs
+        threads = [self._pack_thread(
+            inst, self.syscalls[:self.syscalls_start], -1, schedule
+        )]
+        threads.extend([
+            self._pack_thread(inst, thread, i, schedule)
+            for i, thread in enumerate(self.thread_subs)
+        ])
 
-        cursor += len(region_meta)
-        region_head += pack_ptr(cursor)  # code offset
+        return BytecodeParts(
+            inst=inst,
+            ptrs=[ptr.addr for ptr in inst.ptrs],
+            threads=threads,
+            fini=self._pack_fini(inst),
+        )
 
-        cursor += len(region_code)
-        region_head += pack_ptr(cursor)  # heap offset
+    def gen_bytecode(
+            self, schedule: Optional[Schedule] = None
+    ) -> Tuple['Executable', bytearray]:
+        # NOTE: general executable layout (v2):
+        #   - head
+        #       - (8) magic string (bytecod2)
+        #       - (8) code offset
+        #       - (8) heap offset
+        #       - (8) heap address in the guest, relocated against
+        #   - code
+        #       - (8) number of sub threads
+        #       - (8) offset to main thread
+        #       - (8) offset to fini (closing the fds)
+        #       - (*) offset to each of the sub threads
+        #       - (*) per each stream (main, fini, and subs)
+        #           - (*) per instruction, till END
+        #               - (8) op (see BYTECODE_OPS)
+        #               - (8) operand a
+        #               - (8) operand b
+        #               - (8) operand c
+        #   - heap (with the pointers relocated)
 
-        # return combined
-        return inst, region_head + region_meta + region_code + region_heap
+        parts = self.gen_parts(schedule)
+        return parts.inst, parts.assemble(config.BYTECODE_VADDR)
 
     # form
     def gen_synopsis(self) -> Synopsis:
@@ -1423,6 +1489,62 @@ class Executable(object):
 
 
 @dataclass
+class BytecodeParts(object):
+    """
+    The pieces of an executable before the layout, either assembled here or
+    written straight into the bytecode region by the native packer
+    """
+    inst: Executable
+    ptrs: List[int]
+    threads: List[array]
+    fini: array
+
+    @property
+    def ncpu(self) -> int:
+        return len(self.threads) - 1
+
+    @property
+    def streams(self) -> List[array]:
+        # in the order of the offsets in the code header
+        return [self.threads[0], self.fini] + self.threads[1:]
+
+    def assemble(self, base: int) -> bytearray:
+        streams = self.streams
+
+        # build component: code
+        region_code = bytearray(pack_ptr(self.ncpu))
+
+        # derive cursors
+        cursor = (1 + len(streams)) * SPEC_PTR_SIZE
+        for stream in streams:
+            region_code += pack_ptr(cursor)
+            cursor += len(stream) * SPEC_PTR_SIZE
+
+        # add thread bytecode
+        for stream in streams:
+            region_code += stream.tobytes()
+
+        # build component: head
+        region_head = bytearray(BYTECODE_MAGIC)
+
+        cursor = 4 * SPEC_PTR_SIZE
+        region_head += pack_ptr(cursor)  # code offset
+
+        cursor += len(region_code)
+        region_head += pack_ptr(cursor)  # heap offset
+        region_head += pack_ptr(base + cursor)  # heap address
+
+        # build component: heap, with the pointers relocated to the address
+        region_heap = bytearray(self.inst.heap)
+        for addr in self.ptrs:
+            value = struct.unpack_from('<Q', region_heap, addr)[0]
+            if value:
+                struct.pack_into('<Q', region_heap, addr, base + cursor + value)
+
+        # return combined
+        return region_head + region_code + region_heap
+
+
 class Outcome(object):
     main: List[int]
     subs: List[List[int]]
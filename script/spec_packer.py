@@ -0,0 +1,89 @@
+from typing import Optional, Tuple
+
+import os
+import ctypes
+
+from array import array
+
+from pkg_racer import Package_Racer
+from spec_basis import BytecodeParts
+
+_u64 = ctypes.c_uint64
+_u64_p = ctypes.POINTER(ctypes.c_uint64)
+
+
+class NativePacker(object):
+    """
+    The packer of kernel/spec (libRacerSpec), which writes a program into
+    the bytecode region of an instance in the layout of gen_bytecode()
+    """
+
+    _lib = None  # type: Optional[ctypes.CDLL]
+    _tried = False
+
+    @classmethod
+    def library(cls) -> Optional[ctypes.CDLL]:
+        if cls._tried:
+            return cls._lib
+        cls._tried = True
+
+        path = os.path.join(Package_Racer().path_store, 'lib',
+                            'libRacerSpec.so')
+        if not os.path.exists(path):
+            return None
+
+        lib = ctypes.CDLL(path)
+        lib.spec_pack_program.argtypes = [
+            ctypes.c_void_p, _u64, _u64,
+            _u64_p, _u64,
+            _u64_p, _u64_p, _u64,
+            ctypes.c_void_p, _u64,
+            _u64_p,
+        ]
+        lib.spec_pack_program.restype = ctypes.c_int64
+
+        cls._lib = lib
+        return lib
+
+    @staticmethod
+    def _words(data: array) -> ctypes.Array:
+        # an empty array exports no buffer to point at
+        if len(data) == 0:
+            data = array('Q', [0])
+        return (_u64 * len(data)).from_buffer(data)
+
+    @classmethod
+    def pack(
+            cls, region: memoryview, base: int, parts: BytecodeParts
+    ) -> Tuple[int, int]:
+        """
+        Returns (size of the bytecode, offset of the heap in it)
+        """
+        lib = cls.library()
+        assert lib is not None
+
+        ptrs = array('Q', parts.ptrs)
+
+        # the streams back to back, delimited by offsets
+        streams = parts.streams
+        code = array('Q')
+        code_off = array('Q', [0])
+        for stream in streams:
+            code.extend(stream)
+            code_off.append(len(code))
+
+        heap = parts.inst.heap
+        heap_at = _u64(0)
+
+        size = lib.spec_pack_program(
+            ctypes.addressof(ctypes.c_char.from_buffer(region)), len(region),
+            base,
+            cls._words(ptrs), len(ptrs),
+            cls._words(code), cls._words(code_off), len(streams),
+            ctypes.addressof(ctypes.c_char.from_buffer(heap)), len(heap),
+            ctypes.byref(heap_at)
+        )
+
+        if size == -1:
+            raise RuntimeError('Bytecode overflows its region')
+        return size, heap_at.value